@@ -0,0 +1,247 @@
+#ifndef CAE_BENCH_BENCH_RUNNER_H_
+#define CAE_BENCH_BENCH_RUNNER_H_
+
+#include "util/json.h"
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Benchmark Runner Strategy:
+ *
+ * 1. Registration: Each benchmark is a named closure that performs one
+ *    iteration and reports the bytes and items it processed
+ * 2. Timing: Iterations repeat until a minimum wall time is reached, and the
+ *    mean real and CPU time per iteration are recorded
+ * 3. Output: Results print as a table and serialize to JSON in the layout
+ *    used by Google Benchmark, so existing comparison tooling
+ *    (e.g. compare.py) works across commits
+ */
+
+namespace cae {
+namespace bench {
+
+/**
+ * Work reported by a single benchmark iteration
+ */
+struct IterationResult {
+  size_t bytes_;
+  size_t items_;
+  bool ok_;
+  std::string error_;
+
+  IterationResult() : bytes_(0), items_(0), ok_(true) {}
+};
+
+/**
+ * Aggregated result of one benchmark
+ */
+struct BenchmarkResult {
+  std::string name_;
+  std::map<std::string, std::string> params_;
+  size_t iterations_;
+  double real_time_ns_; // Mean per iteration
+  double cpu_time_ns_;  // Mean per iteration
+  double bytes_per_second_;
+  double items_per_second_;
+  bool ok_;
+  std::string error_;
+
+  BenchmarkResult()
+      : iterations_(0), real_time_ns_(0), cpu_time_ns_(0),
+        bytes_per_second_(0), items_per_second_(0), ok_(true) {}
+};
+
+/**
+ * Registers, runs and reports benchmarks
+ */
+class BenchRunner {
+public:
+  using BenchFn = std::function<IterationResult()>;
+
+  BenchRunner()
+      : min_time_s_(0.5), max_iterations_(1000000), table_(&std::cout) {}
+
+  void SetMinTime(double seconds) { min_time_s_ = seconds; }
+  void SetMaxIterations(size_t iterations) { max_iterations_ = iterations; }
+  void SetFilter(const std::string &filter) { filter_ = filter; }
+  void SetContext(const std::string &key, const std::string &value) {
+    context_[key] = value;
+  }
+  /** Stream receiving the human-readable table */
+  void SetTableStream(std::ostream *table) { table_ = table; }
+
+  /**
+   * Register a benchmark
+   * @param name Unique benchmark name
+   * @param params Parameters recorded alongside the result
+   * @param fn Closure performing one iteration
+   */
+  void Add(const std::string &name,
+           const std::map<std::string, std::string> &params, BenchFn fn) {
+    benchmarks_.push_back({name, params, std::move(fn)});
+  }
+
+  /** Run every registered benchmark that matches the filter */
+  void RunAll() {
+    std::ostream &out = *table_;
+    out << std::left << std::setw(56) << "Benchmark" << std::right
+        << std::setw(14) << "Time(ms)" << std::setw(12) << "Iters"
+        << std::setw(14) << "MB/s" << std::setw(14) << "Items/s" << std::endl;
+    out << std::string(110, '-') << std::endl;
+    for (auto &bench : benchmarks_) {
+      if (!filter_.empty() && bench.name_.find(filter_) == std::string::npos) {
+        continue;
+      }
+      results_.push_back(Run(bench));
+      Print(results_.back());
+    }
+  }
+
+  /** Append a result produced by another runner */
+  void AddResult(const BenchmarkResult &res) { results_.push_back(res); }
+
+  /** Results of the last RunAll */
+  const std::vector<BenchmarkResult> &GetResults() const { return results_; }
+
+  /** Serialize the results as Google Benchmark compatible JSON */
+  void WriteJson(std::ostream &out) const {
+    out << "{\n  \"context\": {\n";
+    auto ctx = BaseContext();
+    for (const auto &kv : context_) {
+      ctx[kv.first] = kv.second;
+    }
+    size_t i = 0;
+    for (const auto &kv : ctx) {
+      out << "    \"" << Escape(kv.first) << "\": \"" << Escape(kv.second)
+          << "\"" << (++i < ctx.size() ? "," : "") << "\n";
+    }
+    out << "  },\n  \"benchmarks\": [\n";
+    for (size_t r = 0; r < results_.size(); ++r) {
+      const auto &res = results_[r];
+      out << "    {\n";
+      out << "      \"name\": \"" << Escape(res.name_) << "\",\n";
+      out << "      \"run_name\": \"" << Escape(res.name_) << "\",\n";
+      out << "      \"run_type\": \"iteration\",\n";
+      out << "      \"iterations\": " << res.iterations_ << ",\n";
+      out << std::fixed << std::setprecision(3);
+      out << "      \"real_time\": " << res.real_time_ns_ << ",\n";
+      out << "      \"cpu_time\": " << res.cpu_time_ns_ << ",\n";
+      out << "      \"time_unit\": \"ns\",\n";
+      out << "      \"bytes_per_second\": " << res.bytes_per_second_ << ",\n";
+      out << "      \"items_per_second\": " << res.items_per_second_ << ",\n";
+      out << std::defaultfloat;
+      if (!res.ok_) {
+        out << "      \"error_occurred\": true,\n";
+        out << "      \"error_message\": \"" << Escape(res.error_) << "\",\n";
+      }
+      out << "      \"params\": {";
+      size_t p = 0;
+      for (const auto &kv : res.params_) {
+        out << (p++ ? ", " : "") << "\"" << Escape(kv.first) << "\": \""
+            << Escape(kv.second) << "\"";
+      }
+      out << "}\n";
+      out << "    }" << (r + 1 < results_.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+  }
+
+private:
+  struct Benchmark {
+    std::string name_;
+    std::map<std::string, std::string> params_;
+    BenchFn fn_;
+  };
+
+  BenchmarkResult Run(Benchmark &bench) {
+    BenchmarkResult res;
+    res.name_ = bench.name_;
+    res.params_ = bench.params_;
+
+    size_t total_bytes = 0;
+    size_t total_items = 0;
+    double real_s = 0;
+    double cpu_s = 0;
+    while (res.iterations_ < max_iterations_ &&
+           (res.iterations_ == 0 || real_s < min_time_s_)) {
+      auto start = std::chrono::steady_clock::now();
+      std::clock_t cpu_start = std::clock();
+      IterationResult it = bench.fn_();
+      std::clock_t cpu_end = std::clock();
+      auto end = std::chrono::steady_clock::now();
+
+      real_s += std::chrono::duration<double>(end - start).count();
+      cpu_s += static_cast<double>(cpu_end - cpu_start) / CLOCKS_PER_SEC;
+      total_bytes += it.bytes_;
+      total_items += it.items_;
+      ++res.iterations_;
+      if (!it.ok_) {
+        res.ok_ = false;
+        res.error_ = it.error_;
+        break;
+      }
+    }
+
+    res.real_time_ns_ = real_s * 1e9 / res.iterations_;
+    res.cpu_time_ns_ = cpu_s * 1e9 / res.iterations_;
+    if (real_s > 0) {
+      res.bytes_per_second_ = total_bytes / real_s;
+      res.items_per_second_ = total_items / real_s;
+    }
+    return res;
+  }
+
+  void Print(const BenchmarkResult &res) const {
+    std::ostream &out = *table_;
+    out << std::left << std::setw(56) << res.name_ << std::right << std::fixed
+        << std::setprecision(3) << std::setw(14) << res.real_time_ns_ / 1e6
+        << std::setw(12) << res.iterations_ << std::setprecision(1)
+        << std::setw(14) << res.bytes_per_second_ / (1024.0 * 1024.0)
+        << std::setw(14) << res.items_per_second_ << std::defaultfloat;
+    if (!res.ok_) {
+      out << "  ERROR: " << res.error_;
+    }
+    out << std::endl;
+  }
+
+  static std::map<std::string, std::string> BaseContext() {
+    std::map<std::string, std::string> ctx;
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    ctx["host_name"] = host;
+    ctx["num_cpus"] = std::to_string(std::thread::hardware_concurrency());
+    std::time_t now = std::time(nullptr);
+    char date[64];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z",
+                  std::localtime(&now));
+    ctx["date"] = date;
+#ifdef CAE_VERSION_STRING
+    ctx["cae_version"] = CAE_VERSION_STRING;
+#endif
+    return ctx;
+  }
+
+  static std::string Escape(const std::string &s) { return JsonEscape(s); }
+
+  double min_time_s_;
+  size_t max_iterations_;
+  std::ostream *table_;
+  std::string filter_;
+  std::map<std::string, std::string> context_;
+  std::vector<Benchmark> benchmarks_;
+  std::vector<BenchmarkResult> results_;
+};
+
+} // namespace bench
+} // namespace cae
+
+#endif // CAE_BENCH_BENCH_RUNNER_H_
@@ -0,0 +1,462 @@
+#include "bench/bench_runner.h"
+#include "bench/dataset_generator.h"
+#include "format/binary_file_omni.h"
+#include "format/csv_parser.h"
+#include "io/chunk_reader.h"
+#include "repo/file_pattern.h"
+#include "util/hash.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace cae;
+using namespace cae::bench;
+
+namespace {
+
+struct BenchOptions {
+  DatasetOptions data_;
+  std::string filter_;
+  std::string json_path_;
+  std::string label_;
+  std::string wrp_path_;
+  double min_time_s_;
+  int e2e_repetitions_;
+  bool run_micro_;
+  bool run_e2e_;
+  bool drop_cache_;
+
+  BenchOptions()
+      : min_time_s_(0.5), e2e_repetitions_(3), run_micro_(true),
+        run_e2e_(true), drop_cache_(false) {
+    data_.out_dir_ = "cae_bench_data";
+    data_.scale_ = 0.25;
+  }
+};
+
+void PrintUsage(const char *program_name) {
+  std::cerr << "Usage: " << program_name << " [options]" << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  --data <dir>       Dataset directory (default: cae_bench_data)"
+            << std::endl;
+  std::cerr << "  --scale <x>        Dataset scale factor (default: 0.25)"
+            << std::endl;
+  std::cerr << "  --seed <n>         Dataset seed (default: 42)" << std::endl;
+  std::cerr << "  --filter <substr>  Only run benchmarks containing substr"
+            << std::endl;
+  std::cerr << "  --json <file>      Write results as JSON to file ('-' for "
+               "stdout)"
+            << std::endl;
+  std::cerr << "  --label <text>     Label stored in the JSON context "
+               "(e.g. git commit)"
+            << std::endl;
+  std::cerr << "  --min-time <s>     Minimum time per microbenchmark "
+               "(default: 0.5)"
+            << std::endl;
+  std::cerr << "  --repetitions <n>  Repetitions per end-to-end benchmark "
+               "(default: 3)"
+            << std::endl;
+  std::cerr << "  --wrp <path>       wrp binary (default: next to cae_bench)"
+            << std::endl;
+  std::cerr << "  --drop-cache       Evict benchmark files from the page cache "
+               "before each read"
+            << std::endl;
+  std::cerr << "  --micro-only       Skip end-to-end benchmarks" << std::endl;
+  std::cerr << "  --e2e-only         Skip microbenchmarks" << std::endl;
+}
+
+/** Silences std::cout for the lifetime of the object */
+class QuietStdout {
+public:
+  QuietStdout() : saved_(std::cout.rdbuf(nullptr)) {}
+  ~QuietStdout() {
+    std::cout.clear();
+    std::cout.rdbuf(saved_);
+  }
+
+private:
+  std::streambuf *saved_;
+};
+
+/** Ask the kernel to drop cached pages of a file */
+void DropCache(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+std::string SizeLabel(size_t bytes) {
+  if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0) {
+    return std::to_string(bytes / (1024 * 1024)) + "M";
+  }
+  return std::to_string(bytes / 1024) + "K";
+}
+
+void AddReadBenchmarks(BenchRunner &runner, const BenchOptions &opts,
+                       const std::string &path, size_t file_size) {
+  const size_t chunk_sizes[] = {64 * 1024, 1024 * 1024, 4 * 1024 * 1024,
+                                16 * 1024 * 1024};
+  const int queue_depths[] = {1, 4, 16};
+  const IoEngine engines[] = {IoEngine::kStdio, IoEngine::kPread,
+                              IoEngine::kMmap};
+  bool drop_cache = opts.drop_cache_;
+
+  for (IoEngine engine : engines) {
+    for (size_t chunk : chunk_sizes) {
+      for (int qd : queue_depths) {
+        // Only pread keeps more than one request in flight
+        if (qd > 1 && engine != IoEngine::kPread) {
+          continue;
+        }
+        ChunkReaderOptions ropts;
+        ropts.engine_ = engine;
+        ropts.chunk_size_ = chunk;
+        ropts.queue_depth_ = qd;
+        std::string name = std::string("read/") + IoEngineName(engine) +
+                           "/chunk:" + SizeLabel(chunk) +
+                           "/qd:" + std::to_string(qd);
+        runner.Add(name,
+                   {{"engine", IoEngineName(engine)},
+                    {"chunk_size", std::to_string(chunk)},
+                    {"queue_depth", std::to_string(qd)},
+                    {"file_size", std::to_string(file_size)}},
+                   [=]() {
+                     if (drop_cache) {
+                       DropCache(path);
+                     }
+                     ChunkReader reader(ropts);
+                     IterationResult res;
+                     std::atomic<size_t> chunks(0);
+                     res.bytes_ = reader.Read(
+                         path, 0, file_size,
+                         [&](size_t, const char *data, size_t len) {
+                           // Touch every page so mmap faults them all in
+                           char acc = 0;
+                           for (size_t i = 0; i < len; i += 4096) {
+                             acc ^= data[i];
+                           }
+                           volatile char sink = acc;
+                           (void)sink;
+                           chunks++;
+                         });
+                     res.items_ = chunks.load();
+                     if (res.bytes_ != file_size) {
+                       res.ok_ = false;
+                       res.error_ = "short read";
+                     }
+                     return res;
+                   });
+      }
+    }
+  }
+
+  // The production read loop, as run by wrp_binary_format_mpi
+  runner.Add("read/binary_file_omni/import",
+             {{"engine", "pread"},
+              {"chunk_size", std::to_string(1024 * 1024)},
+              {"file_size", std::to_string(file_size)}},
+             [=]() {
+               if (drop_cache) {
+                 DropCache(path);
+               }
+               FormatContext ctx;
+               ctx.filename_ = path;
+               ctx.offset_ = 0;
+               ctx.size_ = file_size;
+               BinaryFileOmni client;
+               {
+                 QuietStdout quiet;
+                 client.Import(ctx);
+               }
+               IterationResult res;
+               res.bytes_ = file_size;
+               res.items_ = 1;
+               return res;
+             });
+
+  // Many small ranges: one Import per range vs a single ImportBatch
+  const size_t nranges = 64;
+  auto ranges = std::make_shared<std::vector<FormatContext>>();
+  for (size_t r = 0; r < nranges; ++r) {
+    FormatContext ctx;
+    ctx.filename_ = path;
+    ctx.offset_ = file_size / nranges * r;
+    ctx.size_ = r + 1 < nranges ? file_size / nranges
+                                : file_size - ctx.offset_;
+    ranges->push_back(ctx);
+  }
+  for (bool batched : {false, true}) {
+    runner.Add(std::string("read/binary_file_omni/ranges:") +
+                   std::to_string(nranges) + (batched ? "/batch" : "/import"),
+               {{"engine", "pread"},
+                {"ranges", std::to_string(nranges)},
+                {"file_size", std::to_string(file_size)}},
+               [=]() {
+                 if (drop_cache) {
+                   DropCache(path);
+                 }
+                 BinaryFileOmni client;
+                 {
+                   QuietStdout quiet;
+                   if (batched) {
+                     client.ImportBatch(*ranges);
+                   } else {
+                     for (const auto &ctx : *ranges) {
+                       client.Import(ctx);
+                     }
+                   }
+                 }
+                 IterationResult res;
+                 res.bytes_ = file_size;
+                 res.items_ = nranges;
+                 return res;
+               });
+  }
+}
+
+void AddHashBenchmarks(BenchRunner &runner) {
+  auto buffer = std::make_shared<std::vector<char>>(1024 * 1024);
+  SplitMix64(7).Fill(buffer->data(), buffer->size());
+
+  const size_t block_sizes[] = {64, 4096, 1024 * 1024};
+  for (size_t block : block_sizes) {
+    runner.Add("hash/xxh64/block:" + std::to_string(block),
+               {{"algorithm", "xxh64"}, {"block_size", std::to_string(block)}},
+               [=]() {
+                 IterationResult res;
+                 uint64_t acc = 0;
+                 for (size_t off = 0; off + block <= buffer->size();
+                      off += block) {
+                   acc ^= Xxh64::Hash(buffer->data() + off, block);
+                   res.items_++;
+                 }
+                 volatile uint64_t sink = acc;
+                 (void)sink;
+                 res.bytes_ = res.items_ * block;
+                 return res;
+               });
+    runner.Add("hash/fnv1a64/block:" + std::to_string(block),
+               {{"algorithm", "fnv1a64"}, {"block_size", std::to_string(block)}},
+               [=]() {
+                 IterationResult res;
+                 uint64_t acc = 0;
+                 for (size_t off = 0; off + block <= buffer->size();
+                      off += block) {
+                   acc ^= Fnv1a64(buffer->data() + off, block);
+                   res.items_++;
+                 }
+                 volatile uint64_t sink = acc;
+                 (void)sink;
+                 res.bytes_ = res.items_ * block;
+                 return res;
+               });
+  }
+}
+
+void AddCsvBenchmarks(BenchRunner &runner, const std::string &csv_path) {
+  std::ifstream in(csv_path, std::ios::binary);
+  auto text = std::make_shared<std::string>(
+      (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  const size_t feed_sizes[] = {4096, 1024 * 1024};
+  for (size_t feed : feed_sizes) {
+    runner.Add("csv/parse/feed:" + SizeLabel(feed),
+               {{"feed_size", std::to_string(feed)},
+                {"input_bytes", std::to_string(text->size())}},
+               [=]() {
+                 size_t fields = 0;
+                 CsvParser parser(
+                     [&](const CsvParser::Record &rec) {
+                       fields += rec.size();
+                     });
+                 for (size_t off = 0; off < text->size(); off += feed) {
+                   parser.Feed(text->data() + off,
+                               std::min(feed, text->size() - off));
+                 }
+                 parser.Finish();
+                 IterationResult res;
+                 res.bytes_ = text->size();
+                 res.items_ = parser.GetRecordCount();
+                 if (fields == 0) {
+                   res.ok_ = false;
+                   res.error_ = "no fields parsed";
+                 }
+                 return res;
+               });
+  }
+}
+
+void AddPatternBenchmarks(BenchRunner &runner, const DatasetInfo &small) {
+  const std::pair<std::string, std::string> patterns[] = {
+      {"directory", small.dir_},
+      {"glob", small.dir_ + "/small_*.bin"},
+      {"glob_narrow", small.dir_ + "/small_0000?[0-4].bin"},
+      {"single_file", small.files_.front()}};
+  for (const auto &pattern : patterns) {
+    std::string path = pattern.second;
+    runner.Add("pattern/expand/" + pattern.first,
+               {{"pattern", path},
+                {"candidates", std::to_string(small.files_.size())}},
+               [=]() {
+                 IterationResult res;
+                 QuietStdout quiet;
+                 res.items_ = ExpandFilePattern(path).size();
+                 return res;
+               });
+  }
+}
+
+void AddEndToEndBenchmarks(BenchRunner &runner, const BenchOptions &opts,
+                           DatasetGenerator &gen) {
+  for (const auto &kind : DatasetGenerator::Kinds()) {
+    DatasetInfo info = gen.Generate(kind);
+    std::string cmd = "\"" + opts.wrp_path_ + "\" \"" + info.yaml_path_ +
+                      "\" > /dev/null 2>&1";
+    bool drop_cache = opts.drop_cache_;
+    runner.Add("e2e/wrp/" + kind,
+               {{"dataset", kind},
+                {"files", std::to_string(info.files_.size())},
+                {"logical_bytes", std::to_string(info.logical_bytes_)},
+                {"allocated_bytes", std::to_string(info.allocated_bytes_)}},
+               [=]() {
+                 if (drop_cache) {
+                   for (const auto &file : info.files_) {
+                     DropCache(file);
+                   }
+                 }
+                 IterationResult res;
+                 int rc = system(cmd.c_str());
+                 res.bytes_ = info.logical_bytes_;
+                 res.items_ = info.files_.size();
+                 if (rc != 0) {
+                   res.ok_ = false;
+                   res.error_ = "wrp exited with status " + std::to_string(rc);
+                 }
+                 return res;
+               });
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  BenchOptions opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--data") {
+      opts.data_.out_dir_ = next();
+    } else if (arg == "--scale") {
+      opts.data_.scale_ = std::stod(next());
+    } else if (arg == "--seed") {
+      opts.data_.seed_ = std::stoull(next());
+    } else if (arg == "--filter") {
+      opts.filter_ = next();
+    } else if (arg == "--json") {
+      opts.json_path_ = next();
+    } else if (arg == "--label") {
+      opts.label_ = next();
+    } else if (arg == "--min-time") {
+      opts.min_time_s_ = std::stod(next());
+    } else if (arg == "--repetitions") {
+      opts.e2e_repetitions_ = std::stoi(next());
+    } else if (arg == "--wrp") {
+      opts.wrp_path_ = next();
+    } else if (arg == "--drop-cache") {
+      opts.drop_cache_ = true;
+    } else if (arg == "--micro-only") {
+      opts.run_e2e_ = false;
+    } else if (arg == "--e2e-only") {
+      opts.run_micro_ = false;
+    } else {
+      PrintUsage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+
+  // wrp and its worker binaries live next to cae_bench
+  std::string bin_dir =
+      std::filesystem::absolute(argv[0]).parent_path().string();
+  if (opts.wrp_path_.empty()) {
+    opts.wrp_path_ = bin_dir + "/wrp";
+  }
+  const char *path_env = getenv("PATH");
+  std::string new_path = bin_dir + (path_env ? ":" + std::string(path_env) : "");
+  setenv("PATH", new_path.c_str(), 1);
+
+  try {
+    DatasetGenerator gen(opts.data_);
+    BenchRunner micro;
+    micro.SetMinTime(opts.min_time_s_);
+    micro.SetFilter(opts.filter_);
+    if (opts.json_path_ == "-") {
+      micro.SetTableStream(&std::cerr);
+    }
+
+    if (opts.run_micro_) {
+      DatasetInfo huge = gen.GenerateHugeFile();
+      DatasetInfo small = gen.GenerateSmallFiles();
+      std::string csv_path = opts.data_.out_dir_ + "/micro_table.csv";
+      if (!std::filesystem::exists(csv_path)) {
+        DatasetGenerator::WriteCsvFile(csv_path, 200000, opts.data_.seed_);
+      }
+      AddReadBenchmarks(micro, opts, huge.files_.front(), huge.logical_bytes_);
+      AddHashBenchmarks(micro);
+      AddCsvBenchmarks(micro, csv_path);
+      AddPatternBenchmarks(micro, small);
+    }
+
+    // End-to-end runs are slow; bound them by repetitions, not time
+    BenchRunner e2e;
+    e2e.SetMinTime(0);
+    e2e.SetMaxIterations(opts.e2e_repetitions_);
+    e2e.SetFilter(opts.filter_);
+    if (opts.json_path_ == "-") {
+      e2e.SetTableStream(&std::cerr);
+    }
+    if (opts.run_e2e_) {
+      AddEndToEndBenchmarks(e2e, opts, gen);
+    }
+
+    micro.RunAll();
+    e2e.RunAll();
+
+    // Merge both result sets into one report
+    BenchRunner report = micro;
+    for (const auto &res : e2e.GetResults()) {
+      report.AddResult(res);
+    }
+    report.SetContext("scale", std::to_string(opts.data_.scale_));
+    report.SetContext("seed", std::to_string(opts.data_.seed_));
+    report.SetContext("drop_cache", opts.drop_cache_ ? "true" : "false");
+    if (!opts.label_.empty()) {
+      report.SetContext("label", opts.label_);
+    }
+
+    if (opts.json_path_ == "-") {
+      report.WriteJson(std::cout);
+    } else if (!opts.json_path_.empty()) {
+      std::ofstream out(opts.json_path_, std::ios::trunc);
+      report.WriteJson(out);
+      std::cout << "Wrote results to " << opts.json_path_ << std::endl;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include "bench/dataset_generator.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace cae::bench;
+
+void PrintUsage(const char *program_name) {
+  std::cerr << "Usage: " << program_name
+            << " [--out <dir>] [--scale <x>] [--seed <n>] [kind ...]"
+            << std::endl;
+  std::cerr << "Parameters:" << std::endl;
+  std::cerr << "  --out   - Output directory (default: cae_bench_data)"
+            << std::endl;
+  std::cerr << "  --scale - Scale factor for file counts and sizes (default: 1)"
+            << std::endl;
+  std::cerr << "  --seed  - Seed for deterministic content (default: 42)"
+            << std::endl;
+  std::cerr << "  kind    - Datasets to generate (default: all):";
+  for (const auto &kind : DatasetGenerator::Kinds()) {
+    std::cerr << " " << kind;
+  }
+  std::cerr << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  DatasetOptions opts;
+  std::vector<std::string> kinds;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if ((arg == "--out" || arg == "--scale" || arg == "--seed") &&
+        i + 1 >= argc) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    if (arg == "--out") {
+      opts.out_dir_ = argv[++i];
+    } else if (arg == "--scale") {
+      opts.scale_ = std::stod(argv[++i]);
+    } else if (arg == "--seed") {
+      opts.seed_ = std::stoull(argv[++i]);
+    } else if (arg == "--help" || arg == "-h") {
+      PrintUsage(argv[0]);
+      return 0;
+    } else {
+      kinds.push_back(arg);
+    }
+  }
+  if (kinds.empty()) {
+    kinds = DatasetGenerator::Kinds();
+  }
+
+  try {
+    DatasetGenerator gen(opts);
+    for (const auto &kind : kinds) {
+      DatasetInfo info = gen.Generate(kind);
+      std::cout << info.name_ << ": " << info.files_.size() << " files, "
+                << info.logical_bytes_ << " logical bytes, "
+                << info.allocated_bytes_ << " allocated bytes" << std::endl;
+      std::cout << "  OMNI job: " << info.yaml_path_ << std::endl;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
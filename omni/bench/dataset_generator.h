@@ -0,0 +1,391 @@
+#ifndef CAE_BENCH_DATASET_GENERATOR_H_
+#define CAE_BENCH_DATASET_GENERATOR_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Synthetic Dataset Generation Strategy:
+ *
+ * 1. Determinism: All content comes from a SplitMix64 stream seeded per
+ *    dataset and per file, so the same (seed, scale) always yields
+ *    byte-identical files on any machine
+ * 2. Scale: A single scale factor multiplies file counts and sizes; scale 1
+ *    is sized for a workstation, larger values for parallel filesystems
+ * 3. Reuse: Each dataset directory carries a stamp with its parameters and
+ *    is only regenerated when they change
+ * 4. OMNI Jobs: Every dataset is written with a matching OMNI YAML so it can
+ *    be fed to wrp unchanged
+ */
+
+namespace cae {
+namespace bench {
+
+/** SplitMix64 generator; small, fast and fully deterministic */
+class SplitMix64 {
+public:
+  explicit SplitMix64(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  /** Uniform value in [0, bound) */
+  uint64_t Below(uint64_t bound) { return bound == 0 ? 0 : Next() % bound; }
+
+  /** Fill a buffer with pseudo-random bytes */
+  void Fill(char *data, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+      uint64_t v = Next();
+      std::memcpy(data + i, &v, 8);
+    }
+    if (i < len) {
+      uint64_t v = Next();
+      std::memcpy(data + i, &v, len - i);
+    }
+  }
+
+private:
+  uint64_t state_;
+};
+
+/**
+ * Parameters shared by all generated datasets
+ */
+struct DatasetOptions {
+  std::string out_dir_;
+  double scale_;
+  uint64_t seed_;
+
+  DatasetOptions() : out_dir_("cae_bench_data"), scale_(1.0), seed_(42) {}
+};
+
+/**
+ * Description of a generated dataset
+ */
+struct DatasetInfo {
+  std::string name_;
+  std::string dir_;
+  std::string yaml_path_;
+  std::vector<std::string> files_;
+  size_t logical_bytes_;   // Sum of file sizes
+  size_t allocated_bytes_; // Bytes actually written (excludes holes)
+
+  DatasetInfo() : logical_bytes_(0), allocated_bytes_(0) {}
+};
+
+/**
+ * Generates benchmark datasets on disk
+ */
+class DatasetGenerator {
+public:
+  static constexpr size_t MiB = 1024 * 1024;
+
+  explicit DatasetGenerator(const DatasetOptions &opts) : opts_(opts) {
+    std::filesystem::create_directories(opts_.out_dir_);
+    opts_.out_dir_ = std::filesystem::absolute(opts_.out_dir_).string();
+  }
+
+  /** Names of all dataset kinds */
+  static std::vector<std::string> Kinds() {
+    return {"small_files", "huge_file", "sparse_file", "mixed_formats"};
+  }
+
+  /**
+   * Generate (or reuse) a dataset by name
+   * @param kind One of Kinds()
+   * @return Dataset description
+   */
+  DatasetInfo Generate(const std::string &kind) {
+    if (kind == "small_files") {
+      return GenerateSmallFiles();
+    } else if (kind == "huge_file") {
+      return GenerateHugeFile();
+    } else if (kind == "sparse_file") {
+      return GenerateSparseFile();
+    } else if (kind == "mixed_formats") {
+      return GenerateMixedFormats();
+    }
+    throw std::runtime_error("Unknown dataset kind: " + kind);
+  }
+
+  /** Many small files of identical size (1000 x 4KB at scale 1) */
+  DatasetInfo GenerateSmallFiles() {
+    DatasetInfo info = Begin("small_files");
+    size_t count = Scaled(1000, 1);
+    size_t file_size = 4096;
+    bool fresh = IsStale(info, count * file_size);
+    for (size_t i = 0; i < count; ++i) {
+      std::ostringstream name;
+      name << info.dir_ << "/small_" << std::setw(6) << std::setfill('0') << i
+           << ".bin";
+      if (fresh) {
+        WriteRandomFile(name.str(), file_size, FileSeed(info.name_, i));
+      }
+      info.files_.push_back(name.str());
+      info.logical_bytes_ += file_size;
+    }
+    info.allocated_bytes_ = info.logical_bytes_;
+    Finish(info, {{info.dir_, 0}});
+    return info;
+  }
+
+  /** One large file (256MB at scale 1) */
+  DatasetInfo GenerateHugeFile() {
+    DatasetInfo info = Begin("huge_file");
+    size_t file_size = Scaled(256, 1) * MiB;
+    std::string path = info.dir_ + "/huge.bin";
+    if (IsStale(info, file_size)) {
+      WriteRandomFile(path, file_size, FileSeed(info.name_, 0));
+    }
+    info.files_.push_back(path);
+    info.logical_bytes_ = file_size;
+    info.allocated_bytes_ = file_size;
+    Finish(info, {{path, 0}});
+    return info;
+  }
+
+  /**
+   * A sparse file (256MB logical at scale 1) where only 1MB of every 8MB
+   * holds data, at a pseudo-random position inside each 8MB region
+   */
+  DatasetInfo GenerateSparseFile() {
+    DatasetInfo info = Begin("sparse_file");
+    size_t file_size = Scaled(256, 1) * MiB;
+    size_t region = 8 * MiB;
+    size_t extent = 1 * MiB;
+    std::string path = info.dir_ + "/sparse.bin";
+    bool fresh = IsStale(info, file_size);
+
+    int fd = -1;
+    if (fresh) {
+      fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0) {
+        throw std::runtime_error("Could not create " + path + ": " +
+                                 strerror(errno));
+      }
+      if (ftruncate(fd, static_cast<off_t>(file_size)) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not size " + path);
+      }
+    }
+
+    SplitMix64 rng(FileSeed(info.name_, 0));
+    std::vector<char> buffer(extent);
+    for (size_t base = 0; base < file_size; base += region) {
+      size_t slots = std::min(region, file_size - base) / extent;
+      if (slots == 0) {
+        break;
+      }
+      size_t off = base + rng.Below(slots) * extent;
+      rng.Fill(buffer.data(), buffer.size());
+      if (fresh) {
+        WriteAll(fd, buffer.data(), buffer.size(), off, path);
+      }
+      info.allocated_bytes_ += extent;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+
+    info.files_.push_back(path);
+    info.logical_bytes_ = file_size;
+    Finish(info, {{path, 0}});
+    return info;
+  }
+
+  /** A mix of CSV, binary and JSON-lines files of different sizes */
+  DatasetInfo GenerateMixedFormats() {
+    DatasetInfo info = Begin("mixed_formats");
+    size_t count = Scaled(4, 1);
+    bool fresh = IsStale(info, count);
+    std::vector<std::pair<std::string, size_t>> entries;
+
+    for (size_t i = 0; i < count; ++i) {
+      std::string csv = info.dir_ + "/table_" + std::to_string(i) + ".csv";
+      std::string bin = info.dir_ + "/blob_" + std::to_string(i) + ".bin";
+      std::string jsonl = info.dir_ + "/events_" + std::to_string(i) + ".jsonl";
+      if (fresh) {
+        WriteCsvFile(csv, 20000 * (i + 1), FileSeed("csv", i));
+        WriteRandomFile(bin, (i + 1) * 4 * MiB, FileSeed("bin", i));
+        WriteJsonLinesFile(jsonl, 10000 * (i + 1), FileSeed("jsonl", i));
+      }
+      for (const auto &path : {csv, bin, jsonl}) {
+        size_t size = std::filesystem::file_size(path);
+        info.files_.push_back(path);
+        info.logical_bytes_ += size;
+        entries.push_back({path, 0});
+      }
+    }
+    info.allocated_bytes_ = info.logical_bytes_;
+    Finish(info, entries);
+    return info;
+  }
+
+  /**
+   * Write a CSV table with a header and typed columns
+   * @param path Output file
+   * @param rows Number of data rows
+   * @param seed Content seed
+   */
+  static void WriteCsvFile(const std::string &path, size_t rows,
+                           uint64_t seed) {
+    static const char *kSites[] = {"alpha", "bravo", "charlie", "delta",
+                                   "echo"};
+    SplitMix64 rng(seed);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "id,timestamp,site,temperature,pressure,flag,note\n";
+    for (size_t r = 0; r < rows; ++r) {
+      double temp = static_cast<double>(rng.Below(100000)) / 1000.0 - 20.0;
+      double pres = 900.0 + static_cast<double>(rng.Below(20000)) / 100.0;
+      out << r << "," << (1700000000 + r * 10) << ","
+          << kSites[rng.Below(5)] << "," << std::fixed << std::setprecision(3)
+          << temp << "," << std::setprecision(2) << pres << ","
+          << (rng.Below(2) ? "true" : "false") << ",";
+      if (rng.Below(10) == 0) {
+        out << "\"quoted, note " << rng.Below(1000) << "\"";
+      }
+      out << "\n";
+    }
+  }
+
+  /** Write a JSON-lines event log */
+  static void WriteJsonLinesFile(const std::string &path, size_t rows,
+                                 uint64_t seed) {
+    SplitMix64 rng(seed);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    for (size_t r = 0; r < rows; ++r) {
+      out << "{\"seq\":" << r << ",\"sensor\":" << rng.Below(64)
+          << ",\"value\":" << rng.Below(1000000) << "}\n";
+    }
+  }
+
+  /** Write a file of pseudo-random bytes */
+  static void WriteRandomFile(const std::string &path, size_t size,
+                              uint64_t seed) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("Could not create " + path + ": " +
+                               strerror(errno));
+    }
+    SplitMix64 rng(seed);
+    std::vector<char> buffer(std::min(size, 4 * MiB));
+    for (size_t done = 0; done < size;) {
+      size_t len = std::min(size - done, buffer.size());
+      rng.Fill(buffer.data(), len);
+      WriteAll(fd, buffer.data(), len, done, path);
+      done += len;
+    }
+    close(fd);
+  }
+
+private:
+  DatasetInfo Begin(const std::string &name) {
+    DatasetInfo info;
+    info.name_ = name;
+    info.dir_ = opts_.out_dir_ + "/" + name;
+    info.yaml_path_ = opts_.out_dir_ + "/" + name + ".yaml";
+    std::filesystem::create_directories(info.dir_);
+    return info;
+  }
+
+  /** Returns true (and clears the directory) if the stamp does not match */
+  bool IsStale(const DatasetInfo &info, size_t shape) {
+    std::string want = Stamp(shape);
+    std::ifstream in(info.dir_ + "/.cae_dataset");
+    std::string have((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    if (have == want) {
+      return false;
+    }
+    for (const auto &entry : std::filesystem::directory_iterator(info.dir_)) {
+      std::filesystem::remove_all(entry.path());
+    }
+    pending_stamp_ = want;
+    return true;
+  }
+
+  /** Write the stamp and the OMNI YAML for a dataset */
+  void Finish(const DatasetInfo &info,
+              const std::vector<std::pair<std::string, size_t>> &entries) {
+    if (!pending_stamp_.empty()) {
+      std::ofstream(info.dir_ + "/.cae_dataset") << pending_stamp_;
+      pending_stamp_.clear();
+    }
+
+    std::ofstream yaml(info.yaml_path_, std::ios::trunc);
+    yaml << "# Generated by cae_datagen (seed " << opts_.seed_ << ", scale "
+         << opts_.scale_ << ")\n";
+    yaml << "name: bench_" << info.name_ << "\n";
+    yaml << "max_scale: 4\n";
+    yaml << "data:\n";
+    for (const auto &entry : entries) {
+      yaml << "- path: " << entry.first << "\n";
+      yaml << "  offset: " << entry.second << "\n";
+      yaml << "  description:\n";
+      yaml << "    - bench\n";
+      yaml << "    - " << info.name_ << "\n";
+    }
+  }
+
+  std::string Stamp(size_t shape) const {
+    std::ostringstream oss;
+    oss << "seed=" << opts_.seed_ << " scale=" << opts_.scale_
+        << " shape=" << shape;
+    return oss.str();
+  }
+
+  size_t Scaled(size_t base, size_t min_value) const {
+    return std::max(min_value,
+                    static_cast<size_t>(static_cast<double>(base) *
+                                        opts_.scale_));
+  }
+
+  uint64_t FileSeed(const std::string &name, size_t index) const {
+    uint64_t h = opts_.seed_ ^ 0xcbf29ce484222325ULL;
+    for (char c : name) {
+      h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return h + index * 0x9e3779b97f4a7c15ULL;
+  }
+
+  static void WriteAll(int fd, const char *data, size_t len, size_t offset,
+                       const std::string &path) {
+    size_t done = 0;
+    while (done < len) {
+      ssize_t ret = pwrite(fd, data + done, len - done,
+                           static_cast<off_t>(offset + done));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error("Write failed for " + path + ": " +
+                                 strerror(errno));
+      }
+      done += static_cast<size_t>(ret);
+    }
+  }
+
+  DatasetOptions opts_;
+  std::string pending_stamp_;
+};
+
+} // namespace bench
+} // namespace cae
+
+#endif // CAE_BENCH_DATASET_GENERATOR_H_
@@ -0,0 +1,404 @@
+#ifndef CAE_CATALOG_CATALOG_WRITER_H_
+#define CAE_CATALOG_CATALOG_WRITER_H_
+
+#include "io/compressed_reader.h"
+#include "metadata_collector.h"
+#include "schema_probe.h"
+#include "util/json.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Catalog Output Strategy:
+ *
+ * 1. Parts: When an import finishes, its rank 0 writes one part per import
+ *    under <catalog>/parts: CSV rows and JSON lines for every file it read
+ * 2. Assembly: At job end wrp joins the parts, in name order, into
+ *    file_assets.csv (the columns of DataHub's csv-enricher source, like
+ *    data/file_assets.csv) and file_assets.jsonl (the full metadata)
+ * 3. Rows: Each file gets one row for the dataset and one per column or
+ *    HDF5 dataset (the subresource); description tags become DataHub tags,
+ *    and owners, glossary terms and domain come from the job's catalog
+ *    settings (<catalog>/catalog.json)
+ */
+
+namespace cae {
+
+/**
+ * DataHub settings applied to every cataloged file
+ */
+struct CatalogOptions {
+  std::string platform_; // Data platform of the dataset URNs
+  std::string env_;      // Fabric of the dataset URNs
+  std::vector<std::string> owners_;
+  std::vector<std::string> glossary_terms_;
+  std::string domain_;
+  std::string ownership_type_;
+  std::string ownership_type_urn_;
+
+  CatalogOptions()
+      : platform_("file"), env_("PROD"), ownership_type_("TECHNICAL_OWNER") {}
+
+  /** Read settings saved by Save; missing keys keep their defaults */
+  bool Load(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+      return false;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    ForEachFlatObject(text.str(), [&](const JsonFields &fields) {
+      auto get = [&](const char *key, std::string &out) {
+        auto it = fields.find(key);
+        if (it != fields.end()) {
+          out = it->second;
+        }
+      };
+      std::string owners, terms;
+      get("platform", platform_);
+      get("env", env_);
+      get("owners", owners);
+      get("glossary_terms", terms);
+      get("domain", domain_);
+      get("ownership_type", ownership_type_);
+      get("ownership_type_urn", ownership_type_urn_);
+      owners_ = Split(owners, '|');
+      glossary_terms_ = Split(terms, '|');
+    });
+    return true;
+  }
+
+  /** Save the settings for the workers of a job */
+  void Save(const std::string &path) const {
+    std::ofstream out(path);
+    out << "{\"platform\": " << JsonString(platform_)
+        << ", \"env\": " << JsonString(env_)
+        << ", \"owners\": " << JsonString(Join(owners_, '|'))
+        << ", \"glossary_terms\": " << JsonString(Join(glossary_terms_, '|'))
+        << ", \"domain\": " << JsonString(domain_)
+        << ", \"ownership_type\": " << JsonString(ownership_type_)
+        << ", \"ownership_type_urn\": " << JsonString(ownership_type_urn_)
+        << "}\n";
+    if (!out) {
+      throw std::runtime_error("Could not write catalog settings: " + path);
+    }
+  }
+
+  static std::vector<std::string> Split(const std::string &s, char sep) {
+    std::vector<std::string> parts;
+    std::string part;
+    std::istringstream in(s);
+    while (std::getline(in, part, sep)) {
+      size_t b = part.find_first_not_of(" \t");
+      size_t e = part.find_last_not_of(" \t");
+      if (b != std::string::npos) {
+        parts.push_back(part.substr(b, e - b + 1));
+      }
+    }
+    return parts;
+  }
+
+  static std::string Join(const std::vector<std::string> &parts, char sep) {
+    std::string s;
+    for (const auto &part : parts) {
+      s += (s.empty() ? "" : std::string(1, sep)) + part;
+    }
+    return s;
+  }
+};
+
+/**
+ * Writes and assembles catalog parts
+ */
+class CatalogWriter {
+public:
+  static constexpr size_t HISTOGRAM_BINS = 32;
+  static constexpr const char *CSV_HEADER =
+      "resource,subresource,glossary_terms,tags,owners,ownership_type,"
+      "description,domain,ownership_type_urn";
+
+  /** Settings file of a catalog directory */
+  static std::string GetOptionsPath(const std::string &dir) {
+    return dir + "/catalog.json";
+  }
+
+  /**
+   * Write the catalog part of one import
+   * Probes the schema of self-describing files, which reads only their
+   * metadata, and computes the digest of every completely read file.
+   * @param dir Catalog directory
+   * @param name Part name, unique per import
+   * @param files Merged metadata of every rank
+   * @param decompress Whether compressed files were imported decoded
+   * @return Number of files written
+   */
+  static size_t WritePart(const std::string &dir, const std::string &name,
+                          std::map<std::string, FileMetadata> &files,
+                          bool decompress) {
+    CatalogOptions options;
+    options.Load(GetOptionsPath(dir));
+    std::string parts = dir + "/parts";
+    std::filesystem::create_directories(parts);
+    std::string base = parts + "/" + name;
+    std::ofstream csv(base + ".csv.tmp");
+    std::ofstream jsonl(base + ".jsonl.tmp");
+    for (auto &kv : files) {
+      WriteFile(kv.second, options, decompress, csv, jsonl);
+    }
+    csv.close();
+    jsonl.close();
+    if (!csv || !jsonl) {
+      throw std::runtime_error("Could not write catalog part: " + base);
+    }
+    std::filesystem::rename(base + ".csv.tmp", base + ".csv");
+    std::filesystem::rename(base + ".jsonl.tmp", base + ".jsonl");
+    return files.size();
+  }
+
+  /**
+   * Join every part into file_assets.csv and file_assets.jsonl
+   * The parts are removed once the catalog is written.
+   * @return Number of cataloged files
+   */
+  static size_t Assemble(const std::string &dir) {
+    std::string parts = dir + "/parts";
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(parts, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      if (it->path().extension() == ".jsonl") {
+        names.push_back(it->path().stem().string());
+      }
+    }
+    std::sort(names.begin(), names.end());
+
+    std::ofstream csv(dir + "/file_assets.csv.tmp");
+    std::ofstream jsonl(dir + "/file_assets.jsonl.tmp");
+    csv << CSV_HEADER << "\n";
+    size_t count = 0;
+    for (const auto &name : names) {
+      std::ifstream part_csv(parts + "/" + name + ".csv");
+      std::ifstream part_jsonl(parts + "/" + name + ".jsonl");
+      csv << part_csv.rdbuf();
+      std::string line;
+      while (std::getline(part_jsonl, line)) {
+        jsonl << line << "\n";
+        ++count;
+      }
+    }
+    csv.close();
+    jsonl.close();
+    if (!csv || !jsonl) {
+      throw std::runtime_error("Could not write catalog in " + dir);
+    }
+    std::filesystem::rename(dir + "/file_assets.csv.tmp",
+                            dir + "/file_assets.csv");
+    std::filesystem::rename(dir + "/file_assets.jsonl.tmp",
+                            dir + "/file_assets.jsonl");
+    std::filesystem::remove_all(parts, ec);
+    return count;
+  }
+
+  /** Quote a CSV field when it holds a delimiter, quote or newline */
+  static std::string CsvField(const std::string &s) {
+    if (s.find_first_of(",\"\r\n") == std::string::npos) {
+      return s;
+    }
+    std::string quoted = "\"";
+    for (char c : s) {
+      quoted += c == '"' ? "\"\"" : std::string(1, c);
+    }
+    return quoted + "\"";
+  }
+
+  /** DataHub array column: [urn1|urn2], each name prefixed unless a URN */
+  static std::string UrnList(const std::vector<std::string> &names,
+                             const std::string &prefix) {
+    if (names.empty()) {
+      return "";
+    }
+    std::string s = "[";
+    for (size_t i = 0; i < names.size(); ++i) {
+      s += (i ? "|" : "") + Urn(names[i], prefix);
+    }
+    return s + "]";
+  }
+
+  static std::string Urn(const std::string &name, const std::string &prefix) {
+    return name.rfind("urn:li:", 0) == 0 ? name : prefix + name;
+  }
+
+  /**
+   * JSON of a column profile: statistics, the distinct count estimate and,
+   * for numeric columns, quantiles and a histogram of at most
+   * HISTOGRAM_BINS bins
+   */
+  static std::string ColumnJson(const ColumnProfile &col) {
+    std::string json =
+        "{\"name\": " + JsonString(col.name_) +
+        ", \"type\": " + JsonString(ColumnTypeName(col.type_)) +
+        ", \"count\": " + std::to_string(col.count_) +
+        ", \"nulls\": " + std::to_string(col.nulls_) +
+        ", \"min\": " + JsonString(col.GetMin()) +
+        ", \"max\": " + JsonString(col.GetMax()) +
+        ", \"distinct\": " + std::to_string(col.distinct_.Estimate());
+    static const std::vector<double> fractions = {0.01, 0.05, 0.25, 0.5,
+                                                  0.75, 0.95, 0.99};
+    static const char *names[] = {"p1",  "p5",  "p25", "p50",
+                                  "p75", "p95", "p99"};
+    std::vector<double> quantiles = col.quantiles_.GetQuantiles(fractions);
+    if (!quantiles.empty()) {
+      json += ", \"quantiles\": {";
+      for (size_t i = 0; i < quantiles.size(); ++i) {
+        json += std::string(i ? ", " : "") + "\"" + names[i] +
+                "\": " + ColumnProfile::FormatDouble(quantiles[i]);
+      }
+      json += "}, \"histogram\": [";
+      std::vector<LogHistogram::Bin> bins =
+          col.histogram_.GetBins(HISTOGRAM_BINS);
+      for (size_t i = 0; i < bins.size(); ++i) {
+        json += std::string(i ? ", " : "") + "[" +
+                ColumnProfile::FormatDouble(bins[i].lower_) + ", " +
+                ColumnProfile::FormatDouble(bins[i].upper_) + ", " +
+                std::to_string(bins[i].count_) + "]";
+      }
+      json += "]";
+    }
+    return json + "}";
+  }
+
+private:
+  static void WriteFile(FileMetadata &file, const CatalogOptions &options,
+                        bool decompress, std::ostream &csv,
+                        std::ostream &jsonl) {
+    struct stat st;
+    bool exists = stat(file.path_.c_str(), &st) == 0;
+    size_t size = exists ? static_cast<size_t>(st.st_size) : 0;
+    size_t content_size = size;
+    Compression compression = Compression::kNone;
+    int fd = exists ? open(file.path_.c_str(), O_RDONLY) : -1;
+    if (fd >= 0) {
+      compression = DetectCompression(fd);
+      close(fd);
+    }
+    if (decompress && compression != Compression::kNone) {
+      try {
+        content_size =
+            CompressedIndex::Get(file.path_, compression)->uncompressed_size_;
+      } catch (const std::exception &) {
+        content_size = 0;
+      }
+    }
+    std::string digest;
+    bool complete =
+        exists && MetadataCollector::GetDigest(file, content_size, digest);
+
+    SchemaInfo schema;
+    schema.format_ = SchemaProbe::DetectFormat(file.path_, file.format_);
+    std::string schema_error;
+    if (exists && compression == Compression::kNone) {
+      SchemaProbe::Probe(file.path_, schema, schema_error);
+    }
+
+    std::string columns;
+    for (const auto &col : file.columns_) {
+      columns += std::string(columns.empty() ? "" : ", ") + ColumnJson(col);
+      SchemaField field;
+      field.name_ = col.name_;
+      field.description_ = std::string(ColumnTypeName(col.type_)) +
+                           ", min " + col.GetMin() + ", max " + col.GetMax() +
+                           ", " + std::to_string(col.nulls_) + " nulls of " +
+                           std::to_string(col.count_) + ", ~" +
+                           std::to_string(col.distinct_.Estimate()) +
+                           " distinct";
+      std::vector<double> median = col.quantiles_.GetQuantiles({0.5});
+      if (!median.empty()) {
+        field.description_ +=
+            ", median ~" + ColumnProfile::FormatDouble(median[0]);
+      }
+      schema.fields_.push_back(field);
+    }
+
+    std::vector<std::string> tags = CatalogOptions::Split(file.tags_, ',');
+    std::string resource = "urn:li:dataset:(urn:li:dataPlatform:" +
+                           options.platform_ + "," + file.path_ + "," +
+                           options.env_ + ")";
+
+    // JSON line with everything that was extracted
+    std::string tag_json;
+    for (const auto &tag : tags) {
+      tag_json += (tag_json.empty() ? "" : ", ") + JsonString(tag);
+    }
+    jsonl << "{\"path\": " << JsonString(file.path_)
+          << ", \"resource\": " << JsonString(resource)
+          << ", \"format\": " << JsonString(schema.format_)
+          << ", \"imported_as\": " << JsonString(file.format_)
+          << ", \"size\": " << size
+          << ", \"content_size\": " << content_size
+          << ", \"compression\": "
+          << JsonString(CompressionName(compression))
+          << ", \"mtime_ns\": "
+          << (exists ? static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                           st.st_mtim.tv_nsec
+                     : 0)
+          << ", \"digest\": " << (complete ? JsonString(digest) : "null")
+          << ", \"digest_algorithm\": \"xxh64-of-xxh64-64KiB-segments\""
+          << ", \"tags\": [" << tag_json << "]";
+    if (!file.columns_.empty()) {
+      jsonl << ", \"rows\": " << file.rows_ << ", \"columns\": [" << columns
+            << "]";
+    }
+    if (!schema.json_.empty()) {
+      jsonl << ", \"schema\": " << schema.json_;
+    }
+    if (!schema_error.empty()) {
+      jsonl << ", \"schema_error\": " << JsonString(schema_error);
+    }
+    jsonl << "}\n";
+
+    // One csv-enricher row for the dataset, one per field
+    std::string description = schema.format_ + ", " +
+                              std::to_string(content_size) + " bytes";
+    if (!file.columns_.empty()) {
+      description += ", " + std::to_string(file.rows_) + " rows, " +
+                     std::to_string(file.columns_.size()) + " columns";
+    } else if (!schema.fields_.empty()) {
+      description += ", " + std::to_string(schema.fields_.size()) +
+                     (schema.format_ == "hdf5" ? " datasets" : " columns");
+    }
+    if (complete) {
+      description += ", xxh64 " + digest;
+    }
+    bool owned = !options.owners_.empty();
+    csv << CsvField(resource) << ","
+        << "," << CsvField(UrnList(options.glossary_terms_,
+                                   "urn:li:glossaryTerm:"))
+        << "," << CsvField(UrnList(tags, "urn:li:tag:"))
+        << "," << CsvField(UrnList(options.owners_, "urn:li:corpuser:"))
+        << "," << (owned ? CsvField(options.ownership_type_) : "")
+        << "," << CsvField(description) << ","
+        << CsvField(options.domain_.empty()
+                        ? ""
+                        : Urn(options.domain_, "urn:li:domain:"))
+        << "," << (owned ? CsvField(options.ownership_type_urn_) : "")
+        << "\n";
+    for (const auto &field : schema.fields_) {
+      csv << CsvField(resource) << "," << CsvField(field.name_) << ",,,,,"
+          << CsvField(field.description_) << ",,\n";
+    }
+  }
+};
+
+} // namespace cae
+
+#endif // CAE_CATALOG_CATALOG_WRITER_H_
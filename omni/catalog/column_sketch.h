@@ -0,0 +1,454 @@
+#ifndef CAE_CATALOG_COLUMN_SKETCH_H_
+#define CAE_CATALOG_COLUMN_SKETCH_H_
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Column Sketch Strategy:
+ *
+ * 1. Mergeable: Every sketch has a Merge that gives the same kind of answer
+ *    as one sketch over all the values, so per-batch sketches combine into
+ *    per-rank ones and those into one per column of the job
+ * 2. Batched Updates: Values arrive a column batch at a time; hashes and
+ *    numbers are computed into flat arrays first, and the sketches update
+ *    from those arrays in tight loops the compiler can vectorize
+ * 3. Distinct Counts: HyperLogLog with 2^PRECISION one-byte registers
+ *    (about 1.6% standard error), linear counting for small cardinalities
+ * 4. Quantiles: KLL compactors with a fixed seed; rank error is about 1.7%
+ *    with K = 200, using a few KB per column
+ * 5. Histograms: Fixed logarithmic bins (SUB_BINS per power of two, on each
+ *    side of zero), so no value range has to be known up front and bins of
+ *    different ranks always line up
+ * 6. Encoding: Sketches serialize to self-contained little-endian strings
+ */
+
+namespace cae {
+
+/** Little-endian encoding shared by the sketches */
+class SketchCodec {
+public:
+  static void Put(std::string &out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+      out.push_back(static_cast<char>(v >> (8 * i)));
+    }
+  }
+
+  static void PutDouble(std::string &out, double d) {
+    uint64_t v;
+    std::memcpy(&v, &d, sizeof(v));
+    Put(out, v);
+  }
+
+  /** Read a value at pos; false if the string is too short */
+  static bool Get(const std::string &in, size_t &pos, uint64_t &v) {
+    if (pos > in.size() || in.size() - pos < 8) {
+      return false;
+    }
+    v = 0;
+    for (int i = 0; i < 8; ++i) {
+      v |= static_cast<uint64_t>(static_cast<unsigned char>(in[pos++]))
+           << (8 * i);
+    }
+    return true;
+  }
+
+  static bool GetDouble(const std::string &in, size_t &pos, double &d) {
+    uint64_t v;
+    if (!Get(in, pos, v)) {
+      return false;
+    }
+    std::memcpy(&d, &v, sizeof(d));
+    return true;
+  }
+};
+
+/**
+ * HyperLogLog distinct counter over 64-bit hashes
+ */
+class HyperLogLog {
+public:
+  static constexpr int PRECISION = 12;
+  static constexpr size_t REGISTERS = size_t(1) << PRECISION;
+
+  HyperLogLog() {}
+
+  /** Add a batch of hashed values */
+  void AddHashes(const uint64_t *hashes, size_t n) {
+    if (n == 0) {
+      return;
+    }
+    if (registers_.empty()) {
+      registers_.assign(REGISTERS, 0);
+    }
+    // Index and rank for the whole batch first, in a loop that vectorizes
+    std::vector<uint16_t> index(n);
+    std::vector<uint8_t> rank(n);
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t h = hashes[i];
+      index[i] = static_cast<uint16_t>(h >> (64 - PRECISION));
+      uint64_t rest = (h << PRECISION) | (uint64_t(1) << (PRECISION - 1));
+      rank[i] = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      uint8_t &reg = registers_[index[i]];
+      reg = std::max(reg, rank[i]);
+    }
+  }
+
+  void Merge(const HyperLogLog &other) {
+    if (other.registers_.empty()) {
+      return;
+    }
+    if (registers_.empty()) {
+      registers_ = other.registers_;
+      return;
+    }
+    for (size_t i = 0; i < REGISTERS; ++i) {
+      registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+  }
+
+  /** Estimated number of distinct values */
+  uint64_t Estimate() const {
+    if (registers_.empty()) {
+      return 0;
+    }
+    double m = static_cast<double>(REGISTERS);
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < REGISTERS; ++i) {
+      sum += std::ldexp(1.0, -registers_[i]);
+      zeros += registers_[i] == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+      estimate = m * std::log(m / static_cast<double>(zeros));
+    }
+    return static_cast<uint64_t>(estimate + 0.5);
+  }
+
+  /** Registers as bytes; empty when no value was added */
+  std::string Serialize() const {
+    return std::string(registers_.begin(), registers_.end());
+  }
+
+  bool Deserialize(const std::string &in) {
+    if (!in.empty() && in.size() != REGISTERS) {
+      return false;
+    }
+    registers_.assign(in.begin(), in.end());
+    return true;
+  }
+
+private:
+  std::vector<uint8_t> registers_; // Allocated on the first value
+};
+
+/**
+ * KLL quantile sketch of doubles
+ */
+class KllSketch {
+public:
+  static constexpr size_t K = 200;
+  static constexpr size_t MIN_CAPACITY = 8;
+
+  KllSketch() : count_(0), random_(0x9E3779B97F4A7C15ULL) {}
+
+  /** Add a batch of values */
+  void AddValues(const double *values, size_t n) {
+    if (levels_.empty()) {
+      levels_.emplace_back();
+    }
+    size_t i = 0;
+    while (i < n) {
+      size_t room = Capacity(0) > levels_[0].size()
+                        ? Capacity(0) - levels_[0].size()
+                        : 0;
+      size_t take = std::min(n - i, std::max<size_t>(room, 1));
+      levels_[0].insert(levels_[0].end(), values + i, values + i + take);
+      i += take;
+      count_ += take;
+      Compress();
+    }
+  }
+
+  void Merge(const KllSketch &other) {
+    if (levels_.size() < other.levels_.size()) {
+      levels_.resize(other.levels_.size());
+    }
+    for (size_t h = 0; h < other.levels_.size(); ++h) {
+      levels_[h].insert(levels_[h].end(), other.levels_[h].begin(),
+                        other.levels_[h].end());
+    }
+    count_ += other.count_;
+    Compress();
+  }
+
+  /** Number of values added */
+  uint64_t GetCount() const { return count_; }
+
+  /**
+   * Approximate quantiles
+   * @param fractions Ranks in [0, 1], ascending
+   * @return One value per fraction; empty if no value was added
+   */
+  std::vector<double> GetQuantiles(const std::vector<double> &fractions) const {
+    std::vector<std::pair<double, uint64_t>> weighted;
+    uint64_t total = 0;
+    for (size_t h = 0; h < levels_.size(); ++h) {
+      for (double v : levels_[h]) {
+        weighted.emplace_back(v, uint64_t(1) << h);
+        total += uint64_t(1) << h;
+      }
+    }
+    std::vector<double> result;
+    if (weighted.empty()) {
+      return result;
+    }
+    std::sort(weighted.begin(), weighted.end());
+    size_t w = 0;
+    uint64_t seen = weighted[0].second;
+    for (double q : fractions) {
+      double target = q * static_cast<double>(total);
+      while (w + 1 < weighted.size() && static_cast<double>(seen) < target) {
+        seen += weighted[++w].second;
+      }
+      result.push_back(weighted[w].first);
+    }
+    return result;
+  }
+
+  std::string Serialize() const {
+    std::string out;
+    SketchCodec::Put(out, count_);
+    SketchCodec::Put(out, levels_.size());
+    for (const auto &level : levels_) {
+      SketchCodec::Put(out, level.size());
+      for (double v : level) {
+        SketchCodec::PutDouble(out, v);
+      }
+    }
+    return out;
+  }
+
+  bool Deserialize(const std::string &in) {
+    size_t pos = 0;
+    uint64_t nlevels;
+    if (in.empty()) {
+      *this = KllSketch();
+      return true;
+    }
+    if (!SketchCodec::Get(in, pos, count_) ||
+        !SketchCodec::Get(in, pos, nlevels) || nlevels > 64) {
+      return false;
+    }
+    levels_.assign(nlevels, std::vector<double>());
+    for (auto &level : levels_) {
+      uint64_t size;
+      if (!SketchCodec::Get(in, pos, size) || size > (in.size() - pos) / 8) {
+        return false;
+      }
+      level.resize(size);
+      for (double &v : level) {
+        SketchCodec::GetDouble(in, pos, v);
+      }
+    }
+    return true;
+  }
+
+private:
+  /** Items a level keeps before compaction; lower levels keep fewer */
+  size_t Capacity(size_t level) const {
+    size_t depth = levels_.size() - 1 - level;
+    return std::max<size_t>(
+        MIN_CAPACITY,
+        static_cast<size_t>(std::ceil(K * std::pow(2.0 / 3.0, depth))));
+  }
+
+  /**
+   * Halve every level over capacity: sort it and promote every other item,
+   * starting at a random one, with twice the weight
+   */
+  void Compress() {
+    for (size_t h = 0; h < levels_.size(); ++h) {
+      if (levels_[h].size() < Capacity(h)) {
+        continue;
+      }
+      if (h + 1 == levels_.size()) {
+        levels_.emplace_back();
+      }
+      std::vector<double> &level = levels_[h];
+      std::sort(level.begin(), level.end());
+      // An odd item out stays behind
+      double leftover = 0;
+      bool odd = level.size() % 2 != 0;
+      if (odd) {
+        leftover = level.back();
+        level.pop_back();
+      }
+      random_ ^= random_ << 13;
+      random_ ^= random_ >> 7;
+      random_ ^= random_ << 17;
+      size_t start = random_ & 1;
+      std::vector<double> &up = levels_[h + 1];
+      for (size_t i = start; i < level.size(); i += 2) {
+        up.push_back(level[i]);
+      }
+      level.clear();
+      if (odd) {
+        level.push_back(leftover);
+      }
+    }
+  }
+
+  std::vector<std::vector<double>> levels_; // Level h items weigh 2^h
+  uint64_t count_;
+  uint64_t random_; // xorshift state
+};
+
+/**
+ * Histogram with fixed logarithmic bins
+ */
+class LogHistogram {
+public:
+  static constexpr int SUB_BINS = 4;   // Bins per power of two
+  static constexpr int MIN_EXP = -1100; // Below every double exponent
+
+  /** A bin and its bounds */
+  struct Bin {
+    double lower_;
+    double upper_;
+    uint64_t count_;
+  };
+
+  /** Add a batch of values; NaN and infinities are skipped */
+  void AddValues(const double *values, size_t n) {
+    std::vector<int32_t> keys(n);
+    for (size_t i = 0; i < n; ++i) {
+      keys[i] = GetKey(values[i]);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < n;) {
+      size_t j = i;
+      while (j < n && keys[j] == keys[i]) {
+        ++j;
+      }
+      if (keys[i] != NAN_KEY) {
+        bins_[keys[i]] += j - i;
+      }
+      i = j;
+    }
+  }
+
+  void Merge(const LogHistogram &other) {
+    for (const auto &bin : other.bins_) {
+      bins_[bin.first] += bin.second;
+    }
+  }
+
+  /**
+   * Non-empty bins in ascending order, neighbors joined until there are at
+   * most max_bins
+   */
+  std::vector<Bin> GetBins(size_t max_bins) const {
+    std::vector<Bin> bins;
+    for (const auto &kv : bins_) {
+      double lower, upper;
+      GetBounds(kv.first, lower, upper);
+      bins.push_back(Bin{lower, upper, kv.second});
+    }
+    while (max_bins > 0 && bins.size() > max_bins) {
+      std::vector<Bin> joined;
+      for (size_t i = 0; i < bins.size(); i += 2) {
+        Bin bin = bins[i];
+        if (i + 1 < bins.size()) {
+          bin.upper_ = bins[i + 1].upper_;
+          bin.count_ += bins[i + 1].count_;
+        }
+        joined.push_back(bin);
+      }
+      bins.swap(joined);
+    }
+    return bins;
+  }
+
+  std::string Serialize() const {
+    std::string out;
+    SketchCodec::Put(out, bins_.size());
+    for (const auto &kv : bins_) {
+      SketchCodec::Put(out,
+                       static_cast<uint64_t>(static_cast<int64_t>(kv.first)));
+      SketchCodec::Put(out, kv.second);
+    }
+    return out;
+  }
+
+  bool Deserialize(const std::string &in) {
+    bins_.clear();
+    if (in.empty()) {
+      return true;
+    }
+    size_t pos = 0;
+    uint64_t n;
+    if (!SketchCodec::Get(in, pos, n)) {
+      return false;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      uint64_t key, count;
+      if (!SketchCodec::Get(in, pos, key) ||
+          !SketchCodec::Get(in, pos, count)) {
+        return false;
+      }
+      bins_[static_cast<int32_t>(static_cast<int64_t>(key))] += count;
+    }
+    return true;
+  }
+
+private:
+  static constexpr int32_t NAN_KEY = INT32_MIN; // Also infinities
+
+  /** 0 for zero; +/-(1 + bin of |v|) on each side */
+  static int32_t GetKey(double v) {
+    if (!std::isfinite(v)) {
+      return NAN_KEY;
+    }
+    if (v == 0) {
+      return 0;
+    }
+    int exp;
+    double mantissa = std::frexp(std::fabs(v), &exp); // [0.5, 1)
+    int sub = std::min(SUB_BINS - 1,
+                       static_cast<int>((mantissa - 0.5) * 2 * SUB_BINS));
+    int32_t magnitude = (exp - MIN_EXP) * SUB_BINS + sub + 1;
+    return v < 0 ? -magnitude : magnitude;
+  }
+
+  static void GetBounds(int32_t key, double &lower, double &upper) {
+    if (key == 0) {
+      lower = upper = 0;
+      return;
+    }
+    int32_t magnitude = (key < 0 ? -key : key) - 1;
+    int exp = magnitude / SUB_BINS + MIN_EXP;
+    int sub = magnitude % SUB_BINS;
+    double low = std::ldexp(0.5 + 0.5 * sub / SUB_BINS, exp);
+    double high = std::ldexp(0.5 + 0.5 * (sub + 1) / SUB_BINS, exp);
+    lower = key < 0 ? -high : low;
+    upper = key < 0 ? -low : high;
+  }
+
+  std::map<int32_t, uint64_t> bins_; // Key -> count
+};
+
+} // namespace cae
+
+#endif // CAE_CATALOG_COLUMN_SKETCH_H_
@@ -0,0 +1,578 @@
+#ifndef CAE_CATALOG_METADATA_COLLECTOR_H_
+#define CAE_CATALOG_METADATA_COLLECTOR_H_
+
+#include "column_sketch.h"
+#include "sink/output_sink.h"
+#include "util/hash.h"
+#include "util/value_class.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Same-Pass Metadata Extraction Strategy:
+ *
+ * 1. Observation: Format clients hand every chunk, hole and column batch
+ *    they import to the rank's collector, so metadata never needs a second
+ *    read of the data
+ * 2. Digest: Content is cut into DIGEST_SEGMENT-aligned segments, each
+ *    hashed with XXH64 as soon as it is complete; the file digest is the
+ *    XXH64 of the segment digests in order, so it does not depend on how
+ *    the file was split over ranks and threads. Segments cut by a range
+ *    boundary are kept as pieces until the rest arrives, possibly from
+ *    another rank
+ * 3. Column Profiles: CSV values are typed (bool, int64, double or string)
+ *    by util/value_class.h and counted per column, with min/max, null counts and sketches of the
+ *    distinct values, quantiles and histogram (see catalog/column_sketch.h)
+ *    that merge across batches and ranks
+ * 4. Reduction: Ranks serialize their collectors at job end and merge them
+ *    pairwise up a binary tree; rank 0 writes the catalog (see
+ *    catalog/catalog_writer.h)
+ */
+
+namespace cae {
+
+/** Inferred type of a column, from narrowest to widest */
+using ColumnType = ValueType;
+
+inline const char *ColumnTypeName(ColumnType type) {
+  switch (type) {
+  case ColumnType::kNull:
+    return "null";
+  case ColumnType::kBool:
+    return "bool";
+  case ColumnType::kInt64:
+    return "int64";
+  case ColumnType::kDouble:
+    return "double";
+  case ColumnType::kString:
+    return "string";
+  }
+  return "string";
+}
+
+/**
+ * Type, null count, min/max and sketches of one column
+ */
+struct ColumnProfile {
+  static constexpr size_t MAX_STAT_LENGTH = 64; // String min/max are cut
+
+  std::string name_;
+  ColumnType type_;
+  uint64_t count_; // Values, nulls included
+  uint64_t nulls_;
+  bool has_int_;
+  int64_t int_min_, int_max_;
+  bool has_num_; // Over int64 and double values
+  double num_min_, num_max_;
+  bool has_str_; // Over every non-null value
+  std::string str_min_, str_max_;
+  HyperLogLog distinct_; // Over every non-null value
+  KllSketch quantiles_;  // Over int64 and double values
+  LogHistogram histogram_;
+
+  ColumnProfile()
+      : type_(ColumnType::kNull), count_(0), nulls_(0), has_int_(false),
+        int_min_(0), int_max_(0), has_num_(false), num_min_(0), num_max_(0),
+        has_str_(false) {}
+
+  /** Add a batch of values; surrounding blanks are ignored */
+  void AddValues(const std::vector<std::string> &values) {
+    std::vector<uint64_t> hashes;
+    std::vector<double> numbers;
+    hashes.reserve(values.size());
+    for (const auto &value : values) {
+      Add(value, hashes, numbers);
+    }
+    distinct_.AddHashes(hashes.data(), hashes.size());
+    quantiles_.AddValues(numbers.data(), numbers.size());
+    histogram_.AddValues(numbers.data(), numbers.size());
+  }
+
+  /** Add the values of another profile of the same column */
+  void Merge(const ColumnProfile &other) {
+    type_ = Widen(type_, other.type_);
+    count_ += other.count_;
+    nulls_ += other.nulls_;
+    if (other.has_int_) {
+      AddInt(other.int_min_);
+      AddInt(other.int_max_);
+    }
+    if (other.has_num_) {
+      AddNum(other.num_min_);
+      AddNum(other.num_max_);
+    }
+    if (other.has_str_) {
+      AddStr(other.str_min_);
+      AddStr(other.str_max_);
+    }
+    distinct_.Merge(other.distinct_);
+    quantiles_.Merge(other.quantiles_);
+    histogram_.Merge(other.histogram_);
+  }
+
+  /** Minimum in the column's type, empty if every value is null */
+  std::string GetMin() const { return Stat(true); }
+
+  /** Maximum in the column's type, empty if every value is null */
+  std::string GetMax() const { return Stat(false); }
+
+  /** Shortest text that reads back as the same double */
+  static std::string FormatDouble(double d) {
+    char buf[32];
+    for (int precision = 15; precision <= 17; ++precision) {
+      std::snprintf(buf, sizeof(buf), "%.*g", precision, d);
+      if (std::strtod(buf, nullptr) == d) {
+        break;
+      }
+    }
+    return buf;
+  }
+
+  /** Common type of two types */
+  static ColumnType Widen(ColumnType a, ColumnType b) {
+    if (a == ColumnType::kNull || a == b) {
+      return b;
+    }
+    if (b == ColumnType::kNull) {
+      return a;
+    }
+    if ((a == ColumnType::kInt64 && b == ColumnType::kDouble) ||
+        (a == ColumnType::kDouble && b == ColumnType::kInt64)) {
+      return ColumnType::kDouble;
+    }
+    return ColumnType::kString;
+  }
+
+private:
+  /**
+   * Type and count one value; its hash and number are appended for the
+   * sketches, which update a batch at a time
+   */
+  void Add(const std::string &value, std::vector<uint64_t> &hashes,
+           std::vector<double> &numbers) {
+    ++count_;
+    ValueClass v = ValueClass::Of(value);
+    if (v.type_ == ValueType::kNull) {
+      ++nulls_;
+      return;
+    }
+    hashes.push_back(Xxh64::Hash(v.text_.data(), v.text_.size()));
+    if (v.type_ == ValueType::kInt64) {
+      AddInt(v.int_);
+    }
+    if (v.IsNumber()) {
+      AddNum(v.double_);
+      numbers.push_back(v.double_);
+    }
+    type_ = Widen(type_, v.type_);
+    AddStr(v.text_.substr(0, MAX_STAT_LENGTH));
+  }
+
+  void AddInt(int64_t i) {
+    int_min_ = has_int_ ? std::min(int_min_, i) : i;
+    int_max_ = has_int_ ? std::max(int_max_, i) : i;
+    has_int_ = true;
+  }
+
+  void AddNum(double d) {
+    if (d != d) {
+      return; // NaN has no order
+    }
+    num_min_ = has_num_ ? std::min(num_min_, d) : d;
+    num_max_ = has_num_ ? std::max(num_max_, d) : d;
+    has_num_ = true;
+  }
+
+  void AddStr(const std::string &s) {
+    if (!has_str_ || s < str_min_) {
+      str_min_ = s;
+    }
+    if (!has_str_ || s > str_max_) {
+      str_max_ = s;
+    }
+    has_str_ = true;
+  }
+
+  std::string Stat(bool min) const {
+    switch (type_) {
+    case ColumnType::kNull:
+      return "";
+    case ColumnType::kInt64:
+      return std::to_string(min ? int_min_ : int_max_);
+    case ColumnType::kDouble:
+      return FormatDouble(min ? num_min_ : num_max_);
+    default:
+      return min ? str_min_ : str_max_;
+    }
+  }
+};
+
+/**
+ * Metadata gathered for one file
+ */
+struct FileMetadata {
+  std::string path_;
+  std::string format_; // Client that imported the file
+  std::string tags_;   // Comma-separated description tags
+  uint64_t rows_;      // Records, for record formats
+  std::vector<ColumnProfile> columns_;
+  std::vector<std::pair<uint64_t, uint64_t>> segments_; // (index, xxh64)
+  std::map<uint64_t, std::string> pieces_; // Offset -> bytes of a segment
+
+  FileMetadata() : rows_(0) {}
+};
+
+/**
+ * Thread-safe collector of the metadata of the files a rank imports
+ */
+class MetadataCollector {
+public:
+  static constexpr size_t DIGEST_SEGMENT = 64 * 1024;
+
+  /**
+   * Declare a file, so it is cataloged even if it has no bytes
+   * @param path File as imported
+   * @param format Format client importing it
+   * @param tags Comma-separated description tags
+   */
+  void AddFile(const std::string &path, const std::string &format,
+               const std::string &tags) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    FileMetadata &file = files_[path];
+    file.path_ = path;
+    file.format_ = format;
+    if (!tags.empty()) {
+      file.tags_ = tags;
+    }
+  }
+
+  /** Observe imported bytes; offsets are in (uncompressed) content bytes */
+  void AddBytes(const std::string &path, size_t offset, const char *data,
+                size_t length) {
+    AddRange(path, offset, length, data);
+  }
+
+  /** Observe a hole, which reads as zeros */
+  void AddHole(const std::string &path, size_t offset, size_t length) {
+    AddRange(path, offset, length, nullptr);
+  }
+
+  /** Observe a batch of records */
+  void AddColumns(const std::string &path, const ColumnBatch &batch) {
+    std::vector<ColumnProfile> profiles(batch.columns_.size());
+    for (size_t c = 0; c < batch.columns_.size(); ++c) {
+      profiles[c].name_ = batch.GetName(c);
+      profiles[c].AddValues(batch.columns_[c]);
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    FileMetadata &file = files_[path];
+    file.path_ = path;
+    file.rows_ += batch.GetRowCount();
+    MergeColumns(file, profiles);
+  }
+
+  /** Remove and return every file observed, by path */
+  std::map<std::string, FileMetadata> TakeFiles() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return std::move(files_);
+  }
+
+  /**
+   * File digest, once every segment of the content has been observed
+   * Combines the remaining pieces, so call it after the final Merge.
+   * @param file File to digest
+   * @param size Content size in bytes
+   * @param hex Output: XXH64 of the segment digests
+   * @return false if some bytes were never observed (a partial import)
+   */
+  static bool GetDigest(FileMetadata &file, size_t size, std::string &hex) {
+    size_t nsegments = (size + DIGEST_SEGMENT - 1) / DIGEST_SEGMENT;
+    for (const auto &piece : file.pieces_) {
+      uint64_t start = piece.first - piece.first % DIGEST_SEGMENT;
+      size_t expected = std::min<size_t>(DIGEST_SEGMENT, size - start);
+      if (piece.first == start && piece.second.size() == expected) {
+        file.segments_.emplace_back(
+            start / DIGEST_SEGMENT,
+            Xxh64::Hash(piece.second.data(), piece.second.size()));
+      }
+    }
+    std::sort(file.segments_.begin(), file.segments_.end());
+    file.segments_.erase(
+        std::unique(file.segments_.begin(), file.segments_.end(),
+                    [](const std::pair<uint64_t, uint64_t> &a,
+                       const std::pair<uint64_t, uint64_t> &b) {
+                      return a.first == b.first;
+                    }),
+        file.segments_.end());
+    if (file.segments_.size() != nsegments ||
+        (nsegments > 0 && file.segments_.back().first != nsegments - 1)) {
+      return false;
+    }
+    Xxh64 digest;
+    for (const auto &segment : file.segments_) {
+      unsigned char le[8];
+      for (int i = 0; i < 8; ++i) {
+        le[i] = static_cast<unsigned char>(segment.second >> (8 * i));
+      }
+      digest.Update(le, sizeof(le));
+    }
+    hex = digest.HexDigest();
+    return true;
+  }
+
+  /** Serialize every file for the reduction to rank 0 */
+  std::string Serialize() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::string out;
+    Put(out, files_.size());
+    for (const auto &kv : files_) {
+      const FileMetadata &file = kv.second;
+      ColumnBatch::EncodeValue(file.path_, out);
+      ColumnBatch::EncodeValue(file.format_, out);
+      ColumnBatch::EncodeValue(file.tags_, out);
+      Put(out, file.rows_);
+      Put(out, file.columns_.size());
+      for (const auto &col : file.columns_) {
+        ColumnBatch::EncodeValue(col.name_, out);
+        Put(out, static_cast<uint64_t>(col.type_));
+        Put(out, col.count_);
+        Put(out, col.nulls_);
+        Put(out, col.has_int_);
+        Put(out, static_cast<uint64_t>(col.int_min_));
+        Put(out, static_cast<uint64_t>(col.int_max_));
+        Put(out, col.has_num_);
+        ColumnBatch::EncodeValue(ColumnProfile::FormatDouble(col.num_min_),
+                                 out);
+        ColumnBatch::EncodeValue(ColumnProfile::FormatDouble(col.num_max_),
+                                 out);
+        Put(out, col.has_str_);
+        ColumnBatch::EncodeValue(col.str_min_, out);
+        ColumnBatch::EncodeValue(col.str_max_, out);
+        ColumnBatch::EncodeValue(col.distinct_.Serialize(), out);
+        ColumnBatch::EncodeValue(col.quantiles_.Serialize(), out);
+        ColumnBatch::EncodeValue(col.histogram_.Serialize(), out);
+      }
+      Put(out, file.segments_.size());
+      for (const auto &segment : file.segments_) {
+        Put(out, segment.first);
+        Put(out, segment.second);
+      }
+      Put(out, file.pieces_.size());
+      for (const auto &piece : file.pieces_) {
+        Put(out, piece.first);
+        ColumnBatch::EncodeValue(piece.second, out);
+      }
+    }
+    return out;
+  }
+
+  /**
+   * Merge the serialized collector of another rank
+   * @throws std::runtime_error if the data is truncated or malformed
+   */
+  void Merge(const std::string &data) {
+    Reader in(data);
+    uint64_t nfiles = in.Num();
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (uint64_t f = 0; f < nfiles; ++f) {
+      std::string path = in.Str();
+      FileMetadata &file = files_[path];
+      file.path_ = path;
+      std::string format = in.Str();
+      std::string tags = in.Str();
+      if (!format.empty()) {
+        file.format_ = format;
+      }
+      if (!tags.empty()) {
+        file.tags_ = tags;
+      }
+      file.rows_ += in.Num();
+      std::vector<ColumnProfile> columns(in.Num());
+      for (auto &col : columns) {
+        col.name_ = in.Str();
+        col.type_ = static_cast<ColumnType>(in.Num());
+        col.count_ = in.Num();
+        col.nulls_ = in.Num();
+        col.has_int_ = in.Num() != 0;
+        col.int_min_ = static_cast<int64_t>(in.Num());
+        col.int_max_ = static_cast<int64_t>(in.Num());
+        col.has_num_ = in.Num() != 0;
+        col.num_min_ = std::strtod(in.Str().c_str(), nullptr);
+        col.num_max_ = std::strtod(in.Str().c_str(), nullptr);
+        col.has_str_ = in.Num() != 0;
+        col.str_min_ = in.Str();
+        col.str_max_ = in.Str();
+        if (!col.distinct_.Deserialize(in.Str()) ||
+            !col.quantiles_.Deserialize(in.Str()) ||
+            !col.histogram_.Deserialize(in.Str())) {
+          throw std::runtime_error("Malformed column sketch");
+        }
+      }
+      MergeColumns(file, columns);
+      uint64_t nsegments = in.Num();
+      for (uint64_t s = 0; s < nsegments; ++s) {
+        uint64_t index = in.Num();
+        file.segments_.emplace_back(index, in.Num());
+      }
+      uint64_t npieces = in.Num();
+      for (uint64_t p = 0; p < npieces; ++p) {
+        uint64_t offset = in.Num();
+        std::string bytes = in.Str();
+        AddPiece(file, offset, bytes.data(), bytes.size());
+      }
+    }
+  }
+
+private:
+  /** Sequential reader of Serialize output */
+  class Reader {
+  public:
+    explicit Reader(const std::string &data) : data_(data), pos_(0) {}
+
+    uint64_t Num() {
+      Need(8);
+      uint64_t v = 0;
+      for (int i = 0; i < 8; ++i) {
+        v |= static_cast<uint64_t>(static_cast<unsigned char>(data_[pos_++]))
+             << (8 * i);
+      }
+      return v;
+    }
+
+    std::string Str() {
+      Need(4);
+      uint32_t len = 0;
+      for (int i = 0; i < 4; ++i) {
+        len |= static_cast<uint32_t>(static_cast<unsigned char>(data_[pos_++]))
+               << (8 * i);
+      }
+      Need(len);
+      std::string s = data_.substr(pos_, len);
+      pos_ += len;
+      return s;
+    }
+
+  private:
+    void Need(size_t n) const {
+      if (data_.size() - pos_ < n) {
+        throw std::runtime_error("Truncated metadata");
+      }
+    }
+
+    const std::string &data_;
+    size_t pos_;
+  };
+
+  static void Put(std::string &out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+      out.push_back(static_cast<char>(v >> (8 * i)));
+    }
+  }
+
+  static void MergeColumns(FileMetadata &file,
+                           const std::vector<ColumnProfile> &columns) {
+    if (file.columns_.size() < columns.size()) {
+      file.columns_.resize(columns.size());
+    }
+    for (size_t c = 0; c < columns.size(); ++c) {
+      if (file.columns_[c].name_.empty()) {
+        file.columns_[c].name_ = columns[c].name_;
+      }
+      file.columns_[c].Merge(columns[c]);
+    }
+  }
+
+  /**
+   * Hash the whole segments of a range and keep the partial ones as pieces
+   * @param data Bytes of the range, or nullptr for zeros
+   */
+  void AddRange(const std::string &path, size_t offset, size_t length,
+                const char *data) {
+    std::vector<std::pair<uint64_t, uint64_t>> segments;
+    std::vector<std::pair<size_t, size_t>> partial; // (offset, length)
+    size_t pos = offset;
+    size_t end = offset + length;
+    while (pos < end) {
+      size_t seg_end = pos - pos % DIGEST_SEGMENT + DIGEST_SEGMENT;
+      size_t len = std::min(end, seg_end) - pos;
+      if (len == DIGEST_SEGMENT) {
+        uint64_t hash = data ? Xxh64::Hash(data + (pos - offset), len)
+                             : GetZeroSegmentHash();
+        segments.emplace_back(pos / DIGEST_SEGMENT, hash);
+      } else {
+        partial.emplace_back(pos, len);
+      }
+      pos += len;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    FileMetadata &file = files_[path];
+    file.path_ = path;
+    file.segments_.insert(file.segments_.end(), segments.begin(),
+                          segments.end());
+    for (const auto &p : partial) {
+      if (data) {
+        AddPiece(file, p.first, data + (p.first - offset), p.second);
+      } else {
+        std::string zeros(p.second, '\0');
+        AddPiece(file, p.first, zeros.data(), zeros.size());
+      }
+    }
+  }
+
+  /**
+   * Add bytes inside one segment, joining them with adjacent pieces and
+   * hashing the segment once it is complete
+   */
+  static void AddPiece(FileMetadata &file, uint64_t offset, const char *data,
+                       size_t length) {
+    uint64_t seg_start = offset - offset % DIGEST_SEGMENT;
+    std::string bytes(data, length);
+    auto next = file.pieces_.find(offset + length);
+    if (next != file.pieces_.end() &&
+        next->first - next->first % DIGEST_SEGMENT == seg_start) {
+      bytes += next->second;
+      file.pieces_.erase(next);
+    }
+    auto prev = file.pieces_.lower_bound(offset);
+    if (prev != file.pieces_.begin()) {
+      --prev;
+      if (prev->first >= seg_start &&
+          prev->first + prev->second.size() == offset) {
+        offset = prev->first;
+        bytes = prev->second + bytes;
+        file.pieces_.erase(prev);
+      }
+    }
+    if (offset == seg_start && bytes.size() == DIGEST_SEGMENT) {
+      file.segments_.emplace_back(offset / DIGEST_SEGMENT,
+                                  Xxh64::Hash(bytes.data(), bytes.size()));
+      return;
+    }
+    file.pieces_[offset] = std::move(bytes);
+  }
+
+  static uint64_t GetZeroSegmentHash() {
+    static const uint64_t hash = [] {
+      std::string zeros(DIGEST_SEGMENT, '\0');
+      return Xxh64::Hash(zeros.data(), zeros.size());
+    }();
+    return hash;
+  }
+
+  mutable std::mutex mtx_;
+  std::map<std::string, FileMetadata> files_;
+};
+
+} // namespace cae
+
+#endif // CAE_CATALOG_METADATA_COLLECTOR_H_
@@ -0,0 +1,639 @@
+#include "schema_probe.h"
+#include "format/format_registry.h"
+#include "util/json.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#ifdef CAE_ENABLE_HDF5
+#include <hdf5.h>
+#endif
+
+namespace cae {
+
+namespace {
+
+constexpr char HDF5_MAGIC[] = "\x89HDF\r\n\x1a\n";
+constexpr size_t MAX_PARQUET_FOOTER = 64 * 1024 * 1024;
+
+/** Read up to length bytes at an offset */
+std::string ReadAt(int fd, size_t offset, size_t length) {
+  std::string buf(length, '\0');
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = pread(fd, &buf[done], length - done,
+                      static_cast<off_t>(offset + done));
+    if (n <= 0) {
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+  buf.resize(done);
+  return buf;
+}
+
+/**
+ * Reader of the Thrift compact protocol, enough to walk a Parquet footer
+ */
+class ThriftReader {
+public:
+  enum Type {
+    kStop = 0,
+    kTrue = 1,
+    kFalse = 2,
+    kByte = 3,
+    kI16 = 4,
+    kI32 = 5,
+    kI64 = 6,
+    kDouble = 7,
+    kBinary = 8,
+    kList = 9,
+    kSet = 10,
+    kMap = 11,
+    kStruct = 12
+  };
+
+  ThriftReader(const char *data, size_t size)
+      : p_(reinterpret_cast<const uint8_t *>(data)), end_(p_ + size) {}
+
+  /**
+   * Next field of the current struct
+   * @param last_id Id of the previous field, updated
+   * @return Its type, kStop at the end of the struct
+   */
+  int ReadField(int16_t &last_id) {
+    uint8_t byte = Byte();
+    int type = byte & 0x0f;
+    if (type == kStop) {
+      return kStop;
+    }
+    int delta = byte >> 4;
+    last_id = delta ? static_cast<int16_t>(last_id + delta)
+                    : static_cast<int16_t>(Zigzag(Varint()));
+    return type;
+  }
+
+  /** List or set header; returns the element count */
+  size_t ReadList(int &elem_type) {
+    uint8_t byte = Byte();
+    elem_type = byte & 0x0f;
+    size_t size = byte >> 4;
+    if (size == 15) {
+      size = static_cast<size_t>(Varint());
+    }
+    return size;
+  }
+
+  int64_t ReadInt() { return Zigzag(Varint()); }
+
+  std::string ReadString() {
+    uint64_t len = Varint();
+    if (len > static_cast<uint64_t>(end_ - p_)) {
+      throw std::runtime_error("truncated footer");
+    }
+    std::string s(reinterpret_cast<const char *>(p_), len);
+    p_ += len;
+    return s;
+  }
+
+  /** Skip a value of a type */
+  void Skip(int type) {
+    switch (type) {
+    case kTrue:
+    case kFalse:
+      return; // Field booleans are in the header
+    case kByte:
+      Byte();
+      return;
+    case kI16:
+    case kI32:
+    case kI64:
+      Varint();
+      return;
+    case kDouble:
+      Advance(8);
+      return;
+    case kBinary:
+      ReadString();
+      return;
+    case kList:
+    case kSet: {
+      int elem;
+      size_t n = ReadList(elem);
+      for (size_t i = 0; i < n; ++i) {
+        if (elem == kTrue || elem == kFalse) {
+          Byte(); // List booleans take a byte each
+        } else {
+          Skip(elem);
+        }
+      }
+      return;
+    }
+    case kMap: {
+      uint64_t n = Varint();
+      if (n == 0) {
+        return;
+      }
+      uint8_t types = Byte();
+      for (uint64_t i = 0; i < n; ++i) {
+        Skip(types >> 4);
+        Skip(types & 0x0f);
+      }
+      return;
+    }
+    case kStruct: {
+      int16_t id = 0;
+      int field;
+      while ((field = ReadField(id)) != kStop) {
+        Skip(field);
+      }
+      return;
+    }
+    default:
+      throw std::runtime_error("bad thrift type");
+    }
+  }
+
+private:
+  uint8_t Byte() {
+    if (p_ >= end_) {
+      throw std::runtime_error("truncated footer");
+    }
+    return *p_++;
+  }
+
+  void Advance(size_t n) {
+    if (n > static_cast<size_t>(end_ - p_)) {
+      throw std::runtime_error("truncated footer");
+    }
+    p_ += n;
+  }
+
+  uint64_t Varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t b = Byte();
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        return v;
+      }
+    }
+    throw std::runtime_error("bad varint");
+  }
+
+  static int64_t Zigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+  }
+
+  const uint8_t *p_;
+  const uint8_t *end_;
+};
+
+/** A Parquet SchemaElement */
+struct ParquetElement {
+  std::string name_;
+  int type_;
+  int repetition_;
+  int converted_;
+  int logical_; // Field id of the LogicalType union
+  int children_;
+
+  ParquetElement()
+      : type_(-1), repetition_(-1), converted_(-1), logical_(-1),
+        children_(0) {}
+};
+
+const char *ParquetTypeName(int type) {
+  static const char *names[] = {"BOOLEAN", "INT32",  "INT64",
+                                "INT96",   "FLOAT",  "DOUBLE",
+                                "BYTE_ARRAY", "FIXED_LEN_BYTE_ARRAY"};
+  return type >= 0 && type < 8 ? names[type] : "";
+}
+
+const char *ParquetRepetitionName(int repetition) {
+  static const char *names[] = {"REQUIRED", "OPTIONAL", "REPEATED"};
+  return repetition >= 0 && repetition < 3 ? names[repetition] : "";
+}
+
+const char *ParquetConvertedName(int converted) {
+  static const char *names[] = {
+      "UTF8",        "MAP",         "MAP_KEY_VALUE",    "LIST",
+      "ENUM",        "DECIMAL",     "DATE",             "TIME_MILLIS",
+      "TIME_MICROS", "TIMESTAMP_MILLIS", "TIMESTAMP_MICROS", "UINT_8",
+      "UINT_16",     "UINT_32",     "UINT_64",          "INT_8",
+      "INT_16",      "INT_32",      "INT_64",           "JSON",
+      "BSON",        "INTERVAL"};
+  return converted >= 0 && converted < 22 ? names[converted] : "";
+}
+
+const char *ParquetLogicalName(int id) {
+  static const char *names[] = {"",        "STRING",    "MAP",     "LIST",
+                                "ENUM",    "DECIMAL",   "DATE",    "TIME",
+                                "TIMESTAMP", "",        "INTEGER", "UNKNOWN",
+                                "JSON",    "BSON",      "UUID",    "FLOAT16"};
+  return id > 0 && id < 16 ? names[id] : "";
+}
+
+ParquetElement ReadSchemaElement(ThriftReader &in) {
+  ParquetElement e;
+  int16_t id = 0;
+  int type;
+  while ((type = in.ReadField(id)) != ThriftReader::kStop) {
+    if (id == 1 && type == ThriftReader::kI32) {
+      e.type_ = static_cast<int>(in.ReadInt());
+    } else if (id == 3 && type == ThriftReader::kI32) {
+      e.repetition_ = static_cast<int>(in.ReadInt());
+    } else if (id == 4 && type == ThriftReader::kBinary) {
+      e.name_ = in.ReadString();
+    } else if (id == 5 && type == ThriftReader::kI32) {
+      e.children_ = static_cast<int>(in.ReadInt());
+    } else if (id == 6 && type == ThriftReader::kI32) {
+      e.converted_ = static_cast<int>(in.ReadInt());
+    } else if (id == 10 && type == ThriftReader::kStruct) {
+      // LogicalType is a union; the set field names the type
+      int16_t lid = 0;
+      int ltype;
+      while ((ltype = in.ReadField(lid)) != ThriftReader::kStop) {
+        e.logical_ = lid;
+        in.Skip(ltype);
+      }
+    } else {
+      in.Skip(type);
+    }
+  }
+  return e;
+}
+
+/** Append the leaf columns under elements[i] with dotted paths */
+size_t FlattenParquet(const std::vector<ParquetElement> &elements, size_t i,
+                      const std::string &prefix, SchemaInfo &info,
+                      std::string &columns) {
+  const ParquetElement &e = elements[i];
+  std::string path = prefix.empty() ? e.name_ : prefix + "." + e.name_;
+  size_t next = i + 1;
+  if (e.children_ > 0) {
+    for (int c = 0; c < e.children_ && next < elements.size(); ++c) {
+      next = FlattenParquet(elements, next, path, info, columns);
+    }
+    return next;
+  }
+  std::string logical = ParquetLogicalName(e.logical_);
+  if (logical.empty()) {
+    logical = ParquetConvertedName(e.converted_);
+  }
+  columns += std::string(columns.empty() ? "" : ", ") +
+             "{\"name\": " + JsonString(path) +
+             ", \"type\": " + JsonString(ParquetTypeName(e.type_)) +
+             ", \"logical_type\": " + JsonString(logical) +
+             ", \"repetition\": " +
+             JsonString(ParquetRepetitionName(e.repetition_)) + "}";
+  SchemaField field;
+  field.name_ = path;
+  field.description_ = std::string(ParquetTypeName(e.type_)) +
+                       (logical.empty() ? "" : " (" + logical + ")") + ", " +
+                       ParquetRepetitionName(e.repetition_);
+  info.fields_.push_back(field);
+  return next;
+}
+
+#ifdef CAE_ENABLE_HDF5
+/** Type of an HDF5 datatype, e.g. int32, float64, string */
+std::string Hdf5TypeName(hid_t type) {
+  size_t bits = H5Tget_size(type) * 8;
+  switch (H5Tget_class(type)) {
+  case H5T_INTEGER:
+    return (H5Tget_sign(type) == H5T_SGN_NONE ? "uint" : "int") +
+           std::to_string(bits);
+  case H5T_FLOAT:
+    return "float" + std::to_string(bits);
+  case H5T_STRING:
+    return "string";
+  case H5T_BITFIELD:
+    return "bitfield" + std::to_string(bits);
+  case H5T_OPAQUE:
+    return "opaque";
+  case H5T_REFERENCE:
+    return "reference";
+  case H5T_ENUM:
+    return "enum";
+  case H5T_VLEN:
+    return "vlen";
+  case H5T_ARRAY:
+    return "array";
+  case H5T_COMPOUND: {
+    std::string s = "compound{";
+    int n = H5Tget_nmembers(type);
+    for (int m = 0; m < n; ++m) {
+      char *name = H5Tget_member_name(type, static_cast<unsigned>(m));
+      hid_t member = H5Tget_member_type(type, static_cast<unsigned>(m));
+      s += std::string(m ? "," : "") + (name ? name : "") + ":" +
+           Hdf5TypeName(member);
+      H5Tclose(member);
+      H5free_memory(name);
+    }
+    return s + "}";
+  }
+  default:
+    return "unknown";
+  }
+}
+
+/** Shape of a dataspace as a JSON array; scalars are [] */
+std::string Hdf5Shape(hid_t space, std::string &text) {
+  int rank = H5Sget_simple_extent_ndims(space);
+  std::string json = "[";
+  text.clear();
+  if (rank > 0) {
+    std::vector<hsize_t> dims(static_cast<size_t>(rank));
+    H5Sget_simple_extent_dims(space, dims.data(), nullptr);
+    for (int d = 0; d < rank; ++d) {
+      json += (d ? ", " : "") + std::to_string(dims[d]);
+      text += (d ? " x " : "") + std::to_string(dims[d]);
+    }
+  }
+  return json + "]";
+}
+
+/** Value of a scalar numeric or string attribute, as JSON; empty otherwise */
+std::string Hdf5AttributeValue(hid_t attr, hid_t type, hid_t space) {
+  if (H5Sget_simple_extent_npoints(space) != 1) {
+    return "";
+  }
+  H5T_class_t cls = H5Tget_class(type);
+  if (cls == H5T_INTEGER) {
+    long long v = 0;
+    if (H5Aread(attr, H5T_NATIVE_LLONG, &v) >= 0) {
+      return std::to_string(v);
+    }
+  } else if (cls == H5T_FLOAT) {
+    double v = 0;
+    if (H5Aread(attr, H5T_NATIVE_DOUBLE, &v) >= 0 && v == v) {
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%.17g", v);
+      return buf;
+    }
+  } else if (cls == H5T_STRING) {
+    if (H5Tis_variable_str(type) > 0) {
+      char *s = nullptr;
+      hid_t mem = H5Tcopy(H5T_C_S1);
+      H5Tset_size(mem, H5T_VARIABLE);
+      std::string value;
+      if (H5Aread(attr, mem, &s) >= 0 && s) {
+        value = JsonString(s);
+        H5free_memory(s);
+      }
+      H5Tclose(mem);
+      return value;
+    }
+    std::string buf(H5Tget_size(type), '\0');
+    if (H5Aread(attr, type, &buf[0]) >= 0) {
+      return JsonString(buf.c_str());
+    }
+  }
+  return "";
+}
+
+herr_t Hdf5AttributeVisit(hid_t loc, const char *name, const H5A_info_t *,
+                          void *data) {
+  std::string &json = *static_cast<std::string *>(data);
+  hid_t attr = H5Aopen(loc, name, H5P_DEFAULT);
+  if (attr < 0) {
+    return 0;
+  }
+  hid_t type = H5Aget_type(attr);
+  hid_t space = H5Aget_space(attr);
+  std::string text;
+  std::string shape = Hdf5Shape(space, text);
+  std::string value = Hdf5AttributeValue(attr, type, space);
+  json += std::string(json.empty() ? "" : ", ") +
+          "{\"name\": " + JsonString(name) +
+          ", \"type\": " + JsonString(Hdf5TypeName(type)) +
+          ", \"shape\": " + shape +
+          (value.empty() ? "" : ", \"value\": " + value) + "}";
+  H5Sclose(space);
+  H5Tclose(type);
+  H5Aclose(attr);
+  return 0;
+}
+
+/** Attributes of an object as a JSON array */
+std::string Hdf5Attributes(hid_t obj) {
+  std::string json;
+  hsize_t idx = 0;
+  H5Aiterate2(obj, H5_INDEX_NAME, H5_ITER_NATIVE, &idx, Hdf5AttributeVisit,
+              &json);
+  return "[" + json + "]";
+}
+
+struct Hdf5Visit {
+  std::string objects_;
+  SchemaInfo *info_;
+  size_t count_;
+};
+
+/** Describe one object as a JSON object */
+std::string Hdf5Object(hid_t obj, const std::string &path, SchemaInfo &info) {
+  std::string json = "{\"path\": " + JsonString(path);
+  if (H5Iget_type(obj) == H5I_DATASET) {
+    hid_t type = H5Dget_type(obj);
+    hid_t space = H5Dget_space(obj);
+    std::string text;
+    std::string shape = Hdf5Shape(space, text);
+    std::string type_name = Hdf5TypeName(type);
+    json += ", \"kind\": \"dataset\", \"type\": " + JsonString(type_name) +
+            ", \"shape\": " + shape;
+    SchemaField field;
+    field.name_ = path;
+    field.description_ =
+        "dataset " + type_name + (text.empty() ? "" : " [" + text + "]");
+    info.fields_.push_back(field);
+    H5Sclose(space);
+    H5Tclose(type);
+  } else {
+    json += ", \"kind\": \"group\"";
+  }
+  return json + ", \"attributes\": " + Hdf5Attributes(obj) + "}";
+}
+
+herr_t Hdf5LinkVisit(hid_t group, const char *name, const H5L_info_t *link,
+                     void *data) {
+  Hdf5Visit &visit = *static_cast<Hdf5Visit *>(data);
+  if (visit.count_ >= SchemaProbe::MAX_OBJECTS) {
+    return 1; // Stop; the tree is cut
+  }
+  std::string path = std::string("/") + name;
+  std::string json;
+  if (link->type != H5L_TYPE_HARD) {
+    json = "{\"path\": " + JsonString(path) + ", \"kind\": \"link\"}";
+  } else {
+    hid_t obj = H5Oopen(group, name, H5P_DEFAULT);
+    if (obj < 0) {
+      return 0;
+    }
+    json = Hdf5Object(obj, path, *visit.info_);
+    H5Oclose(obj);
+  }
+  visit.objects_ += ", " + json;
+  ++visit.count_;
+  return 0;
+}
+#endif
+
+} // namespace
+
+std::string SchemaProbe::DetectFormat(const std::string &path,
+                                      const std::string &imported_as) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    std::string head = ReadAt(fd, 0, 8);
+    // HDF5 superblocks may follow a user block of 512 bytes or more
+    bool hdf5 = head == std::string(HDF5_MAGIC, 8);
+    for (size_t at = 512; !hdf5 && at <= 8192; at *= 2) {
+      hdf5 = ReadAt(fd, at, 8) == std::string(HDF5_MAGIC, 8);
+    }
+    close(fd);
+    if (hdf5) {
+      return "hdf5";
+    }
+    if (head.compare(0, 4, "PAR1") == 0) {
+      return "parquet";
+    }
+    if (head.compare(0, 6, "ARROW1") == 0) {
+      return "arrow";
+    }
+  }
+  const FormatCapabilities *caps = FormatRegistry::Get().Detect(path);
+  if (caps && caps->name_ != "binary") {
+    return caps->name_;
+  }
+  return imported_as.empty() ? "binary" : imported_as;
+}
+
+bool SchemaProbe::Probe(const std::string &path, SchemaInfo &info,
+                        std::string &error) {
+  if (info.format_ == "parquet") {
+    return ProbeParquet(path, info, error);
+  }
+  if (info.format_ == "hdf5") {
+    return ProbeHdf5(path, info, error);
+  }
+  return true; // No embedded schema
+}
+
+bool SchemaProbe::ProbeParquet(const std::string &path, SchemaInfo &info,
+                               std::string &error) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = std::strerror(errno);
+    return false;
+  }
+  struct stat st;
+  std::string footer;
+  if (fstat(fd, &st) == 0 && st.st_size >= 12) {
+    size_t size = static_cast<size_t>(st.st_size);
+    std::string tail = ReadAt(fd, size - 8, 8);
+    if (tail.size() == 8 && tail.compare(4, 4, "PAR1") == 0) {
+      uint32_t len = 0;
+      for (int i = 0; i < 4; ++i) {
+        len |= static_cast<uint32_t>(static_cast<unsigned char>(tail[i]))
+               << (8 * i);
+      }
+      if (len <= size - 12 && len <= MAX_PARQUET_FOOTER) {
+        footer = ReadAt(fd, size - 8 - len, len);
+      }
+    }
+  }
+  close(fd);
+  if (footer.empty()) {
+    error = "no Parquet footer";
+    return false;
+  }
+
+  try {
+    ThriftReader in(footer.data(), footer.size());
+    std::vector<ParquetElement> elements;
+    int64_t num_rows = -1;
+    size_t row_groups = 0;
+    std::string created_by;
+    int16_t id = 0;
+    int type;
+    while ((type = in.ReadField(id)) != ThriftReader::kStop) {
+      if (id == 2 && type == ThriftReader::kList) {
+        int elem;
+        size_t n = in.ReadList(elem);
+        for (size_t i = 0; i < n; ++i) {
+          elements.push_back(ReadSchemaElement(in));
+        }
+      } else if (id == 3 && type == ThriftReader::kI64) {
+        num_rows = in.ReadInt();
+      } else if (id == 4 && type == ThriftReader::kList) {
+        int elem;
+        row_groups = in.ReadList(elem);
+        for (size_t i = 0; i < row_groups; ++i) {
+          in.Skip(elem);
+        }
+      } else if (id == 6 && type == ThriftReader::kBinary) {
+        created_by = in.ReadString();
+      } else {
+        in.Skip(type);
+      }
+    }
+    if (elements.empty()) {
+      error = "empty Parquet schema";
+      return false;
+    }
+    std::string columns;
+    size_t next = 1; // elements[0] is the root
+    while (next < elements.size()) {
+      next = FlattenParquet(elements, next, "", info, columns);
+    }
+    info.json_ = "{\"num_rows\": " + std::to_string(num_rows) +
+                 ", \"row_groups\": " + std::to_string(row_groups) +
+                 ", \"created_by\": " + JsonString(created_by) +
+                 ", \"columns\": [" + columns + "]}";
+  } catch (const std::exception &e) {
+    error = std::string("bad Parquet footer: ") + e.what();
+    return false;
+  }
+  return true;
+}
+
+bool SchemaProbe::ProbeHdf5(const std::string &path, SchemaInfo &info,
+                            std::string &error) {
+#ifdef CAE_ENABLE_HDF5
+  H5Eset_auto2(H5E_DEFAULT, nullptr, nullptr);
+  hid_t file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file < 0) {
+    error = "not a readable HDF5 file";
+    return false;
+  }
+  Hdf5Visit visit;
+  visit.info_ = &info;
+  visit.count_ = 0;
+  hid_t root = H5Gopen2(file, "/", H5P_DEFAULT);
+  visit.objects_ = Hdf5Object(root, "/", info);
+  H5Gclose(root);
+  herr_t status = H5Lvisit(file, H5_INDEX_NAME, H5_ITER_INC, Hdf5LinkVisit,
+                           &visit);
+  H5Fclose(file);
+  if (status < 0) {
+    error = "could not visit HDF5 objects";
+    return false;
+  }
+  info.json_ = "{\"objects\": [" + visit.objects_ + "], \"truncated\": " +
+               (status > 0 ? "true" : "false") + "}";
+  return true;
+#else
+  (void)path;
+  (void)info;
+  error = "built without CAE_ENABLE_HDF5";
+  return false;
+#endif
+}
+
+} // namespace cae
@@ -0,0 +1,77 @@
+#ifndef CAE_CATALOG_SCHEMA_PROBE_H_
+#define CAE_CATALOG_SCHEMA_PROBE_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * Schema Probing Strategy:
+ *
+ * 1. Detection: The content format comes from magic bytes (Parquet, HDF5,
+ *    Arrow), then from the format registry, then from the importing client
+ * 2. Metadata Only: Self-describing formats keep their schema apart from the
+ *    data; probes read just that part (the Parquet footer, the HDF5 object
+ *    headers), so the data is still read once
+ * 3. Parquet: The Thrift-encoded footer is decoded directly into the leaf
+ *    columns with their physical, logical and repetition types
+ * 4. HDF5: Groups and datasets are visited through links, with dataset
+ *    types and shapes and every attribute; small scalar attributes include
+ *    their value. Needs CAE_ENABLE_HDF5
+ */
+
+namespace cae {
+
+/**
+ * A named part of a file (column, dataset) described in the catalog
+ */
+struct SchemaField {
+  std::string name_;
+  std::string description_;
+};
+
+/**
+ * Schema of a file
+ */
+struct SchemaInfo {
+  std::string format_; // Content format, e.g. "parquet"
+  std::string json_;   // JSON object, empty if the format has no schema
+  std::vector<SchemaField> fields_;
+};
+
+/**
+ * Reads the schema of self-describing files
+ */
+class SchemaProbe {
+public:
+  static constexpr size_t MAX_OBJECTS = 10000; // HDF5 objects described
+
+  /**
+   * Content format of a file
+   * @param path File to inspect
+   * @param imported_as Format client that imported it
+   */
+  static std::string DetectFormat(const std::string &path,
+                                  const std::string &imported_as);
+
+  /**
+   * Read the schema of a file in a supported format
+   * @param path File to inspect
+   * @param info Output; format_ must be set (see DetectFormat)
+   * @param error Reason on failure
+   * @return false if the schema could not be read
+   */
+  static bool Probe(const std::string &path, SchemaInfo &info,
+                    std::string &error);
+
+  /** Decode the schema in a Parquet footer */
+  static bool ProbeParquet(const std::string &path, SchemaInfo &info,
+                           std::string &error);
+
+  /** Describe the groups, datasets and attributes of an HDF5 file */
+  static bool ProbeHdf5(const std::string &path, SchemaInfo &info,
+                        std::string &error);
+};
+
+} // namespace cae
+
+#endif // CAE_CATALOG_SCHEMA_PROBE_H_
@@ -51,6 +51,30 @@ else
     exit 1
 fi
 
+echo ""
+echo "=== Test Case 3: Inputs of the Same Name ==="
+echo "Command: bash ../omni/config/test_dataset_names.sh"
+echo ""
+
+if bash ../omni/config/test_dataset_names.sh; then
+    echo "✅ Dataset name test PASSED"
+else
+    echo "❌ Dataset name test FAILED"
+    exit 1
+fi
+
+echo ""
+echo "=== Test Case 4: Reads, Batching, Dedup, Follow, Serve and Query ==="
+echo "Command: bash ../omni/config/test_features.sh"
+echo ""
+
+if bash ../omni/config/test_features.sh; then
+    echo "✅ Feature test PASSED"
+else
+    echo "❌ Feature test FAILED"
+    exit 1
+fi
+
 echo ""
 echo "=========================================="
 echo "🎉 ALL TESTS PASSED SUCCESSFULLY!"
@@ -0,0 +1,54 @@
+#!/bin/bash
+
+# Test that files of the same name in different directories get their own
+# datasets instead of overwriting each other's shards
+# This script should be run from the build/ directory
+
+echo "=========================================="
+echo "OMNI Dataset Name Test"
+echo "=========================================="
+
+# Check if we're in the correct directory
+if [ ! -f "bin/wrp" ]; then
+    echo "❌ Error: wrp executable not found."
+    echo "Please run this script from the build/ directory."
+    echo "Usage: cd build && bash ../omni/config/test_dataset_names.sh"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+mkdir -p "$WORK/a" "$WORK/b"
+head -c 300000 /dev/urandom > "$WORK/a/data.bin"
+head -c 200000 /dev/urandom > "$WORK/b/data.bin"
+cat > "$WORK/job.yaml" <<YAML
+name: dataset_names
+output:
+  sink: container
+  path: $WORK/out
+data:
+  - path: $WORK/*/data.bin
+YAML
+
+echo "=== Test Case 1: Two Inputs Named data.bin ==="
+echo "Command: ./bin/wrp $WORK/job.yaml"
+echo ""
+
+if ! ./bin/wrp "$WORK/job.yaml"; then
+    echo "❌ Import FAILED"
+    exit 1
+fi
+
+# One dataset per input, each holding all of its file's bytes
+datasets=$(ls -d "$WORK"/out/data.bin-* 2>/dev/null | wc -l)
+if [ "$datasets" -ne 2 ]; then
+    echo "❌ Expected 2 datasets, found $datasets"
+    exit 1
+fi
+for size in 300000 200000; do
+    if ! grep -qs "\"raw_bytes\": $size" "$WORK"/out/data.bin-*/manifest.json; then
+        echo "❌ No dataset holds the $size bytes of one input"
+        exit 1
+    fi
+done
+echo "✅ Dataset name test PASSED"
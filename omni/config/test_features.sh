@@ -0,0 +1,248 @@
+#!/bin/bash
+
+# Behavior tests of sparse and compressed reads, small-file batching,
+# deduplication, follow mode, the ingest daemon and the record index
+# The jobs are the *_test.yaml configs next to this script; their paths are
+# relative to a scratch directory that this script fills with inputs
+# This script should be run from the build/ directory
+
+echo "=========================================="
+echo "OMNI Feature Test"
+echo "=========================================="
+
+# Check if we're in the correct directory
+if [ ! -f "bin/wrp" ]; then
+    echo "❌ Error: wrp executable not found."
+    echo "Please run this script from the build/ directory."
+    echo "Usage: cd build && bash ../omni/config/test_features.sh"
+    exit 1
+fi
+
+WRP="$(pwd)/bin/wrp"
+export PATH="$(pwd)/bin:$PATH"  # mpirun finds the workers on PATH
+CONFIG="$(cd "$(dirname "$0")" && pwd)"
+WORK=$(mktemp -d)
+SERVE_PID=
+trap '[ -n "$SERVE_PID" ] && kill -INT "$SERVE_PID" 2>/dev/null; rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+fail() {
+    echo "❌ $1"
+    exit 1
+}
+
+# "offset length xxh64" of the byte blocks of a shard index
+byte_blocks() {
+    sed -n 's/.*"kind": "bytes".*"offset": \([0-9]*\), "length": \([0-9]*\).*"xxh64": "\([0-9a-f]*\)".*/\1 \2 \3/p' "$@"
+}
+
+# "offset length" of the holes of a shard index
+holes() {
+    sed -n 's/.*"kind": "hole".*"offset": \([0-9]*\), "length": \([0-9]*\).*/\1 \2/p' "$@"
+}
+
+# A number of the manifest summary of the datasets matching a pattern
+summary() {
+    grep -ho "\"$2\": [0-9]*" $1/manifest.json | awk '{ sum += $2 } END { print sum + 0 }'
+}
+
+echo "✅ Prerequisites check passed"
+echo ""
+
+# Test Case 1: Sparse and compressed reads
+echo "=== Test Case 1: Sparse Files and Compressed Ranges ==="
+echo "Command: $WRP $CONFIG/reads_test.yaml"
+echo ""
+
+truncate -s 16M sparse.bin
+head -c 1048576 /dev/urandom > sparse_head.bin
+head -c 1048576 /dev/urandom > sparse_tail.bin
+dd if=sparse_head.bin of=sparse.bin conv=notrunc status=none
+dd if=sparse_tail.bin of=sparse.bin bs=1M seek=8 conv=notrunc status=none
+seq 1 3000000 > plain.txt
+if command -v gzip > /dev/null; then
+    gzip -c plain.txt > plain.txt.gz
+else
+    cp plain.txt plain.txt.gz  # Without gzip the ranges are still compared
+fi
+
+if ! "$WRP" "$CONFIG/reads_test.yaml"; then
+    fail "Read job FAILED"
+fi
+
+# Holes are recorded, not read; the data extents hold the bytes of the files
+# written into them
+if [ "$(du -k sparse.bin | cut -f1)" -lt 16384 ]; then
+    expected=$(printf '1048576 7340032\n9437184 7340032')
+    if [ "$(holes reads_out/sparse.bin-*/shard-*.json)" != "$expected" ]; then
+        fail "The holes of sparse.bin were not skipped"
+    fi
+else
+    echo "The filesystem of $WORK does not keep holes; only bytes are checked"
+fi
+for part in head tail; do
+    want=$(byte_blocks reads_out/sparse_$part.bin-*/shard-*.json | cut -d' ' -f3)
+    if ! byte_blocks reads_out/sparse.bin-*/shard-*.json | grep -q " $want\$"; then
+        fail "sparse.bin does not hold the bytes of sparse_$part.bin"
+    fi
+done
+
+# The decoded range has the blocks of the same range of the plain file
+plain=$(byte_blocks reads_out/plain.txt-*/shard-*.json)
+if [ -z "$plain" ] ||
+   [ "$plain" != "$(byte_blocks reads_out/plain.txt.gz-*/shard-*.json)" ]; then
+    fail "The compressed range does not match the plain range"
+fi
+echo "✅ Read test PASSED"
+
+# Test Case 2: Small-file batching
+echo ""
+echo "=== Test Case 2: Small Files in One Launch ==="
+if command -v mpirun > /dev/null; then
+    echo "Command: $WRP --mpi $CONFIG/small_files_test.yaml"
+    echo ""
+    mkdir small
+    for i in $(seq 1 20); do
+        head -c $((1000 + i * 100)) /dev/urandom > small/f$i.dat
+    done
+    if ! "$WRP" --mpi "$CONFIG/small_files_test.yaml"; then
+        fail "Small-file job FAILED"
+    fi
+    # One batch dataset holds every file; the batch list is removed
+    datasets=$(ls -d small_out/*/ | wc -l)
+    if [ "$datasets" -ne 1 ] || [ -z "$(ls -d small_out/batch_job_*/)" ]; then
+        fail "Expected 1 batch dataset, found $datasets datasets"
+    fi
+    if [ "$(summary 'small_out/*' raw_bytes)" -ne 41000 ]; then
+        fail "The batch dataset does not hold the 41000 bytes of the files"
+    fi
+    if ls small_out | grep -qv -- '-[0-9a-f]*$'; then
+        fail "The batch list was left in small_out"
+    fi
+    echo "✅ Small-file test PASSED"
+else
+    echo "mpirun not found; skipped"
+fi
+
+# Test Case 3: Deduplication
+echo ""
+echo "=== Test Case 3: Deduplication Across Runs ==="
+echo "Command: $WRP $CONFIG/dedup_test.yaml (twice)"
+echo ""
+
+head -c 3000000 /dev/urandom > dedup.bin
+if ! "$WRP" "$CONFIG/dedup_test.yaml" ||
+   [ "$(summary 'dedup_out/dedup.bin-*' dedup_bytes)" -ne 0 ]; then
+    fail "First dedup run FAILED"
+fi
+if ! "$WRP" "$CONFIG/dedup_test.yaml"; then
+    fail "Second dedup run FAILED"
+fi
+if [ "$(summary 'dedup_out/dedup.bin-*' dedup_bytes)" -ne 3000000 ] ||
+   [ "$(summary 'dedup_out/dedup.bin-*' stored_bytes)" -ne 0 ]; then
+    fail "The second run stored chunks the first one had written"
+fi
+echo "✅ Dedup test PASSED"
+
+# Test Case 4: Follow mode
+echo ""
+echo "=== Test Case 4: Following a Growing File ==="
+echo "Command: $WRP $CONFIG/follow_test.yaml (twice)"
+echo ""
+
+seq 1 1000 > follow.txt
+(sleep 0.3; seq 1001 2000 >> follow.txt) &
+if ! "$WRP" "$CONFIG/follow_test.yaml"; then
+    fail "First follow run FAILED"
+fi
+wait
+first=$(stat -c %s follow.txt)
+offset=$(awk -F'\t' '$1 ~ /follow.txt$/ { print $5 }' follow_offsets.tsv)
+if [ "$offset" != "$first" ] ||
+   [ "$(summary 'follow_out/follow.txt-*' raw_bytes)" -ne "$first" ]; then
+    fail "Committed offset $offset, expected all $first bytes"
+fi
+
+# A restarted job imports only what was appended since
+seq 2001 2500 >> follow.txt
+if ! "$WRP" "$CONFIG/follow_test.yaml"; then
+    fail "Second follow run FAILED"
+fi
+total=$(stat -c %s follow.txt)
+offset=$(awk -F'\t' '$1 ~ /follow.txt$/ { print $5 }' follow_offsets.tsv)
+if [ "$offset" != "$total" ] ||
+   [ "$(ls -d follow_out/follow.txt-*/ | wc -l)" -ne 2 ] ||
+   [ "$(summary 'follow_out/follow.txt-*' raw_bytes)" -ne "$total" ]; then
+    fail "The restarted job did not resume at offset $first"
+fi
+echo "✅ Follow test PASSED"
+
+# Test Case 5: Ingest daemon
+echo ""
+echo "=== Test Case 5: wrp serve and wrp submit ==="
+echo "Command: $WRP submit --socket $WORK/sock/wrp.sock $CONFIG/serve_test.yaml"
+echo ""
+
+mkdir -m 700 sock
+head -c 500000 /dev/urandom > serve.bin
+"$WRP" serve --socket "$WORK/sock/wrp.sock" > serve.log 2>&1 &
+SERVE_PID=$!
+for i in $(seq 1 100); do
+    [ -S sock/wrp.sock ] && break
+    sleep 0.1
+done
+if ! "$WRP" submit --socket "$WORK/sock/wrp.sock" "$CONFIG/serve_test.yaml"; then
+    fail "Submitted job FAILED"
+fi
+if [ "$(summary 'serve_out/serve.bin-*' raw_bytes)" -ne 500000 ]; then
+    fail "The daemon's job did not import serve.bin"
+fi
+# A job that fails in the daemon fails the client
+if "$WRP" submit --socket "$WORK/sock/wrp.sock" missing.yaml 2> /dev/null; then
+    fail "A failed job exited with 0"
+fi
+kill -INT "$SERVE_PID"
+if ! wait "$SERVE_PID"; then
+    cat serve.log
+    fail "The daemon did not stop cleanly"
+fi
+SERVE_PID=
+echo "✅ Serve test PASSED"
+
+# Test Case 6: Record index queries
+echo ""
+echo "=== Test Case 6: wrp query ==="
+echo "Command: $WRP $CONFIG/query_test.yaml"
+echo ""
+
+(echo "id,val,name"; seq 1 200000 | awk '{ print $1 "," $1 % 7 ",n" $1 % 13 }') > table.csv
+if ! "$WRP" "$CONFIG/query_test.yaml"; then
+    fail "Index job FAILED"
+fi
+dataset=$(ls -d query_out/table.csv-*/)
+
+# Query output: one "path offset size" line per range, then a summary
+check_query() {
+    local want="$1"
+    shift
+    "$WRP" query "$dataset" "$@" > query.out 2>&1 ||
+        fail "wrp query $* FAILED"
+    grep -q "^Query: $want," query.out ||
+        fail "wrp query $*: expected $want, got: $(tail -1 query.out)"
+}
+check_query "1 ranges, 65536 records" --range id=1..10  # First chunk only
+check_query "1 ranges, 200000 records" --eq val=3
+check_query "1 ranges, 200000 records" --eq name=n5
+check_query "0 ranges, 0 records" --eq id=999999
+check_query "0 ranges, 0 records" --eq name=absent
+
+# The range found holds the record
+check_query "1 ranges, 65536 records" --eq id=70000
+read -r path offset size < query.out
+if ! tail -c +$((offset + 1)) "$path" | head -c "$size" | grep -qx "70000,0,n8"; then
+    fail "The range at $offset does not hold id 70000"
+fi
+echo "✅ Query test PASSED"
+
+echo ""
+echo "✅ Feature test PASSED"
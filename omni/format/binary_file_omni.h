@@ -1,40 +1,80 @@
 #ifndef CAE_FORMAT_BINARY_FILE_OMNI_H_
 #define CAE_FORMAT_BINARY_FILE_OMNI_H_
 
+#include "catalog/metadata_collector.h"
 #include "format_client.h"
+#include "io/compressed_reader.h"
+#include "io/file_extents.h"
+#include "io/file_layout.h"
+#include "io/io_tuner.h"
+#include "runtime/numa_buffer.h"
+#include "sink/output_sink.h"
 #include <algorithm>
-#include <cstdio>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
 #include <iostream>
 #include <memory>
-#include <sys/stat.h>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
 #include <vector>
 
 /**
  * Simple Binary File Processing Strategy:
  *
- * This module provides straightforward binary file processing using standard
- * C stdio functions:
+ * This module provides straightforward binary file processing using POSIX
+ * positional reads:
  *
- * 1. File Reading: Uses fopen, fread, fclose for all file operations
+ * 1. File Reading: Uses open and pread; the descriptor and read buffer are
+ *    kept between Import calls on the same file, and the clients of a
+ *    process share one descriptor per file (see io/file_layout.h)
  * 2. Chunked Processing: Reads files in manageable chunks for memory efficiency
- * 3. Simple Output: Provides basic file processing information and statistics
+ * 3. Sparse Files: Holes found with SEEK_DATA/SEEK_HOLE (or FIEMAP) are
+ *    skipped and reported as zero-filled extents instead of being read
+ * 4. Compressed Inputs: gzip, bzip2 and zstd files are decoded and offsets
+ *    and sizes refer to uncompressed bytes (see io/compressed_reader.h)
+ * 5. Batches: ImportBatch sorts ranges by (file, offset), opens each file
+ *    once and reads up to batch_io_depth ranges concurrently
+ * 6. Output: Chunks and holes are passed to the output sink when one is
+ *    set, along with basic processing information and statistics
+ * 7. Errors: open and pread are retried on transient errors (see
+ *    io/retry_policy.h); a range that still fails is reported from the
+ *    first byte not passed on, so it can be imported again elsewhere
+ * 8. Auto-Tuning: Uncompressed reads take their chunk size and read-ahead
+ *    depth from a per-file tuner that measures the achieved bandwidth (see
+ *    io/io_tuner.h); read-ahead is requested with POSIX_FADV_WILLNEED so
+ *    chunks still reach the sink in order. The buffer grows with the chunk
+ * 9. QoS: Every pread takes its tokens from the client's throttle first;
+ *    decoded chunks are charged by their uncompressed size, which bounds
+ *    what was read from storage
+ * 10. Known Files: Compression and extents the launch already resolved
+ *    are used instead of being detected again for every range
  */
 
 namespace cae {
 
 /**
- * Binary file content processing client using standard stdio
+ * Binary file content processing client using positional reads
  */
 class BinaryFileOmni : public FormatClient {
-private:
+public:
   static constexpr size_t DEFAULT_CHUNK_SIZE = 1024 * 1024; // 1MB chunks
+  static constexpr int DEFAULT_BATCH_IO_DEPTH = 4; // Concurrent batch reads
 
-public:
   /** Default constructor */
-  BinaryFileOmni() = default;
+  BinaryFileOmni() : fd_(-1), batch_io_depth_(DEFAULT_BATCH_IO_DEPTH) {}
 
   /** Destructor */
-  ~BinaryFileOmni() override = default;
+  ~BinaryFileOmni() override { CloseCachedFile(); }
+
+  BinaryFileOmni(const BinaryFileOmni &) = delete;
+  BinaryFileOmni &operator=(const BinaryFileOmni &) = delete;
 
   /** Describe the file */
   std::string Describe(const FormatContext &ctx) override {
@@ -43,7 +83,7 @@ public:
            " bytes, offset: " + std::to_string(ctx.offset_) + ")";
   }
 
-  /** Process a binary file using standard stdio functions */
+  /** Process a byte range of a binary file */
   void Import(const FormatContext &ctx) override {
     std::cout << "Processing file: " << ctx.filename_ << std::endl;
     std::cout << "Size: " << ctx.size_ << " bytes" << std::endl;
@@ -52,74 +92,428 @@ public:
       std::cout << "Expected hash: " << ctx.hash_ << std::endl;
     }
 
-    // Open file for reading
-    FILE *file = fopen(ctx.filename_.c_str(), "rb");
-    if (!file) {
-      std::cerr << "Error: Failed to open file " << ctx.filename_ << std::endl;
+    // Reuse the descriptor when the previous call read the same file
+    int fd = OpenCachedFile(ctx.filename_);
+    if (fd < 0) {
+      std::string reason = std::string("open: ") + std::strerror(errno);
+      std::cerr << "Error: Failed to open file " << ctx.filename_ << ": "
+                << reason << std::endl;
+      ReportFailure(
+          ImportFailure(ctx.filename_, ctx.offset_, ctx.size_, true, reason));
       return;
     }
 
-    // Seek to the specified offset
-    if (fseek(file, (long)ctx.offset_, SEEK_SET) != 0) {
-      std::cerr << "Error: Failed to seek to offset " << ctx.offset_
-                << " in file " << ctx.filename_ << std::endl;
-      fclose(file);
+    // The buffer is first-touched by the thread that imports first
+    if (!buffer_) {
+      buffer_ = std::make_unique<NumaBuffer>(DEFAULT_CHUNK_SIZE);
+    }
+
+    if (auto_tune_) {
+      IoSettings io = IoTuner::ForFile(ctx.filename_)->Get();
+      std::cout << "Reading file in tuned chunks, starting at "
+                << io.chunk_size_ << " bytes with read-ahead depth "
+                << io.depth_ << std::endl;
+    } else {
+      std::cout << "Reading file in chunks of " << DEFAULT_CHUNK_SIZE
+                << " bytes" << std::endl;
+    }
+
+    size_t processed = 0;
+    RangeStats stats = ReadRange(fd, ctx, *buffer_, true, [&](size_t bytes) {
+      processed += bytes;
+      OnChunkProcessed(processed);
+    });
+
+    std::cout << "File processing completed. Total bytes read: "
+              << stats.read_ << "/" << ctx.size_;
+    if (stats.processed_ > stats.read_) {
+      std::cout << " (" << stats.processed_ - stats.read_
+                << " bytes in holes)";
+    }
+    std::cout << std::endl;
+
+    if (stats.processed_ == ctx.size_) {
+      std::cout << "Successfully processed entire requested range" << std::endl;
+    } else {
+      std::cout << "Warning: Only processed " << stats.processed_ << " out of "
+                << ctx.size_ << " requested bytes" << std::endl;
+    }
+  }
+
+  /**
+   * Process a batch of byte ranges
+   * Ranges are read in (file, offset) order, every file is opened once, and
+   * up to batch_io_depth ranges are in flight at a time, each with its own
+   * buffer. OnChunkProcessed receives the bytes processed across the batch.
+   * @param batch Ranges to import
+   */
+  void ImportBatch(const std::vector<FormatContext> &batch) override {
+    if (batch.empty()) {
       return;
     }
 
-    // Process the file in chunks
-    std::vector<char> buffer(DEFAULT_CHUNK_SIZE);
+    // Sort so each file is read front to back
+    std::vector<size_t> order(batch.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return std::tie(batch[a].filename_, batch[a].offset_) <
+             std::tie(batch[b].filename_, batch[b].offset_);
+    });
+
+    // Open every distinct file once; sorted order keeps equal names adjacent.
+    // Descriptors and open errors are kept per range and only read by the
+    // reader threads
+    std::vector<int> fds(batch.size(), -1);
+    std::vector<std::string> open_errors(batch.size());
+    std::vector<int> opened;
+    for (size_t i = 0; i < order.size(); ++i) {
+      const std::string &name = batch[order[i]].filename_;
+      if (i > 0 && name == batch[order[i - 1]].filename_) {
+        fds[order[i]] = fds[order[i - 1]];
+        open_errors[order[i]] = open_errors[order[i - 1]];
+        continue;
+      }
+      int fd = retry_.Run([&] { return open(name.c_str(), O_RDONLY); });
+      if (fd < 0) {
+        std::cerr << "Error: Failed to open file " << name << ": "
+                  << std::strerror(errno) << std::endl;
+        open_errors[order[i]] = std::string("open: ") + std::strerror(errno);
+      } else {
+        opened.push_back(fd);
+      }
+      fds[order[i]] = fd;
+    }
+
+    std::cout << "Processing batch: " << batch.size() << " ranges in "
+              << opened.size() << " file(s)" << std::endl;
+
+    std::atomic<size_t> next(0);
+    std::mutex mtx;
+    size_t processed = 0;
     size_t total_read = 0;
-    size_t remaining = ctx.size_;
-
-    std::cout << "Reading file in chunks of " << DEFAULT_CHUNK_SIZE << " bytes"
-              << std::endl;
-
-    while (remaining > 0 && total_read < ctx.size_) {
-      size_t chunk_size = std::min(remaining, DEFAULT_CHUNK_SIZE);
-      size_t bytes_read = fread(buffer.data(), 1, chunk_size, file);
-
-      if (bytes_read == 0) {
-        if (feof(file)) {
-          std::cout << "Reached end of file after reading " << total_read
-                    << " bytes" << std::endl;
-          break;
-        } else {
-          std::cerr << "Error reading file after " << total_read << " bytes"
+    size_t total_requested = 0;
+
+    auto worker = [&]() {
+      NumaBuffer buffer(DEFAULT_CHUNK_SIZE);
+      for (size_t i = next++; i < order.size(); i = next++) {
+        const FormatContext &ctx = batch[order[i]];
+        int fd = fds[order[i]];
+        if (fd < 0) {
+          ReportFailure(ImportFailure(ctx.filename_, ctx.offset_, ctx.size_,
+                                      true, open_errors[order[i]]));
+          continue;
+        }
+        RangeStats stats = ReadRange(fd, ctx, buffer, false, [&](size_t bytes) {
+          std::lock_guard<std::mutex> lock(mtx);
+          processed += bytes;
+          OnChunkProcessed(processed);
+        });
+
+        std::lock_guard<std::mutex> lock(mtx);
+        total_read += stats.read_;
+        total_requested += ctx.size_;
+        if (stats.processed_ != ctx.size_) {
+          std::cout << "Warning: Only processed " << stats.processed_
+                    << " out of " << ctx.size_ << " requested bytes of "
+                    << ctx.filename_ << " at offset " << ctx.offset_
                     << std::endl;
-          break;
         }
       }
+    };
 
-      total_read += bytes_read;
-      remaining -= bytes_read;
+    size_t nthreads = std::min<size_t>(
+        static_cast<size_t>(std::max(batch_io_depth_, 1)), order.size());
+    if (nthreads == 1) {
+      worker();
+    } else {
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < nthreads; ++t) {
+        threads.emplace_back(worker);
+      }
+      for (auto &t : threads) {
+        t.join();
+      }
+    }
 
-      // Process the chunk (for now, just report progress)
-      std::cout << "Read chunk: " << bytes_read
-                << " bytes (total: " << total_read << "/" << ctx.size_ << ")"
-                << std::endl;
+    for (int fd : opened) {
+      close(fd);
+    }
 
-      // Call progress callback
-      OnChunkProcessed(total_read);
+    std::cout << "Batch processing completed. Total bytes read: "
+              << total_read << "/" << total_requested;
+    if (processed > total_read) {
+      std::cout << " (" << processed - total_read << " bytes in holes)";
     }
+    std::cout << std::endl;
+  }
 
-    fclose(file);
+  /** Set how data extents are discovered before reading */
+  void SetExtentMethod(ExtentMethod method) { extent_method_ = method; }
 
-    std::cout << "File processing completed. Total bytes read: " << total_read
-              << "/" << ctx.size_ << std::endl;
+  /** Decode compressed inputs (default) or read them as raw bytes */
+  void SetDecompress(bool decompress) { decompress_ = decompress; }
 
-    if (total_read == ctx.size_) {
-      std::cout << "Successfully processed entire requested range" << std::endl;
-    } else {
-      std::cout << "Warning: Only processed " << total_read << " out of "
-                << ctx.size_ << " requested bytes" << std::endl;
+  /** Set how many ranges of a batch are read concurrently */
+  void SetBatchIoDepth(int depth) { batch_io_depth_ = std::max(depth, 1); }
+
+  /** Tune chunk size and read-ahead at runtime (default) or use fixed ones */
+  void SetAutoTune(bool auto_tune) { auto_tune_ = auto_tune; }
+
+  /**
+   * Options: decompress, extents (seek_data/fiemap/none), io_depth,
+   * auto_tune, retries and retry_backoff_ms
+   */
+  bool SetOption(const std::string &key, const std::string &value) override {
+    if (SetRetryOption(key, value)) {
+      return true;
+    } else if (key == "decompress") {
+      return ParseBool(value, decompress_);
+    } else if (key == "auto_tune") {
+      return ParseBool(value, auto_tune_);
+    } else if (key == "extents") {
+      return ParseExtentMethod(value, extent_method_);
+    } else if (key == "io_depth") {
+      try {
+        SetBatchIoDepth(std::stoi(value));
+      } catch (const std::exception &) {
+        return false;
+      }
+      return true;
     }
+    return false;
   }
 
 protected:
-  virtual void OnChunkProcessed(size_t bytes_processed) {}
+  /**
+   * Called for every hole; the range reads as zeros and was not read.
+   * May be called concurrently from the threads of ImportBatch.
+   */
+  virtual void OnHole(const FormatContext &ctx, size_t offset,
+                      size_t length) {}
+
+private:
+  /** Outcome of reading one range */
+  struct RangeStats {
+    size_t read_;      // Bytes read from data extents
+    size_t processed_; // Bytes read plus hole bytes skipped
+  };
+
+  /**
+   * Read one range through a buffer, skipping holes
+   * @param fd Open descriptor of ctx.filename_
+   * @param ctx Range to read
+   * @param buffer Read buffer; grown when the tuner picks larger chunks
+   * @param verbose Print per-chunk and per-hole messages
+   * @param on_progress Called with the bytes covered by each chunk or hole
+   */
+  RangeStats ReadRange(int fd, const FormatContext &ctx, NumaBuffer &buffer,
+                       bool verbose,
+                       const std::function<void(size_t)> &on_progress) {
+    const KnownFile *known = FindKnownFile(ctx.filename_);
+    if (decompress_) {
+      Compression compression =
+          known ? known->layout_.GetCompression() : DetectCompression(fd);
+      if (compression != Compression::kNone) {
+        return ReadCompressedRange(fd, compression, ctx, buffer, verbose,
+                                   on_progress);
+      }
+    }
+
+    RangeStats stats{0, 0};
+    std::shared_ptr<IoTuner> tuner;
+    if (auto_tune_) {
+      tuner = IoTuner::ForFile(ctx.filename_);
+    }
+    size_t advised = 0; // End of the read-ahead requested so far
+
+    // Discover data extents so holes are skipped instead of read, unless
+    // the launch mapped them already
+    std::vector<FileExtent> extents;
+    if (!known || !known->GetExtents(ctx.offset_, ctx.size_, extents)) {
+      extents = FileExtents::Map(fd, ctx.offset_, ctx.size_, extent_method_);
+    }
+
+    for (const auto &ext : extents) {
+      if (ext.is_hole_) {
+        // Holes read as zeros; report them instead of reading them
+        if (verbose) {
+          std::cout << "Skipped hole: " << ext.length_ << " bytes at offset "
+                    << ext.offset_ << std::endl;
+        }
+        OnHole(ctx, ext.offset_, ext.length_);
+        if (sink_) {
+          sink_->WriteHole(ctx, ext.offset_, ext.length_);
+        }
+        if (catalog_) {
+          catalog_->AddHole(ctx.filename_, ext.offset_, ext.length_);
+        }
+        stats.processed_ += ext.length_;
+        on_progress(ext.length_);
+        continue;
+      }
+
+      size_t pos = ext.offset_;
+      size_t end = ext.offset_ + ext.length_;
+      while (pos < end) {
+        IoSettings io = tuner ? tuner->Get() : IoSettings(buffer.size(), 1);
+        if (io.chunk_size_ > buffer.size()) {
+          buffer = NumaBuffer(io.chunk_size_);
+        }
+        size_t chunk_size = std::min(end - pos, io.chunk_size_);
+        if (io.depth_ > 1) {
+          // Keep the next chunks in flight in the kernel
+          size_t from = std::max(advised, pos + chunk_size);
+          size_t ahead = std::min(
+              end, pos + static_cast<size_t>(io.depth_) * io.chunk_size_);
+          if (ahead > from) {
+            posix_fadvise(fd, static_cast<off_t>(from),
+                          static_cast<off_t>(ahead - from),
+                          POSIX_FADV_WILLNEED);
+            advised = ahead;
+          }
+        }
+        Throttle(chunk_size);
+        auto start = std::chrono::steady_clock::now();
+        ssize_t bytes_read = retry_.Run([&] {
+          return pread(fd, buffer.data(), chunk_size, static_cast<off_t>(pos));
+        });
+        if (bytes_read < 0) {
+          std::string reason = std::string("pread: ") + std::strerror(errno);
+          std::cerr << "Error reading " << ctx.filename_ << " at offset "
+                    << pos << ": " << reason << std::endl;
+          ReportFailure(ImportFailure(ctx.filename_, pos,
+                                      ctx.offset_ + ctx.size_ - pos, true,
+                                      reason));
+          return stats;
+        }
+        if (bytes_read == 0) {
+          // The file is shorter than when the range was planned
+          std::string reason = "file ends at offset " + std::to_string(pos);
+          std::cerr << "Error reading " << ctx.filename_ << ": " << reason
+                    << ", before the end of the range" << std::endl;
+          ReportFailure(ImportFailure(ctx.filename_, pos,
+                                      ctx.offset_ + ctx.size_ - pos, true,
+                                      reason));
+          return stats;
+        }
+
+        size_t n = static_cast<size_t>(bytes_read);
+        if (tuner) {
+          std::chrono::duration<double> elapsed =
+              std::chrono::steady_clock::now() - start;
+          tuner->Record(io, n, elapsed.count());
+        }
+        if (sink_) {
+          sink_->WriteChunk(ctx, pos, buffer.data(), n);
+        }
+        if (catalog_) {
+          catalog_->AddBytes(ctx.filename_, pos, buffer.data(), n);
+        }
+        pos += n;
+        stats.read_ += n;
+        stats.processed_ += n;
+
+        if (verbose) {
+          std::cout << "Read chunk: " << n << " bytes (total: "
+                    << stats.processed_ << "/" << ctx.size_ << ")"
+                    << std::endl;
+        }
+        on_progress(n);
+      }
+    }
+    if (stats.processed_ < ctx.size_) {
+      // The extents end early: the file is shorter than when it was planned
+      size_t pos = ctx.offset_ + stats.processed_;
+      std::string reason = "file ends at offset " + std::to_string(pos);
+      std::cerr << "Error reading " << ctx.filename_ << ": " << reason
+                << ", before the end of the range" << std::endl;
+      ReportFailure(ImportFailure(ctx.filename_, pos,
+                                  ctx.size_ - stats.processed_, true, reason));
+    }
+    return stats;
+  }
+
+  /** Decode a range given in uncompressed coordinates */
+  RangeStats ReadCompressedRange(
+      int fd, Compression compression, const FormatContext &ctx,
+      NumaBuffer &buffer, bool verbose,
+      const std::function<void(size_t)> &on_progress) {
+    RangeStats stats{0, 0};
+    size_t done = ctx.offset_; // End of the bytes passed on
+    try {
+      CompressedReader reader(CompressedIndex::Get(ctx.filename_, compression));
+      reader.Read(fd, ctx.offset_, ctx.size_, buffer.data(), buffer.size(),
+                  [&](size_t offset, const char *data, size_t length) {
+                    Throttle(length);
+                    if (sink_) {
+                      sink_->WriteChunk(ctx, offset, data, length);
+                    }
+                    if (catalog_) {
+                      catalog_->AddBytes(ctx.filename_, offset, data, length);
+                    }
+                    stats.read_ += length;
+                    stats.processed_ += length;
+                    done = offset + length;
+                    if (verbose) {
+                      std::cout << "Decoded chunk: " << length
+                                << " bytes (total: " << stats.processed_
+                                << "/" << ctx.size_ << ")" << std::endl;
+                    }
+                    on_progress(length);
+                  });
+    } catch (const std::exception &e) {
+      std::cerr << "Error decoding " << CompressionName(compression)
+                << " file " << ctx.filename_ << ": " << e.what() << std::endl;
+      size_t end = ctx.offset_ + ctx.size_;
+      ReportFailure(ImportFailure(ctx.filename_, done,
+                                  end > done ? end - done : 0, true,
+                                  e.what()));
+      return stats;
+    }
+    size_t end = ctx.offset_ + ctx.size_;
+    if (done < end) {
+      std::string reason =
+          "decoded data ends at offset " + std::to_string(done);
+      std::cerr << "Error decoding " << ctx.filename_ << ": " << reason
+                << ", before the end of the range" << std::endl;
+      ReportFailure(
+          ImportFailure(ctx.filename_, done, end - done, true, reason));
+    }
+    return stats;
+  }
+
+  /** Descriptor for a path, reusing the one from the previous call */
+  int OpenCachedFile(const std::string &path) {
+    if (fd_ >= 0 && path == cached_path_) {
+      return fd_;
+    }
+    CloseCachedFile();
+    fd_ = FileHandles::Get().Acquire(path, [&] {
+      return retry_.Run([&] { return open(path.c_str(), O_RDONLY); });
+    });
+    if (fd_ >= 0) {
+      cached_path_ = path;
+    }
+    return fd_;
+  }
+
+  void CloseCachedFile() {
+    if (fd_ >= 0) {
+      FileHandles::Get().Release(cached_path_);
+    }
+    fd_ = -1;
+    cached_path_.clear();
+  }
+
+  ExtentMethod extent_method_ = ExtentMethod::kSeekData;
+  bool decompress_ = true;
+  bool auto_tune_ = true;
+  std::string cached_path_;
+  int fd_;
+  std::unique_ptr<NumaBuffer> buffer_;
+  int batch_io_depth_;
 };
 
 } // namespace cae
 
-#endif // CAE_FORMAT_BINARY_FILE_OMNI_H_
\ No newline at end of file
+#endif // CAE_FORMAT_BINARY_FILE_OMNI_H_
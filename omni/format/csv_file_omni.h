@@ -0,0 +1,336 @@
+#ifndef CAE_FORMAT_CSV_FILE_OMNI_H_
+#define CAE_FORMAT_CSV_FILE_OMNI_H_
+
+#include "catalog/metadata_collector.h"
+#include "csv_parser.h"
+#include "format_client.h"
+#include "io/compressed_reader.h"
+#include "sink/output_sink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * CSV Import Strategy:
+ *
+ * 1. Record Alignment: A range owns the records that start inside it; the
+ *    start is moved past the first newline and the end is extended to the
+ *    next one, so ranges can be split anywhere without losing records
+ *    (quoted fields containing newlines must not straddle a range boundary)
+ * 2. Header: The first record of the file names the columns for every range
+ * 3. Column Batches: Records are gathered into batches of ROWS_PER_BATCH and
+ *    handed to the output sink column by column, with the bytes they span
+ * 4. Compressed Inputs: gzip, bzip2 and zstd files are decoded, with
+ *    offsets in uncompressed bytes (see io/compressed_reader.h)
+ * 5. Errors: open and pread are retried on transient errors; a range that
+ *    still fails is reported, as resumable only if nothing of it was passed
+ *    on yet
+ * 6. QoS: Every read, including the header and record-boundary probes,
+ *    takes its tokens from the client's throttle first
+ * 7. Known Files: A file the launch already resolved is not stat'ed or
+ *    probed for compression again for each range
+ */
+
+namespace cae {
+
+/**
+ * CSV content processing client
+ */
+class CsvFileOmni : public FormatClient {
+private:
+  static constexpr size_t DEFAULT_CHUNK_SIZE = 1024 * 1024; // 1MB chunks
+  static constexpr size_t ROWS_PER_BATCH = 65536;
+
+public:
+  /** Default constructor */
+  CsvFileOmni() : delimiter_(','), has_header_(true), decompress_(true) {}
+
+  /** Describe the file */
+  std::string Describe(const FormatContext &ctx) override {
+    return "CSV file: " + ctx.filename_ +
+           " (size: " + std::to_string(ctx.size_) +
+           " bytes, offset: " + std::to_string(ctx.offset_) + ")";
+  }
+
+  /** Parse the records that start in a byte range of a CSV file */
+  void Import(const FormatContext &ctx) override {
+    std::cout << "Processing CSV file: " << ctx.filename_ << std::endl;
+    std::cout << "Size: " << ctx.size_ << " bytes" << std::endl;
+    std::cout << "Offset: " << ctx.offset_ << " bytes" << std::endl;
+
+    int fd = retry_.Run([&] { return open(ctx.filename_.c_str(), O_RDONLY); });
+    if (fd < 0) {
+      std::string reason = std::string("open: ") + std::strerror(errno);
+      std::cerr << "Error: Failed to open file " << ctx.filename_ << ": "
+                << reason << std::endl;
+      ReportFailure(
+          ImportFailure(ctx.filename_, ctx.offset_, ctx.size_, true, reason));
+      return;
+    }
+
+    bool passed_on = false; // Whether bytes or records reached the outputs
+    try {
+      Source source(fd, ctx.filename_, decompress_, retry_, throttle_.get(),
+                    FindKnownFile(ctx.filename_));
+      size_t end = std::min(ctx.offset_ + ctx.size_, source.size_);
+
+      // Column names come from the first record of the file
+      ColumnBatch batch;
+      size_t header_end = 0;
+      std::string first = source.ReadLine(0, header_end);
+      CsvParser::Record fields;
+      std::deque<std::string> scratch;
+      CsvParser::SplitRecord(first, delimiter_, fields, scratch);
+      for (size_t c = 0; c < fields.size(); ++c) {
+        batch.names_.push_back(has_header_ ? std::string(fields[c])
+                                           : "col" + std::to_string(c));
+      }
+      batch.columns_.resize(batch.names_.size());
+
+      size_t begin = ctx.offset_ == 0 ? 0 : source.NextRecord(ctx.offset_);
+      if (has_header_) {
+        begin = std::max(begin, header_end);
+      }
+      size_t stop = end >= source.size_ ? source.size_ : source.NextRecord(end);
+
+      size_t batch_offset = begin;
+      size_t records = 0;
+      CsvParser *parser_ptr = nullptr;
+      CsvParser parser([&](const CsvParser::Record &rec) {
+        // A full batch ends where the next record starts
+        size_t offset = begin + parser_ptr->GetRecordOffset();
+        if (batch.GetRowCount() >= ROWS_PER_BATCH) {
+          FlushBatch(ctx, batch_offset, offset, batch);
+        }
+        if (batch.GetRowCount() == 0) {
+          batch_offset = offset;
+        }
+        AddRecord(batch, rec);
+        records++;
+      }, delimiter_);
+      parser_ptr = &parser;
+
+      size_t consumed = 0;
+      std::vector<char> buffer(DEFAULT_CHUNK_SIZE);
+      if (catalog_ && ctx.offset_ == 0 && begin > 0) {
+        // The header is not parsed as data but belongs to the digest
+        source.Read(0, begin, buffer,
+                    [&](size_t offset, const char *data, size_t length) {
+                      passed_on = true;
+                      catalog_->AddBytes(ctx.filename_, offset, data, length);
+                    });
+      }
+      if (stop > begin) {
+        source.Read(begin, stop - begin, buffer,
+                    [&](size_t offset, const char *data, size_t length) {
+                      passed_on = true;
+                      if (catalog_) {
+                        catalog_->AddBytes(ctx.filename_, offset, data,
+                                           length);
+                      }
+                      parser.Feed(data, length);
+                      consumed += length;
+                      OnChunkProcessed(std::min(consumed, ctx.size_));
+                    });
+      }
+      parser.Finish();
+      FlushBatch(ctx, batch_offset, stop, batch);
+      OnChunkProcessed(end > ctx.offset_ ? end - ctx.offset_ : 0);
+
+      std::cout << "CSV processing completed: " << records << " records, "
+                << batch.names_.size() << " columns, " << consumed
+                << " bytes parsed" << std::endl;
+    } catch (const std::exception &e) {
+      std::cerr << "Error processing CSV file " << ctx.filename_ << ": "
+                << e.what() << std::endl;
+      ReportFailure(ImportFailure(ctx.filename_, ctx.offset_, ctx.size_,
+                                  !passed_on, e.what()));
+    }
+    close(fd);
+  }
+
+  /** Set the field delimiter */
+  void SetDelimiter(char delimiter) { delimiter_ = delimiter; }
+
+  /** Whether the first record holds column names (default true) */
+  void SetHasHeader(bool has_header) { has_header_ = has_header; }
+
+  /** Decode compressed inputs (default) or read them as raw bytes */
+  void SetDecompress(bool decompress) { decompress_ = decompress; }
+
+  /**
+   * Options: decompress, delimiter (one character), header, retries and
+   * retry_backoff_ms
+   */
+  bool SetOption(const std::string &key, const std::string &value) override {
+    if (SetRetryOption(key, value)) {
+      return true;
+    } else if (key == "decompress") {
+      return ParseBool(value, decompress_);
+    } else if (key == "delimiter") {
+      if (value.size() != 1) {
+        return false;
+      }
+      delimiter_ = value[0];
+      return true;
+    } else if (key == "header") {
+      return ParseBool(value, has_header_);
+    }
+    return false;
+  }
+
+private:
+  /** Plain or compressed file addressed in (uncompressed) bytes */
+  struct Source {
+    int fd_;
+    size_t size_;
+    std::shared_ptr<const CompressedIndex> index_;
+    const RetryPolicy &retry_;
+    IoThrottle *throttle_; // Null = unthrottled
+
+    /** @param known What the launch knows about the file, or nullptr */
+    Source(int fd, const std::string &path, bool decompress,
+           const RetryPolicy &retry, IoThrottle *throttle,
+           const KnownFile *known)
+        : fd_(fd), size_(0), retry_(retry), throttle_(throttle) {
+      struct stat st;
+      if (known) {
+        size_ = static_cast<size_t>(known->layout_.size_);
+      } else if (fstat(fd, &st) == 0) {
+        size_ = static_cast<size_t>(st.st_size);
+      }
+      Compression compression = Compression::kNone;
+      if (decompress) {
+        compression =
+            known ? known->layout_.GetCompression() : DetectCompression(fd);
+      }
+      if (compression != Compression::kNone) {
+        index_ = CompressedIndex::Get(path, compression);
+        size_ = index_->uncompressed_size_;
+      }
+    }
+
+    void Read(size_t offset, size_t length, std::vector<char> &buffer,
+              const CompressedReader::ChunkCallback &callback) {
+      if (index_) {
+        CompressedReader(index_).Read(
+            fd_, offset, length, buffer.data(), buffer.size(),
+            [&](size_t pos, const char *data, size_t len) {
+              if (throttle_) {
+                throttle_->Acquire(len);
+              }
+              callback(pos, data, len);
+            });
+        return;
+      }
+      size_t end = std::min(offset + length, size_);
+      while (offset < end) {
+        if (throttle_) {
+          throttle_->Acquire(std::min(end - offset, buffer.size()));
+        }
+        ssize_t n = retry_.Run([&] {
+          return pread(fd_, buffer.data(),
+                       std::min(end - offset, buffer.size()),
+                       static_cast<off_t>(offset));
+        });
+        if (n < 0) {
+          throw std::runtime_error(std::string("Read failed: ") +
+                                   std::strerror(errno));
+        }
+        if (n == 0) {
+          break;
+        }
+        callback(offset, buffer.data(), static_cast<size_t>(n));
+        offset += static_cast<size_t>(n);
+      }
+    }
+
+    /** Offset just past the first newline at or after pos - 1 */
+    size_t NextRecord(size_t pos) {
+      std::vector<char> buffer(64 * 1024);
+      size_t from = pos - 1;
+      while (from < size_) {
+        size_t found = size_;
+        Read(from, buffer.size(), buffer,
+             [&](size_t offset, const char *data, size_t length) {
+               if (found != size_) {
+                 return;
+               }
+               const void *nl = std::memchr(data, '\n', length);
+               if (nl) {
+                 found = offset + (static_cast<const char *>(nl) - data);
+               }
+             });
+        if (found != size_) {
+          return found + 1;
+        }
+        from += buffer.size();
+      }
+      return size_;
+    }
+
+    /** The record starting at pos, and the offset of the next one */
+    std::string ReadLine(size_t pos, size_t &next) {
+      next = NextRecord(pos + 1);
+      std::string line;
+      std::vector<char> buffer(64 * 1024);
+      Read(pos, next - pos, buffer,
+           [&](size_t, const char *data, size_t length) {
+             line.append(data, length);
+           });
+      if (!line.empty() && line.back() == '\n') {
+        line.pop_back();
+      }
+      return line;
+    }
+  };
+
+  /** Append a record, widening the batch if it has extra fields */
+  static void AddRecord(ColumnBatch &batch, const CsvParser::Record &rec) {
+    size_t rows = batch.GetRowCount();
+    while (batch.columns_.size() < rec.size()) {
+      batch.names_.push_back("col" + std::to_string(batch.columns_.size()));
+      batch.columns_.emplace_back(rows);
+    }
+    for (size_t c = 0; c < batch.columns_.size(); ++c) {
+      if (c < rec.size()) {
+        batch.columns_[c].emplace_back(rec[c]);
+      } else {
+        batch.columns_[c].emplace_back();
+      }
+    }
+  }
+
+  /** Pass on the records of [offset, end) */
+  void FlushBatch(const FormatContext &ctx, size_t offset, size_t end,
+                  ColumnBatch &batch) {
+    if (batch.GetRowCount() == 0) {
+      return;
+    }
+    batch.source_size_ = end - offset;
+    if (sink_) {
+      sink_->WriteColumns(ctx, offset, batch);
+    }
+    if (catalog_) {
+      catalog_->AddColumns(ctx.filename_, batch);
+    }
+    batch.Clear();
+  }
+
+  char delimiter_;
+  bool has_header_;
+  bool decompress_;
+};
+
+} // namespace cae
+
+#endif // CAE_FORMAT_CSV_FILE_OMNI_H_
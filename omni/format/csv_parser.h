@@ -0,0 +1,163 @@
+#ifndef CAE_FORMAT_CSV_PARSER_H_
+#define CAE_FORMAT_CSV_PARSER_H_
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Streaming CSV Parsing Strategy:
+ *
+ * 1. Chunk Feeding: Bytes arrive in arbitrary chunks straight from the read
+ *    loop; records are emitted as soon as their terminating newline is seen
+ * 2. Carry-over: A record split across chunks is stitched in a small pending
+ *    buffer, so the common case parses directly out of the read buffer
+ * 3. RFC 4180 Quoting: Quoted fields may contain delimiters, newlines and
+ *    doubled quotes; only those fields are copied to unescape them
+ */
+
+namespace cae {
+
+/**
+ * Incremental CSV record parser
+ */
+class CsvParser {
+public:
+  /** Fields of one record; views are valid only during the callback */
+  using Record = std::vector<std::string_view>;
+  using RecordCallback = std::function<void(const Record &)>;
+
+  /**
+   * Construct a parser
+   * @param callback Called once per parsed record
+   * @param delimiter Field delimiter
+   */
+  explicit CsvParser(RecordCallback callback, char delimiter = ',')
+      : callback_(std::move(callback)), delimiter_(delimiter), records_(0),
+        fed_(0), line_start_(0), in_quotes_(false) {}
+
+  /**
+   * Parse a chunk of bytes
+   * @param data Chunk data
+   * @param len Chunk length
+   */
+  void Feed(const char *data, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i < len; ++i) {
+      char c = data[i];
+      if (c == '"') {
+        in_quotes_ = !in_quotes_;
+      } else if (c == '\n' && !in_quotes_) {
+        if (pending_.empty()) {
+          EmitRecord(std::string_view(data + start, i - start));
+        } else {
+          pending_.append(data + start, i - start);
+          EmitRecord(pending_);
+          pending_.clear();
+        }
+        start = i + 1;
+        line_start_ = fed_ + start;
+      }
+    }
+    if (start < len) {
+      pending_.append(data + start, len - start);
+    }
+    fed_ += len;
+  }
+
+  /** Flush a trailing record that has no terminating newline */
+  void Finish() {
+    if (!pending_.empty()) {
+      EmitRecord(pending_);
+      pending_.clear();
+    }
+    in_quotes_ = false;
+  }
+
+  /** Number of records emitted so far */
+  size_t GetRecordCount() const { return records_; }
+
+  /**
+   * Offset of the record being emitted, counted from the first byte fed;
+   * valid inside the record callback
+   */
+  size_t GetRecordOffset() const { return line_start_; }
+
+  /**
+   * Split a single record into fields
+   * @param line Record without its terminating newline
+   * @param delimiter Field delimiter
+   * @param fields Output field views
+   * @param scratch Storage for unescaped quoted fields
+   */
+  static void SplitRecord(std::string_view line, char delimiter,
+                          Record &fields, std::deque<std::string> &scratch) {
+    fields.clear();
+    scratch.clear();
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+
+    size_t pos = 0;
+    while (true) {
+      if (pos < line.size() && line[pos] == '"') {
+        // Quoted field: unescape doubled quotes into scratch storage
+        std::string &field = scratch.emplace_back();
+        size_t i = pos + 1;
+        while (i < line.size()) {
+          if (line[i] == '"') {
+            if (i + 1 < line.size() && line[i + 1] == '"') {
+              field.push_back('"');
+              i += 2;
+              continue;
+            }
+            ++i;
+            break;
+          }
+          field.push_back(line[i++]);
+        }
+        fields.emplace_back(field);
+        size_t next = line.find(delimiter, i);
+        if (next == std::string_view::npos) {
+          break;
+        }
+        pos = next + 1;
+      } else {
+        size_t next = line.find(delimiter, pos);
+        if (next == std::string_view::npos) {
+          fields.emplace_back(line.substr(pos));
+          break;
+        }
+        fields.emplace_back(line.substr(pos, next - pos));
+        pos = next + 1;
+      }
+    }
+  }
+
+private:
+  void EmitRecord(std::string_view line) {
+    if (line.empty() || (line.size() == 1 && line[0] == '\r')) {
+      return;
+    }
+    SplitRecord(line, delimiter_, fields_, scratch_);
+    ++records_;
+    callback_(fields_);
+  }
+
+  RecordCallback callback_;
+  char delimiter_;
+  size_t records_;
+  size_t fed_;        // Bytes fed before the current chunk
+  size_t line_start_; // Offset of the record being assembled
+  bool in_quotes_;
+  std::string pending_;
+  Record fields_;
+  std::deque<std::string> scratch_;
+};
+
+} // namespace cae
+
+#endif // CAE_FORMAT_CSV_PARSER_H_
@@ -1,11 +1,22 @@
 #ifndef CAE_FORMAT_FORMAT_CLIENT_H_
 #define CAE_FORMAT_FORMAT_CLIENT_H_
 
+#include "io/file_layout.h"
+#include "io/io_throttle.h"
+#include "io/retry_policy.h"
+#include <algorithm>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace cae {
 
+class MetadataCollector;
+class OutputSink;
+
 /**
  * Context information for format processing
  */
@@ -19,16 +30,184 @@ struct FormatContext {
   FormatContext() : offset_(0), size_(0) {}
 };
 
+/**
+ * A byte range a client could not import
+ */
+struct ImportFailure {
+  // Exit status of a worker that imported all but some ranges
+  static constexpr int EXIT_STATUS = 2;
+
+  std::string filename_;
+  size_t offset_;
+  size_t size_;
+  bool resumable_; // Nothing of the range was passed on; it can be redone
+  std::string reason_;
+
+  ImportFailure() : offset_(0), size_(0), resumable_(false) {}
+  ImportFailure(const std::string &filename, size_t offset, size_t size,
+                bool resumable, const std::string &reason)
+      : filename_(filename), offset_(offset), size_(size),
+        resumable_(resumable), reason_(reason) {}
+};
+
 /**
  * Abstract base class for format clients that can import data
  */
 class FormatClient {
 public:
+  FormatClient() : progress_base_(0), progress_last_(0) {}
   virtual ~FormatClient() = default;
   virtual void Import(const FormatContext &ctx) = 0;
 
+  /**
+   * Import several contexts in one call
+   * The default imports them one at a time; clients override this to reuse
+   * file handles and buffers and to overlap the reads of a batch.
+   * @param batch Contexts to import, in any order
+   */
+  virtual void ImportBatch(const std::vector<FormatContext> &batch) {
+    // Progress of each Import continues from the previous ones
+    size_t done = 0;
+    for (const auto &ctx : batch) {
+      progress_base_ = done;
+      progress_last_ = 0;
+      Import(ctx);
+      done += progress_last_;
+    }
+    progress_base_ = 0;
+  }
+
   /** Describe the format/file */
   virtual std::string Describe(const FormatContext &ctx) = 0;
+
+  /** Send imported data to a sink; without one it is read and dropped */
+  void SetSink(std::shared_ptr<OutputSink> sink) { sink_ = std::move(sink); }
+
+  /** Report imported bytes and records to a catalog collector as well */
+  void SetCatalog(std::shared_ptr<MetadataCollector> catalog) {
+    catalog_ = std::move(catalog);
+  }
+
+  /**
+   * Limit the bandwidth and IOPS of this client's reads; clients take
+   * tokens in their read loops (see io/io_throttle.h)
+   */
+  void SetThrottle(std::shared_ptr<IoThrottle> throttle) {
+    throttle_ = std::move(throttle);
+  }
+
+  /**
+   * Layouts, formats and extents the launch already resolved; clients use
+   * them instead of looking at those files again (see io/file_layout.h)
+   */
+  void SetKnownFiles(std::shared_ptr<const KnownFiles> files) {
+    known_files_ = std::move(files);
+  }
+
+  /**
+   * Set a client option by name, e.g. "decompress" or "delimiter"
+   * Lets the worker configure clients it only knows through the registry.
+   * @return false if the client does not know the option or its value
+   */
+  virtual bool SetOption(const std::string &key, const std::string &value) {
+    return false;
+  }
+
+  /**
+   * Remove and return the ranges that failed since the last call
+   * Failures are recorded instead of thrown, so one bad range does not end
+   * an import.
+   */
+  std::vector<ImportFailure> TakeFailures() {
+    std::lock_guard<std::mutex> lock(failures_mtx_);
+    return std::move(failures_);
+  }
+
+  /** Receive the bytes processed so far in each Import or ImportBatch call */
+  void SetProgressCallback(std::function<void(size_t)> callback) {
+    progress_ = std::move(callback);
+  }
+
+  /** Parse a boolean option value: true/false, yes/no, on/off or 1/0 */
+  static bool ParseBool(const std::string &value, bool &out) {
+    if (value == "true" || value == "yes" || value == "on" || value == "1") {
+      out = true;
+    } else if (value == "false" || value == "no" || value == "off" ||
+               value == "0") {
+      out = false;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+protected:
+  /** Record a range that could not be imported; safe from any thread */
+  void ReportFailure(const ImportFailure &failure) {
+    std::lock_guard<std::mutex> lock(failures_mtx_);
+    failures_.push_back(failure);
+  }
+
+  /**
+   * Apply the retries (attempts) and retry_backoff_ms options
+   * @return false if the key is not a retry option or the value is invalid
+   */
+  bool SetRetryOption(const std::string &key, const std::string &value) {
+    int *field = key == "retries"            ? &retry_.attempts_
+                 : key == "retry_backoff_ms" ? &retry_.backoff_ms_
+                                             : nullptr;
+    if (!field) {
+      return false;
+    }
+    try {
+      *field = std::max(std::stoi(value), key == "retries" ? 1 : 0);
+    } catch (const std::exception &) {
+      return false;
+    }
+    return true;
+  }
+
+  /** What the launch knows about a file, or nullptr */
+  const KnownFile *FindKnownFile(const std::string &path) const {
+    if (!known_files_) {
+      return nullptr;
+    }
+    auto it = known_files_->find(path);
+    return it == known_files_->end() || !it->second.layout_.valid_
+               ? nullptr
+               : &it->second;
+  }
+
+  /** Wait for the tokens of one read of up to bytes bytes, if throttled */
+  void Throttle(size_t bytes) {
+    if (throttle_) {
+      throttle_->Acquire(bytes);
+    }
+  }
+
+  /**
+   * Called after every chunk with the bytes processed so far in the current
+   * Import or ImportBatch call. Calls are never concurrent.
+   */
+  virtual void OnChunkProcessed(size_t bytes_processed) {
+    progress_last_ = bytes_processed;
+    if (progress_) {
+      progress_(progress_base_ + bytes_processed);
+    }
+  }
+
+  std::shared_ptr<OutputSink> sink_;
+  std::shared_ptr<MetadataCollector> catalog_;
+  RetryPolicy retry_; // Retries of transient I/O errors
+  std::shared_ptr<IoThrottle> throttle_; // Null = unthrottled
+  std::shared_ptr<const KnownFiles> known_files_; // Null = none
+
+private:
+  std::mutex failures_mtx_;
+  std::vector<ImportFailure> failures_;
+  std::function<void(size_t)> progress_;
+  size_t progress_base_; // Bytes of earlier Imports in a default ImportBatch
+  size_t progress_last_;
 };
 
 } // namespace cae
@@ -1,7 +1,5 @@
 #include "format_factory.h"
-#include "binary_file_omni.h"
-#include <algorithm>
-#include <cctype>
+#include "format_registry.h"
 #include <stdexcept>
 
 namespace cae {
@@ -10,9 +8,13 @@ std::unique_ptr<FormatClient> FormatFactory::Get(Format format) {
   switch (format) {
   case Format::kPosix:
   case Format::kBinary:
-    return std::make_unique<BinaryFileOmni>();
+    return Get("binary");
+  case Format::kCsv:
+    return Get("csv");
   case Format::kHDF5:
-    // TODO: Implement HDF5 client
+    if (FormatRegistry::Get().Find("hdf5")) {
+      return Get("hdf5"); // Provided by a plugin
+    }
     throw std::runtime_error("HDF5 format client not yet implemented");
   default:
     throw std::runtime_error("Unknown format type");
@@ -21,17 +23,7 @@ std::unique_ptr<FormatClient> FormatFactory::Get(Format format) {
 
 std::unique_ptr<FormatClient>
 FormatFactory::Get(const std::string &format_str) {
-  std::string lower_format = format_str;
-  std::transform(lower_format.begin(), lower_format.end(), lower_format.begin(),
-                 [](unsigned char c) { return std::tolower(c); });
-
-  if (lower_format == "posix" || lower_format == "binary") {
-    return Get(Format::kPosix);
-  } else if (lower_format == "hdf5") {
-    return Get(Format::kHDF5);
-  } else {
-    throw std::runtime_error("Unknown format string: " + format_str);
-  }
+  return FormatRegistry::Get().Create(format_str);
 }
 
-} // namespace cae
\ No newline at end of file
+} // namespace cae
@@ -9,10 +9,12 @@ namespace cae {
 /**
  * Enumeration of supported formats
  */
-enum class Format { kPosix, kHDF5, kBinary };
+enum class Format { kPosix, kHDF5, kBinary, kCsv };
 
 /**
  * Factory class for creating format clients
+ * Clients come from the registry (see format/format_registry.h), so
+ * plugins are created the same way as built-in clients.
  */
 class FormatFactory {
 public:
@@ -0,0 +1,124 @@
+#include "format_registry.h"
+#include "binary_file_omni.h"
+#include "csv_file_omni.h"
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+namespace cae {
+
+namespace {
+
+/** Whether the CPU has a feature, by its GCC name */
+bool HasCpuFeature(const std::string &feature) {
+#if defined(__x86_64__) || defined(__i386__)
+  // __builtin_cpu_supports needs a literal, so known names are listed
+  if (feature == "sse4.2")
+    return __builtin_cpu_supports("sse4.2");
+  if (feature == "avx")
+    return __builtin_cpu_supports("avx");
+  if (feature == "avx2")
+    return __builtin_cpu_supports("avx2");
+  if (feature == "bmi2")
+    return __builtin_cpu_supports("bmi2");
+  if (feature == "avx512f")
+    return __builtin_cpu_supports("avx512f");
+  if (feature == "avx512bw")
+    return __builtin_cpu_supports("avx512bw");
+  if (feature == "avx512vl")
+    return __builtin_cpu_supports("avx512vl");
+  if (feature == "avx512vbmi")
+    return __builtin_cpu_supports("avx512vbmi");
+#endif
+  return false;
+}
+
+/** File name without a compression suffix */
+std::string StripCompressionSuffix(std::string name) {
+  for (const char *ext : {".gz", ".bz2", ".zst"}) {
+    std::string suffix(ext);
+    if (name.size() > suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      name.resize(name.size() - suffix.size());
+      break;
+    }
+  }
+  return name;
+}
+
+} // namespace
+
+FormatRegistry &FormatRegistry::Get() {
+  static FormatRegistry *registry = [] {
+    auto *r = new FormatRegistry();
+    FormatCapabilities binary;
+    binary.name_ = "binary";
+    binary.splittable_ = true;
+    r->Register(binary, [] { return std::make_unique<BinaryFileOmni>(); });
+
+    // Same client under its historical name
+    FormatCapabilities posix = binary;
+    posix.name_ = "posix";
+    r->Register(posix, [] { return std::make_unique<BinaryFileOmni>(); });
+
+    FormatCapabilities csv;
+    csv.name_ = "csv";
+    csv.extensions_ = {".csv"};
+    csv.splittable_ = true; // Ranges are realigned to record boundaries
+    r->Register(csv, [] { return std::make_unique<CsvFileOmni>(); });
+    return r;
+  }();
+  return *registry;
+}
+
+const FormatCapabilities *
+FormatRegistry::Detect(const std::string &path) const {
+  std::string head;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    char buf[MAX_MAGIC_SIZE];
+    ssize_t n = pread(fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      head.assign(buf, static_cast<size_t>(n));
+    }
+    close(fd);
+  }
+  return Detect(path, head);
+}
+
+const FormatCapabilities *
+FormatRegistry::Detect(const std::string &path,
+                       const std::string &head) const {
+  const FormatCapabilities *by_magic = nullptr;
+  const FormatCapabilities *by_ext = nullptr;
+  std::string name =
+      StripCompressionSuffix(std::filesystem::path(path).filename().string());
+  std::string ext =
+      ToLower(std::filesystem::path(name).extension().string());
+  for (const auto &format : GetNames()) {
+    const FormatCapabilities *caps = Find(format);
+    for (const auto &magic : caps->magic_) {
+      if (!by_magic && !magic.empty() &&
+          head.compare(0, magic.size(), magic) == 0) {
+        by_magic = caps;
+      }
+    }
+    for (const auto &candidate : caps->extensions_) {
+      if (!by_ext && !ext.empty() && ToLower(candidate) == ext) {
+        by_ext = caps;
+      }
+    }
+  }
+  return by_magic ? by_magic : by_ext;
+}
+
+bool FormatRegistry::IsSupported(const FormatCapabilities &caps) {
+  for (const auto &feature : caps.cpu_features_) {
+    if (!HasCpuFeature(feature)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace cae
@@ -0,0 +1,165 @@
+#ifndef CAE_FORMAT_FORMAT_REGISTRY_H_
+#define CAE_FORMAT_FORMAT_REGISTRY_H_
+
+#include "format_client.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Format Registry Strategy:
+ *
+ * 1. Registration: The built-in clients are registered when the registry is
+ *    first used; plugins add theirs when they are loaded (see
+ *    plugin/plugin_loader.h). Registration is header-only so plugins never
+ *    link against the engine
+ * 2. Capabilities: Every client declares the magic bytes and extensions it
+ *    reads, whether a file can be split into ranges and its preferred range
+ *    size, which the worker uses instead of per-format special cases
+ * 3. Variants: Several clients may register one name, e.g. an AVX-512 build
+ *    and a generic one; the highest-priority variant whose CPU features are
+ *    present is used, and on a tie the one registered last, so a plugin can
+ *    replace a built-in client
+ * 4. Detection: Files without an explicit format are matched by magic bytes
+ *    first and by extension second (ignoring a .gz/.bz2/.zst suffix)
+ */
+
+namespace cae {
+
+/**
+ * What a format client can read and how its work may be divided
+ */
+struct FormatCapabilities {
+  std::string name_;                     // Lower case, e.g. "csv"
+  std::vector<std::string> magic_;       // Leading bytes identifying a file
+  std::vector<std::string> extensions_;  // With the dot, e.g. ".csv"
+  bool splittable_;          // Ranges of one file may go to different workers
+  size_t granularity_;       // Preferred range size in bytes, 0 = default
+  std::vector<std::string> cpu_features_; // Required, e.g. "avx512f"
+  int priority_;             // Among variants of a name, highest wins
+  std::string source_;       // "builtin" or the plugin that registered it
+
+  FormatCapabilities() : splittable_(true), granularity_(0), priority_(0) {}
+};
+
+/** Creates a new client of a registered format */
+using FormatCreator = std::function<std::unique_ptr<FormatClient>()>;
+
+/**
+ * Registry of the format clients available to this process
+ */
+class FormatRegistry {
+public:
+  static constexpr size_t MAX_MAGIC_SIZE = 64; // Bytes Detect looks at
+
+  /** Process-wide registry, holding the built-in formats */
+  static FormatRegistry &Get();
+
+  /**
+   * Register a format client
+   * @param caps Capabilities; the name is stored in lower case
+   * @param create Creates a client
+   */
+  void Register(const FormatCapabilities &caps, FormatCreator create) {
+    Entry entry;
+    entry.caps_ = caps;
+    entry.caps_.name_ = ToLower(caps.name_);
+    if (entry.caps_.source_.empty()) {
+      entry.caps_.source_ = source_;
+    }
+    entry.create_ = std::move(create);
+    entries_.push_back(std::move(entry));
+  }
+
+  /** Set the source recorded for formats registered from now on */
+  void SetSource(const std::string &source) { source_ = source; }
+
+  /**
+   * Best variant of a format usable on this CPU
+   * @param name Format name, any case
+   * @return Its capabilities, or nullptr if no usable variant is registered
+   */
+  const FormatCapabilities *Find(const std::string &name) const {
+    const Entry *entry = FindEntry(ToLower(name));
+    return entry ? &entry->caps_ : nullptr;
+  }
+
+  /**
+   * Create a client of a format
+   * @throws std::runtime_error if no usable variant is registered
+   */
+  std::unique_ptr<FormatClient> Create(const std::string &name) const {
+    const Entry *entry = FindEntry(ToLower(name));
+    if (!entry) {
+      throw std::runtime_error("Unknown format string: " + name);
+    }
+    return entry->create_();
+  }
+
+  /**
+   * Detect the format of a file from its magic bytes, then its extension
+   * @return The matching format, or nullptr if none matches
+   */
+  const FormatCapabilities *Detect(const std::string &path) const;
+
+  /**
+   * Detect the format of a file whose first bytes were already read
+   * @param path Its path, for the extension
+   * @param head Up to MAX_MAGIC_SIZE bytes from its start
+   */
+  const FormatCapabilities *Detect(const std::string &path,
+                                   const std::string &head) const;
+
+  /** Names of the formats usable on this CPU, sorted */
+  std::vector<std::string> GetNames() const {
+    std::vector<std::string> names;
+    for (const auto &entry : entries_) {
+      if (IsSupported(entry.caps_) &&
+          std::find(names.begin(), names.end(), entry.caps_.name_) ==
+              names.end()) {
+        names.push_back(entry.caps_.name_);
+      }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+
+  /** Whether this CPU has every feature a variant requires */
+  static bool IsSupported(const FormatCapabilities &caps);
+
+  static std::string ToLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return s;
+  }
+
+private:
+  struct Entry {
+    FormatCapabilities caps_;
+    FormatCreator create_;
+  };
+
+  FormatRegistry() : source_("builtin") {}
+
+  const Entry *FindEntry(const std::string &name) const {
+    const Entry *best = nullptr;
+    for (const auto &entry : entries_) {
+      if (entry.caps_.name_ == name && IsSupported(entry.caps_) &&
+          (!best || entry.caps_.priority_ >= best->caps_.priority_)) {
+        best = &entry;
+      }
+    }
+    return best;
+  }
+
+  std::vector<Entry> entries_;
+  std::string source_;
+};
+
+} // namespace cae
+
+#endif // CAE_FORMAT_FORMAT_REGISTRY_H_
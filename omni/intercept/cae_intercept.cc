@@ -0,0 +1,582 @@
+/**
+ * LD_PRELOAD Read Interception:
+ *
+ * 1. Scope: open/open64/openat of files with a complete staged copy (see
+ *    intercept/stage_index.h) under $CAE_STAGE_DIR are tracked; every other
+ *    path, and every open for writing, goes straight to libc
+ * 2. Reads: read, pread and mmap of a tracked descriptor are served from
+ *    the node-local cache ($CAE_CACHE_DIR), which is filled from the staged
+ *    blocks on first use (see intercept/stage_cache.h)
+ * 3. Safe Fallback: A tracked descriptor is still the real file, so anything
+ *    not intercepted (dup'd descriptors, readv, children after exec) reads
+ *    correct data from the parallel filesystem, only without the cache
+ * 4. Missing Sources: When the source no longer exists, open returns the
+ *    fully filled cache file instead
+ * 5. stdio: fopen of a staged file fills the whole cache file and opens it,
+ *    since stdio reads inside libc cannot be intercepted
+ * 6. Descriptor Reuse: Every descriptor an open returns untracked replaces
+ *    what was tracked under its number, close, fclose and close_range drop
+ *    entries, and a tracked descriptor is only served while fstat still
+ *    shows the file it was opened on, so a number closed behind the hooks'
+ *    back (e.g. inside libc) and reused never reads another file's cache
+ */
+
+#include "intercept/stage_cache.h"
+#include "intercept/stage_index.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace cae {
+namespace {
+
+/** Nonzero while the library itself is running; its own I/O is not hooked */
+thread_local int hook_depth = 0;
+
+struct HookGuard {
+  HookGuard() { ++hook_depth; }
+  ~HookGuard() { --hook_depth; }
+};
+
+template <typename Fn> Fn Real(const char *name) {
+  return reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+}
+
+using OpenFn = int (*)(const char *, int, ...);
+using OpenatFn = int (*)(int, const char *, int, ...);
+using FopenFn = FILE *(*)(const char *, const char *);
+
+/**
+ * Staged files, their caches and the descriptors that read them
+ */
+class Interceptor {
+public:
+  static Interceptor &Get() {
+    static Interceptor instance;
+    return instance;
+  }
+
+  /** Whether any descriptor is tracked; checked before taking the lock */
+  bool HasTracked() const { return tracked_count_.load() > 0; }
+
+  /**
+   * Open a path, tracking the descriptor when it has a staged copy
+   * @param open_path Opens a path with the caller's flags and mode
+   */
+  template <typename OpenPath>
+  int Open(const char *path, OpenPath open_path) {
+    const StagedFile *file = index_.Find(path);
+    std::shared_ptr<StagedFileCache> cache = file ? GetCache(*file) : nullptr;
+    if (!cache) {
+      return Untrack(open_path(path));
+    }
+
+    int fd = open_path(path);
+    if (fd < 0 && errno == ENOENT) {
+      // The staged copy is all that is left of the source
+      if (!cache->Fill(0, cache->GetSize())) {
+        errno = EIO;
+        return -1;
+      }
+      Log("serving removed " + file->source_ + " from " + cache->GetPath());
+      return Untrack(open_path(cache->GetPath().c_str()));
+    }
+    if (fd >= 0) {
+      Track(fd, cache);
+      Log("serving " + file->source_ + " from " + file->dataset_);
+    }
+    return fd;
+  }
+
+  /** Fill the cache file of a staged path; empty to read the path itself */
+  std::string GetFilledPath(const char *path) {
+    const StagedFile *file = index_.Find(path);
+    std::shared_ptr<StagedFileCache> cache = file ? GetCache(*file) : nullptr;
+    if (!cache || !cache->Fill(0, cache->GetSize())) {
+      return "";
+    }
+    Log("serving " + file->source_ + " to stdio from " + cache->GetPath());
+    return cache->GetPath();
+  }
+
+  /**
+   * Cache behind a descriptor, or nullptr if it is not tracked or no
+   * longer refers to the file it was tracked for
+   */
+  std::shared_ptr<StagedFileCache> Find(int fd) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = fds_.find(fd);
+    if (it == fds_.end()) {
+      return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_dev != it->second.dev_ ||
+        st.st_ino != it->second.ino_) {
+      fds_.erase(it);
+      tracked_count_--;
+      return nullptr;
+    }
+    return it->second.cache_;
+  }
+
+  /** Track a descriptor, replacing whatever was tracked under its number */
+  void Track(int fd, std::shared_ptr<StagedFileCache> cache) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      Untrack(fd);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    Tracked &tracked = fds_[fd];
+    if (!tracked.cache_) {
+      tracked_count_++;
+    }
+    tracked.cache_ = std::move(cache);
+    tracked.dev_ = st.st_dev;
+    tracked.ino_ = st.st_ino;
+  }
+
+  /** Forget a descriptor; returns it */
+  int Untrack(int fd) {
+    if (fd < 0 || !HasTracked()) {
+      return fd;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (fds_.erase(fd)) {
+      tracked_count_--;
+    }
+    return fd;
+  }
+
+  /** Forget the descriptors in [first, last] */
+  void UntrackRange(unsigned int first, unsigned int last) {
+    if (!HasTracked()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto it = fds_.begin(); it != fds_.end();) {
+      unsigned int fd = static_cast<unsigned int>(it->first);
+      if (fd >= first && fd <= last) {
+        it = fds_.erase(it);
+        tracked_count_--;
+      } else {
+        ++it;
+      }
+    }
+  }
+
+private:
+  /** A tracked descriptor and the file it was opened on */
+  struct Tracked {
+    std::shared_ptr<StagedFileCache> cache_;
+    dev_t dev_ = 0;
+    ino_t ino_ = 0;
+  };
+
+  Interceptor() : tracked_count_(0), verbose_(false) {
+    HookGuard guard;
+    const char *verbose = getenv("CAE_INTERCEPT_VERBOSE");
+    verbose_ = verbose && *verbose && std::strcmp(verbose, "0") != 0;
+
+    const char *cache_dir = getenv("CAE_CACHE_DIR");
+    cache_dir_ = cache_dir && *cache_dir ? cache_dir
+                                         : PrivateDir::GetTempPath("cae_cache");
+
+    std::vector<std::string> dirs;
+    const char *stage = getenv("CAE_STAGE_DIR");
+    if (stage) {
+      std::stringstream ss(stage);
+      std::string dir;
+      while (std::getline(ss, dir, ':')) {
+        if (!dir.empty()) {
+          dirs.push_back(dir);
+        }
+      }
+    }
+    try {
+      index_.Load(dirs);
+    } catch (const std::exception &e) {
+      std::cerr << "cae_intercept: could not load staged data: " << e.what()
+                << std::endl;
+    }
+    Log("loaded " + std::to_string(index_.GetFileCount()) +
+        " staged file(s), cache " + cache_dir_);
+  }
+
+  std::shared_ptr<StagedFileCache> GetCache(const StagedFile &file) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = caches_.find(file.source_);
+    if (it != caches_.end()) {
+      return it->second;
+    }
+    std::shared_ptr<StagedFileCache> cache;
+    try {
+      cache = std::make_shared<StagedFileCache>(file, cache_dir_);
+    } catch (const std::exception &e) {
+      std::cerr << "cae_intercept: " << e.what() << std::endl;
+    }
+    caches_[file.source_] = cache; // A failure is not retried
+    return cache;
+  }
+
+  void Log(const std::string &message) const {
+    if (verbose_) {
+      std::cerr << "cae_intercept: " << message << std::endl;
+    }
+  }
+
+  StageIndex index_;
+  std::string cache_dir_;
+  std::mutex mtx_;
+  std::unordered_map<std::string, std::shared_ptr<StagedFileCache>> caches_;
+  std::unordered_map<int, Tracked> fds_;
+  std::atomic<size_t> tracked_count_;
+  bool verbose_;
+};
+
+/** Whether open flags only read */
+bool IsReadOnly(int flags) {
+  return (flags & O_ACCMODE) == O_RDONLY && !(flags & (O_CREAT | O_TRUNC));
+}
+
+/** Whether an fopen mode only reads */
+bool IsReadOnly(const char *mode) {
+  return mode && mode[0] == 'r' && !std::strchr(mode, '+');
+}
+
+/** Mode argument of open, present only when a file may be created */
+mode_t GetMode(int flags, va_list args) {
+  if (flags & (O_CREAT | O_TMPFILE)) {
+    return static_cast<mode_t>(va_arg(args, int));
+  }
+  return 0;
+}
+
+/** A descriptor opened past the interceptor; it replaces a stale entry */
+int Untracked(int fd) {
+  if (hook_depth) {
+    return fd; // The library's own files; Find still checks the file
+  }
+  HookGuard guard;
+  return Interceptor::Get().Untrack(fd);
+}
+
+int HookOpen(OpenFn real, const char *path, int flags, mode_t mode) {
+  if (hook_depth || !path || !IsReadOnly(flags)) {
+    return Untracked(real(path, flags, mode));
+  }
+  HookGuard guard;
+  return Interceptor::Get().Open(path, [&](const char *p) {
+    return real(p, flags, mode);
+  });
+}
+
+int HookOpenat(OpenatFn real, int dirfd, const char *path, int flags,
+               mode_t mode) {
+  // Relative paths under another directory are not resolved
+  if (hook_depth || !path || !IsReadOnly(flags) ||
+      (dirfd != AT_FDCWD && path[0] != '/')) {
+    return Untracked(real(dirfd, path, flags, mode));
+  }
+  HookGuard guard;
+  return Interceptor::Get().Open(path, [&](const char *p) {
+    return real(dirfd, p, flags, mode);
+  });
+}
+
+FILE *HookFopen(FopenFn real, const char *path, const char *mode) {
+  FILE *file = nullptr;
+  if (hook_depth || !path || !IsReadOnly(mode)) {
+    file = real(path, mode);
+  } else {
+    HookGuard guard;
+    std::string filled = Interceptor::Get().GetFilledPath(path);
+    file = real(filled.empty() ? path : filled.c_str(), mode);
+  }
+  if (file) {
+    Untracked(fileno(file));
+  }
+  return file;
+}
+
+/** Serve a positional read of a tracked descriptor; -2 if untracked */
+ssize_t HookPread(int fd, void *buf, size_t count, off_t offset) {
+  if (hook_depth || !Interceptor::Get().HasTracked()) {
+    return -2;
+  }
+  HookGuard guard;
+  std::shared_ptr<StagedFileCache> cache = Interceptor::Get().Find(fd);
+  if (!cache || offset < 0) {
+    return -2;
+  }
+  return cache->Read(buf, count, static_cast<size_t>(offset));
+}
+
+/** Serve a read at the file position of a tracked descriptor */
+ssize_t HookRead(int fd, void *buf, size_t count) {
+  if (hook_depth || !Interceptor::Get().HasTracked()) {
+    return -2;
+  }
+  HookGuard guard;
+  std::shared_ptr<StagedFileCache> cache = Interceptor::Get().Find(fd);
+  if (!cache) {
+    return -2;
+  }
+  off_t pos = lseek(fd, 0, SEEK_CUR);
+  if (pos < 0) {
+    return -2;
+  }
+  ssize_t n = cache->Read(buf, count, static_cast<size_t>(pos));
+  if (n > 0) {
+    lseek(fd, pos + n, SEEK_SET);
+  }
+  return n;
+}
+
+using MmapFn = void *(*)(void *, size_t, int, int, int, off_t);
+
+void *HookMmap(MmapFn real, void *addr, size_t length, int prot, int flags,
+               int fd, off_t offset) {
+  bool shared_write = (flags & MAP_SHARED) && (prot & PROT_WRITE);
+  if (hook_depth || fd < 0 || shared_write ||
+      !Interceptor::Get().HasTracked()) {
+    return real(addr, length, prot, flags, fd, offset);
+  }
+  HookGuard guard;
+  std::shared_ptr<StagedFileCache> cache = Interceptor::Get().Find(fd);
+  if (!cache || !cache->Fill(static_cast<size_t>(offset), length)) {
+    return real(addr, length, prot, flags, fd, offset);
+  }
+  return real(addr, length, prot, flags, cache->GetFd(), offset);
+}
+
+void HookDup(int oldfd, int newfd) {
+  if (newfd < 0 || hook_depth || !Interceptor::Get().HasTracked()) {
+    return;
+  }
+  HookGuard guard;
+  std::shared_ptr<StagedFileCache> cache = Interceptor::Get().Find(oldfd);
+  if (cache) {
+    Interceptor::Get().Track(newfd, cache);
+  }
+}
+
+void HookClose(int fd) {
+  if (hook_depth || !Interceptor::Get().HasTracked()) {
+    return;
+  }
+  HookGuard guard;
+  Interceptor::Get().Untrack(fd);
+}
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+void HookCloseRange(unsigned int first, unsigned int last, int flags) {
+  // Descriptors only marked close-on-exec stay open here
+  if (hook_depth || (flags & CLOSE_RANGE_CLOEXEC) ||
+      !Interceptor::Get().HasTracked()) {
+    return;
+  }
+  HookGuard guard;
+  Interceptor::Get().UntrackRange(first, last);
+}
+
+} // namespace
+} // namespace cae
+
+extern "C" {
+
+int open(const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = cae::GetMode(flags, args);
+  va_end(args);
+  static auto real = cae::Real<cae::OpenFn>("open");
+  return cae::HookOpen(real, path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = cae::GetMode(flags, args);
+  va_end(args);
+  static auto real = cae::Real<cae::OpenFn>("open64");
+  return cae::HookOpen(real, path, flags, mode);
+}
+
+int __open_2(const char *path, int flags) {
+  static auto real = cae::Real<cae::OpenFn>("open");
+  return cae::HookOpen(real, path, flags, 0);
+}
+
+int __open64_2(const char *path, int flags) {
+  static auto real = cae::Real<cae::OpenFn>("open64");
+  return cae::HookOpen(real, path, flags, 0);
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = cae::GetMode(flags, args);
+  va_end(args);
+  static auto real = cae::Real<cae::OpenatFn>("openat");
+  return cae::HookOpenat(real, dirfd, path, flags, mode);
+}
+
+int openat64(int dirfd, const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = cae::GetMode(flags, args);
+  va_end(args);
+  static auto real = cae::Real<cae::OpenatFn>("openat64");
+  return cae::HookOpenat(real, dirfd, path, flags, mode);
+}
+
+FILE *fopen(const char *path, const char *mode) {
+  static auto real = cae::Real<cae::FopenFn>("fopen");
+  return cae::HookFopen(real, path, mode);
+}
+
+FILE *fopen64(const char *path, const char *mode) {
+  static auto real = cae::Real<cae::FopenFn>("fopen64");
+  return cae::HookFopen(real, path, mode);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+  static auto real = cae::Real<ssize_t (*)(int, void *, size_t)>("read");
+  ssize_t n = cae::HookRead(fd, buf, count);
+  return n == -2 ? real(fd, buf, count) : n;
+}
+
+ssize_t __read_chk(int fd, void *buf, size_t count, size_t buflen) {
+  static auto real =
+      cae::Real<ssize_t (*)(int, void *, size_t, size_t)>("__read_chk");
+  if (count > buflen) {
+    return real(fd, buf, count, buflen); // Let libc report the overflow
+  }
+  ssize_t n = cae::HookRead(fd, buf, count);
+  return n == -2 ? real(fd, buf, count, buflen) : n;
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+  static auto real =
+      cae::Real<ssize_t (*)(int, void *, size_t, off_t)>("pread");
+  ssize_t n = cae::HookPread(fd, buf, count, offset);
+  return n == -2 ? real(fd, buf, count, offset) : n;
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset) {
+  static auto real =
+      cae::Real<ssize_t (*)(int, void *, size_t, off64_t)>("pread64");
+  ssize_t n = cae::HookPread(fd, buf, count, static_cast<off_t>(offset));
+  return n == -2 ? real(fd, buf, count, offset) : n;
+}
+
+ssize_t __pread_chk(int fd, void *buf, size_t count, off_t offset,
+                    size_t buflen) {
+  static auto real =
+      cae::Real<ssize_t (*)(int, void *, size_t, off_t, size_t)>(
+          "__pread_chk");
+  if (count > buflen) {
+    return real(fd, buf, count, offset, buflen);
+  }
+  ssize_t n = cae::HookPread(fd, buf, count, offset);
+  return n == -2 ? real(fd, buf, count, offset, buflen) : n;
+}
+
+ssize_t __pread64_chk(int fd, void *buf, size_t count, off64_t offset,
+                      size_t buflen) {
+  static auto real =
+      cae::Real<ssize_t (*)(int, void *, size_t, off64_t, size_t)>(
+          "__pread64_chk");
+  if (count > buflen) {
+    return real(fd, buf, count, offset, buflen);
+  }
+  ssize_t n = cae::HookPread(fd, buf, count, static_cast<off_t>(offset));
+  return n == -2 ? real(fd, buf, count, offset, buflen) : n;
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+           off_t offset) {
+  static auto real = cae::Real<cae::MmapFn>("mmap");
+  return cae::HookMmap(real, addr, length, prot, flags, fd, offset);
+}
+
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd,
+             off64_t offset) {
+  static auto real = cae::Real<cae::MmapFn>("mmap64");
+  return cae::HookMmap(real, addr, length, prot, flags, fd,
+                       static_cast<off_t>(offset));
+}
+
+int dup(int oldfd) {
+  static auto real = cae::Real<int (*)(int)>("dup");
+  int fd = real(oldfd);
+  cae::HookDup(oldfd, fd);
+  return fd;
+}
+
+int dup2(int oldfd, int newfd) {
+  static auto real = cae::Real<int (*)(int, int)>("dup2");
+  cae::HookClose(newfd);
+  int fd = real(oldfd, newfd);
+  cae::HookDup(oldfd, fd);
+  return fd;
+}
+
+int dup3(int oldfd, int newfd, int flags) {
+  static auto real = cae::Real<int (*)(int, int, int)>("dup3");
+  cae::HookClose(newfd);
+  int fd = real(oldfd, newfd, flags);
+  cae::HookDup(oldfd, fd);
+  return fd;
+}
+
+int close(int fd) {
+  static auto real = cae::Real<int (*)(int)>("close");
+  cae::HookClose(fd);
+  return real(fd);
+}
+
+int fclose(FILE *stream) {
+  static auto real = cae::Real<int (*)(FILE *)>("fclose");
+  if (stream) {
+    cae::HookClose(fileno(stream));
+  }
+  return real(stream);
+}
+
+int close_range(unsigned int first, unsigned int last, int flags) __THROW {
+  using CloseRangeFn = int (*)(unsigned int, unsigned int, int);
+  static auto real = cae::Real<CloseRangeFn>("close_range");
+  cae::HookCloseRange(first, last, flags);
+#ifdef SYS_close_range
+  if (!real) {
+    return static_cast<int>(syscall(SYS_close_range, first, last, flags));
+  }
+#endif
+  if (!real) {
+    errno = ENOSYS;
+    return -1;
+  }
+  return real(first, last, flags);
+}
+
+} // extern "C"
@@ -0,0 +1,251 @@
+#ifndef CAE_INTERCEPT_STAGE_CACHE_H_
+#define CAE_INTERCEPT_STAGE_CACHE_H_
+
+#include "io/private_dir.h"
+#include "stage_index.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Node-Local Cache of Staged Files:
+ *
+ * 1. Lazy Fill: A staged file is materialized block by block into a sparse
+ *    cache file the first time a block is read; holes are never written
+ * 2. Shared Between Processes: A one-byte-per-block map next to the cache
+ *    file records filled blocks, so every process on the node fills each
+ *    block at most once; a block is marked only after its data is written
+ * 3. Keyed by Copy: Cache files are named after the source, dataset and
+ *    staging time, so restaging a file never serves an older copy
+ * 4. Trust: The cache directory must be private to the user (see
+ *    io/private_dir.h) and its files are opened without following
+ *    symlinks. A block is checked against the XXH64 its shard index
+ *    records both after it is decoded and before a block another process
+ *    marked filled is served; a block that does not match is filled again
+ */
+
+namespace cae {
+
+/**
+ * Cache file of one staged file
+ * All methods are thread safe.
+ */
+class StagedFileCache {
+public:
+  /**
+   * Open (or create) the cache file of a staged file
+   * @param file Staged file; must outlive the cache
+   * @param cache_dir Node-local cache directory, created if needed; throws
+   *        if it is not private to the user
+   */
+  StagedFileCache(const StagedFile &file, const std::string &cache_dir)
+      : file_(file), data_fd_(-1), map_fd_(-1),
+        filled_(file.blocks_.size(), 0) {
+    PrivateDir::Ensure(cache_dir);
+    std::string base = cache_dir + "/" + file.GetCacheKey();
+    path_ = base + ".data";
+    int flags = O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC;
+    data_fd_ = open(path_.c_str(), flags, 0600);
+    map_fd_ = open((base + ".map").c_str(), flags, 0600);
+    if (data_fd_ < 0 || map_fd_ < 0) {
+      Close();
+      throw std::runtime_error("Could not open cache file " + base + ": " +
+                               std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(data_fd_, &st) == 0 &&
+        static_cast<size_t>(st.st_size) < file.size_) {
+      if (ftruncate(data_fd_, static_cast<off_t>(file.size_)) != 0) {
+        Close();
+        throw std::runtime_error("Could not size cache file " + base);
+      }
+    }
+    for (size_t i = 0; i < file.blocks_.size(); ++i) {
+      if (file.blocks_[i].hole_) {
+        filled_[i] = 1;
+      }
+    }
+  }
+
+  ~StagedFileCache() { Close(); }
+
+  StagedFileCache(const StagedFileCache &) = delete;
+  StagedFileCache &operator=(const StagedFileCache &) = delete;
+
+  /** Size of the file */
+  size_t GetSize() const { return file_.size_; }
+
+  /** Descriptor of the cache file; valid once a range has been filled */
+  int GetFd() const { return data_fd_; }
+
+  /** Path of the cache file */
+  const std::string &GetPath() const { return path_; }
+
+  /**
+   * Make sure a byte range is present in the cache file
+   * @return false if a block could not be read from its shard
+   */
+  bool Fill(size_t offset, size_t length) {
+    if (offset >= file_.size_ || length == 0) {
+      return true;
+    }
+    size_t end = std::min(file_.size_, offset + length);
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (size_t i = file_.FindBlock(offset);
+         i < file_.blocks_.size() && file_.blocks_[i].offset_ < end; ++i) {
+      if (!filled_[i] && !FillBlock(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Read from the staged file
+   * @return Bytes read, or -1 with errno set
+   */
+  ssize_t Read(void *buf, size_t count, size_t offset) {
+    if (offset >= file_.size_) {
+      return 0;
+    }
+    count = std::min(count, file_.size_ - offset);
+    if (!Fill(offset, count)) {
+      errno = EIO;
+      return -1;
+    }
+    return pread(data_fd_, buf, count, static_cast<off_t>(offset));
+  }
+
+private:
+  /** Copy one block from its shard into the cache file */
+  bool FillBlock(size_t i) {
+    const StagedBlock &block = file_.blocks_[i];
+    char mark = 0;
+    if (pread(map_fd_, &mark, 1, static_cast<off_t>(i)) == 1 && mark &&
+        block.has_xxh64_) {
+      // Filled by another process; served only if it still matches
+      raw_.resize(block.length_);
+      if (ReadFull(data_fd_, raw_.data(), raw_.size(), block.offset_) &&
+          Xxh64::Hash(raw_.data(), raw_.size()) == block.xxh64_) {
+        filled_[i] = 1;
+        return true;
+      }
+    }
+    int shard_fd = GetShardFd(block.shard_);
+    if (shard_fd < 0) {
+      return false;
+    }
+    // The block header carries the digest too; the index's wins if both
+    std::vector<char> stored(StageIndex::BLOCK_HEADER_SIZE + block.stored_);
+    if (!ReadFull(shard_fd, stored.data(), stored.size(),
+                  block.file_offset_) ||
+        std::memcmp(stored.data(), "CBLK", 4) != 0) {
+      return false;
+    }
+    uint64_t digest = 0;
+    for (int k = 7; k >= 0; --k) {
+      digest = (digest << 8) | static_cast<unsigned char>(stored[24 + k]);
+    }
+    if (block.has_xxh64_ && digest != block.xxh64_) {
+      return false;
+    }
+    try {
+      DecompressBlock(block.codec_,
+                      stored.data() + StageIndex::BLOCK_HEADER_SIZE,
+                      block.stored_, block.length_, raw_);
+    } catch (const std::exception &) {
+      return false;
+    }
+    if (Xxh64::Hash(raw_.data(), raw_.size()) != digest) {
+      return false;
+    }
+    if (!WriteFull(data_fd_, raw_.data(), raw_.size(), block.offset_)) {
+      return false;
+    }
+    mark = 1;
+    if (pwrite(map_fd_, &mark, 1, static_cast<off_t>(i)) != 1) {
+      return false;
+    }
+    filled_[i] = 1;
+    return true;
+  }
+
+  int GetShardFd(const std::string &shard) {
+    auto it = shard_fds_.find(shard);
+    if (it != shard_fds_.end()) {
+      return it->second;
+    }
+    int fd = open(shard.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      shard_fds_[shard] = fd;
+    }
+    return fd;
+  }
+
+  static bool ReadFull(int fd, char *buf, size_t len, size_t offset) {
+    while (len > 0) {
+      ssize_t n = pread(fd, buf, len, static_cast<off_t>(offset));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      buf += n;
+      len -= static_cast<size_t>(n);
+      offset += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  static bool WriteFull(int fd, const char *buf, size_t len, size_t offset) {
+    while (len > 0) {
+      ssize_t n = pwrite(fd, buf, len, static_cast<off_t>(offset));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      buf += n;
+      len -= static_cast<size_t>(n);
+      offset += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  void Close() {
+    for (auto &kv : shard_fds_) {
+      close(kv.second);
+    }
+    shard_fds_.clear();
+    if (data_fd_ >= 0) {
+      close(data_fd_);
+      data_fd_ = -1;
+    }
+    if (map_fd_ >= 0) {
+      close(map_fd_);
+      map_fd_ = -1;
+    }
+  }
+
+  const StagedFile &file_;
+  std::string path_;
+  int data_fd_;
+  int map_fd_;
+  std::vector<char> filled_; // Blocks known to be in the cache file
+  std::map<std::string, int> shard_fds_;
+  std::vector<char> raw_;
+  std::mutex mtx_;
+};
+
+} // namespace cae
+
+#endif // CAE_INTERCEPT_STAGE_CACHE_H_
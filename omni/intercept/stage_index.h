@@ -0,0 +1,270 @@
+#ifndef CAE_INTERCEPT_STAGE_INDEX_H_
+#define CAE_INTERCEPT_STAGE_INDEX_H_
+
+#include "io/block_codec.h"
+#include "util/hash.h"
+#include "util/json.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+/**
+ * Staged Data Lookup:
+ *
+ * 1. Sources: Container datasets written by the container sink (see
+ *    sink/container_sink.h) are scanned under each stage directory; their
+ *    shard indexes say which bytes of which source file every block holds
+ * 2. Complete Copies Only: A source is served only when the byte blocks and
+ *    holes of one dataset cover it from the first to the last byte, so a
+ *    served file never mixes staged and unstaged data
+ * 3. Freshness: A source whose size or mtime changed since it was staged is
+ *    not served; a source that no longer exists is served from its copy
+ * 4. Deduplicated Datasets: Blocks with a pack, and "ref" blocks, are read
+ *    from the chunk store pack they name instead of the dataset's shard
+ */
+
+namespace cae {
+
+/**
+ * A byte block or hole of a staged file
+ */
+struct StagedBlock {
+  size_t offset_; // Offset in the source file
+  size_t length_; // Raw bytes
+  bool hole_;
+  std::string shard_;  // Shard or pack holding the block
+  size_t file_offset_; // Offset of the block header in the shard
+  size_t stored_;      // Stored payload bytes
+  Codec codec_;
+  uint64_t xxh64_;     // Digest of the raw bytes, if has_xxh64_
+  bool has_xxh64_;
+
+  StagedBlock()
+      : offset_(0), length_(0), hole_(false), file_offset_(0), stored_(0),
+        codec_(Codec::kNone), xxh64_(0), has_xxh64_(false) {}
+};
+
+/**
+ * A source file with a complete staged copy
+ */
+struct StagedFile {
+  std::string source_;   // Canonical source path
+  std::string dataset_;  // Dataset directory
+  size_t size_;          // Bytes covered by the blocks
+  int64_t source_size_;  // Source size when staged, -1 if unknown
+  int64_t mtime_ns_;     // Source mtime when staged, -1 if unknown
+  int64_t staged_ns_;    // mtime of the newest shard index, for ordering
+  std::vector<StagedBlock> blocks_; // Sorted by offset, no gaps
+
+  StagedFile() : size_(0), source_size_(-1), mtime_ns_(-1), staged_ns_(0) {}
+
+  /** Key naming this copy in node-local caches */
+  std::string GetCacheKey() const {
+    std::string key = source_ + "\n" + dataset_ + "\n" +
+                      std::to_string(staged_ns_);
+    return Xxh64::ToHex(Xxh64::Hash(key.data(), key.size()));
+  }
+
+  /** Index of the block containing an offset */
+  size_t FindBlock(size_t offset) const {
+    auto it = std::upper_bound(
+        blocks_.begin(), blocks_.end(), offset,
+        [](size_t off, const StagedBlock &b) { return off < b.offset_; });
+    return it == blocks_.begin() ? 0 : (it - blocks_.begin()) - 1;
+  }
+};
+
+/**
+ * Index of every source file staged under a set of directories
+ */
+class StageIndex {
+public:
+  static constexpr size_t BLOCK_HEADER_SIZE = 32;
+
+  /**
+   * Scan stage directories for container datasets
+   * @param dirs Output directories of container jobs, or datasets themselves
+   */
+  void Load(const std::vector<std::string> &dirs) {
+    std::map<std::pair<std::string, std::string>, StagedFile> candidates;
+    for (const auto &dir : dirs) {
+      std::error_code ec;
+      std::filesystem::recursive_directory_iterator it(dir, ec), end;
+      for (; !ec && it != end; it.increment(ec)) {
+        if (it.depth() > 1) {
+          it.disable_recursion_pending();
+        }
+        std::string name = it->path().filename().string();
+        if (name.rfind("shard-", 0) == 0 &&
+            it->path().extension() == ".json") {
+          LoadShardIndex(it->path(), candidates);
+        }
+      }
+    }
+
+    for (auto &kv : candidates) {
+      StagedFile &file = kv.second;
+      if (!Finalize(file)) {
+        continue;
+      }
+      auto found = files_.find(file.source_);
+      if (found == files_.end() || found->second.staged_ns_ < file.staged_ns_) {
+        files_[file.source_] = std::move(file);
+      }
+    }
+  }
+
+  /**
+   * Staged copy of a path, if it is complete and still current
+   * @param path Path as opened by an application
+   * @return The staged file, or nullptr to read the path itself
+   */
+  const StagedFile *Find(const std::string &path) const {
+    if (files_.empty()) {
+      return nullptr;
+    }
+    auto it = files_.find(Canonical(path));
+    if (it == files_.end()) {
+      return nullptr;
+    }
+    const StagedFile &file = it->second;
+    struct stat st;
+    if (stat(file.source_.c_str(), &st) == 0 &&
+        (static_cast<size_t>(st.st_size) != file.size_ ||
+         (file.mtime_ns_ >= 0 && ToNs(st.st_mtim) != file.mtime_ns_))) {
+      return nullptr;
+    }
+    return &file;
+  }
+
+  /** Number of servable files */
+  size_t GetFileCount() const { return files_.size(); }
+
+private:
+  static int64_t ToNs(const struct timespec &ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  static std::string Canonical(const std::string &path) {
+    std::error_code ec;
+    std::string canonical =
+        std::filesystem::weakly_canonical(path, ec).string();
+    return ec ? path : canonical;
+  }
+
+  /** Add the byte blocks and holes of one shard index to its dataset */
+  static void LoadShardIndex(
+      const std::filesystem::path &index,
+      std::map<std::pair<std::string, std::string>, StagedFile> &candidates) {
+    std::ifstream in(index);
+    if (!in) {
+      return;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string dataset = index.parent_path().string();
+    std::string shard =
+        (index.parent_path() / index.stem()).string() + ".cae";
+    struct stat st;
+    int64_t staged_ns = stat(index.c_str(), &st) == 0 ? ToNs(st.st_mtim) : 0;
+
+    ForEachFlatObject(text.str(), [&](const JsonFields &fields) {
+      auto kind = fields.find("kind");
+      auto path = fields.find("path");
+      if (path != fields.end()) {
+        // Source size and mtime recorded when the shard was closed
+        StagedFile &file =
+            candidates[{dataset, Canonical(path->second)}];
+        file.source_size_ = GetInt(fields, "size", -1);
+        file.mtime_ns_ = GetInt(fields, "mtime_ns", -1);
+        return;
+      }
+      if (kind == fields.end() ||
+          (kind->second != "bytes" && kind->second != "ref" &&
+           kind->second != "hole")) {
+        return;
+      }
+      auto source = fields.find("source");
+      if (source == fields.end()) {
+        return;
+      }
+      StagedFile &file = candidates[{dataset, Canonical(source->second)}];
+      file.source_ = Canonical(source->second);
+      file.dataset_ = dataset;
+      file.staged_ns_ = std::max(file.staged_ns_, staged_ns);
+      StagedBlock block;
+      block.offset_ = static_cast<size_t>(GetInt(fields, "offset", 0));
+      block.length_ = static_cast<size_t>(GetInt(fields, "length", 0));
+      block.hole_ = kind->second == "hole";
+      if (!block.hole_) {
+        auto pack = fields.find("pack");
+        block.shard_ = pack == fields.end()
+                           ? shard
+                           : (index.parent_path() / pack->second).string();
+        block.file_offset_ =
+            static_cast<size_t>(GetInt(fields, "file_offset", 0));
+        block.stored_ = static_cast<size_t>(GetInt(fields, "stored", 0));
+        auto codec = fields.find("codec");
+        if (codec == fields.end() || !ParseCodec(codec->second, block.codec_)) {
+          return; // Written with a codec this build cannot decode
+        }
+        auto digest = fields.find("xxh64");
+        if (digest != fields.end() && !digest->second.empty()) {
+          char *end = nullptr;
+          block.xxh64_ = std::strtoull(digest->second.c_str(), &end, 16);
+          block.has_xxh64_ = *end == '\0';
+        }
+      }
+      file.blocks_.push_back(block);
+    });
+  }
+
+  static int64_t GetInt(const JsonFields &fields, const std::string &key,
+                        int64_t def) {
+    auto it = fields.find(key);
+    return it == fields.end() ? def : std::strtoll(it->second.c_str(),
+                                                   nullptr, 10);
+  }
+
+  /** Sort the blocks and check that they cover the file without gaps */
+  static bool Finalize(StagedFile &file) {
+    if (file.source_.empty() || file.blocks_.empty()) {
+      return false;
+    }
+    std::sort(file.blocks_.begin(), file.blocks_.end(),
+              [](const StagedBlock &a, const StagedBlock &b) {
+                return a.offset_ < b.offset_;
+              });
+    std::vector<StagedBlock> blocks;
+    size_t end = 0;
+    for (auto &block : file.blocks_) {
+      if (block.offset_ > end) {
+        return false;
+      }
+      if (block.offset_ + block.length_ <= end) {
+        continue; // Already covered by an overlapping import
+      }
+      if (block.offset_ < end) {
+        return false; // Partial overlap; blocks cannot be trimmed
+      }
+      end = block.offset_ + block.length_;
+      blocks.push_back(std::move(block));
+    }
+    file.blocks_ = std::move(blocks);
+    file.size_ = end;
+    return file.source_size_ < 0 ||
+           static_cast<size_t>(file.source_size_) == end;
+  }
+
+  std::map<std::string, StagedFile> files_;
+};
+
+} // namespace cae
+
+#endif // CAE_INTERCEPT_STAGE_INDEX_H_
@@ -0,0 +1,171 @@
+#ifndef CAE_IO_BLOCK_CODEC_H_
+#define CAE_IO_BLOCK_CODEC_H_
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef CAE_ENABLE_COMPRESSION
+#include <zlib.h>
+#endif
+
+#ifdef CAE_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * Block Compression for Output Containers:
+ *
+ * 1. Codecs: zstd when built with CAE_ENABLE_ZSTD, otherwise zlib; both run
+ *    at their fastest level so compression keeps up with the read loop
+ * 2. Self-Contained Blocks: Every block is compressed on its own, so
+ *    readers can decode any block without touching its neighbours
+ */
+
+namespace cae {
+
+/**
+ * Compression codec of an output block
+ */
+enum class Codec { kNone = 0, kZlib = 1, kZstd = 2 };
+
+/** Best codec available in this build */
+inline Codec DefaultCodec() {
+#if defined(CAE_ENABLE_ZSTD)
+  return Codec::kZstd;
+#elif defined(CAE_ENABLE_COMPRESSION)
+  return Codec::kZlib;
+#else
+  return Codec::kNone;
+#endif
+}
+
+/** Name of a codec */
+inline const char *CodecName(Codec codec) {
+  switch (codec) {
+  case Codec::kNone:
+    return "none";
+  case Codec::kZlib:
+    return "zlib";
+  case Codec::kZstd:
+    return "zstd";
+  }
+  return "unknown";
+}
+
+/**
+ * Parse a codec name ("auto", "none", "zlib", "zstd")
+ * @return false for unknown names and codecs missing from this build
+ */
+inline bool ParseCodec(const std::string &name, Codec &codec) {
+  if (name == "auto") {
+    codec = DefaultCodec();
+  } else if (name == "none") {
+    codec = Codec::kNone;
+#ifdef CAE_ENABLE_COMPRESSION
+  } else if (name == "zlib") {
+    codec = Codec::kZlib;
+#endif
+#ifdef CAE_ENABLE_ZSTD
+  } else if (name == "zstd") {
+    codec = Codec::kZstd;
+#endif
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Compress one block
+ * @param codec Codec to use
+ * @param data Uncompressed bytes
+ * @param len Number of uncompressed bytes
+ * @param out Compressed bytes (resized to fit)
+ */
+inline void CompressBlock(Codec codec, const char *data, size_t len,
+                          std::vector<char> &out) {
+  switch (codec) {
+#ifdef CAE_ENABLE_COMPRESSION
+  case Codec::kZlib: {
+    uLongf bound = compressBound(static_cast<uLong>(len));
+    out.resize(bound);
+    if (compress2(reinterpret_cast<Bytef *>(out.data()), &bound,
+                  reinterpret_cast<const Bytef *>(data),
+                  static_cast<uLong>(len), Z_BEST_SPEED) != Z_OK) {
+      throw std::runtime_error("zlib compression failed");
+    }
+    out.resize(bound);
+    return;
+  }
+#endif
+#ifdef CAE_ENABLE_ZSTD
+  case Codec::kZstd: {
+    out.resize(ZSTD_compressBound(len));
+    size_t n = ZSTD_compress(out.data(), out.size(), data, len, 1);
+    if (ZSTD_isError(n)) {
+      throw std::runtime_error(std::string("zstd compression failed: ") +
+                               ZSTD_getErrorName(n));
+    }
+    out.resize(n);
+    return;
+  }
+#endif
+  case Codec::kNone:
+    out.assign(data, data + len);
+    return;
+  default:
+    throw std::runtime_error(std::string("Codec not available: ") +
+                             CodecName(codec));
+  }
+}
+
+/**
+ * Decompress one block
+ * @param codec Codec the block was written with
+ * @param data Compressed bytes
+ * @param len Number of compressed bytes
+ * @param raw_len Number of uncompressed bytes
+ * @param out Uncompressed bytes (resized to raw_len)
+ */
+inline void DecompressBlock(Codec codec, const char *data, size_t len,
+                            size_t raw_len, std::vector<char> &out) {
+  out.resize(raw_len);
+  switch (codec) {
+#ifdef CAE_ENABLE_COMPRESSION
+  case Codec::kZlib: {
+    uLongf n = static_cast<uLongf>(raw_len);
+    if (uncompress(reinterpret_cast<Bytef *>(out.data()), &n,
+                   reinterpret_cast<const Bytef *>(data),
+                   static_cast<uLong>(len)) != Z_OK ||
+        n != raw_len) {
+      throw std::runtime_error("Corrupt zlib block");
+    }
+    return;
+  }
+#endif
+#ifdef CAE_ENABLE_ZSTD
+  case Codec::kZstd: {
+    size_t n = ZSTD_decompress(out.data(), raw_len, data, len);
+    if (ZSTD_isError(n) || n != raw_len) {
+      throw std::runtime_error("Corrupt zstd block");
+    }
+    return;
+  }
+#endif
+  case Codec::kNone:
+    if (len != raw_len) {
+      throw std::runtime_error("Corrupt stored block");
+    }
+    out.assign(data, data + len);
+    return;
+  default:
+    throw std::runtime_error(std::string("Codec not available: ") +
+                             CodecName(codec));
+  }
+}
+
+} // namespace cae
+
+#endif // CAE_IO_BLOCK_CODEC_H_
@@ -0,0 +1,262 @@
+#ifndef CAE_IO_CHUNK_READER_H_
+#define CAE_IO_CHUNK_READER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Chunked Range Reading Strategy:
+ *
+ * 1. I/O Engines: stdio (fread), POSIX pread, and mmap are interchangeable
+ *    behind one read loop so they can be compared on the same storage
+ * 2. Queue Depth: The pread engine keeps up to queue_depth chunk requests
+ *    in flight, one per reader thread, pulling chunk indices from a shared
+ *    counter
+ * 3. Callbacks: Every chunk is handed to a callback with its absolute file
+ *    offset; with queue_depth > 1 callbacks run concurrently and out of order
+ */
+
+namespace cae {
+
+/**
+ * I/O engine used to read a byte range
+ */
+enum class IoEngine { kStdio, kPread, kMmap };
+
+/** Parse an engine name ("stdio", "pread", "mmap") */
+inline bool ParseIoEngine(const std::string &name, IoEngine &engine) {
+  if (name == "stdio") {
+    engine = IoEngine::kStdio;
+  } else if (name == "pread") {
+    engine = IoEngine::kPread;
+  } else if (name == "mmap") {
+    engine = IoEngine::kMmap;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/** Name of an engine */
+inline const char *IoEngineName(IoEngine engine) {
+  switch (engine) {
+  case IoEngine::kStdio:
+    return "stdio";
+  case IoEngine::kPread:
+    return "pread";
+  case IoEngine::kMmap:
+    return "mmap";
+  }
+  return "unknown";
+}
+
+/**
+ * Options controlling how a range is read
+ */
+struct ChunkReaderOptions {
+  size_t chunk_size_;
+  int queue_depth_;
+  IoEngine engine_;
+
+  ChunkReaderOptions()
+      : chunk_size_(1024 * 1024), queue_depth_(1), engine_(IoEngine::kPread) {}
+};
+
+/**
+ * Reads a byte range of a file chunk by chunk
+ */
+class ChunkReader {
+public:
+  /** Callback receiving (absolute offset, data, length) for every chunk */
+  using ChunkCallback = std::function<void(size_t, const char *, size_t)>;
+
+  explicit ChunkReader(const ChunkReaderOptions &opts = ChunkReaderOptions())
+      : opts_(opts) {
+    opts_.chunk_size_ = std::max<size_t>(opts_.chunk_size_, 1);
+    opts_.queue_depth_ = std::max(opts_.queue_depth_, 1);
+  }
+
+  /** Options in effect */
+  const ChunkReaderOptions &GetOptions() const { return opts_; }
+
+  /**
+   * Read [offset, offset + size) of a file
+   * @param path File path
+   * @param offset Starting offset in bytes
+   * @param size Number of bytes to read
+   * @param callback Invoked once per chunk read
+   * @return Number of bytes delivered to the callback
+   */
+  size_t Read(const std::string &path, size_t offset, size_t size,
+              const ChunkCallback &callback) const {
+    switch (opts_.engine_) {
+    case IoEngine::kStdio:
+      return ReadStdio(path, offset, size, callback);
+    case IoEngine::kMmap:
+      return ReadMmap(path, offset, size, callback);
+    case IoEngine::kPread:
+    default:
+      return ReadPread(path, offset, size, callback);
+    }
+  }
+
+private:
+  size_t ReadStdio(const std::string &path, size_t offset, size_t size,
+                   const ChunkCallback &callback) const {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+      std::cerr << "Error: Failed to open file " << path << std::endl;
+      return 0;
+    }
+    if (fseeko(file, static_cast<off_t>(offset), SEEK_SET) != 0) {
+      std::cerr << "Error: Failed to seek to offset " << offset << " in file "
+                << path << std::endl;
+      fclose(file);
+      return 0;
+    }
+
+    std::vector<char> buffer(opts_.chunk_size_);
+    size_t total_read = 0;
+    while (total_read < size) {
+      size_t want = std::min(size - total_read, opts_.chunk_size_);
+      size_t got = fread(buffer.data(), 1, want, file);
+      if (got == 0) {
+        break;
+      }
+      callback(offset + total_read, buffer.data(), got);
+      total_read += got;
+    }
+    fclose(file);
+    return total_read;
+  }
+
+  size_t ReadPread(const std::string &path, size_t offset, size_t size,
+                   const ChunkCallback &callback) const {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Error: Failed to open file " << path << ": "
+                << strerror(errno) << std::endl;
+      return 0;
+    }
+
+    size_t nchunks = (size + opts_.chunk_size_ - 1) / opts_.chunk_size_;
+    std::atomic<size_t> next_chunk(0);
+    std::atomic<size_t> total_read(0);
+
+    auto worker = [&]() {
+      std::vector<char> buffer(opts_.chunk_size_);
+      size_t idx;
+      while ((idx = next_chunk.fetch_add(1)) < nchunks) {
+        size_t chunk_off = idx * opts_.chunk_size_;
+        size_t want = std::min(size - chunk_off, opts_.chunk_size_);
+        size_t got = PreadFull(fd, buffer.data(), want, offset + chunk_off);
+        if (got > 0) {
+          callback(offset + chunk_off, buffer.data(), got);
+          total_read += got;
+        }
+        if (got < want) {
+          break;
+        }
+      }
+    };
+
+    int nthreads = static_cast<int>(
+        std::min<size_t>(static_cast<size_t>(opts_.queue_depth_), nchunks));
+    if (nthreads <= 1) {
+      worker();
+    } else {
+      std::vector<std::thread> threads;
+      for (int i = 0; i < nthreads; ++i) {
+        threads.emplace_back(worker);
+      }
+      for (auto &t : threads) {
+        t.join();
+      }
+    }
+
+    close(fd);
+    return total_read.load();
+  }
+
+  size_t ReadMmap(const std::string &path, size_t offset, size_t size,
+                  const ChunkCallback &callback) const {
+    if (size == 0) {
+      return 0;
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Error: Failed to open file " << path << ": "
+                << strerror(errno) << std::endl;
+      return 0;
+    }
+
+    // Never map past EOF: touching those pages raises SIGBUS
+    struct stat st;
+    if (fstat(fd, &st) != 0 || offset >= static_cast<size_t>(st.st_size)) {
+      close(fd);
+      return 0;
+    }
+    size = std::min(size, static_cast<size_t>(st.st_size) - offset);
+
+    // mmap offsets must be page aligned
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t map_off = offset - (offset % page);
+    size_t lead = offset - map_off;
+    void *addr = mmap(nullptr, size + lead, PROT_READ, MAP_PRIVATE, fd,
+                      static_cast<off_t>(map_off));
+    close(fd);
+    if (addr == MAP_FAILED) {
+      std::cerr << "Error: Failed to mmap file " << path << ": "
+                << strerror(errno) << std::endl;
+      return 0;
+    }
+    madvise(addr, size + lead, MADV_SEQUENTIAL);
+
+    const char *base = static_cast<const char *>(addr) + lead;
+    for (size_t done = 0; done < size; done += opts_.chunk_size_) {
+      size_t len = std::min(size - done, opts_.chunk_size_);
+      callback(offset + done, base + done, len);
+    }
+    munmap(addr, size + lead);
+    return size;
+  }
+
+  static size_t PreadFull(int fd, char *buf, size_t len, size_t offset) {
+    size_t done = 0;
+    while (done < len) {
+      ssize_t ret = pread(fd, buf + done, len - done,
+                          static_cast<off_t>(offset + done));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "Error: pread failed at offset " << offset + done << ": "
+                  << strerror(errno) << std::endl;
+        break;
+      }
+      if (ret == 0) {
+        break;
+      }
+      done += static_cast<size_t>(ret);
+    }
+    return done;
+  }
+
+  ChunkReaderOptions opts_;
+};
+
+} // namespace cae
+
+#endif // CAE_IO_CHUNK_READER_H_
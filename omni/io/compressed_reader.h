@@ -0,0 +1,898 @@
+#ifndef CAE_IO_COMPRESSED_READER_H_
+#define CAE_IO_COMPRESSED_READER_H_
+
+#include "io/private_dir.h"
+#include "util/hash.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef CAE_ENABLE_COMPRESSION
+#include <bzlib.h>
+#include <zlib.h>
+#endif
+
+#ifdef CAE_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * Seekable Compressed Inputs:
+ *
+ * 1. Access Points: A one-time pass over the compressed file records where
+ *    decoding can resume, roughly every DEFAULT_SPAN uncompressed bytes;
+ *    gzip points keep the 32KB history window and bit position (as in
+ *    zlib's zran example), bzip2 and zstd points sit on stream/frame starts
+ * 2. Index Cache: The access points are saved under $CAE_INDEX_DIR (default
+ *    ~/.cache/cae/index, or the private $TMPDIR/cae_index-<uid> without
+ *    HOME), keyed by path and checked against size and mtime, so later jobs
+ *    and other ranks skip the pass. Within a process, each file has its own
+ *    lock, so one file's pass does not hold up lookups of the others
+ * 3. Random Access: A range in uncompressed coordinates is decoded from the
+ *    nearest access point before it, so ranks and threads can decompress
+ *    disjoint ranges of one file in parallel
+ * 4. zstd: Seek tables of the zstd seekable format are used directly; zstd
+ *    support needs CAE_ENABLE_ZSTD
+ */
+
+namespace cae {
+
+/**
+ * Compression format of an input file
+ */
+enum class Compression { kNone, kGzip, kBzip2, kZstd };
+
+/** Name of a compression format */
+inline const char *CompressionName(Compression compression) {
+  switch (compression) {
+  case Compression::kNone:
+    return "none";
+  case Compression::kGzip:
+    return "gzip";
+  case Compression::kBzip2:
+    return "bzip2";
+  case Compression::kZstd:
+    return "zstd";
+  }
+  return "unknown";
+}
+
+/** Detect the compression of an open file from its magic bytes */
+inline Compression DetectCompression(int fd) {
+  unsigned char magic[4] = {0, 0, 0, 0};
+  ssize_t n = pread(fd, magic, sizeof(magic), 0);
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return Compression::kGzip;
+  }
+  if (n >= 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h') {
+    return Compression::kBzip2;
+  }
+  if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd) {
+    return Compression::kZstd;
+  }
+  return Compression::kNone;
+}
+
+/**
+ * A point where decoding can resume
+ */
+struct CompressedBlock {
+  size_t comp_offset_;   // First compressed byte to feed the decoder
+  size_t uncomp_offset_; // Uncompressed offset of the first decoded byte
+  int bits_;             // gzip: bits of the byte before comp_offset_ to prime
+  bool stream_start_;    // Decoding starts at a member/stream/frame header
+  std::vector<unsigned char> window_; // gzip: history for raw inflate
+
+  CompressedBlock()
+      : comp_offset_(0), uncomp_offset_(0), bits_(0), stream_start_(true) {}
+  CompressedBlock(size_t comp_offset, size_t uncomp_offset)
+      : comp_offset_(comp_offset), uncomp_offset_(uncomp_offset), bits_(0),
+        stream_start_(true) {}
+};
+
+/**
+ * Access-point index of a compressed file
+ */
+class CompressedIndex {
+public:
+  static constexpr size_t DEFAULT_SPAN = 1024 * 1024; // 1MB between points
+  static constexpr size_t WINDOW_SIZE = 32768;        // Deflate history
+
+  Compression compression_;
+  size_t file_size_;
+  int64_t mtime_ns_;
+  size_t uncompressed_size_;
+  std::vector<CompressedBlock> blocks_;
+
+  CompressedIndex()
+      : compression_(Compression::kNone), file_size_(0), mtime_ns_(0),
+        uncompressed_size_(0) {}
+
+  /** Index of the last access point at or before an uncompressed offset */
+  size_t FindBlock(size_t offset) const {
+    auto it = std::upper_bound(
+        blocks_.begin(), blocks_.end(), offset,
+        [](size_t off, const CompressedBlock &b) {
+          return off < b.uncomp_offset_;
+        });
+    return it == blocks_.begin() ? 0 : (it - blocks_.begin()) - 1;
+  }
+
+  /** Largest uncompressed distance between consecutive access points */
+  size_t GetMaxSpan() const {
+    size_t span = 0;
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      size_t next = i + 1 < blocks_.size() ? blocks_[i + 1].uncomp_offset_
+                                           : uncompressed_size_;
+      span = std::max(span, next - blocks_[i].uncomp_offset_);
+    }
+    return span;
+  }
+
+  /**
+   * Split an uncompressed range into parts that start at access points, so
+   * no part decodes bytes another part owns
+   * @param begin First uncompressed byte
+   * @param end One past the last uncompressed byte
+   * @param nparts Number of parts
+   * @return nparts + 1 boundaries
+   */
+  std::vector<size_t> Split(size_t begin, size_t end, int nparts) const {
+    nparts = std::max(nparts, 1);
+    std::vector<size_t> bounds(static_cast<size_t>(nparts) + 1, end);
+    bounds[0] = begin;
+    for (int p = 1; p < nparts; ++p) {
+      size_t target = begin + (end - begin) / nparts * p;
+      size_t snapped = blocks_.empty()
+                           ? target
+                           : blocks_[FindBlock(target)].uncomp_offset_;
+      bounds[p] = std::min(std::max(snapped, bounds[p - 1]), end);
+    }
+    return bounds;
+  }
+
+  /**
+   * Where the index of a file is cached; empty if it cannot be cached. The
+   * fallback under $TMPDIR must be private, since another user could plant
+   * access points there
+   */
+  static std::string GetCachePath(const std::string &path) {
+    std::string dir;
+    if (const char *env = getenv("CAE_INDEX_DIR")) {
+      dir = env;
+    } else if (const char *home = getenv("HOME")) {
+      dir = std::string(home) + "/.cache/cae/index";
+    } else {
+      dir = PrivateDir::GetTempPath("cae_index");
+      try {
+        PrivateDir::Ensure(dir);
+      } catch (const std::exception &e) {
+        static std::once_flag warned;
+        std::call_once(warned, [&] {
+          std::cerr << "Warning: " << e.what()
+                    << "; compressed-file indexes are not cached" << std::endl;
+        });
+        return std::string();
+      }
+    }
+    std::error_code ec;
+    std::string key = std::filesystem::weakly_canonical(path, ec).string();
+    if (ec) {
+      key = path;
+    }
+    return dir + "/" + Xxh64::ToHex(Xxh64::Hash(key.data(), key.size())) +
+           ".cidx";
+  }
+
+  /**
+   * Index of a file, from this process's cache, the on-disk cache, or a
+   * fresh build (which is then cached). Only callers of the same file wait
+   * for a build; other files are looked up and built meanwhile
+   * @param path Compressed file
+   * @param compression Format of the file
+   * @return Shared, immutable index
+   */
+  static std::shared_ptr<const CompressedIndex> Get(const std::string &path,
+                                                    Compression compression) {
+    struct Entry {
+      std::mutex mtx_; // Held while the file's index is loaded or built
+      std::shared_ptr<const CompressedIndex> index_;
+    };
+    static std::mutex mtx; // Guards the map only
+    static std::map<std::string, std::shared_ptr<Entry>> cache;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      throw std::runtime_error("Could not stat file: " + path);
+    }
+    size_t file_size = static_cast<size_t>(st.st_size);
+    int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                       st.st_mtim.tv_nsec;
+
+    std::shared_ptr<Entry> entry;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      std::shared_ptr<Entry> &slot = cache[path];
+      if (!slot) {
+        slot = std::make_shared<Entry>();
+      }
+      entry = slot;
+    }
+    std::lock_guard<std::mutex> lock(entry->mtx_);
+    if (entry->index_ && entry->index_->file_size_ == file_size &&
+        entry->index_->mtime_ns_ == mtime_ns) {
+      return entry->index_;
+    }
+
+    auto index = std::make_shared<CompressedIndex>();
+    std::string index_path = GetCachePath(path);
+    if (index_path.empty() || !index->Load(index_path) ||
+        index->compression_ != compression ||
+        index->file_size_ != file_size || index->mtime_ns_ != mtime_ns) {
+      *index = Build(path, compression);
+      index->file_size_ = file_size;
+      index->mtime_ns_ = mtime_ns;
+      if (!index_path.empty()) {
+        index->Save(index_path); // Best effort; the index is still usable
+      }
+    }
+    entry->index_ = index;
+    return index;
+  }
+
+  /**
+   * Decode a whole file once and record its access points
+   * @param path Compressed file
+   * @param compression Format of the file
+   * @param span Uncompressed bytes between access points
+   */
+  static CompressedIndex Build(const std::string &path, Compression compression,
+                               size_t span = DEFAULT_SPAN) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open file: " + path);
+    }
+    CompressedIndex index;
+    index.compression_ = compression;
+    index.blocks_.emplace_back(0, 0);
+    try {
+      switch (compression) {
+      case Compression::kGzip:
+        BuildGzip(fd, span, index);
+        break;
+      case Compression::kBzip2:
+        BuildBzip2(fd, span, index);
+        break;
+      case Compression::kZstd:
+        BuildZstd(fd, span, index);
+        break;
+      case Compression::kNone:
+      default:
+        throw std::runtime_error("File is not compressed: " + path);
+      }
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+    close(fd);
+    return index;
+  }
+
+  /** Write the index; returns false if the cache is not writable */
+  bool Save(const std::string &index_path) const {
+    std::error_code ec;
+    std::filesystem::create_directories(
+        std::filesystem::path(index_path).parent_path(), ec);
+    // Write then rename, so concurrent readers never see a partial index
+    std::string tmp = index_path + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    if (!out) {
+      return false;
+    }
+    out.write(MAGIC, sizeof(MAGIC));
+    WriteU64(out, static_cast<uint64_t>(compression_));
+    WriteU64(out, static_cast<uint64_t>(file_size_));
+    WriteU64(out, static_cast<uint64_t>(mtime_ns_));
+    WriteU64(out, static_cast<uint64_t>(uncompressed_size_));
+    WriteU64(out, static_cast<uint64_t>(blocks_.size()));
+    for (const auto &b : blocks_) {
+      WriteU64(out, static_cast<uint64_t>(b.comp_offset_));
+      WriteU64(out, static_cast<uint64_t>(b.uncomp_offset_));
+      WriteU64(out, static_cast<uint64_t>(b.bits_) |
+                   (b.stream_start_ ? (1ULL << 8) : 0));
+      WriteU64(out, static_cast<uint64_t>(b.window_.size()));
+      out.write(reinterpret_cast<const char *>(b.window_.data()),
+                static_cast<std::streamsize>(b.window_.size()));
+    }
+    out.close();
+    if (!out || rename(tmp.c_str(), index_path.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /** Read a saved index; returns false if missing or malformed */
+  bool Load(const std::string &index_path) {
+    std::ifstream in(index_path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+      return false;
+    }
+    uint64_t compression, file_size, mtime_ns, uncompressed_size, count;
+    if (!ReadU64(in, compression) || !ReadU64(in, file_size) || !ReadU64(in, mtime_ns) ||
+        !ReadU64(in, uncompressed_size) || !ReadU64(in, count)) {
+      return false;
+    }
+    std::vector<CompressedBlock> blocks;
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t comp, uncomp, flags, window;
+      if (!ReadU64(in, comp) || !ReadU64(in, uncomp) || !ReadU64(in, flags) ||
+          !ReadU64(in, window) || window > WINDOW_SIZE) {
+        return false;
+      }
+      CompressedBlock b(comp, uncomp);
+      b.bits_ = static_cast<int>(flags & 0xff);
+      b.stream_start_ = (flags >> 8) & 1;
+      b.window_.resize(window);
+      if (!in.read(reinterpret_cast<char *>(b.window_.data()),
+                   static_cast<std::streamsize>(window))) {
+        return false;
+      }
+      blocks.push_back(std::move(b));
+    }
+    compression_ = static_cast<Compression>(compression);
+    file_size_ = file_size;
+    mtime_ns_ = static_cast<int64_t>(mtime_ns);
+    uncompressed_size_ = uncompressed_size;
+    blocks_.swap(blocks);
+    return !blocks_.empty();
+  }
+
+private:
+  static constexpr char MAGIC[8] = {'C', 'A', 'E', 'C', 'I', 'D', 'X', '1'};
+  static constexpr size_t INPUT_CHUNK = 256 * 1024;
+
+  static void WriteU64(std::ofstream &out, uint64_t value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  static bool ReadU64(std::ifstream &in, uint64_t &value) {
+    return static_cast<bool>(
+        in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+  }
+
+  /** Read the next input chunk; returns bytes read */
+  static size_t ReadInput(int fd, size_t &pos, unsigned char *buf,
+                          size_t len) {
+    ssize_t n;
+    do {
+      n = pread(fd, buf, len, static_cast<off_t>(pos));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+      throw std::runtime_error(std::string("Read failed: ") +
+                               std::strerror(errno));
+    }
+    pos += static_cast<size_t>(n);
+    return static_cast<size_t>(n);
+  }
+
+  static void BuildGzip(int fd, size_t span, CompressedIndex &index) {
+#ifdef CAE_ENABLE_COMPRESSION
+    std::vector<unsigned char> in(INPUT_CHUNK);
+    std::vector<unsigned char> window(WINDOW_SIZE);
+    z_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 47) != Z_OK) { // gzip or zlib header
+      throw std::runtime_error("inflateInit2 failed");
+    }
+
+    size_t file_pos = 0;
+    size_t totin = 0;  // Compressed bytes consumed
+    size_t totout = 0; // Uncompressed bytes produced
+    size_t last = 0;   // Uncompressed offset of the last access point
+    strm.avail_out = 0;
+    for (;;) {
+      if (strm.avail_in == 0) {
+        strm.avail_in = static_cast<uInt>(
+            ReadInput(fd, file_pos, in.data(), in.size()));
+        strm.next_in = in.data();
+        if (strm.avail_in == 0) {
+          inflateEnd(&strm);
+          throw std::runtime_error("Truncated gzip stream");
+        }
+      }
+      if (strm.avail_out == 0) {
+        strm.avail_out = WINDOW_SIZE;
+        strm.next_out = window.data();
+      }
+
+      totin += strm.avail_in;
+      totout += strm.avail_out;
+      int ret = inflate(&strm, Z_BLOCK); // Stop at deflate block boundaries
+      totin -= strm.avail_in;
+      totout -= strm.avail_out;
+      if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
+        inflateEnd(&strm);
+        throw std::runtime_error("Corrupt gzip stream");
+      }
+
+      if (ret == Z_STREAM_END) {
+        // Concatenated members (pigz, bgzf) continue after the trailer
+        if (strm.avail_in == 0) {
+          strm.avail_in = static_cast<uInt>(
+              ReadInput(fd, file_pos, in.data(), in.size()));
+          strm.next_in = in.data();
+        }
+        if (strm.avail_in == 0 || strm.next_in[0] != 0x1f) {
+          break;
+        }
+        inflateReset(&strm);
+        if (totout - last >= span) {
+          index.blocks_.emplace_back(totin, totout);
+          last = totout;
+        }
+        continue;
+      }
+
+      // At the end of a deflate block that is not the last one, state is
+      // fully described by the bit position and the 32KB history
+      bool boundary = (strm.data_type & 128) && !(strm.data_type & 64);
+      if (boundary && totout - last >= span) {
+        CompressedBlock b(totin, totout);
+        b.bits_ = strm.data_type & 7;
+        b.stream_start_ = false;
+        size_t history = std::min<size_t>(totout, WINDOW_SIZE);
+        b.window_.resize(history);
+        // The history buffer is circular; unroll it oldest byte first
+        size_t left = strm.avail_out;
+        std::vector<unsigned char> ordered(WINDOW_SIZE);
+        std::memcpy(ordered.data(), window.data() + WINDOW_SIZE - left, left);
+        std::memcpy(ordered.data() + left, window.data(), WINDOW_SIZE - left);
+        std::memcpy(b.window_.data(), ordered.data() + WINDOW_SIZE - history,
+                    history);
+        index.blocks_.push_back(std::move(b));
+        last = totout;
+      }
+    }
+    inflateEnd(&strm);
+    index.uncompressed_size_ = totout;
+#else
+    (void)fd;
+    (void)span;
+    (void)index;
+    throw std::runtime_error("gzip support requires CAE_ENABLE_COMPRESSION");
+#endif
+  }
+
+  static void BuildBzip2(int fd, size_t span, CompressedIndex &index) {
+#ifdef CAE_ENABLE_COMPRESSION
+    // Only stream starts are byte aligned, so multi-stream files (pbzip2,
+    // lbzip2) get one access point per stream and single streams get one
+    std::vector<unsigned char> in(INPUT_CHUNK);
+    std::vector<char> out(INPUT_CHUNK * 4);
+    bz_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+      throw std::runtime_error("BZ2_bzDecompressInit failed");
+    }
+
+    size_t file_pos = 0;
+    size_t totin = 0;
+    size_t totout = 0;
+    size_t last = 0;
+    for (;;) {
+      if (strm.avail_in == 0) {
+        strm.avail_in = static_cast<unsigned>(
+            ReadInput(fd, file_pos, in.data(), in.size()));
+        strm.next_in = reinterpret_cast<char *>(in.data());
+        if (strm.avail_in == 0) {
+          BZ2_bzDecompressEnd(&strm);
+          throw std::runtime_error("Truncated bzip2 stream");
+        }
+      }
+      strm.next_out = out.data();
+      strm.avail_out = static_cast<unsigned>(out.size());
+
+      unsigned avail_in = strm.avail_in;
+      int ret = BZ2_bzDecompress(&strm);
+      totin += avail_in - strm.avail_in;
+      totout += out.size() - strm.avail_out;
+      if (ret != BZ_OK && ret != BZ_STREAM_END) {
+        BZ2_bzDecompressEnd(&strm);
+        throw std::runtime_error("Corrupt bzip2 stream");
+      }
+
+      if (ret == BZ_STREAM_END) {
+        char *next_in = strm.next_in;
+        unsigned rest = strm.avail_in;
+        BZ2_bzDecompressEnd(&strm);
+        if (rest == 0) {
+          rest = static_cast<unsigned>(
+              ReadInput(fd, file_pos, in.data(), in.size()));
+          next_in = reinterpret_cast<char *>(in.data());
+        }
+        if (rest == 0 || next_in[0] != 'B') {
+          break;
+        }
+        std::memset(&strm, 0, sizeof(strm));
+        BZ2_bzDecompressInit(&strm, 0, 0);
+        strm.next_in = next_in;
+        strm.avail_in = rest;
+        if (totout - last >= span) {
+          index.blocks_.emplace_back(totin, totout);
+          last = totout;
+        }
+      }
+    }
+    index.uncompressed_size_ = totout;
+#else
+    (void)fd;
+    (void)span;
+    (void)index;
+    throw std::runtime_error("bzip2 support requires CAE_ENABLE_COMPRESSION");
+#endif
+  }
+
+  static void BuildZstd(int fd, size_t span, CompressedIndex &index) {
+#ifdef CAE_ENABLE_ZSTD
+    // Seekable format: the last skippable frame holds the frame sizes
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= 9) {
+      size_t file_size = static_cast<size_t>(st.st_size);
+      unsigned char footer[9];
+      size_t pos = file_size - sizeof(footer);
+      if (ReadInput(fd, pos, footer, sizeof(footer)) == sizeof(footer) &&
+          ReadLe32(footer + 5) == 0x8F92EAB1) {
+        uint32_t nframes = ReadLe32(footer);
+        size_t entry = (footer[4] & 0x80) ? 12 : 8;
+        size_t table = nframes * entry;
+        if (table + sizeof(footer) + 8 <= file_size) {
+          std::vector<unsigned char> entries(table);
+          size_t tpos = file_size - sizeof(footer) - table;
+          if (ReadInput(fd, tpos, entries.data(), table) == table) {
+            size_t comp = 0, uncomp = 0, last = 0;
+            for (uint32_t f = 0; f < nframes; ++f) {
+              if (uncomp - last >= span) {
+                index.blocks_.emplace_back(comp, uncomp);
+                last = uncomp;
+              }
+              comp += ReadLe32(&entries[f * entry]);
+              uncomp += ReadLe32(&entries[f * entry + 4]);
+            }
+            index.uncompressed_size_ = uncomp;
+            return;
+          }
+        }
+      }
+    }
+
+    // Plain multi-frame files: decode once and note frame boundaries
+    std::vector<unsigned char> in(ZSTD_DStreamInSize());
+    std::vector<unsigned char> out(ZSTD_DStreamOutSize());
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    size_t file_pos = 0, totin = 0, totout = 0, last = 0;
+    for (;;) {
+      size_t n = ReadInput(fd, file_pos, in.data(), in.size());
+      if (n == 0) {
+        break;
+      }
+      ZSTD_inBuffer input = {in.data(), n, 0};
+      while (input.pos < input.size) {
+        ZSTD_outBuffer output = {out.data(), out.size(), 0};
+        size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret)) {
+          ZSTD_freeDCtx(dctx);
+          throw std::runtime_error(std::string("Corrupt zstd stream: ") +
+                                   ZSTD_getErrorName(ret));
+        }
+        totout += output.pos;
+        if (ret == 0 && totout - last >= span) {
+          index.blocks_.emplace_back(totin + input.pos, totout);
+          last = totout;
+        }
+      }
+      totin += n;
+    }
+    ZSTD_freeDCtx(dctx);
+    index.uncompressed_size_ = totout;
+#else
+    (void)fd;
+    (void)span;
+    (void)index;
+    throw std::runtime_error("zstd support requires CAE_ENABLE_ZSTD");
+#endif
+  }
+
+  static uint32_t ReadLe32(const unsigned char *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+  }
+};
+
+/**
+ * Decodes ranges of a compressed file in uncompressed coordinates
+ */
+class CompressedReader {
+public:
+  /** Receives decoded bytes and their uncompressed offset */
+  using ChunkCallback =
+      std::function<void(size_t offset, const char *data, size_t length)>;
+
+  explicit CompressedReader(std::shared_ptr<const CompressedIndex> index)
+      : index_(std::move(index)) {}
+
+  /**
+   * Decode [offset, offset + size) through a caller buffer
+   * @param fd Open descriptor of the compressed file
+   * @param offset First uncompressed byte
+   * @param size Uncompressed bytes to deliver (clamped to the end)
+   * @param buf Output buffer
+   * @param buf_size Size of the output buffer
+   * @param callback Called for every decoded chunk inside the range
+   * @return Uncompressed bytes delivered
+   */
+  size_t Read(int fd, size_t offset, size_t size, char *buf, size_t buf_size,
+              const ChunkCallback &callback) const {
+    size_t total = index_->uncompressed_size_;
+    size_t end = offset < total ? offset + std::min(size, total - offset)
+                                : offset;
+    if (end <= offset) {
+      return 0;
+    }
+    const CompressedBlock &block = index_->blocks_[index_->FindBlock(offset)];
+    Sink sink{offset, end, block.uncomp_offset_, 0, callback};
+    switch (index_->compression_) {
+    case Compression::kGzip:
+      ReadGzip(fd, block, buf, buf_size, sink);
+      break;
+    case Compression::kBzip2:
+      ReadBzip2(fd, block, buf, buf_size, sink);
+      break;
+    case Compression::kZstd:
+      ReadZstd(fd, block, buf, buf_size, sink);
+      break;
+    case Compression::kNone:
+    default:
+      break;
+    }
+    return sink.delivered_;
+  }
+
+private:
+  /** Forwards the part of the decoded stream that falls in the range */
+  struct Sink {
+    size_t begin_;
+    size_t end_;
+    size_t pos_; // Uncompressed offset of the next decoded byte
+    size_t delivered_;
+    const ChunkCallback &callback_;
+
+    /** Consume decoded bytes; returns false once the range is complete */
+    bool Put(const char *data, size_t len) {
+      size_t lo = std::max(pos_, begin_);
+      size_t hi = std::min(pos_ + len, end_);
+      if (hi > lo) {
+        callback_(lo, data + (lo - pos_), hi - lo);
+        delivered_ += hi - lo;
+      }
+      pos_ += len;
+      return pos_ < end_;
+    }
+  };
+
+  static constexpr size_t INPUT_CHUNK = 256 * 1024;
+
+  static size_t ReadInput(int fd, size_t &pos, unsigned char *buf,
+                          size_t len) {
+    ssize_t n;
+    do {
+      n = pread(fd, buf, len, static_cast<off_t>(pos));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+      throw std::runtime_error(std::string("Read failed: ") +
+                               std::strerror(errno));
+    }
+    pos += static_cast<size_t>(n);
+    return static_cast<size_t>(n);
+  }
+
+  static void ReadGzip(int fd, const CompressedBlock &block, char *buf,
+                       size_t buf_size, Sink &sink) {
+#ifdef CAE_ENABLE_COMPRESSION
+    std::vector<unsigned char> in(INPUT_CHUNK);
+    size_t file_pos = block.comp_offset_;
+    bool raw = !block.stream_start_;
+    z_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, raw ? -15 : 47) != Z_OK) {
+      throw std::runtime_error("inflateInit2 failed");
+    }
+    if (raw) {
+      if (block.bits_) {
+        unsigned char c;
+        size_t prime_pos = block.comp_offset_ - 1;
+        ReadInput(fd, prime_pos, &c, 1);
+        inflatePrime(&strm, block.bits_, c >> (8 - block.bits_));
+      }
+      inflateSetDictionary(&strm, block.window_.data(),
+                           static_cast<uInt>(block.window_.size()));
+    }
+
+    bool more = true;
+    while (more) {
+      if (strm.avail_in == 0) {
+        strm.avail_in = static_cast<uInt>(
+            ReadInput(fd, file_pos, in.data(), in.size()));
+        strm.next_in = in.data();
+        if (strm.avail_in == 0) {
+          break;
+        }
+      }
+      strm.next_out = reinterpret_cast<unsigned char *>(buf);
+      strm.avail_out = static_cast<uInt>(buf_size);
+      int ret = inflate(&strm, Z_NO_FLUSH);
+      if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
+        inflateEnd(&strm);
+        throw std::runtime_error("Corrupt gzip stream");
+      }
+      more = sink.Put(buf, buf_size - strm.avail_out);
+
+      if (more && ret == Z_STREAM_END) {
+        // Raw decoding stops before the member trailer; skip it
+        size_t skip = raw ? 8 : 0;
+        while (skip > 0) {
+          if (strm.avail_in == 0) {
+            strm.avail_in = static_cast<uInt>(
+                ReadInput(fd, file_pos, in.data(), in.size()));
+            strm.next_in = in.data();
+            if (strm.avail_in == 0) {
+              break;
+            }
+          }
+          size_t n = std::min<size_t>(skip, strm.avail_in);
+          strm.next_in += n;
+          strm.avail_in -= static_cast<uInt>(n);
+          skip -= n;
+        }
+        if (strm.avail_in == 0) {
+          strm.avail_in = static_cast<uInt>(
+              ReadInput(fd, file_pos, in.data(), in.size()));
+          strm.next_in = in.data();
+        }
+        if (strm.avail_in == 0 || strm.next_in[0] != 0x1f) {
+          break;
+        }
+        inflateReset2(&strm, 47);
+        raw = false;
+      }
+    }
+    inflateEnd(&strm);
+#else
+    (void)fd;
+    (void)block;
+    (void)buf;
+    (void)buf_size;
+    (void)sink;
+    throw std::runtime_error("gzip support requires CAE_ENABLE_COMPRESSION");
+#endif
+  }
+
+  static void ReadBzip2(int fd, const CompressedBlock &block, char *buf,
+                        size_t buf_size, Sink &sink) {
+#ifdef CAE_ENABLE_COMPRESSION
+    std::vector<unsigned char> in(INPUT_CHUNK);
+    size_t file_pos = block.comp_offset_;
+    bz_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+      throw std::runtime_error("BZ2_bzDecompressInit failed");
+    }
+
+    bool more = true;
+    while (more) {
+      if (strm.avail_in == 0) {
+        strm.avail_in = static_cast<unsigned>(
+            ReadInput(fd, file_pos, in.data(), in.size()));
+        strm.next_in = reinterpret_cast<char *>(in.data());
+        if (strm.avail_in == 0) {
+          break;
+        }
+      }
+      strm.next_out = buf;
+      strm.avail_out = static_cast<unsigned>(buf_size);
+      int ret = BZ2_bzDecompress(&strm);
+      if (ret != BZ_OK && ret != BZ_STREAM_END) {
+        BZ2_bzDecompressEnd(&strm);
+        throw std::runtime_error("Corrupt bzip2 stream");
+      }
+      more = sink.Put(buf, buf_size - strm.avail_out);
+
+      if (more && ret == BZ_STREAM_END) {
+        char *next_in = strm.next_in;
+        unsigned rest = strm.avail_in;
+        BZ2_bzDecompressEnd(&strm);
+        if (rest == 0) {
+          rest = static_cast<unsigned>(
+              ReadInput(fd, file_pos, in.data(), in.size()));
+          next_in = reinterpret_cast<char *>(in.data());
+        }
+        std::memset(&strm, 0, sizeof(strm));
+        BZ2_bzDecompressInit(&strm, 0, 0);
+        if (rest == 0 || next_in[0] != 'B') {
+          break;
+        }
+        strm.next_in = next_in;
+        strm.avail_in = rest;
+      }
+    }
+    BZ2_bzDecompressEnd(&strm);
+#else
+    (void)fd;
+    (void)block;
+    (void)buf;
+    (void)buf_size;
+    (void)sink;
+    throw std::runtime_error("bzip2 support requires CAE_ENABLE_COMPRESSION");
+#endif
+  }
+
+  static void ReadZstd(int fd, const CompressedBlock &block, char *buf,
+                       size_t buf_size, Sink &sink) {
+#ifdef CAE_ENABLE_ZSTD
+    std::vector<unsigned char> in(ZSTD_DStreamInSize());
+    size_t file_pos = block.comp_offset_;
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    bool more = true;
+    while (more) {
+      size_t n = ReadInput(fd, file_pos, in.data(), in.size());
+      if (n == 0) {
+        break;
+      }
+      ZSTD_inBuffer input = {in.data(), n, 0};
+      while (more && input.pos < input.size) {
+        ZSTD_outBuffer output = {buf, buf_size, 0};
+        size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret)) {
+          ZSTD_freeDCtx(dctx);
+          throw std::runtime_error(std::string("Corrupt zstd stream: ") +
+                                   ZSTD_getErrorName(ret));
+        }
+        more = sink.Put(buf, output.pos);
+      }
+    }
+    ZSTD_freeDCtx(dctx);
+#else
+    (void)fd;
+    (void)block;
+    (void)buf;
+    (void)buf_size;
+    (void)sink;
+    throw std::runtime_error("zstd support requires CAE_ENABLE_ZSTD");
+#endif
+  }
+
+  std::shared_ptr<const CompressedIndex> index_;
+};
+
+} // namespace cae
+
+#endif // CAE_IO_COMPRESSED_READER_H_
@@ -0,0 +1,115 @@
+#ifndef CAE_IO_CONTENT_CHUNKER_H_
+#define CAE_IO_CONTENT_CHUNKER_H_
+
+#include "util/hash.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Content-Defined Chunking Strategy:
+ *
+ * 1. Gear Hash: A byte at a time, h = (h << 1) + GEAR[byte]; the top bits
+ *    of h depend only on the last 64 bytes, so a cut point found by them
+ *    moves with the content when bytes are inserted or removed before it
+ * 2. FastCDC Cuts: The first MIN_SIZE bytes of a chunk are never hashed;
+ *    up to AVG_SIZE a cut needs MASK_S (more bits) to be zero, after it
+ *    MASK_L (fewer bits), which keeps chunk sizes close to AVG_SIZE; a
+ *    chunk ends at MAX_SIZE when no cut is found
+ * 3. Fingerprints: A chunk is named by two XXH64 digests with different
+ *    seeds (128 bits); the first one is the block digest the container
+ *    format already records
+ */
+
+namespace cae {
+
+/**
+ * 128-bit content fingerprint of a chunk
+ */
+struct ChunkFingerprint {
+  static constexpr uint64_t SECOND_SEED = 0x9E3779B97F4A7C15ULL;
+
+  uint64_t hi_; // XXH64, seed 0
+  uint64_t lo_; // XXH64, SECOND_SEED
+
+  ChunkFingerprint() : hi_(0), lo_(0) {}
+
+  /** Fingerprint of a byte range */
+  static ChunkFingerprint Of(const char *data, size_t len) {
+    ChunkFingerprint fp;
+    fp.hi_ = Xxh64::Hash(data, len);
+    fp.lo_ = Xxh64::Hash(data, len, SECOND_SEED);
+    return fp;
+  }
+
+  bool operator==(const ChunkFingerprint &other) const {
+    return hi_ == other.hi_ && lo_ == other.lo_;
+  }
+};
+
+/** Random value of each byte, fixed so cut points are the same everywhere */
+struct GearTable {
+  uint64_t v_[256];
+
+  constexpr GearTable() : v_() {
+    uint64_t x = 0x2545F4914F6CDD1DULL;
+    for (int i = 0; i < 256; ++i) {
+      // splitmix64
+      x += 0x9E3779B97F4A7C15ULL;
+      uint64_t z = x;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      v_[i] = z ^ (z >> 31);
+    }
+  }
+};
+
+/**
+ * Finds content-defined cut points with FastCDC normalized chunking
+ */
+class ContentChunker {
+public:
+  static constexpr size_t MIN_SIZE = 16 * 1024;
+  static constexpr size_t AVG_SIZE = 64 * 1024;
+  static constexpr size_t MAX_SIZE = 256 * 1024;
+  static constexpr uint64_t MASK_S = ~0ULL << (64 - 18); // 2 bits over avg
+  static constexpr uint64_t MASK_L = ~0ULL << (64 - 14); // 2 bits under avg
+
+  /**
+   * Length of the chunk starting at data
+   * @param data Bytes not yet chunked
+   * @param len Their number
+   * @return Bytes up to the first cut point, at most min(len, MAX_SIZE);
+   *         len itself when no cut point was found before the end
+   */
+  static size_t FindCut(const char *data, size_t len) {
+    if (len <= MIN_SIZE) {
+      return len;
+    }
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    size_t normal = std::min(len, AVG_SIZE);
+    size_t end = std::min(len, MAX_SIZE);
+    uint64_t h = 0;
+    size_t i = MIN_SIZE;
+    for (; i < normal; ++i) {
+      h = (h << 1) + GEAR.v_[p[i]];
+      if (!(h & MASK_S)) {
+        return i + 1;
+      }
+    }
+    for (; i < end; ++i) {
+      h = (h << 1) + GEAR.v_[p[i]];
+      if (!(h & MASK_L)) {
+        return i + 1;
+      }
+    }
+    return end;
+  }
+
+private:
+  static constexpr GearTable GEAR{};
+};
+
+} // namespace cae
+
+#endif // CAE_IO_CONTENT_CHUNKER_H_
@@ -0,0 +1,348 @@
+#ifndef CAE_IO_FILE_EXTENTS_H_
+#define CAE_IO_FILE_EXTENTS_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <sys/ioctl.h>
+// As in linux/fs.h, whose BLOCK_SIZE and other macros would reach every
+// file that includes this one
+#ifndef FS_IOC_FIEMAP
+#define FS_IOC_FIEMAP _IOWR('f', 11, struct fiemap)
+#endif
+#endif
+
+/**
+ * Sparse File Extent Discovery:
+ *
+ * 1. SEEK_DATA/SEEK_HOLE: Walks the allocated regions of a range with
+ *    lseek; supported by all major Linux filesystems and falls back to a
+ *    single data extent where the filesystem does not track holes
+ * 2. FIEMAP: Optional ioctl that returns the block mapping in one call;
+ *    preallocated-but-unwritten extents read as zeros and count as holes
+ * 3. Balanced Split: Ranges are partitioned by allocated bytes rather than
+ *    logical size, so no worker is handed nothing but holes
+ */
+
+namespace cae {
+
+/**
+ * Method used to discover the data extents of a file
+ */
+enum class ExtentMethod { kNone, kSeekData, kFiemap };
+
+/** Parse an extent method name ("none", "seek_data", "fiemap") */
+inline bool ParseExtentMethod(const std::string &name, ExtentMethod &method) {
+  if (name == "none") {
+    method = ExtentMethod::kNone;
+  } else if (name == "seek_data" || name == "seek") {
+    method = ExtentMethod::kSeekData;
+  } else if (name == "fiemap") {
+    method = ExtentMethod::kFiemap;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/** Name of an extent method */
+inline const char *ExtentMethodName(ExtentMethod method) {
+  switch (method) {
+  case ExtentMethod::kNone:
+    return "none";
+  case ExtentMethod::kSeekData:
+    return "seek_data";
+  case ExtentMethod::kFiemap:
+    return "fiemap";
+  }
+  return "unknown";
+}
+
+/**
+ * A contiguous region of a file that either holds data or is a hole
+ */
+struct FileExtent {
+  size_t offset_;
+  size_t length_;
+  bool is_hole_;
+
+  FileExtent() : offset_(0), length_(0), is_hole_(false) {}
+  FileExtent(size_t offset, size_t length, bool is_hole)
+      : offset_(offset), length_(length), is_hole_(is_hole) {}
+};
+
+/**
+ * Discovers and partitions the data extents of files
+ */
+class FileExtents {
+public:
+  /**
+   * Map [offset, offset + size) of an open file into data and hole extents
+   * The returned extents are ordered and contiguous, and cover the range up
+   * to end of file.
+   * @param fd Open file descriptor
+   * @param offset First byte of the range
+   * @param size Number of bytes in the range
+   * @param method Discovery method
+   * @return Extents covering the range
+   */
+  static std::vector<FileExtent> Map(int fd, size_t offset, size_t size,
+                                     ExtentMethod method) {
+    // Bytes past EOF are neither data nor holes; leave them out
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      size_t file_size = static_cast<size_t>(st.st_size);
+      size = offset < file_size ? std::min(size, file_size - offset) : 0;
+    }
+
+    std::vector<std::pair<size_t, size_t>> data;
+    bool ok = false;
+    switch (method) {
+    case ExtentMethod::kSeekData:
+      ok = MapSeekData(fd, offset, size, data);
+      break;
+    case ExtentMethod::kFiemap:
+      ok = MapFiemap(fd, offset, size, data);
+      if (!ok) {
+        data.clear();
+        ok = MapSeekData(fd, offset, size, data);
+      }
+      break;
+    case ExtentMethod::kNone:
+    default:
+      break;
+    }
+    if (!ok) {
+      data.assign(1, {offset, size});
+    }
+    return Fill(offset, size, data);
+  }
+
+  /** Same as Map() but opens the file by path */
+  static std::vector<FileExtent> Map(const std::string &path, size_t offset,
+                                     size_t size, ExtentMethod method) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return {FileExtent(offset, size, false)};
+    }
+    auto extents = Map(fd, offset, size, method);
+    close(fd);
+    return extents;
+  }
+
+  /** Total bytes held by data extents */
+  static size_t AllocatedBytes(const std::vector<FileExtent> &extents) {
+    size_t total = 0;
+    for (const auto &ext : extents) {
+      if (!ext.is_hole_) {
+        total += ext.length_;
+      }
+    }
+    return total;
+  }
+
+  /**
+   * Partition a mapped range into contiguous parts with equal allocated
+   * bytes. Part i covers [bounds[i], bounds[i + 1]); holes are attached to
+   * the part that precedes them.
+   * @param extents Extents from Map()
+   * @param nparts Number of parts
+   * @return nparts + 1 boundaries
+   */
+  static std::vector<size_t> SplitByAllocated(
+      const std::vector<FileExtent> &extents, int nparts) {
+    nparts = std::max(nparts, 1);
+    size_t begin = extents.empty() ? 0 : extents.front().offset_;
+    size_t end = extents.empty()
+                     ? 0
+                     : extents.back().offset_ + extents.back().length_;
+    size_t allocated = AllocatedBytes(extents);
+
+    std::vector<size_t> bounds(static_cast<size_t>(nparts) + 1, end);
+    bounds[0] = begin;
+    if (allocated == 0) {
+      // Nothing to balance; fall back to an even logical split
+      for (int p = 1; p < nparts; ++p) {
+        bounds[p] = begin + (end - begin) / nparts * p;
+      }
+      return bounds;
+    }
+
+    size_t seen = 0; // Allocated bytes before the current extent
+    size_t part = 1;
+    for (const auto &ext : extents) {
+      if (ext.is_hole_) {
+        continue;
+      }
+      while (part < static_cast<size_t>(nparts)) {
+        size_t target = allocated / nparts * part +
+                        std::min(part, allocated % nparts);
+        if (target > seen + ext.length_) {
+          break;
+        }
+        bounds[part++] = ext.offset_ + (target - seen);
+      }
+      seen += ext.length_;
+    }
+    return bounds;
+  }
+
+  /**
+   * Estimate the allocated bytes of a file from its block count
+   * @param path File path
+   * @return min(st_size, st_blocks * 512), or 0 on error
+   */
+  static size_t EstimateAllocated(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      return 0;
+    }
+    size_t blocks = static_cast<size_t>(st.st_blocks) * 512;
+    return std::min(static_cast<size_t>(st.st_size), blocks);
+  }
+
+private:
+  /** Turn sorted data ranges into contiguous data + hole extents */
+  static std::vector<FileExtent>
+  Fill(size_t offset, size_t size,
+       const std::vector<std::pair<size_t, size_t>> &data) {
+    std::vector<FileExtent> extents;
+    size_t end = offset + size;
+    size_t pos = offset;
+    for (const auto &range : data) {
+      size_t d_begin = std::max(range.first, pos);
+      size_t d_end = std::min(range.first + range.second, end);
+      if (d_end <= d_begin) {
+        continue;
+      }
+      if (d_begin > pos) {
+        extents.emplace_back(pos, d_begin - pos, true);
+      }
+      extents.emplace_back(d_begin, d_end - d_begin, false);
+      pos = d_end;
+    }
+    if (pos < end) {
+      extents.emplace_back(pos, end - pos, true);
+    }
+    return extents;
+  }
+
+  static bool MapSeekData(int fd, size_t offset, size_t size,
+                          std::vector<std::pair<size_t, size_t>> &data) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    size_t end = offset + size;
+    size_t pos = offset;
+    while (pos < end) {
+      off_t d = lseek(fd, static_cast<off_t>(pos), SEEK_DATA);
+      if (d < 0) {
+        if (errno == ENXIO) {
+          break; // No more data before EOF
+        }
+        return false; // Not supported: treat the range as data
+      }
+      if (static_cast<size_t>(d) >= end) {
+        break;
+      }
+      off_t h = lseek(fd, d, SEEK_HOLE);
+      if (h < 0) {
+        return false;
+      }
+      size_t h_end = std::min(static_cast<size_t>(h), end);
+      data.push_back({static_cast<size_t>(d), h_end - static_cast<size_t>(d)});
+      pos = h_end;
+    }
+    return true;
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+    (void)data;
+    return false;
+#endif
+  }
+
+  static bool MapFiemap(int fd, size_t offset, size_t size,
+                        std::vector<std::pair<size_t, size_t>> &data) {
+#ifdef __linux__
+    constexpr unsigned kBatch = 256;
+    size_t alloc_size = sizeof(struct fiemap) +
+                        kBatch * sizeof(struct fiemap_extent);
+    struct fiemap *fm = static_cast<struct fiemap *>(calloc(1, alloc_size));
+    if (!fm) {
+      return false;
+    }
+
+    size_t end = offset + size;
+    size_t pos = offset;
+    bool ok = true;
+    while (pos < end) {
+      std::memset(fm, 0, alloc_size);
+      fm->fm_start = pos;
+      fm->fm_length = end - pos;
+      fm->fm_flags = FIEMAP_FLAG_SYNC;
+      fm->fm_extent_count = kBatch;
+      if (ioctl(fd, FS_IOC_FIEMAP, fm) != 0) {
+        ok = false;
+        break;
+      }
+      if (fm->fm_mapped_extents == 0) {
+        break;
+      }
+      bool last = false;
+      for (unsigned i = 0; i < fm->fm_mapped_extents; ++i) {
+        const struct fiemap_extent &fe = fm->fm_extents[i];
+        size_t e_end = fe.fe_logical + fe.fe_length;
+        // Unwritten (preallocated) extents read back as zeros
+        if (!(fe.fe_flags & FIEMAP_EXTENT_UNWRITTEN)) {
+          size_t b = std::max<size_t>(fe.fe_logical, pos);
+          size_t e = std::min(e_end, end);
+          if (e > b) {
+            data.push_back({b, e - b});
+          }
+        }
+        pos = std::max(pos, e_end);
+        if (fe.fe_flags & FIEMAP_EXTENT_LAST) {
+          last = true;
+        }
+      }
+      if (last) {
+        break;
+      }
+    }
+    free(fm);
+
+    // Merge adjacent extents
+    std::vector<std::pair<size_t, size_t>> merged;
+    for (const auto &range : data) {
+      if (!merged.empty() &&
+          merged.back().first + merged.back().second == range.first) {
+        merged.back().second += range.second;
+      } else {
+        merged.push_back(range);
+      }
+    }
+    data.swap(merged);
+    return ok;
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+    (void)data;
+    return false;
+#endif
+  }
+};
+
+} // namespace cae
+
+#endif // CAE_IO_FILE_EXTENTS_H_
@@ -0,0 +1,251 @@
+#ifndef CAE_IO_FILE_LAYOUT_H_
+#define CAE_IO_FILE_LAYOUT_H_
+
+#include "io/compressed_reader.h"
+#include "io/file_extents.h"
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * File Metadata Strategy:
+ *
+ * 1. Stat Once: Pattern expansion and planning share a job-wide StatCache,
+ *    so a file is stat'ed once however many steps ask for it
+ * 2. Open Once: A file's layout (size, allocated bytes, preferred I/O size,
+ *    compression) comes from one open and fstat; the plan records it for
+ *    the workers
+ * 3. One Rank: In a worker launch only rank 0 looks at file metadata, and
+ *    only for files the plan does not cover; the other ranks get layouts
+ *    in broadcast batches of LAYOUT_BATCH records
+ * 4. Shared Descriptors: FileHandles gives the threads of a rank one
+ *    descriptor per file instead of one each
+ * 5. Known Files: What rank 0 resolved (layout, format and, for a single
+ *    file, its data extents) is handed to the format clients as KnownFiles,
+ *    so no block or retried range looks at the file again
+ */
+
+namespace cae {
+
+/**
+ * What a launch needs to know about a file before reading it
+ */
+struct FileLayout {
+  static constexpr size_t LAYOUT_BATCH = 1024;
+
+  uint64_t size_;      // Bytes on disk
+  uint64_t allocated_; // Allocated bytes, at most size_
+  uint64_t io_block_;  // Preferred I/O size, e.g. the stripe size
+  uint64_t compression_;       // Compression, detected from magic bytes
+  uint64_t uncompressed_size_; // Decoded size; size_ when not compressed
+  uint64_t valid_;             // 0 = the file could not be opened
+
+  FileLayout()
+      : size_(0), allocated_(0), io_block_(0), compression_(0),
+        uncompressed_size_(0), valid_(0) {}
+
+  Compression GetCompression() const {
+    return static_cast<Compression>(compression_);
+  }
+
+  /** Size ranges are addressed in: the decoded size when decompressing */
+  uint64_t GetAddressableSize(bool decompress) const {
+    return decompress && GetCompression() != Compression::kNone
+               ? uncompressed_size_
+               : size_;
+  }
+
+  /** Layout of an open file; uncompressed_size_ is left at size_ */
+  static FileLayout Of(int fd) {
+    FileLayout layout;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      return layout;
+    }
+    layout.FromStat(st);
+    layout.compression_ = static_cast<uint64_t>(DetectCompression(fd));
+    return layout;
+  }
+
+  /**
+   * Layout of a file, opened once
+   * @param decompress Also find the decoded size of a compressed file
+   */
+  static FileLayout Of(const std::string &path, bool decompress) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return FileLayout();
+    }
+    FileLayout layout = Of(fd);
+    close(fd);
+    layout.ResolveUncompressedSize(path, decompress);
+    return layout;
+  }
+
+  /** Fill the decoded size of a compressed file from its index */
+  void ResolveUncompressedSize(const std::string &path, bool decompress) {
+    uncompressed_size_ = size_;
+    if (valid_ && decompress && GetCompression() != Compression::kNone) {
+      uncompressed_size_ =
+          CompressedIndex::Get(path, GetCompression())->uncompressed_size_;
+    }
+  }
+
+  void FromStat(const struct stat &st) {
+    size_ = static_cast<uint64_t>(st.st_size);
+    allocated_ =
+        std::min<uint64_t>(size_, static_cast<uint64_t>(st.st_blocks) * 512);
+    io_block_ = static_cast<uint64_t>(st.st_blksize);
+    uncompressed_size_ = size_;
+    valid_ = 1;
+  }
+};
+
+/**
+ * What a launch already knows about a file
+ */
+struct KnownFile {
+  FileLayout layout_;
+  std::string format_;
+  std::vector<FileExtent> extents_; // Of [extents_begin_, extents_end_)
+  size_t extents_begin_;
+  size_t extents_end_; // extents_begin_ = extents_end_: none mapped
+
+  KnownFile() : extents_begin_(0), extents_end_(0) {}
+
+  /**
+   * The mapped extents of a range
+   * @return False if the range is not covered, so it must be mapped
+   */
+  bool GetExtents(size_t offset, size_t size,
+                  std::vector<FileExtent> &out) const {
+    // Bytes past EOF are neither data nor holes, as in FileExtents::Map
+    size_t file_size = static_cast<size_t>(layout_.size_);
+    size = offset < file_size ? std::min(size, file_size - offset) : 0;
+    if (extents_begin_ == extents_end_ || offset < extents_begin_ ||
+        offset + size > extents_end_) {
+      return false;
+    }
+    out.clear();
+    size_t end = offset + size;
+    // Extents are sorted: start at the first one ending past offset
+    auto it = std::upper_bound(
+        extents_.begin(), extents_.end(), offset,
+        [](size_t pos, const FileExtent &ext) {
+          return pos < ext.offset_ + ext.length_;
+        });
+    for (; it != extents_.end() && it->offset_ < end; ++it) {
+      size_t from = std::max(it->offset_, offset);
+      size_t to = std::min(it->offset_ + it->length_, end);
+      if (from < to) {
+        out.emplace_back(from, to - from, it->is_hole_);
+      }
+    }
+    return true;
+  }
+};
+
+/** Known files by path */
+using KnownFiles = std::unordered_map<std::string, KnownFile>;
+
+/**
+ * stat results of one job, shared by the steps that look at its files
+ */
+class StatCache {
+public:
+  /**
+   * stat a path once
+   * @return False if it could not be stat'ed
+   */
+  bool Stat(const std::string &path, struct stat &st) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      auto it = stats_.find(path);
+      if (it != stats_.end()) {
+        st = it->second.st_;
+        return it->second.ok_;
+      }
+    }
+    Entry entry;
+    entry.ok_ = stat(path.c_str(), &entry.st_) == 0;
+    std::lock_guard<std::mutex> lock(mtx_);
+    stats_.emplace(path, entry);
+    st = entry.st_;
+    return entry.ok_;
+  }
+
+  /** Whether a path is a regular file */
+  bool IsRegularFile(const std::string &path) {
+    struct stat st;
+    return Stat(path, st) && S_ISREG(st.st_mode);
+  }
+
+private:
+  struct Entry {
+    struct stat st_;
+    bool ok_;
+  };
+
+  std::mutex mtx_;
+  std::unordered_map<std::string, Entry> stats_;
+};
+
+/**
+ * Read-only descriptors shared by the threads of a process
+ */
+class FileHandles {
+public:
+  static FileHandles &Get() {
+    static FileHandles *handles = new FileHandles();
+    return *handles;
+  }
+
+  /**
+   * A descriptor of a file, opened on first use
+   * @param open_file Opens the file, e.g. under a retry policy
+   * @return The descriptor, or -1 with errno set
+   */
+  template <typename OpenFn>
+  int Acquire(const std::string &path, OpenFn open_file) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = handles_.find(path);
+    if (it != handles_.end()) {
+      ++it->second.users_;
+      return it->second.fd_;
+    }
+    int fd = open_file();
+    if (fd >= 0) {
+      handles_[path] = Handle{fd, 1};
+    }
+    return fd;
+  }
+
+  /** Give a descriptor back; the last user closes it */
+  void Release(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = handles_.find(path);
+    if (it != handles_.end() && --it->second.users_ == 0) {
+      close(it->second.fd_);
+      handles_.erase(it);
+    }
+  }
+
+private:
+  struct Handle {
+    int fd_;
+    int users_;
+  };
+
+  std::mutex mtx_;
+  std::unordered_map<std::string, Handle> handles_;
+};
+
+} // namespace cae
+
+#endif // CAE_IO_FILE_LAYOUT_H_
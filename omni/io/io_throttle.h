@@ -0,0 +1,247 @@
+#ifndef CAE_IO_IO_THROTTLE_H_
+#define CAE_IO_IO_THROTTLE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * I/O Quality of Service Strategy:
+ *
+ * 1. Priority Classes: Entries are bulk, normal or high. The launcher starts
+ *    higher classes first, and a queued launch of a higher class is admitted
+ *    before queued launches of lower ones
+ * 2. Token Buckets: A bandwidth limit is a bucket of bytes and an IOPS limit
+ *    a bucket of read calls, refilled at the limit's rate. A read takes its
+ *    tokens before it is issued; when the bucket runs into debt the reader
+ *    sleeps until the debt is repaid, so the average rate never exceeds the
+ *    limit. Idle time builds up at most BURST_MS worth of tokens
+ * 3. Hierarchy: An entry's throttle also takes from the job's, so the job
+ *    limit caps the sum of its entries
+ * 4. Cooperation: The ranks of a worker launch share its limit. Every
+ *    RATE_PERIOD_MS rank 0 gathers what each rank asked for and divides the
+ *    rate among them by demand, keeping IDLE_SHARE for ranks that asked for
+ *    nothing, so a rank that starts reading is not stalled
+ */
+
+namespace cae {
+
+/**
+ * Priority class of an entry
+ */
+enum class QosPriority { kBulk = 0, kNormal = 1, kHigh = 2 };
+
+/** Parse a priority name ("bulk", "normal", "high") */
+inline bool ParseQosPriority(const std::string &name, QosPriority &priority) {
+  if (name == "bulk") {
+    priority = QosPriority::kBulk;
+  } else if (name == "normal") {
+    priority = QosPriority::kNormal;
+  } else if (name == "high") {
+    priority = QosPriority::kHigh;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/** Name of a priority class */
+inline const char *QosPriorityName(QosPriority priority) {
+  switch (priority) {
+  case QosPriority::kBulk:
+    return "bulk";
+  case QosPriority::kNormal:
+    return "normal";
+  case QosPriority::kHigh:
+    return "high";
+  }
+  return "unknown";
+}
+
+/**
+ * Priority and limits of a job or an entry
+ */
+struct QosLimits {
+  QosPriority priority_;
+  size_t bandwidth_; // Bytes per second, 0 = unlimited
+  size_t iops_;      // Read calls per second, 0 = unlimited
+
+  QosLimits() : priority_(QosPriority::kNormal), bandwidth_(0), iops_(0) {}
+
+  bool IsLimited() const { return bandwidth_ || iops_; }
+
+  /** The tighter of two limits, each 0 = unlimited */
+  static size_t Min(size_t a, size_t b) {
+    return a && b ? std::min(a, b) : std::max(a, b);
+  }
+};
+
+/**
+ * Token bucket that lets a caller run into debt and sleep it off
+ */
+class TokenBucket {
+public:
+  static constexpr int BURST_MS = 100;
+
+  /** @param rate Tokens per second, 0 = unlimited */
+  explicit TokenBucket(double rate = 0)
+      : rate_(rate), tokens_(0), requested_(0),
+        last_(std::chrono::steady_clock::now()) {}
+
+  /**
+   * Take tokens, sleeping while the bucket is in debt
+   * @return Nanoseconds slept
+   */
+  long Take(double n) {
+    double wait;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      requested_ += n;
+      if (rate_ <= 0) {
+        return 0;
+      }
+      Refill();
+      tokens_ -= n;
+      wait = tokens_ < 0 ? -tokens_ / rate_ : 0;
+    }
+    if (wait <= 0) {
+      return 0;
+    }
+    auto ns = std::chrono::nanoseconds(static_cast<long>(wait * 1e9));
+    std::this_thread::sleep_for(ns);
+    return static_cast<long>(ns.count());
+  }
+
+  /** Change the rate; tokens and debt carry over */
+  void SetRate(double rate) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Refill();
+    rate_ = rate;
+  }
+
+  double GetRate() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return rate_;
+  }
+
+  /** Tokens asked for since the last call */
+  double TakeRequested() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    double requested = requested_;
+    requested_ = 0;
+    return requested;
+  }
+
+private:
+  void Refill() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+    if (rate_ > 0) {
+      tokens_ = std::min(tokens_ + elapsed * rate_, rate_ * BURST_MS / 1000);
+    }
+  }
+
+  mutable std::mutex mtx_;
+  double rate_;
+  double tokens_; // Negative = debt
+  double requested_;
+  std::chrono::steady_clock::time_point last_;
+};
+
+/**
+ * Bandwidth and IOPS limit applied in the read loops of the format clients
+ */
+class IoThrottle {
+public:
+  static constexpr int RATE_PERIOD_MS = 100;
+  static constexpr double IDLE_SHARE = 0.1;
+
+  /**
+   * @param bandwidth Bytes per second, 0 = unlimited
+   * @param iops Read calls per second, 0 = unlimited
+   * @param parent Throttle that is charged as well, e.g. the job's
+   */
+  IoThrottle(size_t bandwidth, size_t iops,
+             std::shared_ptr<IoThrottle> parent = nullptr)
+      : bandwidth_(bandwidth), iops_(iops), bytes_(bandwidth), ops_(iops),
+        parent_(std::move(parent)), waited_ns_(0) {}
+
+  /** Take the tokens of one read call of up to bytes bytes */
+  void Acquire(size_t bytes) {
+    long waited = bytes_.Take(static_cast<double>(bytes)) + ops_.Take(1);
+    if (waited) {
+      waited_ns_ += waited;
+    }
+    if (parent_) {
+      parent_->Acquire(bytes);
+    }
+  }
+
+  /** Limits given at construction */
+  size_t GetBandwidth() const { return bandwidth_; }
+  size_t GetIops() const { return iops_; }
+
+  /** Set this throttle's rates, e.g. to a rank's share of the limits */
+  void SetRates(double bandwidth, double iops) {
+    bytes_.SetRate(bandwidth);
+    ops_.SetRate(iops);
+  }
+
+  /** Bytes and calls asked for since the last call */
+  void TakeDemand(double &bytes, double &ops) {
+    bytes = bytes_.TakeRequested();
+    ops = ops_.TakeRequested();
+  }
+
+  /**
+   * Share of a limit for one of several consumers
+   * @param limit Rate to divide, 0 = unlimited
+   * @param demand What this consumer asked for in the last period
+   * @param total What all consumers asked for
+   * @param nconsumers Number of consumers
+   */
+  static double GetShare(double limit, double demand, double total,
+                         int nconsumers) {
+    if (limit <= 0) {
+      return 0;
+    }
+    double n = std::max(nconsumers, 1);
+    if (total <= 0) {
+      return limit / n;
+    }
+    return limit * IDLE_SHARE / n + limit * (1 - IDLE_SHARE) * demand / total;
+  }
+
+  /** Time spent waiting for tokens of this throttle */
+  long GetWaitedMs() const { return waited_ns_.load() / 1000000; }
+
+  /** Limits as text, e.g. "100 MB/s, 500 IOPS" */
+  static std::string Describe(size_t bandwidth, size_t iops) {
+    char text[64] = "unlimited bandwidth";
+    if (bandwidth) {
+      std::snprintf(text, sizeof(text), "%.1f MB/s",
+                    static_cast<double>(bandwidth) / (1 << 20));
+    }
+    return std::string(text) + ", " +
+           (iops ? std::to_string(iops) + " IOPS" : "unlimited IOPS");
+  }
+
+private:
+  size_t bandwidth_;
+  size_t iops_;
+  TokenBucket bytes_;
+  TokenBucket ops_;
+  std::shared_ptr<IoThrottle> parent_;
+  std::atomic<long> waited_ns_;
+};
+
+} // namespace cae
+
+#endif // CAE_IO_IO_THROTTLE_H_
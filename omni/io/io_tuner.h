@@ -0,0 +1,403 @@
+#ifndef CAE_IO_IO_TUNER_H_
+#define CAE_IO_IO_TUNER_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Adaptive I/O Tuning Strategy:
+ *
+ * 1. Knobs: The chunk size of each read (64KB to 16MB) and the read-ahead
+ *    depth, the number of chunks kept in flight ahead of the reader (1 to
+ *    16), both moved in powers of two
+ * 2. Measurement: Reads are timed and grouped into windows of at least
+ *    WINDOW_BYTES and WINDOW_READS; a window's bandwidth is its bytes over
+ *    the time spent reading them. Reads issued with other settings than the
+ *    current ones are ignored
+ * 3. Hill Climbing: From the best settings so far, one knob is moved one
+ *    step; a move that gains at least MIN_GAIN is kept and repeated, else
+ *    the other direction and then the other knob are tried. Once no move
+ *    helps, the tuner holds, and starts over if bandwidth later falls below
+ *    MAX_DROP of the best
+ * 4. Scope: Each file has its own tuner, started from the settings last
+ *    found on its mount (file system type and mount point)
+ * 5. Persistence: The best settings of every mount are saved to a cache
+ *    file ($CAE_TUNING_FILE, default ~/.cache/cae/io_tuning.tsv), so the
+ *    next run starts from them
+ */
+
+namespace cae {
+
+/** Read settings chosen by the tuner */
+struct IoSettings {
+  size_t chunk_size_;
+  int depth_; // Chunks in flight, including the one being read
+
+  IoSettings() : chunk_size_(1024 * 1024), depth_(1) {}
+  IoSettings(size_t chunk_size, int depth)
+      : chunk_size_(chunk_size), depth_(depth) {}
+
+  bool operator==(const IoSettings &other) const {
+    return chunk_size_ == other.chunk_size_ && depth_ == other.depth_;
+  }
+};
+
+/**
+ * Hill-climbing controller of the read settings of one file
+ */
+class IoTuner {
+public:
+  static constexpr size_t MIN_CHUNK = 64 * 1024;
+  static constexpr size_t MAX_CHUNK = 16 * 1024 * 1024;
+  static constexpr int MAX_DEPTH = 16;
+  static constexpr size_t WINDOW_BYTES = 32 * 1024 * 1024;
+  static constexpr int WINDOW_READS = 8;
+  static constexpr double MIN_GAIN = 0.05;
+  static constexpr double MAX_DROP = 0.5;
+
+  /** @param start Settings of the first window */
+  explicit IoTuner(const IoSettings &start)
+      : current_(Clamp(start)), best_(current_), best_bw_(0),
+        measured_(false), converged_(false), dim_(0), dir_(1),
+        flipped_(false), stale_dims_(0), window_bytes_(0),
+        window_seconds_(0), window_reads_(0) {}
+
+  /** Settings for the next read */
+  IoSettings Get() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return current_;
+  }
+
+  /** Best settings found and their bandwidth in bytes per second */
+  IoSettings GetBest(double &bandwidth) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    bandwidth = best_bw_;
+    return best_;
+  }
+
+  /**
+   * Account for one read
+   * @param used Settings the read was issued with
+   * @param bytes Bytes read
+   * @param seconds Time spent in the read
+   */
+  void Record(const IoSettings &used, size_t bytes, double seconds) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!(used == current_)) {
+      return;
+    }
+    window_bytes_ += bytes;
+    window_seconds_ += seconds;
+    window_reads_++;
+    if (window_bytes_ < WINDOW_BYTES || window_reads_ < WINDOW_READS) {
+      return;
+    }
+    double bandwidth =
+        static_cast<double>(window_bytes_) / std::max(window_seconds_, 1e-9);
+    window_bytes_ = 0;
+    window_seconds_ = 0;
+    window_reads_ = 0;
+    Step(bandwidth);
+  }
+
+  /**
+   * Tuner of a file, shared by every reader of the file in this process
+   * and started from the settings saved for its mount
+   */
+  static std::shared_ptr<IoTuner> ForFile(const std::string &path) {
+    Registry &reg = GetRegistry();
+    std::lock_guard<std::mutex> lock(reg.mtx_);
+    auto it = reg.files_.find(path);
+    if (it != reg.files_.end()) {
+      return it->second.tuner_;
+    }
+    if (!reg.loaded_) {
+      reg.mounts_ = Load(GetCachePath());
+      reg.loaded_ = true;
+    }
+    std::string mount = GetMountKey(path);
+    IoSettings start;
+    auto saved = reg.mounts_.find(mount);
+    if (saved != reg.mounts_.end()) {
+      start = saved->second.settings_;
+    }
+    FileTuner &file = reg.files_[path];
+    file.mount_ = mount;
+    file.tuner_ = std::make_shared<IoTuner>(start);
+    return file.tuner_;
+  }
+
+  /** A mount's best settings */
+  struct MountSettings {
+    IoSettings settings_;
+    double bandwidth_; // Bytes per second
+  };
+
+  /**
+   * Save the best settings found on each mount, merged into the cache file
+   * @return The mounts measured by this process
+   */
+  static std::map<std::string, MountSettings> SaveAll() {
+    Registry &reg = GetRegistry();
+    std::map<std::string, MountSettings> measured;
+    {
+      std::lock_guard<std::mutex> lock(reg.mtx_);
+      for (const auto &file : reg.files_) {
+        MountSettings best;
+        best.settings_ = file.second.tuner_->GetBest(best.bandwidth_);
+        if (best.bandwidth_ <= 0) {
+          continue;
+        }
+        auto it = measured.find(file.second.mount_);
+        if (it == measured.end() || it->second.bandwidth_ < best.bandwidth_) {
+          measured[file.second.mount_] = best;
+        }
+      }
+    }
+    if (measured.empty()) {
+      return measured;
+    }
+
+    // Other jobs may have saved other mounts meanwhile
+    std::string path = GetCachePath();
+    std::map<std::string, MountSettings> all = Load(path);
+    for (const auto &m : measured) {
+      all[m.first] = m.second;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(
+        std::filesystem::path(path).parent_path(), ec);
+    std::string tmp = path + ".tmp" + std::to_string(getpid());
+    {
+      std::ofstream out(tmp);
+      out << "# mount\tchunk_size\tdepth\tbytes_per_second\n";
+      for (const auto &m : all) {
+        out << m.first << "\t" << m.second.settings_.chunk_size_ << "\t"
+            << m.second.settings_.depth_ << "\t"
+            << static_cast<unsigned long long>(m.second.bandwidth_) << "\n";
+      }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+      std::remove(tmp.c_str());
+    }
+    return measured;
+  }
+
+  /** Cache file of the tuned settings */
+  static std::string GetCachePath() {
+    const char *env = std::getenv("CAE_TUNING_FILE");
+    if (env && *env) {
+      return env;
+    }
+    const char *home = std::getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/cae/io_tuning.tsv";
+  }
+
+  /**
+   * Key of the mount holding a path: "<fstype>:<mount point>", from the
+   * longest matching entry of /proc/self/mountinfo
+   */
+  static std::string GetMountKey(const std::string &path) {
+    std::error_code ec;
+    std::string target = std::filesystem::weakly_canonical(path, ec).string();
+    if (ec) {
+      target = path;
+    }
+    std::ifstream info("/proc/self/mountinfo");
+    std::string line, best_point, best_type = "unknown";
+    while (std::getline(info, line)) {
+      // id parent dev root point options [tags] - type source super
+      std::istringstream fields(line);
+      std::string id, parent, dev, root, point, field;
+      fields >> id >> parent >> dev >> root >> point;
+      while (fields >> field && field != "-") {
+      }
+      std::string type;
+      fields >> type;
+      point = Unescape(point);
+      bool inside = target == point || point == "/" ||
+                    target.compare(0, point.size() + 1, point + "/") == 0;
+      if (inside && point.size() >= best_point.size()) {
+        best_point = point;
+        best_type = type;
+      }
+    }
+    return best_type + ":" + (best_point.empty() ? "/" : best_point);
+  }
+
+private:
+  struct FileTuner {
+    std::string mount_;
+    std::shared_ptr<IoTuner> tuner_;
+  };
+
+  struct Registry {
+    std::mutex mtx_;
+    bool loaded_ = false;
+    std::map<std::string, MountSettings> mounts_;
+    std::map<std::string, FileTuner> files_;
+  };
+
+  static Registry &GetRegistry() {
+    static Registry registry;
+    return registry;
+  }
+
+  /** Read a cache file; missing or malformed lines are skipped */
+  static std::map<std::string, MountSettings> Load(const std::string &path) {
+    std::map<std::string, MountSettings> mounts;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      size_t tab = line.find('\t');
+      if (tab == std::string::npos) {
+        continue;
+      }
+      std::istringstream values(line.substr(tab + 1));
+      MountSettings m;
+      unsigned long long bandwidth = 0;
+      if (values >> m.settings_.chunk_size_ >> m.settings_.depth_ >>
+          bandwidth) {
+        m.settings_ = Clamp(m.settings_);
+        m.bandwidth_ = static_cast<double>(bandwidth);
+        mounts[line.substr(0, tab)] = m;
+      }
+    }
+    return mounts;
+  }
+
+  /** Decode the octal escapes (\040 for space) of mountinfo paths */
+  static std::string Unescape(const std::string &s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); ++i) {
+      if (s[i] == '\\' && i + 3 < s.size()) {
+        out += static_cast<char>(std::stoi(s.substr(i + 1, 3), nullptr, 8));
+        i += 3;
+      } else {
+        out += s[i];
+      }
+    }
+    return out;
+  }
+
+  static IoSettings Clamp(const IoSettings &s) {
+    size_t chunk = MIN_CHUNK;
+    while (chunk < s.chunk_size_ && chunk < MAX_CHUNK) {
+      chunk *= 2;
+    }
+    int depth = 1;
+    while (depth < s.depth_ && depth < MAX_DEPTH) {
+      depth *= 2;
+    }
+    return IoSettings(chunk, depth);
+  }
+
+  /** Settings one step from the best along the current knob and direction */
+  bool Neighbor(IoSettings &next) const {
+    next = best_;
+    if (dim_ == 0) {
+      if (dir_ > 0 ? best_.chunk_size_ >= MAX_CHUNK
+                   : best_.chunk_size_ <= MIN_CHUNK) {
+        return false;
+      }
+      next.chunk_size_ =
+          dir_ > 0 ? best_.chunk_size_ * 2 : best_.chunk_size_ / 2;
+    } else {
+      if (dir_ > 0 ? best_.depth_ >= MAX_DEPTH : best_.depth_ <= 1) {
+        return false;
+      }
+      next.depth_ = dir_ > 0 ? best_.depth_ * 2 : best_.depth_ / 2;
+    }
+    return true;
+  }
+
+  /** The last move did not help: turn around, then change knobs */
+  void Reject() {
+    if (!flipped_) {
+      dir_ = -dir_;
+      flipped_ = true;
+      return;
+    }
+    dim_ ^= 1;
+    dir_ = 1;
+    flipped_ = false;
+    if (++stale_dims_ >= 2) {
+      converged_ = true;
+    }
+  }
+
+  /** Move to the next settings to measure */
+  void Probe() {
+    IoSettings next;
+    while (!converged_) {
+      if (Neighbor(next)) {
+        current_ = next;
+        return;
+      }
+      Reject();
+    }
+    current_ = best_;
+  }
+
+  /** Advance the search with the bandwidth of a finished window */
+  void Step(double bandwidth) {
+    if (!measured_) {
+      best_bw_ = bandwidth;
+      measured_ = true;
+      Probe();
+      return;
+    }
+    if (converged_) {
+      if (bandwidth < best_bw_ * MAX_DROP) {
+        // Conditions changed; search again from here
+        best_bw_ = bandwidth;
+        converged_ = false;
+        dim_ = 0;
+        dir_ = 1;
+        flipped_ = false;
+        stale_dims_ = 0;
+        Probe();
+      }
+      return;
+    }
+    if (bandwidth > best_bw_ * (1 + MIN_GAIN)) {
+      best_ = current_;
+      best_bw_ = bandwidth;
+      stale_dims_ = 0;
+    } else {
+      Reject();
+    }
+    Probe();
+  }
+
+  mutable std::mutex mtx_;
+  IoSettings current_;
+  IoSettings best_;
+  double best_bw_;
+  bool measured_;  // The starting settings have been measured
+  bool converged_;
+  int dim_;        // Knob being moved: 0 = chunk size, 1 = depth
+  int dir_;        // +1 = double, -1 = halve
+  bool flipped_;   // Both directions of the knob were tried
+  int stale_dims_; // Knobs exhausted since the last gain
+  size_t window_bytes_;
+  double window_seconds_;
+  int window_reads_;
+};
+
+} // namespace cae
+
+#endif // CAE_IO_IO_TUNER_H_
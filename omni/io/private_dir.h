@@ -0,0 +1,111 @@
+#ifndef CAE_IO_PRIVATE_DIR_H_
+#define CAE_IO_PRIVATE_DIR_H_
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Per-User Private Directories:
+ *
+ * 1. Location: Scratch state that used to live in a directory shared by
+ *    every user of the node (/tmp/cae_cache, ...) goes to
+ *    $TMPDIR/<name>-<uid> instead, falling back to /tmp
+ * 2. Checks: A private directory is created with mode 0700; whether it was
+ *    created or found, lstat must show a directory, not a symlink, owned by
+ *    this user and mode 0700, or it is refused. Another user can then
+ *    neither plant files in it nor read what is written there
+ * 3. Files: Files inside are opened with O_NOFOLLOW, and temporary files
+ *    are created with mkstemp, so a name is never followed elsewhere
+ */
+
+namespace cae {
+
+/**
+ * Directories only this user can enter
+ */
+class PrivateDir {
+public:
+  /**
+   * Check that a directory is private
+   * @return Why it is not, empty if it is
+   */
+  static std::string Check(const std::string &dir) {
+    struct stat st;
+    if (lstat(dir.c_str(), &st) != 0) {
+      return std::strerror(errno);
+    }
+    if (S_ISLNK(st.st_mode) || !S_ISDIR(st.st_mode)) {
+      return "not a directory";
+    }
+    if (st.st_uid != getuid()) {
+      return "owned by another user";
+    }
+    if ((st.st_mode & 0777) != 0700) {
+      return "its mode is not 0700";
+    }
+    return std::string();
+  }
+
+  /**
+   * Create a directory with mode 0700 unless it exists, then check it;
+   * throws if it is not private
+   * @return dir
+   */
+  static const std::string &Ensure(const std::string &dir) {
+    std::error_code ec;
+    std::filesystem::path path(dir);
+    if (!std::filesystem::exists(std::filesystem::symlink_status(path, ec))) {
+      if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path(), ec);
+      }
+      mkdir(dir.c_str(), 0700);
+    }
+    std::string why = Check(dir);
+    if (!why.empty()) {
+      throw std::runtime_error("Refusing to use " + dir + ": " + why);
+    }
+    return dir;
+  }
+
+  /** $TMPDIR/<name>-<uid> (or under /tmp); not created */
+  static std::string GetTempPath(const std::string &name) {
+    const char *tmp = std::getenv("TMPDIR");
+    return std::string(tmp && *tmp ? tmp : "/tmp") + "/" + name + "-" +
+           std::to_string(getuid());
+  }
+
+  /** $TMPDIR/<name>-<uid>, created and checked; throws if not private */
+  static std::string GetTemp(const std::string &name) {
+    return Ensure(GetTempPath(name));
+  }
+
+  /**
+   * Create a new file in a private directory under a unique name
+   * @param dir Directory; must already be private
+   * @param prefix Start of the file name
+   * @param path Set to the file's path
+   * @return Its descriptor; throws on failure
+   */
+  static int CreateTemp(const std::string &dir, const std::string &prefix,
+                        std::string &path) {
+    std::string pattern = dir + "/" + prefix + "XXXXXX";
+    int fd = mkostemp(&pattern[0], O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error("Could not create a file in " + dir + ": " +
+                               std::strerror(errno));
+    }
+    path = pattern;
+    return fd;
+  }
+};
+
+} // namespace cae
+
+#endif // CAE_IO_PRIVATE_DIR_H_
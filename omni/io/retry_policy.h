@@ -0,0 +1,96 @@
+#ifndef CAE_IO_RETRY_POLICY_H_
+#define CAE_IO_RETRY_POLICY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include <thread>
+
+/**
+ * Transient I/O Error Strategy:
+ *
+ * 1. Classification: EIO, ESTALE, EAGAIN and ETIMEDOUT are treated as
+ *    transient (network and parallel file systems report hiccups this way);
+ *    every other error is final. EINTR is retried at once, as before
+ * 2. Backoff: A failed call waits before its next attempt, starting at the
+ *    base delay and doubling up to MAX_BACKOFF_MS, with jitter so ranks
+ *    that failed together do not retry together
+ * 3. Scope: One system call is retried at a time, so nothing the call would
+ *    have produced has been passed on and a retry never duplicates output
+ */
+
+namespace cae {
+
+/**
+ * How often and how patiently transient I/O errors are retried
+ */
+struct RetryPolicy {
+  static constexpr int DEFAULT_ATTEMPTS = 4;
+  static constexpr int DEFAULT_BACKOFF_MS = 100;
+  static constexpr int MAX_BACKOFF_MS = 10000;
+
+  int attempts_;   // Calls per operation, including the first
+  int backoff_ms_; // Delay before the first retry
+
+  RetryPolicy()
+      : attempts_(DEFAULT_ATTEMPTS), backoff_ms_(DEFAULT_BACKOFF_MS) {}
+
+  /** Whether an errno value may succeed when the call is repeated */
+  static bool IsTransient(int err) {
+    return err == EIO || err == ESTALE || err == EAGAIN ||
+           err == EWOULDBLOCK || err == ETIMEDOUT;
+  }
+
+  /**
+   * Delay before a retry, doubling from the base delay with jitter
+   * @param retry Retry number, starting at 1
+   */
+  int GetDelayMs(int retry) const {
+    int shift = std::min(retry - 1, 16);
+    long delay = std::min<long>(static_cast<long>(backoff_ms_) << shift,
+                                MAX_BACKOFF_MS);
+    thread_local std::minstd_rand rng(std::random_device{}());
+    // Jitter in [delay/2, delay]
+    return static_cast<int>(delay / 2 + rng() % (delay / 2 + 1));
+  }
+
+  /**
+   * Run a system call until it succeeds, fails with a final error or runs
+   * out of attempts
+   * @param op Call returning a negative value and setting errno on failure
+   * @return Result of the last call; errno holds its error
+   */
+  template <typename Op> auto Run(Op op) const -> decltype(op()) {
+    for (int attempt = 1;; ++attempt) {
+      auto result = op();
+      if (result >= 0) {
+        return result;
+      }
+      int err = errno;
+      if (err == EINTR) {
+        --attempt;
+        continue;
+      }
+      if (!IsTransient(err) || attempt >= attempts_) {
+        errno = err;
+        return result;
+      }
+      GetRetryCount()++;
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(GetDelayMs(attempt)));
+    }
+  }
+
+  /** Retries made by this process, for reporting */
+  static std::atomic<size_t> &GetRetryCount() {
+    static std::atomic<size_t> count(0);
+    return count;
+  }
+};
+
+} // namespace cae
+
+#endif // CAE_IO_RETRY_POLICY_H_
@@ -0,0 +1,50 @@
+#ifndef CAE_PLUGIN_PLUGIN_API_H_
+#define CAE_PLUGIN_PLUGIN_API_H_
+
+#include "format/format_registry.h"
+#include "repo/repo_registry.h"
+
+/**
+ * Plugin Interface:
+ *
+ * A plugin is a shared object that defines its entry points with
+ * CAE_PLUGIN. Its registration function receives the process registries
+ * and adds format and repository clients to them:
+ *
+ *   static void RegisterMyFormats(cae::FormatRegistry &formats,
+ *                                 cae::RepoRegistry &repos) {
+ *     cae::FormatCapabilities caps;
+ *     caps.name_ = "myformat";
+ *     caps.magic_ = {"MYF1"};
+ *     caps.cpu_features_ = {"avx512f"};
+ *     caps.priority_ = 10;
+ *     formats.Register(caps, [] { return std::make_unique<MyClient>(); });
+ *   }
+ *   CAE_PLUGIN(RegisterMyFormats)
+ *
+ * Plugins are built against the engine headers only. Objects cross the
+ * boundary as C++ types, so a plugin must be built with the same compiler
+ * and standard library as the engine; the ABI version guards the layout of
+ * the registries and client interfaces.
+ */
+
+/** Bumped whenever a registry or client interface changes layout */
+#define CAE_PLUGIN_ABI_VERSION 1
+
+extern "C" {
+/** Returns the CAE_PLUGIN_ABI_VERSION the plugin was built with */
+typedef int (*CaePluginAbiVersionFn)();
+/** Registers the plugin's clients */
+typedef void (*CaePluginRegisterFn)(cae::FormatRegistry *formats,
+                                    cae::RepoRegistry *repos);
+}
+
+/** Define the entry points of a plugin around a registration function */
+#define CAE_PLUGIN(register_fn)                                                \
+  extern "C" int cae_plugin_abi_version() { return CAE_PLUGIN_ABI_VERSION; }   \
+  extern "C" void cae_plugin_register(cae::FormatRegistry *formats,            \
+                                      cae::RepoRegistry *repos) {              \
+    register_fn(*formats, *repos);                                             \
+  }
+
+#endif // CAE_PLUGIN_PLUGIN_API_H_
@@ -0,0 +1,120 @@
+#include "plugin_loader.h"
+#include "plugin_api.h"
+#include <algorithm>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <set>
+
+#ifndef CAE_PLUGIN_DIR
+#define CAE_PLUGIN_DIR ""
+#endif
+
+namespace cae {
+
+namespace {
+
+void SplitPath(const std::string &path, std::vector<std::string> &dirs) {
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t colon = path.find(':', start);
+    if (colon == std::string::npos) {
+      colon = path.size();
+    }
+    if (colon > start) {
+      dirs.push_back(path.substr(start, colon - start));
+    }
+    start = colon + 1;
+  }
+}
+
+std::mutex &GetLoadMutex() {
+  static std::mutex mtx;
+  return mtx;
+}
+
+} // namespace
+
+std::vector<std::string> PluginLoader::GetSearchPath(const std::string &extra) {
+  std::vector<std::string> dirs;
+  SplitPath(extra, dirs);
+  if (const char *env = std::getenv("CAE_PLUGIN_PATH")) {
+    SplitPath(env, dirs);
+  }
+  SplitPath(CAE_PLUGIN_DIR, dirs);
+  return dirs;
+}
+
+size_t PluginLoader::LoadAll(const std::string &extra) {
+  size_t loaded = 0;
+  for (const auto &dir : GetSearchPath(extra)) {
+    std::error_code ec;
+    std::vector<std::string> objects;
+    for (std::filesystem::directory_iterator it(dir, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      if (it->path().extension() == ".so") {
+        objects.push_back(it->path().string());
+      }
+    }
+    std::sort(objects.begin(), objects.end());
+    for (const auto &object : objects) {
+      std::string error;
+      if (Load(object, error)) {
+        ++loaded;
+      } else if (!error.empty()) {
+        std::cerr << "Skipping plugin " << object << ": " << error
+                  << std::endl;
+      }
+    }
+  }
+  return loaded;
+}
+
+bool PluginLoader::Load(const std::string &path, std::string &error) {
+  std::lock_guard<std::mutex> lock(GetLoadMutex());
+  static std::set<std::string> loaded;
+  std::error_code ec;
+  std::string canonical = std::filesystem::canonical(path, ec).string();
+  if (ec) {
+    error = ec.message();
+    return false;
+  }
+  if (loaded.count(canonical)) {
+    return false; // Already loaded from an earlier search directory
+  }
+
+  void *handle = dlopen(canonical.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    error = dlerror();
+    return false;
+  }
+  auto abi_version = reinterpret_cast<CaePluginAbiVersionFn>(
+      dlsym(handle, "cae_plugin_abi_version"));
+  auto register_fn = reinterpret_cast<CaePluginRegisterFn>(
+      dlsym(handle, "cae_plugin_register"));
+  if (!abi_version || !register_fn) {
+    error = "missing cae_plugin_abi_version or cae_plugin_register";
+    dlclose(handle);
+    return false;
+  }
+  if (abi_version() != CAE_PLUGIN_ABI_VERSION) {
+    error = "built for plugin ABI " + std::to_string(abi_version()) +
+            ", engine uses " + std::to_string(CAE_PLUGIN_ABI_VERSION);
+    dlclose(handle);
+    return false;
+  }
+
+  FormatRegistry &formats = FormatRegistry::Get();
+  RepoRegistry &repos = RepoRegistry::Get();
+  formats.SetSource(canonical);
+  repos.SetSource(canonical);
+  register_fn(&formats, &repos);
+  formats.SetSource("builtin");
+  repos.SetSource("builtin");
+  loaded.insert(canonical);
+  return true;
+}
+
+} // namespace cae
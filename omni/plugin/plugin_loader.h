@@ -0,0 +1,53 @@
+#ifndef CAE_PLUGIN_PLUGIN_LOADER_H_
+#define CAE_PLUGIN_PLUGIN_LOADER_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * Plugin Discovery Strategy:
+ *
+ * 1. Search Path: Directories from the job (wrp's plugins list or the
+ *    worker's --plugin-path), then $CAE_PLUGIN_PATH, then the installed
+ *    plugin directory; each is scanned for *.so files in name order
+ * 2. Loading: Each shared object is opened once with dlopen and must export
+ *    cae_plugin_abi_version and cae_plugin_register (see
+ *    plugin/plugin_api.h); objects built for another ABI are skipped
+ * 3. Lifetime: Plugins are never unloaded, since their clients stay
+ *    registered for the life of the process
+ */
+
+namespace cae {
+
+/**
+ * Loads format and repository plugins into the process registries
+ */
+class PluginLoader {
+public:
+  /**
+   * Full search path
+   * @param extra Colon-separated directories searched first
+   * @return Directories in search order
+   */
+  static std::vector<std::string> GetSearchPath(const std::string &extra);
+
+  /**
+   * Load every plugin found on a search path
+   * Failures are reported on stderr and do not stop the scan.
+   * @param extra Colon-separated directories searched first
+   * @return Number of plugins loaded
+   */
+  static size_t LoadAll(const std::string &extra);
+
+  /**
+   * Load one plugin
+   * @param path Shared object
+   * @param error Reason on failure
+   * @return false if the plugin could not be loaded
+   */
+  static bool Load(const std::string &path, std::string &error);
+};
+
+} // namespace cae
+
+#endif // CAE_PLUGIN_PLUGIN_LOADER_H_
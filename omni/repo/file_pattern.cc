@@ -0,0 +1,179 @@
+#include "file_pattern.h"
+#include "io/file_layout.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <glob.h>
+#include <iostream>
+#include <mutex>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace cae {
+
+namespace {
+
+/** Files found in a directory while it had a given mtime */
+struct CachedListing {
+  struct timespec mtime_;
+  std::vector<std::string> files_;
+};
+
+std::mutex listing_mutex;
+std::unordered_map<std::string, CachedListing> listing_cache;
+
+/**
+ * The directory whose entries a pattern depends on: the directory itself,
+ * or the parent of a pattern whose wildcards are all in the last component
+ * @return False if the pattern depends on several directories
+ */
+bool GetListedDirectory(const std::string &pattern, bool has_wildcards,
+                        std::string &dir) {
+  if (!has_wildcards) {
+    dir = pattern;
+    return true;
+  }
+  size_t slash = pattern.rfind('/');
+  dir = slash == std::string::npos ? "." : pattern.substr(0, slash + 1);
+  return dir.find_first_of("*?[{~") == std::string::npos;
+}
+
+/**
+ * Modification time of a directory, if a listing taken now can be trusted
+ * until it changes: a change within the same clock tick as the listing
+ * would not move the mtime, so directories changed in the last second are
+ * not cached
+ */
+bool GetStableMtime(const std::string &dir, struct timespec &mtime) {
+  struct stat st;
+  if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return false;
+  }
+  mtime = st.st_mtim;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec - mtime.tv_sec > 1;
+}
+
+} // namespace
+
+std::string ExpandPath(const std::string &path) {
+  if (path.empty() || path[0] != '~') {
+    return path;
+  }
+
+  if (path.length() == 1 || path[1] == '/') {
+    // ~/... case
+    const char *home = getenv("HOME");
+    if (!home) {
+      struct passwd *pw = getpwuid(getuid());
+      if (pw) {
+        home = pw->pw_dir;
+      }
+    }
+    if (home) {
+      return std::string(home) + (path.length() > 1 ? path.substr(1) : "");
+    }
+  }
+
+  // If we can't expand, return original path
+  return path;
+}
+
+std::vector<std::string> ExpandFilePattern(const std::string &pattern,
+                                           StatCache *stats) {
+  std::vector<std::string> files;
+  StatCache local_stats;
+  StatCache &cache = stats ? *stats : local_stats;
+  
+  if (pattern.empty()) {
+    std::cerr << "Warning: Empty file pattern provided" << std::endl;
+    return files;
+  }
+  
+  // Check if the pattern contains wildcards
+  bool has_wildcards = (pattern.find('*') != std::string::npos) || 
+                       (pattern.find('?') != std::string::npos) ||
+                       (pattern.find('[') != std::string::npos);
+
+  // A listing is reused while its directory is unchanged, e.g. by the
+  // jobs of an ingest service
+  std::string dir, key;
+  struct timespec mtime;
+  bool cacheable = GetListedDirectory(pattern, has_wildcards, dir) &&
+                   GetStableMtime(dir, mtime);
+  if (cacheable) {
+    // Files come back as the pattern named them, so a relative pattern
+    // is cached per working directory
+    std::error_code ec;
+    key = pattern[0] == '/' ? pattern
+                            : fs::current_path(ec).string() + '\n' + pattern;
+    std::lock_guard<std::mutex> lock(listing_mutex);
+    auto it = listing_cache.find(key);
+    if (it != listing_cache.end() &&
+        it->second.mtime_.tv_sec == mtime.tv_sec &&
+        it->second.mtime_.tv_nsec == mtime.tv_nsec) {
+      std::cout << "Expanded " << (has_wildcards ? "pattern" : "directory")
+                << " '" << pattern << "' to " << it->second.files_.size()
+                << " files (cached)" << std::endl;
+      return it->second.files_;
+    }
+  }
+  
+  if (has_wildcards) {
+    // Use glob to expand wildcards
+    glob_t glob_result;
+    int glob_ret = glob(pattern.c_str(), GLOB_TILDE | GLOB_BRACE, nullptr, &glob_result);
+    
+    if (glob_ret == 0) {
+      for (size_t i = 0; i < glob_result.gl_pathc; ++i) {
+        std::string file_path = glob_result.gl_pathv[i];
+        if (cache.IsRegularFile(file_path)) {
+          files.push_back(file_path);
+        }
+      }
+      std::cout << "Expanded pattern '" << pattern << "' to " << files.size() << " files" << std::endl;
+    } else if (glob_ret == GLOB_NOMATCH) {
+      std::cerr << "Warning: No files match pattern: " << pattern << std::endl;
+    } else {
+      std::cerr << "Warning: Error expanding pattern: " << pattern << " (error code: " << glob_ret << ")" << std::endl;
+    }
+    
+    globfree(&glob_result);
+  } else {
+    // Check if it's a directory
+    struct stat st;
+    bool found = cache.Stat(pattern, st);
+    if (found && S_ISDIR(st.st_mode)) {
+      for (const auto &entry : fs::directory_iterator(pattern)) {
+        if (entry.is_regular_file()) {
+          files.push_back(entry.path().string());
+        }
+      }
+      std::cout << "Expanded directory '" << pattern << "' to " << files.size() << " files" << std::endl;
+    } else if (found && S_ISREG(st.st_mode)) {
+      // Single file
+      files.push_back(pattern);
+      std::cout << "Single file: " << pattern << std::endl;
+    } else {
+      std::cerr << "Warning: Path is neither a file nor directory: " << pattern << std::endl;
+    }
+  }
+  
+  // Sort files for consistent ordering
+  std::sort(files.begin(), files.end());
+
+  if (cacheable) {
+    std::lock_guard<std::mutex> lock(listing_mutex);
+    listing_cache[key] = CachedListing{mtime, files};
+  }
+  
+  return files;
+}
+
+} // namespace cae
@@ -0,0 +1,33 @@
+#ifndef CAE_REPO_FILE_PATTERN_H_
+#define CAE_REPO_FILE_PATTERN_H_
+
+#include <string>
+#include <vector>
+
+namespace cae {
+
+class StatCache;
+
+/**
+ * Expand a leading '~' in a path to the user's home directory
+ * @param path Path that may start with '~'
+ * @return Expanded path, or the original path if it cannot be expanded
+ */
+std::string ExpandPath(const std::string &path);
+
+/**
+ * Expand a file pattern into a sorted list of regular files
+ * Supports glob wildcards (*, ?, [...]), directories and single files.
+ * Listings of a directory, or of a pattern with wildcards only in its last
+ * component, are kept for the process while the directory's mtime is
+ * unchanged
+ * @param pattern Wildcard pattern, directory or file path
+ * @param stats The job's stat results, which the files found are added to
+ * @return Sorted list of matching regular files
+ */
+std::vector<std::string> ExpandFilePattern(const std::string &pattern,
+                                           StatCache *stats = nullptr);
+
+} // namespace cae
+
+#endif // CAE_REPO_FILE_PATTERN_H_
@@ -2,6 +2,8 @@
 #define CAE_REPO_FILESYSTEM_REPO_OMNI_H_
 
 #include "repo_client.h"
+#include "io/file_extents.h"
+#include "runtime/cpu_topology.h"
 #include <algorithm>
 #include <iostream>
 #include <sys/stat.h>
@@ -10,13 +12,12 @@ namespace cae {
 
 /**
  * Filesystem repository client implementation
- * Recommends scale based on file size (minimum 64MB per process)
+ * Recommends scale based on file size (minimum 64MB per worker thread)
  */
 class FilesystemRepoClient : public RepoClient {
-private:
-  static constexpr size_t MIN_BYTES_PER_PROCESS = 64 * 1024 * 1024; // 64MB
-
 public:
+  static constexpr size_t MIN_BYTES_PER_WORKER = 64 * 1024 * 1024; // 64MB
+
   /**
    * Recommend scale based on file size
    * Objective: at least 64MB per process
@@ -76,25 +77,58 @@ public:
    * @param max_scale Maximum number of processes allowed
    * @param nprocs Output: recommended number of processes
    * @param nthreads Output: recommended number of threads per process
+   * @param max_threads Maximum threads per process (0 = cores per NUMA node)
    */
   void RecommendScaleForFile(const std::string &file_path, int max_scale,
-                             int &nprocs, int &nthreads) {
-    size_t file_size = GetFileSize(file_path);
-
-    // Calculate number of processes needed for at least 64MB per process
-    if (file_size <= MIN_BYTES_PER_PROCESS) {
-      nprocs = 1;
-    } else {
-      nprocs = static_cast<int>((file_size + MIN_BYTES_PER_PROCESS - 1) /
-                                MIN_BYTES_PER_PROCESS);
-      nprocs = std::min(nprocs, max_scale);
+                             int &nprocs, int &nthreads, int max_threads = 0) {
+    RecommendScaleForSize(file_path, GetFileSize(file_path),
+                          FileExtents::EstimateAllocated(file_path), max_scale,
+                          nprocs, nthreads, max_threads);
+  }
+
+  /**
+   * Recommend scale for a file whose size is already known
+   * Work is sized at 64MB per thread. Threads fill a rank up to one NUMA
+   * domain before another rank is added, so node-level parallelism comes
+   * from threads rather than process count.
+   * @param label File named in the log
+   * @param file_size Size of the file in bytes
+   * @param allocated Allocated bytes of the file (0 = unknown)
+   * @param max_scale Maximum number of processes allowed
+   * @param nprocs Output: recommended number of processes
+   * @param nthreads Output: recommended number of threads per process
+   * @param max_threads Maximum threads per process (0 = cores per NUMA node)
+   */
+  void RecommendScaleForSize(const std::string &label, size_t file_size,
+                             size_t allocated, int max_scale, int &nprocs,
+                             int &nthreads, int max_threads = 0) {
+    // Holes are skipped by the readers, so size the job by allocated bytes
+    size_t work_size = file_size;
+    if (allocated > 0 && allocated < file_size) {
+      work_size = allocated;
+    }
+    if (max_threads <= 0) {
+      max_threads = CpuTopology::GetCoresPerNumaNode();
     }
 
-    // For filesystem operations, single thread per process is usually optimal
-    nthreads = 1;
+    // Calculate number of workers needed for at least 64MB per worker
+    size_t nworkers = 1;
+    if (work_size > MIN_BYTES_PER_WORKER) {
+      nworkers = (work_size + MIN_BYTES_PER_WORKER - 1) / MIN_BYTES_PER_WORKER;
+    }
+
+    // One rank per NUMA domain's worth of threads
+    nprocs = static_cast<int>((nworkers + max_threads - 1) / max_threads);
+    nprocs = std::max(1, std::min(nprocs, max_scale));
+    nthreads = static_cast<int>((nworkers + nprocs - 1) / nprocs);
+    nthreads = std::max(1, std::min(nthreads, max_threads));
 
-    std::cout << "Recommended scale for file " << file_path
-              << " (size: " << file_size << " bytes): " << nprocs
+    std::cout << "Recommended scale for file " << label
+              << " (size: " << file_size << " bytes";
+    if (work_size != file_size) {
+      std::cout << ", allocated: " << work_size << " bytes";
+    }
+    std::cout << "): " << nprocs
               << " processes, " << nthreads << " threads per process"
               << std::endl;
   }
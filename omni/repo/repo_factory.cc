@@ -1,7 +1,5 @@
 #include "repo_factory.h"
-#include "filesystem_repo_omni.h"
-#include <algorithm>
-#include <cctype>
+#include "repo_registry.h"
 #include <stdexcept>
 
 namespace cae {
@@ -9,12 +7,16 @@ namespace cae {
 std::unique_ptr<RepoClient> RepoFactory::Get(Repository repo) {
   switch (repo) {
   case Repository::kFilesystem:
-    return std::make_unique<FilesystemRepoClient>();
+    return Get("filesystem");
   case Repository::kGlobus:
-    // TODO: Implement Globus client
+    if (RepoRegistry::Get().Has("globus")) {
+      return Get("globus"); // Provided by a plugin
+    }
     throw std::runtime_error("Globus repository client not yet implemented");
   case Repository::kS3:
-    // TODO: Implement S3 client
+    if (RepoRegistry::Get().Has("s3")) {
+      return Get("s3"); // Provided by a plugin
+    }
     throw std::runtime_error("S3 repository client not yet implemented");
   default:
     throw std::runtime_error("Unknown repository type");
@@ -22,20 +24,7 @@ std::unique_ptr<RepoClient> RepoFactory::Get(Repository repo) {
 }
 
 std::unique_ptr<RepoClient> RepoFactory::Get(const std::string &repo_str) {
-  std::string lower_repo = repo_str;
-  std::transform(lower_repo.begin(), lower_repo.end(), lower_repo.begin(),
-                 [](unsigned char c) { return std::tolower(c); });
-
-  if (lower_repo == "filesystem" || lower_repo == "posix" ||
-      lower_repo == "local") {
-    return Get(Repository::kFilesystem);
-  } else if (lower_repo == "globus") {
-    return Get(Repository::kGlobus);
-  } else if (lower_repo == "s3" || lower_repo == "amazon") {
-    return Get(Repository::kS3);
-  } else {
-    throw std::runtime_error("Unknown repository string: " + repo_str);
-  }
+  return RepoRegistry::Get().Create(repo_str);
 }
 
-} // namespace cae
\ No newline at end of file
+} // namespace cae
@@ -13,6 +13,8 @@ enum class Repository { kFilesystem, kGlobus, kS3 };
 
 /**
  * Factory class for creating repository clients
+ * Clients come from the registry (see repo/repo_registry.h), so
+ * plugins are created the same way as built-in clients.
  */
 class RepoFactory {
 public:
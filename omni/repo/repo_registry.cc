@@ -0,0 +1,16 @@
+#include "repo_registry.h"
+#include "filesystem_repo_omni.h"
+
+namespace cae {
+
+RepoRegistry &RepoRegistry::Get() {
+  static RepoRegistry *registry = [] {
+    auto *r = new RepoRegistry();
+    r->Register({"filesystem", "posix", "local"},
+                [] { return std::make_unique<FilesystemRepoClient>(); });
+    return r;
+  }();
+  return *registry;
+}
+
+} // namespace cae
@@ -0,0 +1,95 @@
+#ifndef CAE_REPO_REPO_REGISTRY_H_
+#define CAE_REPO_REPO_REGISTRY_H_
+
+#include "repo_client.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cae {
+
+/** Creates a new client of a registered repository */
+using RepoCreator = std::function<std::unique_ptr<RepoClient>()>;
+
+/**
+ * Registry of the repository clients available to this process
+ * The built-in filesystem client is registered when the registry is first
+ * used; plugins add theirs when they are loaded (see plugin/plugin_loader.h).
+ * A name registered again replaces the earlier client.
+ */
+class RepoRegistry {
+public:
+  /** Process-wide registry, holding the built-in repositories */
+  static RepoRegistry &Get();
+
+  /**
+   * Register a repository client
+   * @param names Name and aliases, any case
+   * @param create Creates a client
+   */
+  void Register(const std::vector<std::string> &names, RepoCreator create) {
+    Entry entry;
+    for (const auto &name : names) {
+      entry.names_.push_back(ToLower(name));
+    }
+    entry.source_ = source_;
+    entry.create_ = std::move(create);
+    entries_.push_back(std::move(entry));
+  }
+
+  /** Set the source recorded for repositories registered from now on */
+  void SetSource(const std::string &source) { source_ = source; }
+
+  /** Whether a repository name is registered */
+  bool Has(const std::string &name) const {
+    return FindEntry(ToLower(name)) != nullptr;
+  }
+
+  /**
+   * Create a client of a repository
+   * @throws std::runtime_error if the name is not registered
+   */
+  std::unique_ptr<RepoClient> Create(const std::string &name) const {
+    const Entry *entry = FindEntry(ToLower(name));
+    if (!entry) {
+      throw std::runtime_error("Unknown repository string: " + name);
+    }
+    return entry->create_();
+  }
+
+  static std::string ToLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return s;
+  }
+
+private:
+  struct Entry {
+    std::vector<std::string> names_;
+    std::string source_;
+    RepoCreator create_;
+  };
+
+  RepoRegistry() : source_("builtin") {}
+
+  const Entry *FindEntry(const std::string &name) const {
+    for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+      if (std::find(it->names_.begin(), it->names_.end(), name) !=
+          it->names_.end()) {
+        return &*it;
+      }
+    }
+    return nullptr;
+  }
+
+  std::vector<Entry> entries_;
+  std::string source_;
+};
+
+} // namespace cae
+
+#endif // CAE_REPO_REPO_REGISTRY_H_
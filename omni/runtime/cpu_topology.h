@@ -0,0 +1,216 @@
+#ifndef CAE_RUNTIME_CPU_TOPOLOGY_H_
+#define CAE_RUNTIME_CPU_TOPOLOGY_H_
+
+#include <algorithm>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * CPU Topology Discovery:
+ *
+ * 1. Allowed CPUs: The CPUs this process may run on, as restricted by the
+ *    launcher binding (e.g. mpirun --bind-to numa) or cgroups
+ * 2. NUMA Domains: CPU lists per NUMA node from sysfs; machines without
+ *    NUMA information are treated as a single domain
+ * 3. Pinning: Threads are pinned with pthread_setaffinity_np
+ */
+
+namespace cae {
+
+/**
+ * Queries CPU and NUMA layout of the local node
+ */
+class CpuTopology {
+public:
+  /**
+   * Parse a kernel CPU list such as "0-3,8,10-11"
+   * @param list CPU list string
+   * @return Sorted CPU ids
+   */
+  static std::vector<int> ParseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      item.erase(std::remove_if(item.begin(), item.end(), ::isspace),
+                 item.end());
+      if (item.empty()) {
+        continue;
+      }
+      size_t dash = item.find('-');
+      try {
+        if (dash == std::string::npos) {
+          cpus.push_back(std::stoi(item));
+        } else {
+          int lo = std::stoi(item.substr(0, dash));
+          int hi = std::stoi(item.substr(dash + 1));
+          for (int c = lo; c <= hi; ++c) {
+            cpus.push_back(c);
+          }
+        }
+      } catch (const std::exception &) {
+        // Ignore malformed entries
+      }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    return cpus;
+  }
+
+  /** CPUs the calling process is allowed to run on */
+  static std::vector<int> GetAllowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &set)) {
+          cpus.push_back(c);
+        }
+      }
+    }
+    if (cpus.empty()) {
+      unsigned n = std::max(1u, std::thread::hardware_concurrency());
+      for (unsigned c = 0; c < n; ++c) {
+        cpus.push_back(static_cast<int>(c));
+      }
+    }
+    return cpus;
+  }
+
+  /** CPU lists of every NUMA node, indexed by node id order */
+  static std::vector<std::vector<int>> GetNumaNodes() {
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; ++node) {
+      std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                       "/cpulist");
+      if (!in) {
+        break;
+      }
+      std::string list;
+      std::getline(in, list);
+      nodes.push_back(ParseCpuList(list));
+    }
+    if (nodes.empty()) {
+      unsigned n = std::max(1u, std::thread::hardware_concurrency());
+      std::vector<int> all;
+      for (unsigned c = 0; c < n; ++c) {
+        all.push_back(static_cast<int>(c));
+      }
+      nodes.push_back(all);
+    }
+    return nodes;
+  }
+
+  /** NUMA node id that owns a CPU, or 0 if unknown */
+  static int GetNumaNodeOfCpu(int cpu) {
+    auto nodes = GetNumaNodes();
+    for (size_t n = 0; n < nodes.size(); ++n) {
+      if (std::binary_search(nodes[n].begin(), nodes[n].end(), cpu)) {
+        return static_cast<int>(n);
+      }
+    }
+    return 0;
+  }
+
+  /** Number of NUMA nodes that have CPUs */
+  static int GetNumaNodeCount() {
+    int count = 0;
+    for (const auto &node : GetNumaNodes()) {
+      if (!node.empty()) {
+        ++count;
+      }
+    }
+    return std::max(count, 1);
+  }
+
+  /** Cores in the largest NUMA domain; the natural threads-per-rank */
+  static int GetCoresPerNumaNode() {
+    size_t best = 1;
+    for (const auto &node : GetNumaNodes()) {
+      best = std::max(best, node.size());
+    }
+    return static_cast<int>(best);
+  }
+
+  /**
+   * Choose the CPUs a rank's threads should use
+   * If the allowed CPUs already sit in a single NUMA domain (the launcher
+   * bound the rank) they are used as is. Otherwise the rank takes the
+   * allowed CPUs of one domain, selected by its node-local rank, so
+   * co-located ranks spread over the domains.
+   * @param local_rank Rank index among the ranks on this node
+   * @return CPU ids for the rank's threads
+   */
+  static std::vector<int> SelectRankCpus(int local_rank) {
+    std::vector<int> allowed = GetAllowedCpus();
+    std::vector<std::vector<int>> domains;
+    for (const auto &node : GetNumaNodes()) {
+      std::vector<int> cpus;
+      std::set_intersection(node.begin(), node.end(), allowed.begin(),
+                            allowed.end(), std::back_inserter(cpus));
+      if (!cpus.empty()) {
+        domains.push_back(cpus);
+      }
+    }
+    if (domains.size() <= 1) {
+      return allowed;
+    }
+    return domains[static_cast<size_t>(local_rank) % domains.size()];
+  }
+
+  /**
+   * Pin the calling thread to a single CPU
+   * @param cpu CPU id
+   * @return true on success
+   */
+  static bool PinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  /**
+   * Bind the calling thread to a set of CPUs
+   * @param cpus CPU ids
+   * @return true on success
+   */
+  static bool BindCurrentThread(const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  /** Format CPU ids as a compact kernel-style list ("0-3,8") */
+  static std::string FormatCpuList(const std::vector<int> &cpus) {
+    std::ostringstream oss;
+    for (size_t i = 0; i < cpus.size();) {
+      size_t j = i;
+      while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+        ++j;
+      }
+      if (i > 0) {
+        oss << ",";
+      }
+      oss << cpus[i];
+      if (j > i) {
+        oss << "-" << cpus[j];
+      }
+      i = j + 1;
+    }
+    return oss.str();
+  }
+};
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_CPU_TOPOLOGY_H_
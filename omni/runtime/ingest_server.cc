@@ -0,0 +1,530 @@
+#include "ingest_server.h"
+#include "io/private_dir.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <streambuf>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace cae {
+
+namespace {
+
+std::atomic<bool> stop_requested{false};
+
+/** Socket address of a path; throws if the path is too long */
+struct sockaddr_un GetAddress(const std::string &path) {
+  struct sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Socket path is too long: " + path);
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+  return addr;
+}
+
+/** Connect to a socket, -1 on failure with errno set */
+int Connect(const std::string &path) {
+  struct sockaddr_un addr = GetAddress(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+              sizeof(addr)) != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+void SetTimeout(int fd, int option, int ms) {
+  struct timeval tv;
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(tv));
+}
+
+/**
+ * Connection to one client; once a send fails, later ones are dropped
+ */
+class ClientChannel {
+public:
+  explicit ClientChannel(int fd) : fd_(fd), broken_(false) {}
+
+  /** Send one line; a newline is appended */
+  void Send(const std::string &line) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::string data = line + '\n';
+    size_t sent = 0;
+    while (!broken_ && sent < data.size()) {
+      ssize_t n = send(fd_, data.data() + sent, data.size() - sent,
+                       MSG_NOSIGNAL);
+      if (n > 0) {
+        sent += static_cast<size_t>(n);
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else {
+        broken_ = true;
+      }
+    }
+  }
+
+private:
+  int fd_;
+  bool broken_;
+  std::mutex mtx_;
+};
+
+/**
+ * Stream buffer that sends each complete line to a client with a tag
+ */
+class ClientStreamBuf : public std::streambuf {
+public:
+  ClientStreamBuf(ClientChannel &channel, char tag)
+      : channel_(channel), tag_(tag) {}
+
+  /** Send the last line even if it has no newline */
+  void Finish() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!line_.empty()) {
+      channel_.Send(std::string(1, tag_) + ' ' + line_);
+      line_.clear();
+    }
+  }
+
+protected:
+  int overflow(int c) override {
+    if (c != traits_type::eof()) {
+      char ch = static_cast<char>(c);
+      Put(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    Put(s, static_cast<size_t>(n));
+    return n;
+  }
+
+private:
+  void Put(const char *s, size_t n) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (size_t i = 0; i < n; ++i) {
+      if (s[i] == '\n') {
+        channel_.Send(std::string(1, tag_) + ' ' + line_);
+        line_.clear();
+      } else {
+        line_ += s[i];
+      }
+    }
+  }
+
+  ClientChannel &channel_;
+  char tag_;
+  std::string line_;
+  std::mutex mtx_;
+};
+
+/** Read one line, waiting at most timeout_ms; false on EOF or timeout */
+bool ReadLine(int fd, std::string &buffer, std::string &line,
+              int timeout_ms) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeout_ms);
+  while (true) {
+    size_t newline = buffer.find('\n');
+    if (newline != std::string::npos) {
+      line = buffer.substr(0, newline);
+      buffer.erase(0, newline + 1);
+      return true;
+    }
+    if (buffer.size() > IngestServer::MAX_REQUEST) {
+      return false;
+    }
+    int wait = -1;
+    if (timeout_ms >= 0) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) {
+        return false;
+      }
+      wait = static_cast<int>(left.count());
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, wait);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      return false;
+    }
+    char data[4096];
+    ssize_t n = recv(fd, data, sizeof(data), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(data, static_cast<size_t>(n));
+  }
+}
+
+/** Whether the client of a queued job has closed its connection */
+bool IsHungUp(int fd) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  if (poll(&pfd, 1, 0) <= 0) {
+    return false;
+  }
+  if (pfd.revents & (POLLHUP | POLLERR)) {
+    return true;
+  }
+  char byte;
+  return recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+/** Split "a\tb\tc" */
+std::vector<std::string> SplitTabs(const std::string &text) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (true) {
+    size_t tab = text.find('\t', start);
+    parts.push_back(text.substr(start, tab - start));
+    if (tab == std::string::npos) {
+      return parts;
+    }
+    start = tab + 1;
+  }
+}
+
+} // namespace
+
+IngestServer::IngestServer(const std::string &socket_path, Runner runner,
+                           Classifier classify)
+    : socket_path_(socket_path), runner_(std::move(runner)),
+      classify_(std::move(classify)), running_(false), admitting_(0),
+      next_id_(1), log_(nullptr) {}
+
+void IngestServer::RequestStop() { stop_requested = true; }
+
+std::string IngestServer::GetDefaultSocketPath() {
+  const char *env = std::getenv("CAE_SOCKET");
+  if (env && *env) {
+    return env;
+  }
+  const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+  if (runtime && *runtime) {
+    return std::string(runtime) + "/cae/wrp.sock";
+  }
+  return "/tmp/cae-" + std::to_string(getuid()) + "/wrp.sock";
+}
+
+void IngestServer::Log(const std::string &line) {
+  std::lock_guard<std::mutex> lock(log_mtx_);
+  std::ostream log(log_);
+  log << line << std::endl;
+}
+
+int IngestServer::Run() {
+  stop_requested = false;
+  log_ = std::cout.rdbuf();
+
+  // The socket's directory must be private, whoever created it; a socket
+  // left by a daemon that is gone is replaced, one that still answers is not
+  std::error_code ec;
+  fs::path dir = fs::absolute(fs::path(socket_path_), ec).parent_path();
+  if (!fs::exists(fs::symlink_status(dir, ec))) {
+    fs::create_directories(dir.parent_path(), ec);
+    mkdir(dir.c_str(), 0700);
+  }
+  std::string why = PrivateDir::Check(dir.string());
+  if (!why.empty()) {
+    std::cerr << "Error: refusing to serve in " << dir.string() << ": " << why
+              << std::endl;
+    return 1;
+  }
+  int listen_fd = -1;
+  try {
+    int probe = Connect(socket_path_);
+    if (probe >= 0) {
+      close(probe);
+      std::cerr << "Error: an ingest service is already listening on "
+                << socket_path_ << std::endl;
+      return 1;
+    }
+    unlink(socket_path_.c_str());
+    struct sockaddr_un addr = GetAddress(socket_path_);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr),
+             sizeof(addr)) != 0 ||
+        chmod(socket_path_.c_str(), 0600) != 0 ||
+        listen(listen_fd, 64) != 0) {
+      throw std::runtime_error(std::strerror(errno));
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: cannot listen on " << socket_path_ << ": "
+              << e.what() << std::endl;
+    if (listen_fd >= 0) {
+      close(listen_fd);
+    }
+    return 1;
+  }
+  Log("Serving on " + socket_path_);
+
+  std::thread acceptor(&IngestServer::AcceptLoop, this, listen_fd);
+  while (true) {
+    Pending next;
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      while (queue_.empty() && !stop_requested) {
+        cv_.wait_for(lock, std::chrono::milliseconds(ACCEPT_POLL_MS));
+      }
+      if (stop_requested) {
+        break;
+      }
+      // Highest priority first, then in order of arrival
+      auto best = std::min_element(
+          queue_.begin(), queue_.end(),
+          [](const Pending &a, const Pending &b) {
+            if (a.job_.priority_ != b.job_.priority_) {
+              return a.job_.priority_ > b.job_.priority_;
+            }
+            return a.job_.id_ < b.job_.id_;
+          });
+      next = *best;
+      queue_.erase(best);
+      running_ = true;
+    }
+    Execute(next);
+    std::lock_guard<std::mutex> lock(mtx_);
+    running_ = false;
+  }
+  acceptor.join();
+  close(listen_fd);
+  unlink(socket_path_.c_str());
+  {
+    // Requests still being read may yet queue their jobs
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [this] { return admitting_ == 0; });
+  }
+
+  for (Pending &pending : queue_) {
+    ClientChannel channel(pending.fd_);
+    channel.Send("e Error: the ingest service stopped");
+    channel.Send("exit 1");
+    close(pending.fd_);
+  }
+  queue_.clear();
+  Log("Stopped");
+  return 0;
+}
+
+void IngestServer::AcceptLoop(int listen_fd) {
+  while (!stop_requested) {
+    struct pollfd pfd = {listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0) {
+      continue;
+    }
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    // Requests are read on their own threads, so a client that sends
+    // nothing does not hold up the others
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (admitting_ >= MAX_ADMITTING) {
+        close(fd);
+        continue;
+      }
+      ++admitting_;
+    }
+    std::thread([this, fd] {
+      Admit(fd);
+      std::lock_guard<std::mutex> lock(mtx_);
+      --admitting_;
+      cv_.notify_all();
+    }).detach();
+  }
+}
+
+void IngestServer::Admit(int fd) {
+  ClientChannel channel(fd);
+  std::string buffer, line;
+  if (!ReadLine(fd, buffer, line, REQUEST_TIMEOUT_MS)) {
+    close(fd);
+    return;
+  }
+  SetTimeout(fd, SO_SNDTIMEO, SEND_TIMEOUT_MS);
+
+  // "submit <yaml|plan>\t<cwd>\t<path>"
+  std::vector<std::string> fields = SplitTabs(line);
+  Pending pending;
+  pending.fd_ = fd;
+  std::string error;
+  if (fields.size() != 3 ||
+      (fields[0] != "submit yaml" && fields[0] != "submit plan") ||
+      fields[1].empty() || fields[1][0] != '/' || fields[2].empty() ||
+      fields[2][0] != '/') {
+    error = "Invalid request";
+  } else {
+    pending.job_.plan_ = fields[0] == "submit plan";
+    pending.job_.cwd_ = fields[1];
+    pending.job_.path_ = fields[2];
+    try {
+      pending.job_.priority_ = classify_(pending.job_);
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+  }
+  if (!error.empty()) {
+    channel.Send("e Error: " + error);
+    channel.Send("exit 1");
+    close(fd);
+    return;
+  }
+
+  size_t ahead;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    pending.job_.id_ = next_id_++;
+    ahead = running_ ? 1 : 0;
+    for (const Pending &other : queue_) {
+      if (other.job_.priority_ >= pending.job_.priority_) {
+        ++ahead;
+      }
+    }
+    queue_.push_back(pending);
+  }
+  Log("Job " + std::to_string(pending.job_.id_) + " queued: " +
+      pending.job_.path_ + " (priority " +
+      std::to_string(pending.job_.priority_) + ", " + std::to_string(ahead) +
+      " ahead)");
+  channel.Send("queued " + std::to_string(ahead));
+  cv_.notify_one();
+}
+
+void IngestServer::Execute(Pending &pending) {
+  const IngestJob &job = pending.job_;
+  std::string name = "Job " + std::to_string(job.id_);
+  if (IsHungUp(pending.fd_)) {
+    Log(name + " dropped: its client hung up");
+    close(pending.fd_);
+    return;
+  }
+  Log(name + " started");
+  auto start = std::chrono::steady_clock::now();
+
+  ClientChannel channel(pending.fd_);
+  channel.Send("start");
+  ClientStreamBuf out(channel, 'o');
+  ClientStreamBuf err(channel, 'e');
+  std::streambuf *old_out = std::cout.rdbuf(&out);
+  std::streambuf *old_err = std::cerr.rdbuf(&err);
+
+  // Relative paths in the job are the client's
+  std::string daemon_cwd = fs::current_path().string();
+  int exit_code = 1;
+  if (chdir(job.cwd_.c_str()) != 0) {
+    std::cerr << "Error: cannot change to " << job.cwd_ << ": "
+              << std::strerror(errno) << std::endl;
+  } else {
+    try {
+      exit_code = runner_(job);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+    }
+  }
+  if (chdir(daemon_cwd.c_str()) != 0) {
+    Log(name + ": cannot change back to " + daemon_cwd);
+  }
+
+  std::cout.flush();
+  std::cerr.flush();
+  std::cout.rdbuf(old_out);
+  std::cerr.rdbuf(old_err);
+  out.Finish();
+  err.Finish();
+  channel.Send("exit " + std::to_string(exit_code));
+  close(pending.fd_);
+
+  long ms = static_cast<long>(
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+  Log(name + " finished: exit " + std::to_string(exit_code) + " in " +
+      std::to_string(ms) + " ms");
+}
+
+int IngestClient::Submit(const std::string &socket_path, IngestJob job) {
+  std::error_code ec;
+  job.cwd_ = fs::current_path(ec).string();
+  job.path_ = fs::absolute(job.path_, ec).string();
+  if (job.path_.find_first_of("\t\n") != std::string::npos ||
+      job.cwd_.find_first_of("\t\n") != std::string::npos) {
+    std::cerr << "Error: paths with tabs or newlines cannot be submitted"
+              << std::endl;
+    return 1;
+  }
+
+  int fd;
+  try {
+    fd = Connect(socket_path);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  if (fd < 0) {
+    std::cerr << "Error: no ingest service on " << socket_path << ": "
+              << std::strerror(errno) << " (start one with wrp serve)"
+              << std::endl;
+    return 1;
+  }
+  ClientChannel channel(fd);
+  channel.Send(std::string(job.plan_ ? "submit plan" : "submit yaml") +
+               '\t' + job.cwd_ + '\t' + job.path_);
+
+  std::string buffer, line;
+  while (ReadLine(fd, buffer, line, -1)) {
+    std::string rest = line.size() > 2 ? line.substr(2) : "";
+    if (line.compare(0, 2, "o ") == 0) {
+      std::cout << rest << '\n';
+    } else if (line.compare(0, 2, "e ") == 0) {
+      std::cout.flush();
+      std::cerr << rest << std::endl;
+    } else if (line.compare(0, 7, "queued ") == 0) {
+      if (line != "queued 0") {
+        std::cerr << "Waiting for " << line.substr(7) << " job(s) ahead"
+                  << std::endl;
+      }
+    } else if (line.compare(0, 5, "exit ") == 0) {
+      std::cout.flush();
+      close(fd);
+      return std::atoi(line.c_str() + 5);
+    }
+  }
+  std::cout.flush();
+  close(fd);
+  std::cerr << "Error: the ingest service closed the connection"
+            << std::endl;
+  return 1;
+}
+
+} // namespace cae
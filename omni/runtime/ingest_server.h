@@ -0,0 +1,130 @@
+#ifndef CAE_RUNTIME_INGEST_SERVER_H_
+#define CAE_RUNTIME_INGEST_SERVER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Ingest Service Strategy:
+ *
+ * 1. Daemon: `wrp serve` listens on a Unix domain socket that only its user
+ *    can open, in a directory that must be its user's, not a symlink and
+ *    mode 0700; a second daemon on a socket that is in use is refused
+ * 2. Jobs: A client submits the absolute path of an OMNI file or a saved
+ *    plan with its working directory. Jobs wait in one queue, by priority
+ *    class and then arrival, and run one at a time in the daemon's process,
+ *    each with all of its threads. Requests are read by a thread per
+ *    connection (at most MAX_ADMITTING), never by the accepting thread
+ * 3. Warm State: Loaded plugins, the format registry, I/O tuners,
+ *    compressed-file indexes and directory listings stay in memory from one
+ *    job to the next, and no process is started for a job
+ * 4. Streaming: While a job runs, what it writes to stdout and stderr goes
+ *    to its client line by line. A waiting client is told how many jobs are
+ *    ahead of it, and every client gets its job's exit status; a job whose
+ *    client hung up before it started is dropped
+ * 5. Protocol: Lines of text. The request is
+ *    "submit <yaml|plan>\t<cwd>\t<path>"; the replies are "queued <n>",
+ *    "start", "o <line>" (stdout), "e <line>" (stderr) and "exit <code>"
+ */
+
+namespace cae {
+
+/**
+ * A job submitted to the ingest service
+ */
+struct IngestJob {
+  uint64_t id_;
+  bool plan_;        // A saved plan, else an OMNI YAML file
+  std::string path_; // Absolute
+  std::string cwd_;  // The client's; relative paths in the job start here
+  int priority_;     // Higher runs first
+
+  IngestJob() : id_(0), plan_(false), priority_(0) {}
+};
+
+/**
+ * Daemon that runs submitted jobs one at a time over warm in-process state
+ */
+class IngestServer {
+public:
+  static constexpr int ACCEPT_POLL_MS = 200;
+  static constexpr int REQUEST_TIMEOUT_MS = 5000;
+  static constexpr int SEND_TIMEOUT_MS = 30000;
+  static constexpr size_t MAX_REQUEST = 16384;
+  static constexpr int MAX_ADMITTING = 64; // Requests read at once
+
+  /** Runs a job with stdout and stderr sent to its client; returns its
+   *  exit code */
+  using Runner = std::function<int(const IngestJob &)>;
+
+  /** Priority of a job; throws if the job cannot be read */
+  using Classifier = std::function<int(const IngestJob &)>;
+
+  /**
+   * @param socket_path Socket to listen on
+   * @param runner Runs a job
+   * @param classify Priority of a job when it is submitted
+   */
+  IngestServer(const std::string &socket_path, Runner runner,
+               Classifier classify);
+
+  /**
+   * Serve until RequestStop; jobs still queued then are refused
+   * @return 0, or 1 if the socket could not be opened
+   */
+  int Run();
+
+  /** Stop after the running job; signal safe */
+  static void RequestStop();
+
+  /** $CAE_SOCKET, else $XDG_RUNTIME_DIR/cae/wrp.sock, else
+   *  /tmp/cae-<uid>/wrp.sock */
+  static std::string GetDefaultSocketPath();
+
+private:
+  /** A job with its client's connection */
+  struct Pending {
+    IngestJob job_;
+    int fd_;
+  };
+
+  void AcceptLoop(int listen_fd);
+  void Admit(int fd);
+  void Execute(Pending &pending);
+  void Log(const std::string &line);
+
+  std::string socket_path_;
+  Runner runner_;
+  Classifier classify_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<Pending> queue_;
+  bool running_;
+  int admitting_; // Connections whose request is being read
+  uint64_t next_id_;
+  std::streambuf *log_; // The daemon's own stdout
+  std::mutex log_mtx_;
+};
+
+/**
+ * Client side of the ingest service
+ */
+class IngestClient {
+public:
+  /**
+   * Submit a job and copy its output to stdout and stderr
+   * @param socket_path Socket of the service
+   * @param job The job; path_ and cwd_ are made absolute
+   * @return The job's exit code, 1 if the service could not be reached
+   */
+  static int Submit(const std::string &socket_path, IngestJob job);
+};
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_INGEST_SERVER_H_
@@ -0,0 +1,373 @@
+#include "job_plan.h"
+#include "format/format_registry.h"
+#include "io/file_layout.h"
+#include "repo/file_pattern.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace cae {
+
+namespace {
+
+constexpr char PLAN_MAGIC[8] = {'C', 'A', 'E', 'P', 'L', 'A', 'N', '3'};
+constexpr uint64_t PLAN_BYTE_ORDER = 0x0102030405060708ULL;
+
+/** Plan file header; entries, files and strings follow in that order */
+struct PlanHeader {
+  char magic_[8];
+  uint64_t byte_order_; // Plans are only read on hosts of the same order
+  uint64_t nentries_;
+  uint64_t nfiles_;
+  uint64_t strings_size_;
+  PlanString settings_;
+  uint64_t duplicates_;
+};
+
+/** Run fn(i) for i in [0, n) on up to nthreads threads */
+void ParallelFor(size_t n, int nthreads,
+                 const std::function<void(size_t)> &fn) {
+  size_t nworkers = std::min<size_t>(n, static_cast<size_t>(nthreads));
+  if (nworkers <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nworkers; ++t) {
+    threads.emplace_back([&]() {
+      for (size_t i; (i = next++) < n;) {
+        fn(i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+/** Arena that stores each distinct string once */
+class StringArena {
+public:
+  explicit StringArena(std::vector<char> &bytes) : bytes_(bytes) {}
+
+  PlanString Add(const std::string &s) {
+    auto it = index_.find(s);
+    if (it != index_.end()) {
+      return it->second;
+    }
+    PlanString ref{bytes_.size(), s.size()};
+    bytes_.insert(bytes_.end(), s.begin(), s.end());
+    index_.emplace(s, ref);
+    return ref;
+  }
+
+private:
+  std::vector<char> &bytes_;
+  std::unordered_map<std::string, PlanString> index_;
+};
+
+bool InRange(const PlanString &s, size_t size) {
+  return s.offset_ <= size && s.length_ <= size - s.offset_;
+}
+
+} // namespace
+
+JobPlan::JobPlan()
+    : map_(nullptr), map_size_(0), entries_(nullptr), nentries_(0),
+      files_(nullptr), nfiles_(0), strings_(""), strings_size_(0),
+      settings_{0, 0}, duplicates_(0) {}
+
+JobPlan::~JobPlan() { Release(); }
+
+JobPlan::JobPlan(JobPlan &&other) noexcept : JobPlan() {
+  *this = std::move(other);
+}
+
+JobPlan &JobPlan::operator=(JobPlan &&other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  Release();
+  entry_store_ = std::move(other.entry_store_);
+  file_store_ = std::move(other.file_store_);
+  string_store_ = std::move(other.string_store_);
+  map_ = other.map_;
+  map_size_ = other.map_size_;
+  entries_ = other.entries_;
+  nentries_ = other.nentries_;
+  files_ = other.files_;
+  nfiles_ = other.nfiles_;
+  strings_ = other.strings_;
+  strings_size_ = other.strings_size_;
+  settings_ = other.settings_;
+  duplicates_ = other.duplicates_;
+  if (!map_) {
+    Bind();
+  }
+  other.map_ = nullptr;
+  other.map_size_ = 0;
+  other.Bind();
+  other.settings_ = PlanString{0, 0};
+  other.duplicates_ = 0;
+  return *this;
+}
+
+void JobPlan::Bind() {
+  entries_ = entry_store_.data();
+  nentries_ = entry_store_.size();
+  files_ = file_store_.data();
+  nfiles_ = file_store_.size();
+  strings_ = string_store_.empty() ? "" : string_store_.data();
+  strings_size_ = string_store_.size();
+}
+
+void JobPlan::Release() {
+  if (map_) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
+  }
+}
+
+JobPlan JobPlan::Build(const std::vector<PlanEntrySpec> &specs,
+                       const std::string &settings, int nthreads) {
+  if (nthreads <= 0) {
+    nthreads = DEFAULT_THREADS;
+  }
+
+  // Expand each distinct pattern once, concurrently
+  std::unordered_map<std::string, size_t> pattern_index;
+  std::vector<const std::string *> patterns;
+  std::vector<size_t> spec_pattern(specs.size());
+  for (size_t i = 0; i < specs.size(); ++i) {
+    auto it = pattern_index.emplace(specs[i].pattern_, patterns.size());
+    if (it.second) {
+      patterns.push_back(&specs[i].pattern_);
+    }
+    spec_pattern[i] = it.first->second;
+  }
+  std::vector<std::vector<std::string>> expanded(patterns.size());
+  StatCache stats;
+  ParallelFor(patterns.size(), nthreads, [&](size_t i) {
+    expanded[i] = ExpandFilePattern(ExpandPath(*patterns[i]), &stats);
+  });
+
+  // Keep the first entry that lists a file range
+  struct Pending {
+    const std::string *path_;
+    size_t spec_;
+  };
+  std::vector<Pending> pending;
+  std::vector<std::pair<size_t, size_t>> spec_files(specs.size());
+  std::unordered_set<std::string> seen;
+  JobPlan plan;
+  for (size_t i = 0; i < specs.size(); ++i) {
+    spec_files[i].first = pending.size();
+    for (const auto &path : expanded[spec_pattern[i]]) {
+      std::string key =
+          std::filesystem::absolute(path).lexically_normal().string() + '\0' +
+          std::to_string(specs[i].offset_) + '\0' +
+          std::to_string(specs[i].size_);
+      if (!seen.insert(std::move(key)).second) {
+        ++plan.duplicates_;
+        continue;
+      }
+      pending.push_back(Pending{&path, i});
+    }
+    spec_files[i].second = pending.size() - spec_files[i].first;
+  }
+
+  // One stat, shared with the expansion, and one open per file for its
+  // format and compression
+  std::vector<FileLayout> layouts(pending.size());
+  std::vector<std::string> formats(pending.size());
+  ParallelFor(pending.size(), nthreads, [&](size_t i) {
+    const Pending &p = pending[i];
+    std::string head;
+    struct stat st;
+    if (stats.Stat(*p.path_, st)) {
+      layouts[i].FromStat(st);
+      int fd = S_ISREG(st.st_mode) ? open(p.path_->c_str(), O_RDONLY) : -1;
+      if (fd >= 0) {
+        layouts[i].compression_ =
+            static_cast<uint64_t>(DetectCompression(fd));
+        head.resize(FormatRegistry::MAX_MAGIC_SIZE);
+        ssize_t n = pread(fd, &head[0], head.size(), 0);
+        head.resize(n > 0 ? static_cast<size_t>(n) : 0);
+        close(fd);
+      }
+    }
+    formats[i] = specs[p.spec_].format_;
+    if (formats[i].empty()) {
+      const FormatCapabilities *caps =
+          FormatRegistry::Get().Detect(*p.path_, head);
+      formats[i] = caps ? caps->name_ : "binary";
+    }
+  });
+
+  StringArena arena(plan.string_store_);
+  plan.settings_ = arena.Add(settings);
+  plan.entry_store_.reserve(specs.size());
+  plan.file_store_.reserve(pending.size());
+  for (size_t i = 0; i < specs.size(); ++i) {
+    const PlanEntrySpec &spec = specs[i];
+    PlanEntry entry;
+    entry.description_ = arena.Add(spec.description_);
+    entry.hash_ = arena.Add(spec.hash_);
+    entry.channel_ = arena.Add(spec.channel_);
+    entry.first_file_ = spec_files[i].first;
+    entry.nfiles_ = spec_files[i].second;
+    entry.priority_ = static_cast<uint64_t>(spec.qos_.priority_);
+    entry.bandwidth_ = spec.qos_.bandwidth_;
+    entry.iops_ = spec.qos_.iops_;
+    plan.entry_store_.push_back(entry);
+  }
+  for (size_t i = 0; i < pending.size(); ++i) {
+    const PlanEntrySpec &spec = specs[pending[i].spec_];
+    PlanFile file;
+    file.path_ = arena.Add(*pending[i].path_);
+    file.format_ = arena.Add(formats[i]);
+    file.offset_ = spec.offset_;
+    file.size_ = spec.size_;
+    file.file_size_ = layouts[i].size_;
+    file.allocated_ = layouts[i].allocated_;
+    file.io_block_ = layouts[i].io_block_;
+    file.compression_ = layouts[i].compression_;
+    if (layouts[i].valid_) {
+      if (spec.offset_ >= file.file_size_ && file.file_size_ > 0) {
+        std::cerr << "Warning: Offset " << spec.offset_
+                  << " is beyond file size " << file.file_size_ << " for "
+                  << *pending[i].path_ << std::endl;
+      }
+    } else {
+      std::cerr << "Warning: Could not determine file size for "
+                << *pending[i].path_ << std::endl;
+    }
+    plan.file_store_.push_back(file);
+  }
+  plan.Bind();
+  return plan;
+}
+
+JobPlan JobPlan::Map(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open plan " + path + ": " +
+                             std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(PlanHeader)) {
+    close(fd);
+    throw std::runtime_error("Invalid plan file: " + path);
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Could not map plan " + path + ": " +
+                             std::strerror(errno));
+  }
+
+  JobPlan plan;
+  plan.map_ = map;
+  plan.map_size_ = size;
+  const PlanHeader *header = static_cast<const PlanHeader *>(map);
+  const char *base = static_cast<const char *>(map);
+  size_t records = sizeof(PlanHeader);
+  bool valid = std::memcmp(header->magic_, PLAN_MAGIC, 8) == 0 &&
+               header->byte_order_ == PLAN_BYTE_ORDER &&
+               header->nentries_ <= size / sizeof(PlanEntry) &&
+               header->nfiles_ <= size / sizeof(PlanFile);
+  if (valid) {
+    records += header->nentries_ * sizeof(PlanEntry) +
+               header->nfiles_ * sizeof(PlanFile);
+    valid = records <= size && header->strings_size_ == size - records;
+  }
+  if (!valid) {
+    throw std::runtime_error("Invalid plan file: " + path);
+  }
+  plan.entries_ =
+      reinterpret_cast<const PlanEntry *>(base + sizeof(PlanHeader));
+  plan.nentries_ = header->nentries_;
+  plan.files_ = reinterpret_cast<const PlanFile *>(plan.entries_ +
+                                                   plan.nentries_);
+  plan.nfiles_ = header->nfiles_;
+  plan.strings_ = base + records;
+  plan.strings_size_ = header->strings_size_;
+  plan.settings_ = header->settings_;
+  plan.duplicates_ = header->duplicates_;
+
+  // Every reference must stay inside the mapping
+  size_t nstrings = plan.strings_size_;
+  valid = InRange(plan.settings_, nstrings);
+  for (size_t i = 0; valid && i < plan.nentries_; ++i) {
+    const PlanEntry &e = plan.entries_[i];
+    valid = InRange(e.description_, nstrings) && InRange(e.hash_, nstrings) &&
+            InRange(e.channel_, nstrings) && e.first_file_ <= plan.nfiles_ &&
+            e.nfiles_ <= plan.nfiles_ - e.first_file_ &&
+            e.priority_ <= static_cast<uint64_t>(QosPriority::kHigh);
+  }
+  for (size_t i = 0; valid && i < plan.nfiles_; ++i) {
+    valid = InRange(plan.files_[i].path_, nstrings) &&
+            InRange(plan.files_[i].format_, nstrings);
+  }
+  if (!valid) {
+    throw std::runtime_error("Corrupt plan file: " + path);
+  }
+  return plan;
+}
+
+void JobPlan::Save(const std::string &path) const {
+  PlanHeader header;
+  std::memcpy(header.magic_, PLAN_MAGIC, sizeof(PLAN_MAGIC));
+  header.byte_order_ = PLAN_BYTE_ORDER;
+  header.nentries_ = nentries_;
+  header.nfiles_ = nfiles_;
+  header.strings_size_ = strings_size_;
+  header.settings_ = settings_;
+  header.duplicates_ = duplicates_;
+
+  // A new file under a name no one can guess, renamed over the plan, so a
+  // link planted at either name is never followed
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkostemp(&tmp[0], O_CLOEXEC);
+  FILE *out = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+  if (fd >= 0 && out == nullptr) {
+    close(fd);
+  }
+  bool ok = out != nullptr;
+  if (ok) {
+    ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+         std::fwrite(entries_, sizeof(PlanEntry), nentries_, out) ==
+             nentries_ &&
+         std::fwrite(files_, sizeof(PlanFile), nfiles_, out) == nfiles_ &&
+         std::fwrite(strings_, 1, strings_size_, out) == strings_size_;
+    ok = std::fclose(out) == 0 && ok;
+  }
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    if (fd >= 0) {
+      std::remove(tmp.c_str());
+    }
+    throw std::runtime_error("Could not write plan: " + path);
+  }
+}
+
+} // namespace cae
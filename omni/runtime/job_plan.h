@@ -0,0 +1,161 @@
+#ifndef CAE_RUNTIME_JOB_PLAN_H_
+#define CAE_RUNTIME_JOB_PLAN_H_
+
+#include "io/io_throttle.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Job Planning Strategy:
+ *
+ * 1. Expansion: The path patterns of all data entries are expanded by a
+ *    pool of threads; a pattern used by several entries is expanded once
+ * 2. Deduplication: A file range listed by several entries is imported
+ *    once, by the first entry that lists it
+ * 3. Metadata: Every file is stat'ed once, in parallel, sharing the stat
+ *    results of the expansion, and opened once to detect its format and
+ *    compression, so launching needs no further file system calls. Workers
+ *    read these layouts from the plan instead of stat'ing the files again
+ *    (see io/file_layout.h)
+ * 4. Compact Plan: Entries and files are fixed-size records that refer to
+ *    strings in one arena, where repeated strings (descriptions, formats,
+ *    channels) are stored once. Plans are move-only
+ * 5. Plan Files: A plan can be saved together with the job settings and
+ *    mapped back with mmap; the records are used in place, so a saved plan
+ *    runs without parsing the YAML or touching the file system
+ */
+
+namespace cae {
+
+/** String in the arena of a plan */
+struct PlanString {
+  uint64_t offset_;
+  uint64_t length_;
+};
+
+/**
+ * A data entry of the job
+ */
+struct PlanEntry {
+  PlanString description_; // Comma-separated tags
+  PlanString hash_;
+  PlanString channel_; // Empty = the job's output
+  uint64_t first_file_;
+  uint64_t nfiles_;
+  uint64_t priority_;  // QosPriority
+  uint64_t bandwidth_; // Bytes per second, 0 = unlimited
+  uint64_t iops_;      // 0 = unlimited
+};
+
+/**
+ * A file range to import
+ */
+struct PlanFile {
+  PlanString path_;
+  PlanString format_; // Resolved format name
+  uint64_t offset_;
+  uint64_t size_;      // 0 = to end of file
+  uint64_t file_size_; // 0 if the file could not be stat'ed
+  uint64_t allocated_; // Allocated bytes, which size the job
+  uint64_t io_block_;  // Preferred I/O size, 0 if not stat'ed
+  uint64_t compression_; // Compression of the file
+};
+
+/**
+ * A data entry as written in the job file, before expansion
+ */
+struct PlanEntrySpec {
+  std::string pattern_; // File, directory or glob
+  size_t offset_;
+  size_t size_; // 0 = to end of file
+  std::string description_;
+  std::string hash_;
+  std::string format_; // Empty = detected per file
+  std::string channel_;
+  QosLimits qos_; // The entry's own limits; the job's apply as well
+
+  PlanEntrySpec() : offset_(0), size_(0) {}
+};
+
+/**
+ * Expanded, deduplicated work of a job, built in memory or mapped from a
+ * plan file
+ */
+class JobPlan {
+public:
+  static constexpr int DEFAULT_THREADS = 16; // Planning is latency bound
+
+  JobPlan();
+  ~JobPlan();
+  JobPlan(JobPlan &&other) noexcept;
+  JobPlan &operator=(JobPlan &&other) noexcept;
+  JobPlan(const JobPlan &) = delete;
+  JobPlan &operator=(const JobPlan &) = delete;
+
+  /**
+   * Expand, deduplicate and stat the entries of a job
+   * @param specs Data entries in job order
+   * @param settings Job settings stored with the plan (YAML)
+   * @param nthreads Planning threads, 0 = DEFAULT_THREADS
+   */
+  static JobPlan Build(const std::vector<PlanEntrySpec> &specs,
+                       const std::string &settings, int nthreads = 0);
+
+  /**
+   * Map a plan file saved by Save
+   * @throws std::runtime_error if the file is not a valid plan
+   */
+  static JobPlan Map(const std::string &path);
+
+  /**
+   * Save the plan for Map: written to a new file created with mkstemp
+   * next to path, then renamed over it
+   * @throws std::runtime_error on write errors
+   */
+  void Save(const std::string &path) const;
+
+  size_t GetEntryCount() const { return nentries_; }
+  const PlanEntry &GetEntry(size_t i) const { return entries_[i]; }
+  size_t GetFileCount() const { return nfiles_; }
+  const PlanFile &GetFile(size_t i) const { return files_[i]; }
+
+  /** File ranges dropped because an earlier entry imports them */
+  size_t GetDuplicateCount() const { return duplicates_; }
+
+  /** Text of a string in the arena */
+  std::string_view GetString(const PlanString &s) const {
+    return std::string_view(strings_ + s.offset_, s.length_);
+  }
+
+  /** Job settings given to Build */
+  std::string_view GetSettings() const { return GetString(settings_); }
+
+private:
+  /** Point the views at the owned storage */
+  void Bind();
+  void Release();
+
+  // Storage of a built plan
+  std::vector<PlanEntry> entry_store_;
+  std::vector<PlanFile> file_store_;
+  std::vector<char> string_store_;
+  // Mapping of a plan file
+  void *map_;
+  size_t map_size_;
+  // Views of either
+  const PlanEntry *entries_;
+  size_t nentries_;
+  const PlanFile *files_;
+  size_t nfiles_;
+  const char *strings_;
+  size_t strings_size_;
+  PlanString settings_;
+  size_t duplicates_;
+};
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_JOB_PLAN_H_
@@ -0,0 +1,370 @@
+#include "local_runner.h"
+#include "catalog/catalog_writer.h"
+#include "catalog/metadata_collector.h"
+#include "format/format_registry.h"
+#include "io/compressed_reader.h"
+#include "runtime/cpu_topology.h"
+#include "runtime/range_work_queue.h"
+#include "util/hash.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+namespace cae {
+
+namespace {
+
+/** A scheduling unit: part of one task's range */
+struct Block {
+  size_t task_;
+  size_t offset_;
+  size_t size_;
+};
+
+/** Progress and output of one task while the pool runs */
+struct TaskState {
+  std::mutex mtx_;
+  bool opened_ = false;
+  std::string sink_error_; // Sticky: later blocks fail the same way
+  std::shared_ptr<OutputSink> sink_;
+  bool shared_sink_ = false; // A channel sink, closed after the run
+  std::atomic<size_t> blocks_left_{0};
+  LocalResult result_;
+};
+
+/** Dataset directory of a task */
+std::string GetDatasetDir(const LocalTask &task) {
+  return task.output_dir_ + "/" +
+         OutputSink::GetDatasetName(task.path_, task.offset_, task.size_);
+}
+
+/**
+ * Close a task's own sink and write its manifest, or print its summary
+ * when there is no output directory
+ */
+void CloseTaskSink(const LocalTask &task, TaskState &state) {
+  if (!state.sink_ || state.shared_sink_) {
+    return;
+  }
+  state.sink_->Close();
+  if (task.output_dir_.empty()) {
+    std::cout << "Output (" << task.sink_.name_
+              << "): " << state.sink_->GetSummary() << std::endl;
+  } else {
+    std::string dir = GetDatasetDir(task);
+    std::filesystem::create_directories(dir);
+    OutputSink::WriteManifest(dir, task.sink_.name_,
+                              {state.sink_->GetSummary()});
+  }
+  state.sink_.reset();
+}
+
+/** Whether a failure can be imported again from where it stopped */
+bool IsRetriable(const ImportFailure &failure) {
+  return failure.resumable_ && failure.size_ > 0;
+}
+
+} // namespace
+
+LocalRunner::LocalRunner(const LocalOptions &opts)
+    : opts_(opts), cpus_(CpuTopology::GetAllowedCpus()), steals_(0) {
+  nthreads_ = opts_.nthreads_ > 0 ? opts_.nthreads_
+                                  : static_cast<int>(cpus_.size());
+}
+
+std::vector<LocalResult> LocalRunner::Run(const std::vector<LocalTask> &tasks) {
+  std::vector<TaskState> states(tasks.size());
+  std::shared_ptr<MetadataCollector> catalog;
+  if (!opts_.catalog_dir_.empty()) {
+    catalog = std::make_shared<MetadataCollector>();
+  }
+
+  // Cut every range into blocks; compressed ranges are in uncompressed
+  // bytes and their blocks span at least one access point
+  std::vector<Block> blocks;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    const LocalTask &task = tasks[i];
+    TaskState &state = states[i];
+    const FormatCapabilities *caps = FormatRegistry::Get().Find(task.format_);
+    if (!caps) {
+      state.result_.failures_.emplace_back(task.path_, task.offset_,
+                                           task.size_, false,
+                                           "Unknown format: " + task.format_);
+      continue;
+    }
+    size_t total = task.file_size_;
+    if (total == 0) {
+      std::error_code ec;
+      total = std::filesystem::file_size(task.path_, ec);
+    }
+    size_t min_block = 0;
+    if (opts_.decompress_) {
+      int fd = open(task.path_.c_str(), O_RDONLY);
+      if (fd >= 0) {
+        Compression compression = DetectCompression(fd);
+        close(fd);
+        if (compression != Compression::kNone) {
+          try {
+            auto index = CompressedIndex::Get(task.path_, compression);
+            total = index->uncompressed_size_;
+            min_block = index->GetMaxSpan();
+          } catch (const std::exception &e) {
+            state.result_.failures_.emplace_back(task.path_, task.offset_,
+                                                 task.size_, false, e.what());
+            continue;
+          }
+        }
+      }
+    }
+    size_t begin = std::min(task.offset_, total);
+    size_t end = task.size_ ? begin + std::min(task.size_, total - begin)
+                            : total;
+    state.result_.bytes_ = end - begin;
+    size_t block_size = caps->granularity_ ? caps->granularity_
+                                           : LocalOptions::DEFAULT_BLOCK_SIZE;
+    block_size = std::max(block_size, min_block);
+    if (!caps->splittable_) {
+      block_size = std::max<size_t>(end - begin, 1);
+    }
+    size_t count = 0;
+    for (size_t off = begin; off < end; off += block_size) {
+      blocks.push_back({i, off, std::min(block_size, end - off)});
+      ++count;
+    }
+    state.blocks_left_ = count;
+    if (catalog) {
+      catalog->AddFile(task.path_, task.format_, task.description_);
+    }
+  }
+
+  // Channel sinks are shared by every range that publishes to the channel
+  std::mutex channels_mtx;
+  std::map<std::string, std::shared_ptr<OutputSink>> channels;
+
+  auto open_sink = [&](size_t i) -> std::shared_ptr<OutputSink> {
+    const LocalTask &task = tasks[i];
+    TaskState &state = states[i];
+    std::lock_guard<std::mutex> lock(state.mtx_);
+    if (!state.opened_) {
+      state.opened_ = true;
+      try {
+        if (task.sink_.name_ == "shm") {
+          std::lock_guard<std::mutex> channels_lock(channels_mtx);
+          std::shared_ptr<OutputSink> &sink =
+              channels[task.sink_.channel_.name_];
+          if (!sink) {
+            sink = SinkFactory::Get(task.sink_);
+            sink->Open(SinkContext());
+          }
+          state.sink_ = sink;
+          state.shared_sink_ = true;
+        } else {
+          state.sink_ = SinkFactory::Get(task.sink_);
+          if (state.sink_) {
+            SinkContext ctx;
+            if (!task.output_dir_.empty()) {
+              ctx.output_dir_ = GetDatasetDir(task);
+            }
+            state.sink_->Open(ctx);
+          }
+        }
+      } catch (const std::exception &e) {
+        state.sink_error_ = e.what();
+        state.sink_.reset();
+      }
+    }
+    if (!state.sink_error_.empty()) {
+      throw std::runtime_error(state.sink_error_);
+    }
+    return state.sink_;
+  };
+
+  auto create_client = [&](const std::string &format) {
+    std::unique_ptr<FormatClient> client = FormatRegistry::Get().Create(format);
+    client->SetOption("decompress", opts_.decompress_ ? "true" : "false");
+    client->SetOption("extents", ExtentMethodName(opts_.extent_method_));
+    client->SetOption("io_depth", "1");
+    client->SetOption("auto_tune", opts_.auto_tune_ ? "true" : "false");
+    client->SetOption("retries", std::to_string(opts_.retry_.attempts_));
+    client->SetOption("retry_backoff_ms",
+                      std::to_string(opts_.retry_.backoff_ms_));
+    client->SetCatalog(catalog);
+    return client;
+  };
+
+  // Import one range with a client; failures go to the task
+  auto import = [&](FormatClient &client, size_t i, size_t offset,
+                    size_t size) {
+    const LocalTask &task = tasks[i];
+    TaskState &state = states[i];
+    FormatContext ctx;
+    ctx.filename_ = task.path_;
+    ctx.description_ = task.description_;
+    ctx.hash_ = task.hash_;
+    ctx.offset_ = offset;
+    ctx.size_ = size;
+    std::vector<ImportFailure> failures;
+    try {
+      client.SetSink(open_sink(i));
+      client.SetThrottle(task.throttle_);
+      client.Import(ctx);
+      failures = client.TakeFailures();
+    } catch (const std::exception &e) {
+      // Part of the block may have been passed on
+      failures = client.TakeFailures();
+      failures.emplace_back(task.path_, offset, size, false, e.what());
+    }
+    std::lock_guard<std::mutex> lock(state.mtx_);
+    state.result_.failures_.insert(state.result_.failures_.end(),
+                                   failures.begin(), failures.end());
+  };
+
+  // Import blocks [first, last) on the pool
+  auto run_blocks = [&](size_t first, size_t last) {
+    int nthreads = static_cast<int>(
+        std::max<size_t>(1, std::min<size_t>(nthreads_, last - first)));
+    RangeWorkQueue queue(first, last - first, 1, nthreads);
+
+    auto worker = [&](int tid) {
+      ApplyThreadPlacement(opts_.thread_binding_, cpus_, tid);
+      std::map<std::string, std::unique_ptr<FormatClient>> clients;
+      size_t index, count;
+      while (queue.Next(tid, index, count)) {
+        const Block &block = blocks[index];
+        const LocalTask &task = tasks[block.task_];
+        TaskState &state = states[block.task_];
+        std::unique_ptr<FormatClient> &client = clients[task.format_];
+        try {
+          if (!client) {
+            client = create_client(task.format_);
+          }
+        } catch (const std::exception &e) {
+          std::lock_guard<std::mutex> lock(state.mtx_);
+          state.result_.failures_.emplace_back(task.path_, block.offset_,
+                                               block.size_, true, e.what());
+        }
+        if (client) {
+          import(*client, block.task_, block.offset_, block.size_);
+        }
+
+        // The last block closes the output, unless a range will be retried
+        if (--state.blocks_left_ == 0) {
+          std::lock_guard<std::mutex> lock(state.mtx_);
+          auto &failures = state.result_.failures_;
+          if (std::none_of(failures.begin(), failures.end(), IsRetriable)) {
+            try {
+              CloseTaskSink(task, state);
+            } catch (const std::exception &e) {
+              failures.emplace_back(task.path_, task.offset_, task.size_, false,
+                                    e.what());
+            }
+          }
+        }
+      }
+    };
+
+    if (nthreads == 1) {
+      worker(0);
+    } else {
+      std::vector<std::thread> threads;
+      for (int t = 0; t < nthreads; ++t) {
+        threads.emplace_back(worker, t);
+      }
+      for (auto &t : threads) {
+        t.join();
+      }
+    }
+    steals_ += queue.GetStealCount();
+  };
+
+  // Higher priority classes first, each on its own run of the pool
+  std::stable_sort(blocks.begin(), blocks.end(),
+                   [&](const Block &a, const Block &b) {
+                     return tasks[a.task_].priority_ >
+                            tasks[b.task_].priority_;
+                   });
+  steals_ = 0;
+  for (size_t first = 0, last; first < blocks.size(); first = last) {
+    QosPriority priority = tasks[blocks[first].task_].priority_;
+    last = first;
+    while (last < blocks.size() &&
+           tasks[blocks[last].task_].priority_ == priority) {
+      ++last;
+    }
+    run_blocks(first, last);
+  }
+
+  // Resumable failures get one more attempt with fresh clients
+  std::map<std::string, std::unique_ptr<FormatClient>> clients;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    TaskState &state = states[i];
+    std::vector<ImportFailure> retry;
+    auto &failures = state.result_.failures_;
+    auto split = std::stable_partition(
+        failures.begin(), failures.end(),
+        [](const ImportFailure &f) { return !IsRetriable(f); });
+    retry.assign(split, failures.end());
+    failures.erase(split, failures.end());
+    for (const auto &failure : retry) {
+      std::cerr << "Retrying " << failure.filename_ << " [" << failure.offset_
+                << ", +" << failure.size_ << ") (" << failure.reason_ << ")"
+                << std::endl;
+      try {
+        std::unique_ptr<FormatClient> &client = clients[tasks[i].format_];
+        if (!client) {
+          client = create_client(tasks[i].format_);
+        }
+        import(*client, i, failure.offset_, failure.size_);
+      } catch (const std::exception &e) {
+        failures.emplace_back(failure.filename_, failure.offset_,
+                              failure.size_, false, e.what());
+      }
+    }
+    try {
+      CloseTaskSink(tasks[i], state);
+    } catch (const std::exception &e) {
+      failures.emplace_back(tasks[i].path_, tasks[i].offset_, tasks[i].size_,
+                            false, e.what());
+    }
+  }
+
+  for (const auto &channel : channels) {
+    channel.second->Close();
+    std::cout << "Output (shm " << channel.first
+              << "): " << channel.second->GetSummary() << std::endl;
+  }
+
+  if (catalog) {
+    std::map<std::string, FileMetadata> files = catalog->TakeFiles();
+    // Parts of jobs run at the same time must not collide
+    std::string key =
+        std::to_string(getpid()) + ":" +
+        std::to_string(
+            std::chrono::system_clock::now().time_since_epoch().count());
+    size_t count = CatalogWriter::WritePart(
+        opts_.catalog_dir_,
+        "local-" + Xxh64::ToHex(Xxh64::Hash(key.data(), key.size())), files,
+        opts_.decompress_);
+    std::cout << "Catalog: " << count << " file(s) described in "
+              << opts_.catalog_dir_ << std::endl;
+  }
+
+  std::vector<LocalResult> results;
+  results.reserve(tasks.size());
+  for (auto &state : states) {
+    results.push_back(std::move(state.result_));
+  }
+  return results;
+}
+
+} // namespace cae
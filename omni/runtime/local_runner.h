@@ -0,0 +1,115 @@
+#ifndef CAE_RUNTIME_LOCAL_RUNNER_H_
+#define CAE_RUNTIME_LOCAL_RUNNER_H_
+
+#include "format/format_client.h"
+#include "io/file_extents.h"
+#include "io/io_throttle.h"
+#include "io/retry_policy.h"
+#include "runtime/placement.h"
+#include "sink/sink_factory.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Single-Node Execution Strategy:
+ *
+ * 1. In-Process: The format clients run inside wrp on one pool of threads;
+ *    no MPI runtime is initialized and no process is started
+ * 2. One Pool: Every planned file range is cut into blocks (the format's
+ *    granularity, else 16MB; whole files for formats that cannot be split)
+ *    and all blocks of the job share one work-stealing queue, so a thread
+ *    that finishes its files takes over the rest of another's
+ * 3. Same Output: Each range gets the dataset directory, manifest and
+ *    catalog entry a worker launch would have written; shared-memory
+ *    channels are opened once and shared by the ranges that use them
+ * 4. Failures: Ranges that fail with a resumable error are imported once
+ *    more after the pool drains, as a worker does across its ranks
+ * 5. Priority: The blocks of higher priority classes are all taken before
+ *    a block of a lower class starts; each task reads through its entry's
+ *    throttle, if any (see io/io_throttle.h)
+ */
+
+namespace cae {
+
+/**
+ * A file range imported in-process
+ */
+struct LocalTask {
+  std::string path_;
+  std::string format_;
+  std::string description_;
+  std::string hash_;
+  size_t offset_;
+  size_t size_;      // 0 = to end of file
+  size_t file_size_; // From the plan, 0 = unknown
+  SinkConfig sink_;
+  std::string output_dir_; // Parent of the dataset, empty = no directory
+  QosPriority priority_;
+  std::shared_ptr<IoThrottle> throttle_; // Null = unthrottled
+
+  LocalTask()
+      : offset_(0), size_(0), file_size_(0),
+        priority_(QosPriority::kNormal) {}
+};
+
+/**
+ * Settings of an in-process import, as passed to workers otherwise
+ */
+struct LocalOptions {
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 16 * 1024 * 1024;
+
+  int nthreads_; // 0 = one per CPU the process may use
+  ThreadBinding thread_binding_;
+  ExtentMethod extent_method_;
+  bool decompress_;
+  bool auto_tune_;
+  RetryPolicy retry_;
+  std::string catalog_dir_; // Empty = no catalog
+
+  LocalOptions()
+      : nthreads_(0), thread_binding_(ThreadBinding::kCore),
+        extent_method_(ExtentMethod::kSeekData), decompress_(true),
+        auto_tune_(true) {}
+};
+
+/**
+ * Outcome of one task
+ */
+struct LocalResult {
+  size_t bytes_; // Bytes of the range, in uncompressed coordinates
+  std::vector<ImportFailure> failures_;
+
+  LocalResult() : bytes_(0) {}
+};
+
+/**
+ * Imports file ranges on a work-stealing thread pool in this process
+ */
+class LocalRunner {
+public:
+  explicit LocalRunner(const LocalOptions &opts);
+
+  /**
+   * Import every task
+   * @return The outcome of each task, in task order
+   */
+  std::vector<LocalResult> Run(const std::vector<LocalTask> &tasks);
+
+  /** Threads of the pool, before it is fitted to the number of blocks */
+  int GetThreadCount() const { return nthreads_; }
+
+  /** Blocks taken over from other threads by the last Run */
+  size_t GetStealCount() const { return steals_; }
+
+private:
+  LocalOptions opts_;
+  std::vector<int> cpus_; // CPUs the threads are placed on
+  int nthreads_;
+  size_t steals_;
+};
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_LOCAL_RUNNER_H_
@@ -0,0 +1,158 @@
+#ifndef CAE_RUNTIME_PLACEMENT_H_
+#define CAE_RUNTIME_PLACEMENT_H_
+
+#include "cpu_topology.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Rank and Thread Placement Policies:
+ *
+ * 1. Rank Placement: map_by / bind_to values are passed straight to mpirun
+ *    (--map-by / --bind-to), so ranks stay on the socket or NUMA domain they
+ *    were started on
+ * 2. Thread Placement: Inside a rank, threads are bound to one core each
+ *    (core), to every CPU of the rank's NUMA domain (numa), or left to the
+ *    OS scheduler (none)
+ * 3. Buffers: Read buffers are allocated by each thread after it is bound,
+ *    so first touch places them on the thread's local node
+ */
+
+namespace cae {
+
+/**
+ * How a rank's threads are bound to CPUs
+ */
+enum class ThreadBinding { kNone, kCore, kNuma };
+
+/** Parse a thread binding name ("none", "core", "numa") */
+inline bool ParseThreadBinding(const std::string &name,
+                               ThreadBinding &binding) {
+  if (name == "none") {
+    binding = ThreadBinding::kNone;
+  } else if (name == "core") {
+    binding = ThreadBinding::kCore;
+  } else if (name == "numa") {
+    binding = ThreadBinding::kNuma;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/** Name of a thread binding */
+inline const char *ThreadBindingName(ThreadBinding binding) {
+  switch (binding) {
+  case ThreadBinding::kNone:
+    return "none";
+  case ThreadBinding::kCore:
+    return "core";
+  case ThreadBinding::kNuma:
+    return "numa";
+  }
+  return "unknown";
+}
+
+/**
+ * Placement requested for the ranks and threads of a job
+ */
+struct PlacementPolicy {
+  std::string map_by_;  // mpirun --map-by (empty = launcher default)
+  std::string bind_to_; // mpirun --bind-to (empty = launcher default)
+  ThreadBinding thread_binding_;
+
+  PlacementPolicy() : thread_binding_(ThreadBinding::kCore) {}
+
+  /** Whether a value is a supported --map-by object */
+  static bool IsValidMapBy(const std::string &value) {
+    static const char *kValues[] = {"slot",    "hwthread", "core", "l1cache",
+                                    "l2cache", "l3cache",  "numa", "socket",
+                                    "package", "node",     "board"};
+    return IsOneOf(BaseObject(value), kValues,
+                   sizeof(kValues) / sizeof(kValues[0])) ||
+           value.rfind("ppr:", 0) == 0;
+  }
+
+  /** Whether a value is a supported --bind-to object */
+  static bool IsValidBindTo(const std::string &value) {
+    static const char *kValues[] = {"none",    "hwthread", "core",
+                                    "l1cache", "l2cache",  "l3cache",
+                                    "numa",    "socket",   "package", "board"};
+    return IsOneOf(BaseObject(value), kValues,
+                   sizeof(kValues) / sizeof(kValues[0]));
+  }
+
+  /**
+   * mpirun options for this policy
+   * @param nthreads Threads per rank; used for the default policy
+   * @return Options string starting with a space, or empty
+   */
+  std::string GetMpirunOptions(int nthreads) const {
+    std::string map_by = map_by_;
+    std::string bind_to = bind_to_;
+    // Default: one multi-threaded rank per NUMA domain
+    if (map_by.empty() && bind_to.empty() && nthreads > 1) {
+      map_by = "numa";
+      bind_to = "numa";
+    }
+    std::ostringstream opts;
+    if (!map_by.empty()) {
+      opts << " --map-by " << map_by;
+    }
+    if (!bind_to.empty()) {
+      opts << " --bind-to " << bind_to;
+    }
+    return opts.str();
+  }
+
+private:
+  /** Strip modifiers such as ":PE=4" or ":overload-allowed" */
+  static std::string BaseObject(const std::string &value) {
+    std::string base = value.substr(0, value.find(':'));
+    std::transform(base.begin(), base.end(), base.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return base;
+  }
+
+  static bool IsOneOf(const std::string &value, const char *const *values,
+                      size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      if (value == values[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+/**
+ * Bind the calling thread according to a thread binding policy
+ * @param binding Thread binding policy
+ * @param cpus CPUs of the rank (see CpuTopology::SelectRankCpus)
+ * @param tid Thread index within the rank
+ * @return CPU the thread was bound to, or -1 if bound to a set or unbound
+ */
+inline int ApplyThreadPlacement(ThreadBinding binding,
+                                const std::vector<int> &cpus, int tid) {
+  if (cpus.empty()) {
+    return -1;
+  }
+  switch (binding) {
+  case ThreadBinding::kCore: {
+    int cpu = cpus[static_cast<size_t>(tid) % cpus.size()];
+    return CpuTopology::PinCurrentThread(cpu) ? cpu : -1;
+  }
+  case ThreadBinding::kNuma:
+    CpuTopology::BindCurrentThread(cpus);
+    return -1;
+  case ThreadBinding::kNone:
+  default:
+    return -1;
+  }
+}
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_PLACEMENT_H_
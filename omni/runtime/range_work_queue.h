@@ -0,0 +1,141 @@
+#ifndef CAE_RUNTIME_RANGE_WORK_QUEUE_H_
+#define CAE_RUNTIME_RANGE_WORK_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+/**
+ * Intra-Rank Work Stealing Strategy:
+ *
+ * 1. Initial Split: A rank's byte range is cut into fixed-size blocks and
+ *    each thread owns one contiguous run of blocks, so it reads sequentially
+ * 2. Local Work: A thread takes blocks from the front of its own run
+ * 3. Stealing: An idle thread picks the victim with the most blocks left and
+ *    takes the back half of its run, keeping both runs contiguous
+ */
+
+namespace cae {
+
+/**
+ * Byte-range scheduler shared by the threads of one rank
+ */
+class RangeWorkQueue {
+public:
+  /**
+   * @param offset First byte of the range
+   * @param size Number of bytes in the range
+   * @param block_size Scheduling granule in bytes
+   * @param nworkers Number of threads that will call Next()
+   */
+  RangeWorkQueue(size_t offset, size_t size, size_t block_size, int nworkers)
+      : offset_(offset), size_(size),
+        block_size_(std::max<size_t>(block_size, 1)),
+        nworkers_(std::max(nworkers, 1)),
+        slots_(std::make_unique<Slot[]>(static_cast<size_t>(nworkers_))),
+        steals_(0) {
+    size_t nblocks = (size_ + block_size_ - 1) / block_size_;
+    size_t per = nblocks / nworkers_;
+    size_t extra = nblocks % nworkers_;
+    size_t begin = 0;
+    for (int w = 0; w < nworkers_; ++w) {
+      size_t count = per + (static_cast<size_t>(w) < extra ? 1 : 0);
+      slots_[w].begin_ = begin;
+      slots_[w].end_ = begin + count;
+      begin += count;
+    }
+  }
+
+  /**
+   * Get the next block for a worker, stealing if its own run is empty
+   * @param worker Worker index in [0, nworkers)
+   * @param off Output: absolute byte offset of the block
+   * @param len Output: block length in bytes
+   * @return false once no work is left anywhere
+   */
+  bool Next(int worker, size_t &off, size_t &len) {
+    size_t block;
+    if (TakeLocal(worker, block) || Steal(worker, block)) {
+      off = offset_ + block * block_size_;
+      len = std::min(block_size_, offset_ + size_ - off);
+      return true;
+    }
+    return false;
+  }
+
+  /** Number of successful steals so far */
+  size_t GetStealCount() const { return steals_.load(); }
+
+  int GetWorkerCount() const { return nworkers_; }
+
+private:
+  struct alignas(64) Slot {
+    std::mutex mtx_;
+    size_t begin_ = 0; // Next block to take (in blocks)
+    size_t end_ = 0;   // One past the last owned block
+  };
+
+  bool TakeLocal(int worker, size_t &block) {
+    Slot &slot = slots_[worker];
+    std::lock_guard<std::mutex> lock(slot.mtx_);
+    if (slot.begin_ < slot.end_) {
+      block = slot.begin_++;
+      return true;
+    }
+    return false;
+  }
+
+  bool Steal(int worker, size_t &block) {
+    while (true) {
+      // Find the victim with the most remaining blocks
+      int victim = -1;
+      size_t most = 0;
+      for (int i = 1; i < nworkers_; ++i) {
+        int w = (worker + i) % nworkers_;
+        std::lock_guard<std::mutex> lock(slots_[w].mtx_);
+        size_t left = slots_[w].end_ - slots_[w].begin_;
+        if (left > most) {
+          most = left;
+          victim = w;
+        }
+      }
+      if (victim < 0) {
+        return false;
+      }
+
+      size_t stolen_begin, stolen_end;
+      {
+        Slot &slot = slots_[victim];
+        std::lock_guard<std::mutex> lock(slot.mtx_);
+        size_t left = slot.end_ - slot.begin_;
+        if (left == 0) {
+          continue; // Victim drained meanwhile; look again
+        }
+        stolen_begin = slot.begin_ + left / 2;
+        stolen_end = slot.end_;
+        slot.end_ = stolen_begin;
+      }
+      steals_++;
+
+      Slot &own = slots_[worker];
+      std::lock_guard<std::mutex> lock(own.mtx_);
+      block = stolen_begin;
+      own.begin_ = stolen_begin + 1;
+      own.end_ = stolen_end;
+      return true;
+    }
+  }
+
+  size_t offset_;
+  size_t size_;
+  size_t block_size_;
+  int nworkers_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<size_t> steals_;
+};
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_RANGE_WORK_QUEUE_H_
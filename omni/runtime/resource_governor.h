@@ -0,0 +1,258 @@
+#ifndef CAE_RUNTIME_RESOURCE_GOVERNOR_H_
+#define CAE_RUNTIME_RESOURCE_GOVERNOR_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+/**
+ * Admission Control Strategy:
+ *
+ * 1. Budget: A job has a budget of memory, file descriptors and processes,
+ *    by default sized from the node (3/4 of RAM, the descriptor limit, two
+ *    processes per CPU) and multiplied by the number of hosts
+ * 2. Credits: Every stage that launches work states what it will hold and
+ *    acquires those credits first; a lease returns them when it ends
+ * 3. Backpressure: A stage whose credits are not free waits, so the
+ *    launcher stops starting work instead of overcommitting the nodes
+ * 4. Fairness: Waiters are served in arrival order, so a large request is
+ *    not starved by a stream of small ones. A request larger than the whole
+ *    budget is clamped to it and runs alone
+ * 5. Priority: A waiter of a higher priority class goes before every
+ *    queued waiter of a lower one (see io/io_throttle.h)
+ */
+
+namespace cae {
+
+/**
+ * Parse a byte count with an optional K, M, G or T suffix (powers of 1024)
+ * @return false if the text is not a byte count
+ */
+inline bool ParseByteSize(const std::string &text, size_t &bytes) {
+  size_t pos = 0;
+  unsigned long long value;
+  try {
+    value = std::stoull(text, &pos);
+  } catch (const std::exception &) {
+    return false;
+  }
+  std::string suffix = text.substr(pos);
+  if (!suffix.empty() && (suffix.back() == 'B' || suffix.back() == 'b')) {
+    suffix.pop_back();
+  }
+  int shift = 0;
+  if (suffix.size() > 1) {
+    return false;
+  } else if (suffix.size() == 1) {
+    switch (suffix[0]) {
+    case 'K': case 'k': shift = 10; break;
+    case 'M': case 'm': shift = 20; break;
+    case 'G': case 'g': shift = 30; break;
+    case 'T': case 't': shift = 40; break;
+    default: return false;
+    }
+  }
+  if (value > (~0ULL >> shift)) {
+    return false;
+  }
+  bytes = static_cast<size_t>(value << shift);
+  return true;
+}
+
+/** Amounts of each governed resource */
+struct ResourceCredits {
+  size_t memory_;    // Bytes
+  size_t fds_;       // Open file descriptors
+  size_t processes_; // Running processes
+
+  ResourceCredits() : memory_(0), fds_(0), processes_(0) {}
+  ResourceCredits(size_t memory, size_t fds, size_t processes)
+      : memory_(memory), fds_(fds), processes_(processes) {}
+};
+
+/**
+ * Job-wide budget from which stages acquire credits before they start
+ */
+class ResourceGovernor {
+public:
+  /**
+   * Credits held while a stage runs, returned when the lease is released
+   * or destroyed. Leases are move-only
+   */
+  class Lease {
+  public:
+    Lease() : governor_(nullptr) {}
+    ~Lease() { Release(); }
+    Lease(Lease &&other) noexcept
+        : governor_(other.governor_), credits_(other.credits_) {
+      other.governor_ = nullptr;
+    }
+    Lease &operator=(Lease &&other) noexcept {
+      if (this != &other) {
+        Release();
+        governor_ = other.governor_;
+        credits_ = other.credits_;
+        other.governor_ = nullptr;
+      }
+      return *this;
+    }
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+
+    /** Return the credits early */
+    void Release() {
+      if (governor_) {
+        governor_->Return(credits_);
+        governor_ = nullptr;
+      }
+    }
+
+    const ResourceCredits &GetCredits() const { return credits_; }
+
+  private:
+    friend class ResourceGovernor;
+    Lease(ResourceGovernor *governor, const ResourceCredits &credits)
+        : governor_(governor), credits_(credits) {}
+
+    ResourceGovernor *governor_;
+    ResourceCredits credits_;
+  };
+
+  /**
+   * @param budget Credits available to the job; a zero entry is unlimited
+   */
+  explicit ResourceGovernor(const ResourceCredits &budget)
+      : budget_(budget), next_ticket_(0), waits_(0) {}
+
+  /**
+   * Budget of one node: 3/4 of physical memory, the soft descriptor limit
+   * and two processes per CPU (capped by the process limit)
+   */
+  static ResourceCredits GetNodeBudget() {
+    ResourceCredits budget;
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0) {
+      budget.memory_ = static_cast<size_t>(pages) /
+                       4 * 3 * static_cast<size_t>(page_size);
+    }
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+      budget.fds_ = static_cast<size_t>(limit.rlim_cur);
+    }
+    unsigned ncpus = std::max(1u, std::thread::hardware_concurrency());
+    budget.processes_ = 2 * static_cast<size_t>(ncpus);
+    if (getrlimit(RLIMIT_NPROC, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+      budget.processes_ =
+          std::min(budget.processes_, static_cast<size_t>(limit.rlim_cur));
+    }
+    return budget;
+  }
+
+  /**
+   * Wait until the credits are free, then take them
+   * @param credits Credits the stage will hold; clamped to the budget
+   * @param priority Class of the stage; higher classes are served first
+   * @return Lease that returns the credits when released
+   */
+  Lease Acquire(const ResourceCredits &credits, int priority = 0) {
+    ResourceCredits want = Clamp(credits);
+    std::unique_lock<std::mutex> lock(mutex_);
+    Waiter self(-priority, next_ticket_++);
+    waiting_.insert(self);
+    auto ready = [&] { return *waiting_.begin() == self && Fits(want); };
+    if (!ready()) {
+      ++waits_;
+      cv_.wait(lock, ready);
+    }
+    waiting_.erase(self);
+    Add(in_use_, want, 1);
+    peak_.memory_ = std::max(peak_.memory_, in_use_.memory_);
+    peak_.fds_ = std::max(peak_.fds_, in_use_.fds_);
+    peak_.processes_ = std::max(peak_.processes_, in_use_.processes_);
+    lock.unlock();
+    cv_.notify_all(); // The next waiter may fit as well
+    return Lease(this, want);
+  }
+
+  const ResourceCredits &GetBudget() const { return budget_; }
+
+  /** Highest use seen so far */
+  ResourceCredits GetPeak() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_;
+  }
+
+  /** Number of acquisitions that had to wait */
+  size_t GetWaitCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return waits_;
+  }
+
+private:
+  using Waiter = std::pair<int, uint64_t>; // (-priority, ticket)
+
+  /** Give credits back and wake waiters */
+  void Return(const ResourceCredits &credits) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Add(in_use_, credits, -1);
+    }
+    cv_.notify_all();
+  }
+
+  ResourceCredits Clamp(const ResourceCredits &credits) const {
+    ResourceCredits out = credits;
+    if (budget_.memory_) out.memory_ = std::min(out.memory_, budget_.memory_);
+    if (budget_.fds_) out.fds_ = std::min(out.fds_, budget_.fds_);
+    if (budget_.processes_) {
+      out.processes_ = std::min(out.processes_, budget_.processes_);
+    }
+    return out;
+  }
+
+  bool Fits(const ResourceCredits &want) const {
+    return (!budget_.memory_ ||
+            in_use_.memory_ + want.memory_ <= budget_.memory_) &&
+           (!budget_.fds_ || in_use_.fds_ + want.fds_ <= budget_.fds_) &&
+           (!budget_.processes_ ||
+            in_use_.processes_ + want.processes_ <= budget_.processes_);
+  }
+
+  static void Add(ResourceCredits &total, const ResourceCredits &credits,
+                  int sign) {
+    if (sign > 0) {
+      total.memory_ += credits.memory_;
+      total.fds_ += credits.fds_;
+      total.processes_ += credits.processes_;
+    } else {
+      total.memory_ -= credits.memory_;
+      total.fds_ -= credits.fds_;
+      total.processes_ -= credits.processes_;
+    }
+  }
+
+  ResourceCredits budget_;
+  ResourceCredits in_use_;
+  ResourceCredits peak_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::set<Waiter> waiting_; // Served from the front
+  uint64_t next_ticket_;      // Arrival order of the next waiter
+  size_t waits_;
+};
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_RESOURCE_GOVERNOR_H_
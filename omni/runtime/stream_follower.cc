@@ -0,0 +1,672 @@
+#include "stream_follower.h"
+#include "format/format_registry.h"
+#include "io/file_extents.h"
+#include "io/private_dir.h"
+#include "util/hash.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cae {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> stop_requested{false};
+
+/** Offset a file was imported up to, for one destination */
+struct Committed {
+  uint64_t dev_;
+  uint64_t ino_;
+  size_t offset_;
+};
+
+/** Committed offsets by "<path>\t<destination>" */
+std::map<std::string, Committed> LoadState(const std::string &path) {
+  std::map<std::string, Committed> state;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string file, destination;
+    Committed committed;
+    if (std::getline(fields, file, '\t') &&
+        std::getline(fields, destination, '\t') &&
+        fields >> committed.dev_ >> committed.ino_ >> committed.offset_) {
+      state[file + "\t" + destination] = committed;
+    }
+  }
+  return state;
+}
+
+/**
+ * Save the committed offset of one key. Under an exclusive flock on
+ * "<path>.lock", the file is read again, so offsets other follow jobs
+ * committed meanwhile are kept, and replaced by a rename, so a reader
+ * never sees half of it
+ */
+void CommitState(const std::string &path, const std::string &key,
+                 const Committed &committed) {
+  std::error_code ec;
+  std::filesystem::path dir = std::filesystem::path(path).parent_path();
+  std::filesystem::create_directories(dir, ec);
+  std::string lock_path = path + ".lock";
+  int lock_fd = open(lock_path.c_str(),
+                     O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+    std::cerr << "Warning: could not lock follow offsets " << lock_path
+              << ": " << std::strerror(errno) << std::endl;
+    if (lock_fd >= 0) {
+      close(lock_fd);
+    }
+    return;
+  }
+  std::map<std::string, Committed> state = LoadState(path);
+  state[key] = committed;
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkostemp(&tmp[0], O_CLOEXEC);
+  bool ok = fd >= 0;
+  if (ok) {
+    close(fd);
+    std::ofstream out(tmp);
+    out << "# path\tdestination\tdev\tino\toffset\n";
+    for (const auto &kv : state) {
+      out << kv.first << "\t" << kv.second.dev_ << "\t" << kv.second.ino_
+          << "\t" << kv.second.offset_ << "\n";
+    }
+    out.close();
+    ok = out && std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+      std::remove(tmp.c_str());
+    }
+  }
+  if (!ok) {
+    std::cerr << "Warning: could not save follow offsets to " << path
+              << std::endl;
+  }
+  close(lock_fd); // Releases the lock
+}
+
+/** Where a source's data goes, as part of its state key */
+std::string GetDestination(const FollowSource &source) {
+  if (source.sink_.name_ == "shm") {
+    return "shm:" + source.sink_.channel_.name_;
+  }
+  return source.sink_.name_ == "container" ? source.output_dir_ : "none";
+}
+
+/** Progress of one source */
+struct Stream {
+  const FollowSource *source_ = nullptr;
+  bool pipe_ = false;
+  bool fifo_ = false;         // A named pipe; EOF before a writer is not end
+  bool writer_seen_ = false;
+  int fd_ = -1;               // The pipe, or the file as opened
+  int spool_fd_ = -1;
+  int wd_ = -1;               // inotify watch of a file
+  std::string key_;           // State key of a file
+  std::string format_;
+  bool record_cut_ = false;   // Batches end after a newline
+  uint64_t dev_ = 0;
+  uint64_t ino_ = 0;
+  size_t end_ = 0;            // Bytes available to import
+  size_t waiting_end_ = 0;    // end_ when no record end was found
+  int attempts_ = 0;          // Failed attempts of the pending batch
+  bool ended_ = false;
+  Clock::time_point last_batch_;
+  std::unique_ptr<FormatClient> client_;
+  std::shared_ptr<OutputSink> sink_;
+  bool shared_sink_ = false;
+  std::string dataset_dir_;
+  FollowResult result_;
+
+  /** Descriptor the bytes of the current generation can be read from */
+  int GetDataFd() const { return pipe_ ? spool_fd_ : fd_; }
+
+  bool HasPending() const { return end_ > result_.committed_; }
+};
+
+/** Read a whole buffer from a descriptor */
+bool ReadFull(int fd, char *data, size_t len, size_t offset) {
+  while (len > 0) {
+    ssize_t n = pread(fd, data, len, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+    offset += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+/**
+ * Offset just past the last newline in [begin, end), or begin if there
+ * is none
+ */
+size_t FindRecordEnd(int fd, size_t begin, size_t end) {
+  constexpr size_t STEP = 64 * 1024;
+  std::vector<char> buffer(STEP);
+  while (end > begin) {
+    size_t n = std::min(STEP, end - begin);
+    if (!ReadFull(fd, buffer.data(), n, end - n)) {
+      return begin;
+    }
+    for (size_t i = n; i > 0; --i) {
+      if (buffer[i - 1] == '\n') {
+        return end - n + i;
+      }
+    }
+    end -= n;
+  }
+  return begin;
+}
+
+} // namespace
+
+std::string FollowOptions::GetDefaultStatePath() {
+  const char *env = std::getenv("CAE_FOLLOW_STATE");
+  if (env && *env) {
+    return env;
+  }
+  const char *home = std::getenv("HOME");
+  return std::string(home ? home : "/tmp") + "/.cache/cae/follow_offsets.tsv";
+}
+
+StreamFollower::StreamFollower(const FollowOptions &opts) : opts_(opts) {
+  if (opts_.state_path_.empty()) {
+    opts_.state_path_ = FollowOptions::GetDefaultStatePath();
+  }
+  if (opts_.spool_dir_.empty()) {
+    opts_.spool_dir_ = PrivateDir::GetTempPath("cae_spool");
+  }
+  opts_.poll_ms_ = std::max(opts_.poll_ms_, 1);
+  opts_.batch_ms_ = std::max(opts_.batch_ms_, 0);
+}
+
+void StreamFollower::RequestStop() { stop_requested = true; }
+
+std::vector<FollowResult>
+StreamFollower::Run(const std::vector<FollowSource> &sources) {
+  stop_requested = false;
+  std::map<std::string, Committed> state = LoadState(opts_.state_path_);
+  std::vector<Stream> streams(sources.size());
+  std::map<std::string, std::shared_ptr<OutputSink>> channels;
+
+  int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  int inotify_error = errno;
+  const uint32_t WATCH_EVENTS = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                                IN_MOVE_SELF | IN_DELETE_SELF;
+
+  auto fail = [](Stream &s, const std::string &reason) {
+    std::cerr << "Error: stopped following " << s.source_->path_ << ": "
+              << reason << std::endl;
+    size_t pending = s.end_ - std::min(s.end_, s.result_.committed_);
+    s.result_.failures_.emplace_back(s.result_.path_, s.result_.committed_,
+                                     pending, false, reason);
+    s.end_ = s.result_.committed_;
+    s.ended_ = true;
+  };
+
+  // Finish a source's dataset; a channel sink is closed after the session
+  auto close_sink = [](Stream &s) {
+    if (s.sink_ && !s.shared_sink_) {
+      s.sink_->Close();
+      if (!s.dataset_dir_.empty()) {
+        OutputSink::WriteManifest(s.dataset_dir_, s.source_->sink_.name_,
+                                  {s.sink_->GetSummary()});
+      }
+    }
+    s.sink_.reset();
+  };
+
+  // Start (or restart) a file at its committed offset
+  auto open_file = [&](Stream &s, bool resume) -> bool {
+    const FollowSource &source = *s.source_;
+    if (s.fd_ >= 0) {
+      close(s.fd_);
+    }
+    s.fd_ = open(source.path_.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (s.fd_ < 0 || fstat(s.fd_, &st) != 0) {
+      fail(s, std::string("open: ") + std::strerror(errno));
+      return false;
+    }
+    s.dev_ = st.st_dev;
+    s.ino_ = st.st_ino;
+    s.end_ = static_cast<size_t>(st.st_size);
+    size_t start = resume ? source.offset_ : 0;
+    auto committed = state.find(s.key_);
+    if (resume && committed != state.end() &&
+        committed->second.dev_ == s.dev_ && committed->second.ino_ == s.ino_ &&
+        committed->second.offset_ <= s.end_) {
+      start = committed->second.offset_;
+    }
+    s.result_.start_ = s.result_.committed_ = start;
+    if (inotify_fd >= 0) {
+      if (s.wd_ >= 0) {
+        inotify_rm_watch(inotify_fd, s.wd_);
+      }
+      s.wd_ = inotify_add_watch(inotify_fd, source.path_.c_str(),
+                                WATCH_EVENTS);
+    }
+    return true;
+  };
+
+  // Open a pipe and the spool file its bytes are copied to
+  auto open_pipe = [&](Stream &s) -> bool {
+    const FollowSource &source = *s.source_;
+    s.fd_ = source.path_ == "-"
+                ? dup(STDIN_FILENO)
+                : open(source.path_.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (s.fd_ < 0) {
+      fail(s, std::string("open: ") + std::strerror(errno));
+      return false;
+    }
+    std::string dir = source.output_dir_ + "/.spool";
+    try {
+      if (source.output_dir_.empty()) {
+        dir = PrivateDir::Ensure(opts_.spool_dir_);
+      } else {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+      }
+    } catch (const std::exception &e) {
+      fail(s, e.what());
+      return false;
+    }
+    std::string name = source.path_ == "-"
+                           ? std::string("stdin")
+                           : std::filesystem::path(source.path_)
+                                 .filename()
+                                 .string();
+    std::string key =
+        source.path_ + ":" + std::to_string(getpid()) + ":" +
+        std::to_string(Clock::now().time_since_epoch().count());
+    s.result_.path_ = dir + "/" + name + "-" +
+                      Xxh64::ToHex(Xxh64::Hash(key.data(), key.size())) +
+                      ".spool";
+    s.spool_fd_ = open(s.result_.path_.c_str(),
+                       O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                       0600);
+    if (s.spool_fd_ < 0) {
+      fail(s, "spool " + s.result_.path_ + ": " + std::strerror(errno));
+      return false;
+    }
+    return true;
+  };
+
+  for (size_t i = 0; i < sources.size(); ++i) {
+    Stream &s = streams[i];
+    const FollowSource &source = sources[i];
+    s.source_ = &source;
+    s.result_.path_ = source.path_;
+    struct stat st;
+    if (source.path_ == "-") {
+      s.pipe_ = true;
+    } else if (stat(source.path_.c_str(), &st) != 0) {
+      fail(s, std::string("stat: ") + std::strerror(errno));
+      continue;
+    } else if (S_ISFIFO(st.st_mode)) {
+      s.pipe_ = true;
+      s.fifo_ = true;
+    } else if (!S_ISREG(st.st_mode)) {
+      fail(s, "not a regular file, FIFO or stdin");
+      continue;
+    }
+
+    s.format_ = source.format_;
+    if (s.format_.empty() && !s.pipe_) {
+      const FormatCapabilities *caps =
+          FormatRegistry::Get().Detect(source.path_);
+      s.format_ = caps ? caps->name_ : "binary";
+    } else if (s.format_.empty()) {
+      s.format_ = "binary";
+    }
+    s.record_cut_ = s.format_ != "binary";
+    try {
+      s.client_ = FormatRegistry::Get().Create(s.format_);
+      s.client_->SetOption("decompress", "false");
+      s.client_->SetOption("extents", ExtentMethodName(ExtentMethod::kNone));
+      s.client_->SetOption("io_depth", "1");
+      s.client_->SetOption("auto_tune", opts_.auto_tune_ ? "true" : "false");
+      s.client_->SetOption("retries", std::to_string(opts_.retry_.attempts_));
+      s.client_->SetOption("retry_backoff_ms",
+                           std::to_string(opts_.retry_.backoff_ms_));
+      s.client_->SetThrottle(source.throttle_);
+    } catch (const std::exception &e) {
+      fail(s, e.what());
+      continue;
+    }
+
+    if (s.pipe_) {
+      open_pipe(s);
+    } else {
+      std::error_code ec;
+      std::string canonical =
+          std::filesystem::weakly_canonical(source.path_, ec).string();
+      s.key_ = (ec ? source.path_ : canonical) + "\t" + GetDestination(source);
+      s.result_.path_ = source.path_;
+      open_file(s, true);
+    }
+  }
+  if (inotify_fd < 0) {
+    std::cerr << "Warning: inotify unavailable ("
+              << std::strerror(inotify_error)
+              << "); checking files every " << opts_.poll_ms_ << " ms"
+              << std::endl;
+  }
+
+  // Open a source's sink when its first batch is imported; the dataset of
+  // a file is named after it, where it starts and when, so every session
+  // and every generation of a replaced file gets its own. A pipe's is
+  // named after its spool
+  auto open_sink = [&](Stream &s) {
+    const FollowSource &source = *s.source_;
+    if (source.sink_.name_ == "shm") {
+      std::shared_ptr<OutputSink> &sink = channels[source.sink_.channel_.name_];
+      if (!sink) {
+        sink = SinkFactory::Get(source.sink_);
+        sink->Open(SinkContext());
+      }
+      s.sink_ = sink;
+      s.shared_sink_ = true;
+      return;
+    }
+    s.sink_ = SinkFactory::Get(source.sink_);
+    if (!s.sink_) {
+      return;
+    }
+    SinkContext ctx;
+    if (!source.output_dir_.empty() && s.pipe_) {
+      s.dataset_dir_ = source.output_dir_ + "/" +
+                       std::filesystem::path(s.result_.path_).stem().string();
+      ctx.output_dir_ = s.dataset_dir_;
+    } else if (!source.output_dir_.empty()) {
+      std::string key =
+          s.result_.path_ + ":" + std::to_string(s.result_.start_) + ":" +
+          std::to_string(Clock::now().time_since_epoch().count());
+      s.dataset_dir_ =
+          source.output_dir_ + "/" +
+          std::filesystem::path(s.result_.path_).filename().string() + "-" +
+          Xxh64::ToHex(Xxh64::Hash(key.data(), key.size()));
+      ctx.output_dir_ = s.dataset_dir_;
+    }
+    s.sink_->Open(ctx);
+  };
+
+  // Copy what a pipe has to its spool, without blocking
+  auto drain = [&](Stream &s) {
+    std::vector<char> buffer(1024 * 1024);
+    while (s.end_ - s.result_.committed_ < FollowOptions::MAX_BATCH) {
+      struct pollfd pfd = {s.fd_, POLLIN, 0};
+      if (poll(&pfd, 1, 0) <= 0) {
+        return;
+      }
+      if (pfd.revents & POLLHUP) {
+        s.writer_seen_ = true; // Only reported once a writer has gone
+      }
+      ssize_t n = read(s.fd_, buffer.data(), buffer.size());
+      if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+      }
+      if (n < 0) {
+        fail(s, std::string("read: ") + std::strerror(errno));
+        return;
+      }
+      if (n == 0) {
+        if (!s.fifo_ || s.writer_seen_) {
+          s.ended_ = true;
+          s.waiting_end_ = 0; // The partial record is all there will be
+        }
+        return;
+      }
+      s.writer_seen_ = true;
+      const char *p = buffer.data();
+      size_t left = static_cast<size_t>(n);
+      while (left > 0) {
+        ssize_t w = pwrite(s.spool_fd_, p, left, static_cast<off_t>(s.end_));
+        if (w < 0 && errno == EINTR) {
+          continue;
+        }
+        if (w <= 0) {
+          fail(s, std::string("spool write: ") + std::strerror(errno));
+          return;
+        }
+        p += w;
+        left -= static_cast<size_t>(w);
+        s.end_ += static_cast<size_t>(w);
+      }
+    }
+  };
+
+  // Notice growth, truncation and replacement of a file
+  auto refresh = [&](Stream &s) {
+    struct stat st;
+    if (stat(s.source_->path_.c_str(), &st) != 0) {
+      if (!s.HasPending()) {
+        std::cout << "Follow: " << s.source_->path_
+                  << " was removed; stopped following it" << std::endl;
+        s.ended_ = true;
+      }
+      return;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (st.st_dev != s.dev_ || st.st_ino != s.ino_ ||
+        size < s.result_.committed_) {
+      std::cout << "Follow: " << s.source_->path_
+                << " was truncated or replaced; following it from offset 0"
+                << std::endl;
+      close_sink(s);
+      open_file(s, false);
+      s.waiting_end_ = 0;
+      return;
+    }
+    s.end_ = size;
+  };
+
+  // Import the next micro-batch of a source
+  auto import_batch = [&](Stream &s) -> bool {
+    size_t begin = s.result_.committed_;
+    if (!s.HasPending() || s.end_ == s.waiting_end_) {
+      return false;
+    }
+    size_t end = std::min(s.end_, begin + FollowOptions::MAX_BATCH);
+    bool rest = s.ended_ && end == s.end_; // Last bytes of an ended pipe
+    if (s.record_cut_ && !rest) {
+      size_t cut = FindRecordEnd(s.GetDataFd(), begin, end);
+      if (cut == begin && end - begin < FollowOptions::MAX_BATCH) {
+        s.waiting_end_ = s.end_; // Part of a record; wait for the rest
+        return false;
+      }
+      end = cut > begin ? cut : end;
+    }
+    s.waiting_end_ = 0;
+
+    FormatContext ctx;
+    ctx.filename_ = s.result_.path_;
+    ctx.description_ = s.source_->description_;
+    ctx.hash_ = s.source_->hash_;
+    ctx.offset_ = begin;
+    ctx.size_ = end - begin;
+    std::vector<ImportFailure> failures;
+    try {
+      if (!s.sink_) {
+        open_sink(s);
+      }
+      s.client_->SetSink(s.sink_);
+      s.client_->Import(ctx);
+      failures = s.client_->TakeFailures();
+    } catch (const std::exception &e) {
+      failures = s.client_->TakeFailures();
+      failures.emplace_back(ctx.filename_, begin, end - begin, false,
+                            e.what());
+    }
+    s.last_batch_ = Clock::now();
+
+    // A batch nothing of which was passed on is tried again next time
+    bool retry = !failures.empty() &&
+                 std::all_of(failures.begin(), failures.end(),
+                             [](const ImportFailure &f) {
+                               return f.resumable_;
+                             });
+    if (retry && ++s.attempts_ < opts_.retry_.attempts_) {
+      return false;
+    }
+    s.attempts_ = 0;
+    s.result_.failures_.insert(s.result_.failures_.end(), failures.begin(),
+                               failures.end());
+    try {
+      if (s.sink_) {
+        s.sink_->Flush();
+        if (!s.dataset_dir_.empty()) {
+          OutputSink::WriteManifest(s.dataset_dir_, s.source_->sink_.name_,
+                                    {s.sink_->GetSummary()});
+        }
+      }
+    } catch (const std::exception &e) {
+      fail(s, e.what());
+      return false;
+    }
+    s.result_.committed_ = end;
+    s.result_.batches_++;
+    if (!s.pipe_) {
+      state[s.key_] = {s.dev_, s.ino_, end};
+      CommitState(opts_.state_path_, s.key_, state[s.key_]);
+    }
+    return true;
+  };
+
+  auto last_growth = Clock::now();
+  while (!stop_requested) {
+    bool grew = false;
+    bool active = false;
+    int wait_ms = opts_.poll_ms_;
+    for (auto &s : streams) {
+      if (s.ended_ && !s.HasPending()) {
+        continue;
+      }
+      if (s.pipe_ && !s.ended_) {
+        drain(s);
+      } else if (!s.pipe_) {
+        refresh(s);
+      }
+      auto since = [&] {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   Clock::now() - s.last_batch_)
+            .count();
+      };
+      if (s.ended_ || since() >= opts_.batch_ms_) {
+        grew |= import_batch(s);
+      }
+
+      // More to import: a capped or retried batch, or one that came early
+      bool ready = s.HasPending() && s.end_ != s.waiting_end_;
+      if (ready) {
+        wait_ms = std::min<int>(
+            wait_ms, static_cast<int>(std::max<long long>(
+                         opts_.batch_ms_ - since(), 0)));
+      }
+      active |= !s.ended_ || ready;
+    }
+    if (grew) {
+      last_growth = Clock::now();
+    }
+    if (!active) {
+      break;
+    }
+    if (opts_.idle_timeout_ms_ > 0 &&
+        Clock::now() - last_growth >=
+            std::chrono::milliseconds(opts_.idle_timeout_ms_)) {
+      std::cout << "Follow: nothing new for " << opts_.idle_timeout_ms_
+                << " ms; stopping" << std::endl;
+      break;
+    }
+
+    // Sleep until a file changes, a pipe has data, or the timeout
+    std::vector<struct pollfd> fds;
+    if (inotify_fd >= 0) {
+      fds.push_back({inotify_fd, POLLIN, 0});
+    }
+    for (auto &s : streams) {
+      if (s.pipe_ && !s.ended_ && s.fd_ >= 0) {
+        fds.push_back({s.fd_, POLLIN, 0});
+      }
+    }
+    poll(fds.data(), fds.size(), std::max(wait_ms, 0));
+    if (inotify_fd >= 0) {
+      char events[4096];
+      while (read(inotify_fd, events, sizeof(events)) > 0) {
+      }
+    }
+  }
+
+  // Bytes already taken from a pipe cannot be read again, so they are
+  // imported now, partial record included
+  for (auto &s : streams) {
+    if (s.pipe_ && s.HasPending()) {
+      s.ended_ = true;
+      s.waiting_end_ = 0;
+      while (s.HasPending() && import_batch(s)) {
+      }
+    }
+  }
+
+  std::vector<FollowResult> results;
+  results.reserve(streams.size());
+  for (auto &s : streams) {
+    try {
+      close_sink(s);
+    } catch (const std::exception &e) {
+      s.result_.failures_.emplace_back(s.result_.path_, s.result_.start_, 0,
+                                       false, e.what());
+    }
+    if (s.fd_ >= 0) {
+      close(s.fd_);
+    }
+    if (s.spool_fd_ >= 0) {
+      close(s.spool_fd_);
+      // Only a container dataset refers to its spool; elsewhere it is kept
+      // only while bytes of it are still to be imported
+      if (s.source_->sink_.name_ != "container" && !s.HasPending()) {
+        unlink(s.result_.path_.c_str());
+      }
+    }
+    results.push_back(std::move(s.result_));
+  }
+  for (const auto &channel : channels) {
+    channel.second->Close();
+    std::cout << "Output (shm " << channel.first
+              << "): " << channel.second->GetSummary() << std::endl;
+  }
+  if (inotify_fd >= 0) {
+    close(inotify_fd);
+  }
+  return results;
+}
+
+} // namespace cae
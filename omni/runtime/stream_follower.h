@@ -0,0 +1,119 @@
+#ifndef CAE_RUNTIME_STREAM_FOLLOWER_H_
+#define CAE_RUNTIME_STREAM_FOLLOWER_H_
+
+#include "format/format_client.h"
+#include "io/retry_policy.h"
+#include "sink/sink_factory.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Follow Mode Strategy:
+ *
+ * 1. Sources: Regular files that are still being written, FIFOs and stdin
+ *    ("-"); pipes are copied to a spool file as they are read, so the
+ *    format clients read them like any file. Only container datasets keep
+ *    their spool, as their source; other sinks remove it once its last
+ *    batch is imported
+ * 2. Wake-Up: One thread waits on inotify for the files and on the pipes
+ *    themselves, with a timeout of poll_ms; the timeout also catches writes
+ *    inotify does not see (network file systems) or when it is unavailable
+ * 3. Micro-Batches: Bytes past a source's committed offset are imported as
+ *    one range of at most MAX_BATCH bytes; formats other than binary are
+ *    cut after the last newline, so a batch holds whole records. Batches of
+ *    one source are at least batch_ms apart, so a writer's small appends
+ *    are coalesced
+ * 4. Visibility: After each batch the sink is flushed and the dataset's
+ *    manifest rewritten, so data can be read seconds after it was written
+ * 5. Committed Offsets: The offset up to which a file has been imported is
+ *    saved after each batch, per file and destination, with the file's
+ *    device and inode; a restarted job resumes there. A file that shrinks
+ *    or is replaced starts over at 0. Each save re-reads the state file
+ *    under a flock and renames a new copy over it, so follow jobs sharing
+ *    the file keep each other's offsets
+ * 6. End: Pipes end when their writers close them; following stops once
+ *    every source has ended, nothing grew for idle_timeout_ms (if set), or
+ *    RequestStop was called (SIGINT/SIGTERM in wrp)
+ */
+
+namespace cae {
+
+/**
+ * A source imported as it grows
+ */
+struct FollowSource {
+  std::string path_;   // File or FIFO, "-" = stdin
+  std::string format_; // Empty = detected for files, binary for pipes
+  std::string description_;
+  std::string hash_;
+  size_t offset_;          // Start when no offset was committed
+  SinkConfig sink_;
+  std::string output_dir_; // Parent of the dataset, empty = no directory
+  std::shared_ptr<IoThrottle> throttle_; // Null = unthrottled
+
+  FollowSource() : offset_(0) {}
+};
+
+/**
+ * Settings of a follow session
+ */
+struct FollowOptions {
+  static constexpr size_t MAX_BATCH = 64 * 1024 * 1024;
+  static constexpr int DEFAULT_POLL_MS = 1000;
+  static constexpr int DEFAULT_BATCH_MS = 200;
+
+  int poll_ms_;            // Longest wait without an event
+  int batch_ms_;           // Shortest time between batches of a source
+  int idle_timeout_ms_;    // Stop after this long without growth, 0 = never
+  std::string state_path_; // Committed offsets, empty = GetDefaultStatePath
+  std::string spool_dir_;  // Spools of pipes without an output directory;
+                           // must be private (io/private_dir.h)
+  bool auto_tune_;
+  RetryPolicy retry_;
+
+  FollowOptions()
+      : poll_ms_(DEFAULT_POLL_MS), batch_ms_(DEFAULT_BATCH_MS),
+        idle_timeout_ms_(0), auto_tune_(true) {}
+
+  /** $CAE_FOLLOW_STATE, else ~/.cache/cae/follow_offsets.tsv */
+  static std::string GetDefaultStatePath();
+};
+
+/**
+ * Outcome of following one source
+ */
+struct FollowResult {
+  std::string path_; // What was imported: the file or the pipe's spool
+  size_t start_;     // Offset following started at
+  size_t committed_; // Offset imported up to
+  size_t batches_;
+  std::vector<ImportFailure> failures_;
+
+  FollowResult() : start_(0), committed_(0), batches_(0) {}
+};
+
+/**
+ * Imports growing sources in micro-batches until they end or it is stopped
+ */
+class StreamFollower {
+public:
+  explicit StreamFollower(const FollowOptions &opts);
+
+  /**
+   * Follow every source
+   * @return The outcome of each source, in source order
+   */
+  std::vector<FollowResult> Run(const std::vector<FollowSource> &sources);
+
+  /** Stop every running follower after its current batch; signal safe */
+  static void RequestStop();
+
+private:
+  FollowOptions opts_;
+};
+
+} // namespace cae
+
+#endif // CAE_RUNTIME_STREAM_FOLLOWER_H_
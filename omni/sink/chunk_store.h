@@ -0,0 +1,474 @@
+#ifndef CAE_SINK_CHUNK_STORE_H_
+#define CAE_SINK_CHUNK_STORE_H_
+
+#include "io/block_codec.h"
+#include "io/content_chunker.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Deduplicated Chunk Store:
+ *
+ * 1. Packs: Chunks seen for the first time are appended, as container
+ *    blocks, to a pack file of the process (pack-<id>.cae under the store
+ *    directory); packs are only ever appended to, so a chunk stays where it
+ *    was first written for every later dataset and run that refers to it
+ * 2. Fingerprint Index: PARTITIONS files of open-addressing slots, mapped
+ *    shared; a fingerprint belongs to one partition and probes from a slot
+ *    given by its other bits. The index lives next to the packs, so it
+ *    outlives the job and is used by every process writing to the store.
+ *    Shared mappings are only coherent within a node, so each host keeps
+ *    its own store (see GetHostDir)
+ * 3. Lock-Free Inserts: A writer claims an empty slot by switching its
+ *    state from empty to writing, fills it and then marks it ready; readers
+ *    wait briefly for a slot being written and skip it if it stays so (its
+ *    writer died)
+ * 4. Ordering: New chunks wait in the process until the pack is
+ *    fdatasync'ed, which happens every SYNC_BYTES of pack and on Sync; only
+ *    then are their slots filled, so a fingerprint found in the index names
+ *    bytes on disk even after a crash. Until then the process finds them
+ *    itself, other processes store their own copy. The sync and the inserts
+ *    run on a batch swapped out of the waiting chunks, without the lock
+ *    that lookups take
+ * 5. Bounded: Partitions have a fixed capacity; once MAX_LOAD of it is
+ *    used, new chunks are still stored but no longer indexed
+ */
+
+namespace cae {
+
+/**
+ * Where a stored chunk is
+ */
+struct ChunkLocation {
+  uint32_t pack_;      // Pack id
+  size_t file_offset_; // Offset of the block header in the pack
+  size_t length_;      // Raw bytes
+  size_t stored_;      // Stored payload bytes
+  Codec codec_;
+
+  ChunkLocation()
+      : pack_(0), file_offset_(0), length_(0), stored_(0),
+        codec_(Codec::kNone) {}
+};
+
+/**
+ * Content-addressed chunk store shared by the processes of a node
+ */
+class ChunkStore {
+public:
+  static constexpr int PARTITIONS = 16;
+  static constexpr uint64_t PARTITION_SLOTS = 1ULL << 20; // Sparse files
+  static constexpr double MAX_LOAD = 0.9;
+  static constexpr int WAIT_ROUNDS = 10000; // Yields before a slot is skipped
+  static constexpr size_t SYNC_BYTES = 64 * 1024 * 1024; // Pack per sync
+
+  /**
+   * The store in a directory, shared by every sink of this process
+   * @param dir Store directory, created if needed
+   */
+  static std::shared_ptr<ChunkStore> Open(const std::string &dir) {
+    static std::mutex mtx;
+    static std::map<std::string, std::shared_ptr<ChunkStore>> stores;
+    std::lock_guard<std::mutex> lock(mtx);
+    std::shared_ptr<ChunkStore> &store = stores[dir];
+    if (!store) {
+      store.reset(new ChunkStore(dir));
+    }
+    return store;
+  }
+
+  ~ChunkStore() {
+    try {
+      Sync();
+    } catch (const std::exception &e) {
+      std::cerr << "Warning: " << e.what() << std::endl;
+    }
+    for (auto &part : parts_) {
+      if (part.header_) {
+        munmap(part.header_, part.map_size_);
+      }
+    }
+    if (pack_fd_ >= 0) {
+      close(pack_fd_);
+    }
+  }
+
+  ChunkStore(const ChunkStore &) = delete;
+  ChunkStore &operator=(const ChunkStore &) = delete;
+
+  /**
+   * Look up a chunk
+   * @param fp Fingerprint of its raw bytes
+   * @param loc Set to where it is stored
+   * @return false if the chunk is not known
+   */
+  bool Find(const ChunkFingerprint &fp, ChunkLocation &loc) const {
+    const Partition &part = GetPartition(fp);
+    uint64_t capacity = part.header_->capacity_;
+    for (uint64_t n = 0, i = fp.lo_ % capacity; n < capacity;
+         ++n, i = (i + 1) % capacity) {
+      const Slot &slot = part.slots_[i];
+      uint32_t state = WaitReady(slot);
+      if (state == SLOT_EMPTY) {
+        return false;
+      }
+      if (state == SLOT_READY && slot.hi_ == fp.hi_ && slot.lo_ == fp.lo_) {
+        loc.pack_ = slot.pack_;
+        loc.file_offset_ = slot.file_offset_;
+        loc.length_ = slot.length_;
+        loc.stored_ = slot.stored_;
+        loc.codec_ = static_cast<Codec>(slot.codec_);
+        return true;
+      }
+    }
+    std::lock_guard<std::mutex> lock(pending_mtx_);
+    for (const auto *chunks : {&pending_, &publishing_}) {
+      auto it = chunks->find(std::make_pair(fp.hi_, fp.lo_));
+      if (it != chunks->end()) {
+        loc = it->second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Store a new chunk and index it
+   * @param fp Fingerprint of its raw bytes
+   * @param header Container block header
+   * @param header_size Its bytes
+   * @param stored Stored payload
+   * @param loc Raw length, stored length and codec; set to where it went
+   */
+  void Add(const ChunkFingerprint &fp, const char *header, size_t header_size,
+           const char *stored, ChunkLocation &loc) {
+    OpenPack();
+    loc.pack_ = pack_id_;
+    loc.file_offset_ = pack_end_.fetch_add(header_size + loc.stored_);
+    WriteFull(header, header_size, loc.file_offset_);
+    WriteFull(stored, loc.stored_, loc.file_offset_ + header_size);
+    std::unique_lock<std::mutex> lock(pending_mtx_);
+    pending_.emplace(std::make_pair(fp.hi_, fp.lo_), loc);
+    pending_bytes_ += header_size + loc.stored_;
+    if (pending_bytes_ >= SYNC_BYTES) {
+      Publish(lock);
+    }
+  }
+
+  /** Make the chunks added so far durable, then index them */
+  void Sync() {
+    std::unique_lock<std::mutex> lock(pending_mtx_);
+    Publish(lock);
+  }
+
+  /**
+   * Directory of this host's store under a shared one: the host name, made
+   * safe as one path component
+   */
+  static std::string GetHostDir() {
+    char host[256] = {};
+    if (gethostname(host, sizeof(host) - 1) != 0 || host[0] == '\0') {
+      return "localhost";
+    }
+    std::string name(host);
+    std::replace(name.begin(), name.end(), '/', '_');
+    return name == "." || name == ".." ? "localhost" : name;
+  }
+
+  /** File name of a pack, relative to the store directory */
+  static std::string GetPackName(uint32_t pack) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "pack-%08x.cae", pack);
+    return name;
+  }
+
+  /** Store directory */
+  const std::string &GetDir() const { return dir_; }
+
+private:
+  static constexpr char INDEX_MAGIC[8] = {'C', 'A', 'E', 'F',
+                                          'P', 'I', 'X', '1'};
+  static constexpr char PACK_MAGIC[8] = {'C', 'A', 'E', 'P',
+                                         'A', 'C', 'K', '1'};
+  static constexpr uint32_t SLOT_EMPTY = 0;
+  static constexpr uint32_t SLOT_WRITING = 1;
+  static constexpr uint32_t SLOT_READY = 2;
+
+  /** Start of a partition file */
+  struct Header {
+    char magic_[8];
+    uint64_t capacity_;
+    std::atomic<uint64_t> used_; // Claimed slots
+    char pad_[40];
+  };
+
+  /** One indexed chunk; all zero bytes is an empty slot */
+  struct Slot {
+    std::atomic<uint32_t> state_;
+    uint32_t pack_;
+    uint64_t hi_;
+    uint64_t lo_;
+    uint64_t file_offset_;
+    uint32_t length_;
+    uint32_t stored_;
+    uint8_t codec_;
+    char pad_[15];
+  };
+
+  static_assert(sizeof(Header) == 64, "partition header must be 64 bytes");
+  static_assert(sizeof(Slot) == 56, "index slots must be 56 bytes");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "the chunk index needs lock-free 64-bit atomics");
+
+  struct Partition {
+    Header *header_ = nullptr;
+    Slot *slots_ = nullptr;
+    size_t map_size_ = 0;
+  };
+
+  explicit ChunkStore(const std::string &dir)
+      : dir_(dir), pack_fd_(-1), pack_id_(0), pack_end_(0), full_(false),
+        pending_bytes_(0) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    for (int p = 0; p < PARTITIONS; ++p) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "/index-%02d.fpi", p);
+      MapPartition(dir_ + name, parts_[p]);
+    }
+  }
+
+  /**
+   * Map a partition file, creating it if it does not exist yet; the file
+   * lock keeps two processes from initializing it at once
+   */
+  static void MapPartition(const std::string &path, Partition &part) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open chunk index " + path + ": " +
+                               std::strerror(errno));
+    }
+    flock(fd, LOCK_EX);
+    struct stat st;
+    size_t size = sizeof(Header) + PARTITION_SLOTS * sizeof(Slot);
+    bool fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+    if (fresh && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      int err = errno;
+      close(fd);
+      throw std::runtime_error("Could not size chunk index " + path + ": " +
+                               std::strerror(err));
+    }
+    if (!fresh) {
+      size = static_cast<size_t>(st.st_size);
+    }
+    void *addr = size < sizeof(Header)
+                     ? MAP_FAILED
+                     : mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Could not map chunk index " + path);
+    }
+    Header *header = static_cast<Header *>(addr);
+    if (fresh) {
+      header->capacity_ = PARTITION_SLOTS;
+      header->used_.store(0);
+      std::memcpy(header->magic_, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    if (std::memcmp(header->magic_, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header->capacity_ == 0 ||
+        sizeof(Header) + header->capacity_ * sizeof(Slot) > size) {
+      munmap(addr, size);
+      throw std::runtime_error("Not a chunk index: " + path);
+    }
+    part.header_ = header;
+    part.slots_ = reinterpret_cast<Slot *>(header + 1);
+    part.map_size_ = size;
+  }
+
+  const Partition &GetPartition(const ChunkFingerprint &fp) const {
+    return parts_[fp.hi_ % PARTITIONS];
+  }
+
+  /** State of a slot once it is not being written, or SLOT_WRITING */
+  static uint32_t WaitReady(const Slot &slot) {
+    uint32_t state = slot.state_.load(std::memory_order_acquire);
+    for (int n = 0; state == SLOT_WRITING && n < WAIT_ROUNDS; ++n) {
+      std::this_thread::yield();
+      state = slot.state_.load(std::memory_order_acquire);
+    }
+    return state;
+  }
+
+  /**
+   * fdatasync the pack and index the chunks waiting for it. Called with the
+   * lock held; it is released while syncing and indexing, so Find and Add
+   * of other threads go on, and Find sees the batch in publishing_
+   */
+  void Publish(std::unique_lock<std::mutex> &lock) {
+    if (pending_.empty() && publishing_.empty()) {
+      return;
+    }
+    ChunkMap batch;
+    batch.swap(pending_);
+    size_t batch_bytes = pending_bytes_;
+    pending_bytes_ = 0;
+    publishing_.insert(batch.begin(), batch.end());
+    lock.unlock();
+    // Also makes durable the batches other threads are still indexing, so
+    // Sync returns only once every chunk added before it is on disk
+    int rc = fdatasync(pack_fd_);
+    int err = errno;
+    if (rc == 0) {
+      for (const auto &kv : batch) {
+        ChunkFingerprint fp;
+        fp.hi_ = kv.first.first;
+        fp.lo_ = kv.first.second;
+        Insert(fp, kv.second);
+      }
+    }
+    lock.lock();
+    for (const auto &kv : batch) {
+      auto it = publishing_.find(kv.first);
+      if (it != publishing_.end() &&
+          it->second.file_offset_ == kv.second.file_offset_) {
+        publishing_.erase(it);
+      }
+    }
+    if (rc != 0) {
+      // Still waiting; a later Publish tries again
+      pending_.insert(batch.begin(), batch.end());
+      pending_bytes_ += batch_bytes;
+      throw std::runtime_error("Sync of pack " + GetPackName(pack_id_) +
+                               " failed: " + std::strerror(err));
+    }
+  }
+
+  /** Index a stored chunk; another copy of it may already be indexed */
+  void Insert(const ChunkFingerprint &fp, const ChunkLocation &loc) {
+    Partition &part = parts_[fp.hi_ % PARTITIONS];
+    uint64_t capacity = part.header_->capacity_;
+    if (part.header_->used_.load(std::memory_order_relaxed) >=
+        static_cast<uint64_t>(capacity * MAX_LOAD)) {
+      if (!full_.exchange(true)) {
+        std::cerr << "Warning: chunk index in " << dir_
+                  << " is full; new chunks are no longer deduplicated"
+                  << std::endl;
+      }
+      return;
+    }
+    for (uint64_t n = 0, i = fp.lo_ % capacity; n < capacity;
+         ++n, i = (i + 1) % capacity) {
+      Slot &slot = part.slots_[i];
+      uint32_t state = SLOT_EMPTY;
+      if (slot.state_.compare_exchange_strong(state, SLOT_WRITING,
+                                              std::memory_order_acq_rel)) {
+        slot.pack_ = loc.pack_;
+        slot.hi_ = fp.hi_;
+        slot.lo_ = fp.lo_;
+        slot.file_offset_ = loc.file_offset_;
+        slot.length_ = static_cast<uint32_t>(loc.length_);
+        slot.stored_ = static_cast<uint32_t>(loc.stored_);
+        slot.codec_ = static_cast<uint8_t>(loc.codec_);
+        slot.state_.store(SLOT_READY, std::memory_order_release);
+        part.header_->used_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (WaitReady(slot) == SLOT_READY && slot.hi_ == fp.hi_ &&
+          slot.lo_ == fp.lo_) {
+        return; // Stored at the same time by another writer
+      }
+    }
+  }
+
+  /** Create this process's pack on first use, under a fresh random id */
+  void OpenPack() {
+    std::lock_guard<std::mutex> lock(pack_mtx_);
+    if (pack_fd_ >= 0) {
+      return;
+    }
+    std::random_device rd;
+    std::mt19937_64 rng(
+        (static_cast<uint64_t>(rd()) << 32) ^
+        static_cast<uint64_t>(getpid()) ^
+        std::chrono::steady_clock::now().time_since_epoch().count());
+    for (int attempt = 0; attempt < 64; ++attempt) {
+      uint32_t id = static_cast<uint32_t>(rng());
+      std::string path = dir_ + "/" + GetPackName(id);
+      int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+      if (fd < 0 && errno == EEXIST) {
+        continue;
+      }
+      if (fd < 0) {
+        throw std::runtime_error("Could not create pack " + path + ": " +
+                                 std::strerror(errno));
+      }
+      pack_fd_ = fd;
+      pack_id_ = id;
+      WriteFull(PACK_MAGIC, sizeof(PACK_MAGIC), 0);
+      pack_end_ = sizeof(PACK_MAGIC);
+      return;
+    }
+    throw std::runtime_error("Could not create a pack in " + dir_);
+  }
+
+  void WriteFull(const char *data, size_t len, size_t offset) {
+    while (len > 0) {
+      ssize_t n = pwrite(pack_fd_, data, len, static_cast<off_t>(offset));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        throw std::runtime_error("Write to pack " + GetPackName(pack_id_) +
+                                 " failed: " + std::strerror(errno));
+      }
+      data += n;
+      len -= static_cast<size_t>(n);
+      offset += static_cast<size_t>(n);
+    }
+  }
+
+  std::string dir_;
+  Partition parts_[PARTITIONS];
+
+  std::mutex pack_mtx_;
+  int pack_fd_;
+  uint32_t pack_id_;
+  std::atomic<size_t> pack_end_; // Next free byte of the pack
+  std::atomic<bool> full_;       // Warned that the index is full
+
+  // Chunks written to the pack but not yet synced and indexed, and chunks
+  // being synced and indexed by a Publish that released the lock
+  using ChunkMap = std::map<std::pair<uint64_t, uint64_t>, ChunkLocation>;
+  mutable std::mutex pending_mtx_;
+  ChunkMap pending_;
+  ChunkMap publishing_;
+  size_t pending_bytes_;
+};
+
+} // namespace cae
+
+#endif // CAE_SINK_CHUNK_STORE_H_
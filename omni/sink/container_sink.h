@@ -0,0 +1,627 @@
+#ifndef CAE_SINK_CONTAINER_SINK_H_
+#define CAE_SINK_CONTAINER_SINK_H_
+
+#include "chunk_store.h"
+#include "io/block_codec.h"
+#include "io/content_chunker.h"
+#include "output_sink.h"
+#include "record_index.h"
+#include "util/hash.h"
+#include "util/json.h"
+#include "util/value_class.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Chunked Container Output:
+ *
+ * 1. Shards: Each rank writes shard-<rank>.cae, a header followed by
+ *    independently compressed blocks, plus shard-<rank>.json listing them
+ * 2. Parallel Writes: The calling thread compresses a block, reserves its
+ *    place in the shard with an atomic add and writes it with pwrite, so
+ *    threads never wait on each other's I/O
+ * 3. Byte Blocks: Raw chunks are staged per thread and cut into blocks of
+ *    up to BLOCK_SIZE contiguous source bytes
+ * 4. Column Blocks: Schema formats store each column of a record batch as
+ *    its own block with its inferred type, null count and min/max, so
+ *    readers can skip blocks without decoding them
+ * 5. Deduplication: Optionally, staged bytes are cut at content-defined
+ *    chunk boundaries instead; chunks already in this host's chunk store
+ *    under the output directory (.chunks/<host>, see sink/chunk_store.h)
+ *    are recorded as "ref" blocks pointing into its packs, and only new
+ *    chunks are written, to this process's pack rather than the shard. The
+ *    pack is synced before the shard index that refers to it is written
+ * 6. Record Index: Optionally, every column batch also becomes a chunk of
+ *    shard-<rank>.idx, with zone maps and Bloom filters for point lookups
+ *    (see sink/record_index.h)
+ */
+
+namespace cae {
+
+/**
+ * Statistics of one column block
+ */
+struct ColumnStats {
+  std::string type_; // "int", "float" or "string"
+  std::string min_;
+  std::string max_;
+  size_t nulls_; // Null fields (see util/value_class.h)
+
+  ColumnStats() : type_("string"), nulls_(0) {}
+
+  /**
+   * Infer the type of a column and compute its statistics. A column is int
+   * if every non-null value is int64, float if every one is a number, else
+   * string; bounds are taken over the non-null values
+   */
+  static ColumnStats Compute(const std::vector<std::string> &values) {
+    ColumnStats stats;
+    std::vector<ValueClass> classes;
+    classes.reserve(values.size());
+    bool is_int = true;
+    bool is_float = true;
+    for (const auto &value : values) {
+      classes.push_back(ValueClass::Of(value));
+      const ValueClass &v = classes.back();
+      if (v.type_ == ValueType::kNull) {
+        stats.nulls_++;
+        continue;
+      }
+      is_int = is_int && v.type_ == ValueType::kInt64;
+      is_float = is_float && v.IsNumber();
+    }
+    if (stats.nulls_ == values.size()) {
+      return stats;
+    }
+
+    bool first = true;
+    if (is_int) {
+      int64_t lo = 0, hi = 0;
+      for (const auto &v : classes) {
+        if (v.type_ == ValueType::kInt64) {
+          lo = first ? v.int_ : std::min(lo, v.int_);
+          hi = first ? v.int_ : std::max(hi, v.int_);
+          first = false;
+        }
+      }
+      stats.type_ = "int";
+      stats.min_ = std::to_string(lo);
+      stats.max_ = std::to_string(hi);
+    } else if (is_float) {
+      double lo = 0, hi = 0;
+      for (const auto &v : classes) {
+        if (v.IsNumber()) {
+          lo = first ? v.double_ : std::min(lo, v.double_);
+          hi = first ? v.double_ : std::max(hi, v.double_);
+          first = false;
+        }
+      }
+      stats.type_ = "float";
+      stats.min_ = FormatFloat(lo);
+      stats.max_ = FormatFloat(hi);
+    } else {
+      for (size_t i = 0; i < values.size(); ++i) {
+        if (classes[i].type_ == ValueType::kNull) {
+          continue;
+        }
+        const std::string &v = values[i];
+        if (first || v < stats.min_) {
+          stats.min_ = v;
+        }
+        if (first || v > stats.max_) {
+          stats.max_ = v;
+        }
+        first = false;
+      }
+    }
+    return stats;
+  }
+
+private:
+  static std::string FormatFloat(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.17g", value);
+    return buf;
+  }
+};
+
+/**
+ * Sink that writes compressed, chunked containers, one shard per rank
+ */
+class ContainerSink : public OutputSink {
+public:
+  static constexpr size_t BLOCK_SIZE = 4 * 1024 * 1024; // 4MB raw per block
+  static constexpr size_t HEADER_SIZE = 32;             // Block header bytes
+
+  static constexpr const char *CHUNK_DIR = ".chunks"; // In the output dir
+
+  /**
+   * Construct a container sink
+   * @param codec Block compression codec
+   * @param dedup Store byte blocks as deduplicated chunks
+   * @param index Which column batches to index for lookups
+   */
+  explicit ContainerSink(Codec codec = DefaultCodec(), bool dedup = false,
+                         const RecordIndexOptions &index = RecordIndexOptions())
+      : codec_(codec), dedup_(dedup), index_(index), fd_(-1), rank_(0), end_(0),
+        raw_bytes_(0), stored_bytes_(0), dedup_bytes_(0), ref_blocks_(0) {}
+
+  ~ContainerSink() override {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  void Open(const SinkContext &ctx) override {
+    std::error_code ec;
+    std::filesystem::create_directories(ctx.output_dir_, ec);
+    rank_ = ctx.rank_;
+    char name[32];
+    std::snprintf(name, sizeof(name), "shard-%05d", ctx.rank_);
+    shard_name_ = std::string(name) + ".cae";
+    index_name_ = std::string(name) + ".json";
+    if (index_.enabled_) {
+      record_index_name_ = std::string(name) + RecordIndex::EXTENSION;
+    }
+    output_dir_ = ctx.output_dir_;
+
+    std::string path = output_dir_ + "/" + shard_name_;
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error("Could not create shard " + path + ": " +
+                               std::strerror(errno));
+    }
+    WriteFull(SHARD_MAGIC, sizeof(SHARD_MAGIC), 0);
+    end_ = sizeof(SHARD_MAGIC);
+
+    // Datasets of one output directory share its chunk store
+    if (dedup_) {
+      std::filesystem::path dataset(output_dir_);
+      std::filesystem::path parent = dataset.parent_path();
+      if (!dataset.has_filename()) {
+        parent = parent.parent_path();
+      }
+      store_name_ = std::string(CHUNK_DIR) + "/" + ChunkStore::GetHostDir();
+      store_ = ChunkStore::Open(
+          (parent.empty() ? std::filesystem::path(".") : parent) /
+          store_name_);
+    }
+  }
+
+  void WriteChunk(const FormatContext &ctx, size_t offset, const char *data,
+                  size_t length) override {
+    Stage &stage = GetStage();
+    if (!stage.data_.empty() &&
+        (stage.source_ != ctx.filename_ ||
+         stage.offset_ + stage.data_.size() != offset)) {
+      FlushStage(stage);
+    }
+    while (length > 0) {
+      if (stage.data_.empty()) {
+        stage.source_ = ctx.filename_;
+        stage.offset_ = offset;
+      }
+      size_t n = std::min(length, BLOCK_SIZE - stage.data_.size());
+      stage.data_.append(data, n);
+      data += n;
+      offset += n;
+      length -= n;
+      if (stage.data_.size() == BLOCK_SIZE) {
+        FlushStage(stage, false);
+      }
+    }
+  }
+
+  void WriteHole(const FormatContext &ctx, size_t offset,
+                 size_t length) override {
+    Entry entry;
+    entry.kind_ = "hole";
+    entry.source_ = ctx.filename_;
+    entry.offset_ = offset;
+    entry.length_ = length;
+    std::lock_guard<std::mutex> lock(entries_mtx_);
+    entries_.push_back(std::move(entry));
+  }
+
+  void WriteColumns(const FormatContext &ctx, size_t offset,
+                    const ColumnBatch &batch) override {
+    std::string encoded;
+    std::vector<ZoneMap> zones;
+    for (size_t c = 0; c < batch.columns_.size(); ++c) {
+      const auto &values = batch.columns_[c];
+      encoded.clear();
+      for (const auto &v : values) {
+        ColumnBatch::EncodeValue(v, encoded);
+      }
+
+      Entry entry;
+      entry.kind_ = "column";
+      entry.source_ = ctx.filename_;
+      entry.offset_ = offset;
+      entry.column_ = batch.GetName(c);
+      entry.rows_ = values.size();
+      entry.stats_ = ColumnStats::Compute(values);
+      if (index_.enabled_) {
+        zones.emplace_back(entry.stats_.type_, entry.stats_.min_,
+                           entry.stats_.max_, entry.stats_.nulls_,
+                           values.size());
+      }
+      WriteBlock(entry, BLOCK_COLUMN, encoded.data(), encoded.size());
+    }
+    if (index_.enabled_) {
+      record_index_.Add(ctx.filename_, offset, batch, std::move(zones), index_);
+    }
+  }
+
+  /** Write staged bytes and the shard index of the blocks so far */
+  void Flush() override {
+    {
+      std::lock_guard<std::mutex> lock(stages_mtx_);
+      for (auto &kv : stages_) {
+        FlushStage(kv.second);
+      }
+    }
+    if (store_) {
+      store_->Sync();
+    }
+    WriteIndex();
+    SaveRecordIndex();
+  }
+
+  void Close() override {
+    {
+      std::lock_guard<std::mutex> lock(stages_mtx_);
+      for (auto &kv : stages_) {
+        FlushStage(kv.second);
+      }
+      stages_.clear();
+    }
+    if (store_) {
+      store_->Sync();
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    WriteIndex();
+    SaveRecordIndex();
+  }
+
+  std::string GetSummary() const override {
+    std::lock_guard<std::mutex> lock(entries_mtx_);
+    std::ostringstream oss;
+    oss << "{\"rank\": " << rank_ << ", \"shard\": " << JsonString(shard_name_)
+        << ", \"index\": " << JsonString(index_name_)
+        << ", \"codec\": " << JsonString(CodecName(codec_))
+        << ", \"blocks\": " << entries_.size()
+        << ", \"raw_bytes\": " << raw_bytes_
+        << ", \"stored_bytes\": " << stored_bytes_;
+    if (dedup_) {
+      oss << ", \"dedup_bytes\": " << dedup_bytes_
+          << ", \"ref_blocks\": " << ref_blocks_;
+    }
+    if (index_.enabled_) {
+      oss << ", \"record_index\": " << JsonString(record_index_name_)
+          << ", \"indexed_chunks\": " << record_index_.GetChunkCount()
+          << ", \"bloom_bytes\": " << record_index_.GetBloomBytes();
+    }
+    oss << "}";
+    return oss.str();
+  }
+
+private:
+  static constexpr char SHARD_MAGIC[8] = {'C', 'A', 'E', 'S',
+                                          'H', 'R', 'D', '1'};
+  static constexpr char BLOCK_MAGIC[4] = {'C', 'B', 'L', 'K'};
+  static constexpr unsigned char BLOCK_BYTES = 0;
+  static constexpr unsigned char BLOCK_COLUMN = 1;
+
+  /** One block (or hole) of the shard index */
+  struct Entry {
+    std::string kind_; // "bytes", "ref", "column" or "hole"
+    std::string source_;
+    size_t offset_;      // Offset in the source file
+    size_t length_;      // Raw bytes (hole: hole length)
+    size_t file_offset_; // Offset of the block header in the shard or pack
+    std::string pack_;   // Pack holding the block, empty = the shard
+    size_t stored_;      // Compressed payload bytes
+    Codec codec_;        // Codec of the payload
+    uint64_t xxh64_;     // Digest of the raw bytes
+    std::string column_;
+    size_t rows_;
+    ColumnStats stats_;
+
+    Entry()
+        : offset_(0), length_(0), file_offset_(0), stored_(0),
+          codec_(Codec::kNone), xxh64_(0), rows_(0) {}
+  };
+
+  /** Contiguous bytes a thread has not yet written as a block */
+  struct Stage {
+    std::string source_;
+    size_t offset_ = 0;
+    std::string data_;
+  };
+
+  Stage &GetStage() {
+    std::lock_guard<std::mutex> lock(stages_mtx_);
+    return stages_[std::this_thread::get_id()];
+  }
+
+  /**
+   * Write a thread's staged bytes
+   * @param final The next bytes of the thread do not continue these; else
+   *        a deduplicating sink keeps a trailing chunk that may still grow
+   */
+  void FlushStage(Stage &stage, bool final = true) {
+    if (stage.data_.empty()) {
+      return;
+    }
+    if (store_) {
+      const char *data = stage.data_.data();
+      size_t size = stage.data_.size();
+      size_t pos = 0;
+      while (pos < size) {
+        size_t len = ContentChunker::FindCut(data + pos, size - pos);
+        if (!final && pos + len == size && len < ContentChunker::MAX_SIZE) {
+          break;
+        }
+        WriteDedupChunk(stage.source_, stage.offset_ + pos, data + pos, len);
+        pos += len;
+      }
+      stage.data_.erase(0, pos);
+      stage.offset_ += pos;
+      return;
+    }
+    Entry entry;
+    entry.kind_ = "bytes";
+    entry.source_ = stage.source_;
+    entry.offset_ = stage.offset_;
+    WriteBlock(entry, BLOCK_BYTES, stage.data_.data(), stage.data_.size());
+    stage.data_.clear();
+  }
+
+  /**
+   * Compress a block, reserve space for it and write it
+   * Blocks that do not shrink are stored uncompressed.
+   */
+  void WriteBlock(Entry &entry, unsigned char kind, const char *raw,
+                  size_t len) {
+    entry.xxh64_ = Xxh64::Hash(raw, len);
+    std::vector<char> stored;
+    char header[HEADER_SIZE];
+    EncodeBlock(entry, kind, raw, len, stored, header);
+
+    entry.file_offset_ = end_.fetch_add(HEADER_SIZE + stored.size());
+    WriteFull(header, HEADER_SIZE, entry.file_offset_);
+    WriteFull(stored.data(), stored.size(), entry.file_offset_ + HEADER_SIZE);
+
+    std::lock_guard<std::mutex> lock(entries_mtx_);
+    raw_bytes_ += len;
+    stored_bytes_ += stored.size();
+    entries_.push_back(std::move(entry));
+  }
+
+  /**
+   * Write one content-defined chunk: a reference if the store knows it,
+   * else a new block in the store's pack
+   */
+  void WriteDedupChunk(const std::string &source, size_t offset,
+                       const char *raw, size_t len) {
+    Entry entry;
+    entry.source_ = source;
+    entry.offset_ = offset;
+    ChunkFingerprint fp = ChunkFingerprint::Of(raw, len);
+    entry.xxh64_ = fp.hi_;
+    ChunkLocation loc;
+    bool known = store_->Find(fp, loc) && loc.length_ == len;
+    if (known) {
+      entry.kind_ = "ref";
+      entry.length_ = len;
+      entry.stored_ = loc.stored_;
+      entry.codec_ = loc.codec_;
+    } else {
+      entry.kind_ = "bytes";
+      std::vector<char> stored;
+      char header[HEADER_SIZE];
+      EncodeBlock(entry, BLOCK_BYTES, raw, len, stored, header);
+      loc.length_ = len;
+      loc.stored_ = stored.size();
+      loc.codec_ = entry.codec_;
+      store_->Add(fp, header, HEADER_SIZE, stored.data(), loc);
+    }
+    entry.file_offset_ = loc.file_offset_;
+    entry.pack_ =
+        "../" + store_name_ + "/" + ChunkStore::GetPackName(loc.pack_);
+
+    std::lock_guard<std::mutex> lock(entries_mtx_);
+    raw_bytes_ += len;
+    if (known) {
+      dedup_bytes_ += len;
+      ref_blocks_++;
+    } else {
+      stored_bytes_ += entry.stored_;
+    }
+    entries_.push_back(std::move(entry));
+  }
+
+  /**
+   * Compress a block and build its header; sets the entry's length, codec
+   * and stored size. entry.xxh64_ must already hold the raw digest.
+   */
+  void EncodeBlock(Entry &entry, unsigned char kind, const char *raw,
+                   size_t len, std::vector<char> &stored,
+                   char (&header)[HEADER_SIZE]) const {
+    CompressBlock(codec_, raw, len, stored);
+    entry.codec_ = codec_;
+    if (stored.size() >= len) {
+      stored.assign(raw, raw + len);
+      entry.codec_ = Codec::kNone;
+    }
+    entry.length_ = len;
+    entry.stored_ = stored.size();
+
+    // Header: magic, codec, kind, 2 reserved, raw length, stored length,
+    // xxh64 of the raw bytes; integers little endian
+    std::memset(header, 0, HEADER_SIZE);
+    std::memcpy(header, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+    header[4] = static_cast<char>(entry.codec_);
+    header[5] = static_cast<char>(kind);
+    PutLe64(header + 8, len);
+    PutLe64(header + 16, stored.size());
+    PutLe64(header + 24, entry.xxh64_);
+  }
+
+  void WriteFull(const char *data, size_t len, size_t offset) {
+    while (len > 0) {
+      ssize_t n = pwrite(fd_, data, len, static_cast<off_t>(offset));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        throw std::runtime_error("Write to shard " + shard_name_ +
+                                 " failed: " + std::strerror(errno));
+      }
+      data += n;
+      len -= static_cast<size_t>(n);
+      offset += static_cast<size_t>(n);
+    }
+  }
+
+  static void PutLe64(char *p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+      p[i] = static_cast<char>(v >> (8 * i));
+    }
+  }
+
+  void SaveRecordIndex() {
+    if (index_.enabled_) {
+      record_index_.Save(output_dir_ + "/" + record_index_name_);
+    }
+  }
+
+  /** Write the shard's block list, ordered by source position */
+  void WriteIndex() {
+    std::lock_guard<std::mutex> lock(entries_mtx_);
+    std::sort(entries_.begin(), entries_.end(),
+              [](const Entry &a, const Entry &b) {
+                return std::tie(a.source_, a.offset_, a.column_) <
+                       std::tie(b.source_, b.offset_, b.column_);
+              });
+    // Written aside and renamed, so a reader of a flushed index never
+    // sees half of it
+    std::string path = output_dir_ + "/" + index_name_;
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp);
+    if (!out) {
+      throw std::runtime_error("Could not write shard index: " + path);
+    }
+    out << "{\"shard\": " << JsonString(shard_name_)
+        << ", \"codec\": " << JsonString(CodecName(codec_))
+        << ", \"block_header_size\": " << HEADER_SIZE << ", \"blocks\": [";
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      const Entry &e = entries_[i];
+      out << (i ? ",\n  " : "\n  ") << "{\"kind\": " << JsonString(e.kind_)
+          << ", \"source\": " << JsonString(e.source_)
+          << ", \"offset\": " << e.offset_ << ", \"length\": " << e.length_;
+      if (e.kind_ != "hole") {
+        out << ", \"file_offset\": " << e.file_offset_
+            << ", \"stored\": " << e.stored_
+            << ", \"codec\": " << JsonString(CodecName(e.codec_))
+            << ", \"xxh64\": "
+            << JsonString(Xxh64::ToHex(e.xxh64_));
+        if (!e.pack_.empty()) {
+          out << ", \"pack\": " << JsonString(e.pack_);
+        }
+      }
+      if (e.kind_ == "column") {
+        out << ", \"column\": " << JsonString(e.column_)
+            << ", \"rows\": " << e.rows_
+            << ", \"type\": " << JsonString(e.stats_.type_)
+            << ", \"nulls\": " << e.stats_.nulls_;
+        if (e.stats_.nulls_ < e.rows_) {
+          bool numeric = e.stats_.type_ != "string";
+          out << ", \"min\": "
+              << (numeric ? e.stats_.min_ : JsonString(e.stats_.min_))
+              << ", \"max\": "
+              << (numeric ? e.stats_.max_ : JsonString(e.stats_.max_));
+        }
+      }
+      out << "}";
+    }
+
+    // Size and mtime of each source, so readers can tell a stale copy
+    std::set<std::string> sources;
+    for (const Entry &e : entries_) {
+      sources.insert(e.source_);
+    }
+    out << "\n], \"sources\": [";
+    size_t n = 0;
+    for (const auto &source : sources) {
+      struct stat st;
+      if (stat(source.c_str(), &st) != 0) {
+        continue;
+      }
+      out << (n++ ? ",\n  " : "\n  ") << "{\"path\": " << JsonString(source)
+          << ", \"size\": " << st.st_size << ", \"mtime_ns\": "
+          << static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                 st.st_mtim.tv_nsec
+          << "}";
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("Could not write shard index: " + path);
+    }
+  }
+
+  Codec codec_;
+  bool dedup_;
+  RecordIndexOptions index_;
+  RecordIndex record_index_;
+  std::string record_index_name_;
+  std::shared_ptr<ChunkStore> store_; // Set when deduplicating
+  std::string store_name_;            // Its directory, relative to output
+  int fd_;
+  int rank_;
+  std::string output_dir_;
+  std::string shard_name_;
+  std::string index_name_;
+  std::atomic<size_t> end_; // Next free byte of the shard
+
+  std::mutex stages_mtx_;
+  std::map<std::thread::id, Stage> stages_;
+
+  mutable std::mutex entries_mtx_;
+  std::vector<Entry> entries_;
+  size_t raw_bytes_;
+  size_t stored_bytes_;
+  size_t dedup_bytes_; // Raw bytes written as references
+  size_t ref_blocks_;
+};
+
+} // namespace cae
+
+#endif // CAE_SINK_CONTAINER_SINK_H_
@@ -0,0 +1,168 @@
+#ifndef CAE_SINK_OUTPUT_SINK_H_
+#define CAE_SINK_OUTPUT_SINK_H_
+
+#include "format/format_client.h"
+#include "util/hash.h"
+#include "util/json.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Output Sink Stage:
+ *
+ * 1. Pluggable: Format clients hand every chunk they read (or, for schema
+ *    formats, every batch of records) to an OutputSink instead of dropping it
+ * 2. Per-Rank Shards: Each rank opens its own sink instance and writes its
+ *    own shard, so output never funnels through a single process
+ * 3. Manifest: At the end of a job every rank contributes a short JSON
+ *    summary and rank 0 writes them into one small manifest.json
+ */
+
+namespace cae {
+
+/**
+ * Where and for whom a sink writes
+ */
+struct SinkContext {
+  std::string output_dir_; // Dataset directory shared by all ranks
+  int rank_;
+  int nranks_;
+
+  SinkContext() : rank_(0), nranks_(1) {}
+};
+
+/**
+ * Records of a schema format, stored column by column
+ */
+struct ColumnBatch {
+  std::vector<std::string> names_;
+  std::vector<std::vector<std::string>> columns_; // columns_[column][row]
+  size_t source_size_; // Bytes of the records in the file, 0 = unknown
+
+  ColumnBatch() : source_size_(0) {}
+
+  /** Number of rows in the batch */
+  size_t GetRowCount() const {
+    return columns_.empty() ? 0 : columns_.front().size();
+  }
+
+  /** Drop all rows but keep the column names */
+  void Clear() {
+    for (auto &column : columns_) {
+      column.clear();
+    }
+    source_size_ = 0;
+  }
+
+  /** Name of a column, or colN when the batch has no name for it */
+  std::string GetName(size_t column) const {
+    return column < names_.size() ? names_[column]
+                                  : "col" + std::to_string(column);
+  }
+
+  /** Append a value as a 32-bit little-endian length and its bytes */
+  static void EncodeValue(const std::string &value, std::string &out) {
+    uint32_t len = static_cast<uint32_t>(value.size());
+    char le[4] = {static_cast<char>(len), static_cast<char>(len >> 8),
+                  static_cast<char>(len >> 16), static_cast<char>(len >> 24)};
+    out.append(le, sizeof(le));
+    out.append(value);
+  }
+};
+
+/**
+ * Destination for imported data
+ * All Write calls may come concurrently from the threads of a rank.
+ */
+class OutputSink {
+public:
+  virtual ~OutputSink() = default;
+
+  /** Prepare this rank's output */
+  virtual void Open(const SinkContext &ctx) = 0;
+
+  /**
+   * Store bytes read from a file
+   * @param ctx Range being imported
+   * @param offset Offset of the bytes in the (uncompressed) file
+   * @param data Bytes
+   * @param length Number of bytes
+   */
+  virtual void WriteChunk(const FormatContext &ctx, size_t offset,
+                          const char *data, size_t length) = 0;
+
+  /** Record a hole; the range reads as zeros and carries no data */
+  virtual void WriteHole(const FormatContext &ctx, size_t offset,
+                         size_t length) {}
+
+  /**
+   * Store records of a schema format
+   * @param ctx Range being imported
+   * @param offset File offset of the first record in the batch
+   * @param batch Records, column by column
+   */
+  virtual void WriteColumns(const FormatContext &ctx, size_t offset,
+                            const ColumnBatch &batch) = 0;
+
+  /**
+   * Make everything written so far readable while the sink stays open,
+   * e.g. between the micro-batches of a followed file; not called
+   * concurrently with writes
+   */
+  virtual void Flush() {}
+
+  /** Flush buffered data and finish this rank's output */
+  virtual void Close() = 0;
+
+  /** JSON object describing this rank's output, for the manifest */
+  virtual std::string GetSummary() const = 0;
+
+  /**
+   * Dataset directory name of an imported range: the file name with a
+   * digest of the full path, and of the range unless it is the whole file,
+   * so files of the same name in different directories and concurrent jobs
+   * over parts of one file never share a directory
+   * @param size Size of the range, 0 = to end of file
+   */
+  static std::string GetDatasetName(const std::string &path, size_t offset,
+                                    size_t size) {
+    std::string key = path;
+    if (offset != 0 || size != 0) {
+      key += ":" + std::to_string(offset) + ":" + std::to_string(size);
+    }
+    return std::filesystem::path(path).filename().string() + "-" +
+           Xxh64::ToHex(Xxh64::Hash(key.data(), key.size()));
+  }
+
+  /**
+   * Write the manifest of a dataset
+   * @param output_dir Dataset directory
+   * @param sink_name Sink that produced the dataset
+   * @param summaries GetSummary() of every rank, in rank order
+   */
+  static void WriteManifest(const std::string &output_dir,
+                            const std::string &sink_name,
+                            const std::vector<std::string> &summaries) {
+    std::string path = output_dir + "/manifest.json";
+    std::ofstream out(path);
+    if (!out) {
+      throw std::runtime_error("Could not write manifest: " + path);
+    }
+    out << "{\n  \"sink\": " << JsonString(sink_name) << ",\n";
+    out << "  \"version\": 1,\n";
+    out << "  \"shards\": [";
+    for (size_t i = 0; i < summaries.size(); ++i) {
+      out << (i ? ",\n    " : "\n    ") << summaries[i];
+    }
+    out << "\n  ]\n}\n";
+  }
+};
+
+} // namespace cae
+
+#endif // CAE_SINK_OUTPUT_SINK_H_
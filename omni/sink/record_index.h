@@ -0,0 +1,619 @@
+#ifndef CAE_SINK_RECORD_INDEX_H_
+#define CAE_SINK_RECORD_INDEX_H_
+
+#include "output_sink.h"
+#include "util/hash.h"
+#include "util/value_class.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/**
+ * Record Index Strategy:
+ *
+ * 1. By-Product: Every column batch a schema format hands to the container
+ *    sink becomes one chunk of the index: its source range and rows, a zone
+ *    map (type, min, max, nulls) per column and, for the selected key
+ *    columns, a Bloom filter over the distinct values; nothing is read twice
+ * 2. Blocked Bloom Filters: Split-block filters as in Parquet: a key sets
+ *    one bit in each of the eight 32-bit words of one 32-byte block, so a
+ *    probe touches a single cache line; BITS_PER_KEY bits per distinct
+ *    value give about one false positive in a hundred
+ * 3. Compact: String bounds are cut to MAX_ZONE_BYTES (a cut maximum no
+ *    longer bounds anything), and each rank writes its chunks to one
+ *    little-endian file, shard-<rank>.idx, named in the manifest
+ * 4. Lookups: A chunk is a candidate when no zone map or Bloom filter rules
+ *    out any of the predicates; candidates come back as (file, offset, size)
+ *    ranges that an OMNI job can read again on their own. Values and
+ *    predicate bounds are typed by util/value_class.h, like the column
+ *    statistics the zone maps come from; null fields equal a null value
+ *    and lie in no range
+ */
+
+namespace cae {
+
+/**
+ * Which records a container sink indexes
+ */
+struct RecordIndexOptions {
+  bool enabled_;
+  std::vector<std::string> bloom_columns_; // "*" = every column
+
+  RecordIndexOptions() : enabled_(false) {}
+
+  /** Whether a column gets a Bloom filter */
+  bool HasBloom(const std::string &column) const {
+    for (const auto &name : bloom_columns_) {
+      if (name == "*" || name == column) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Columns as a comma-separated list */
+  std::string JoinColumns() const {
+    std::string list;
+    for (const auto &name : bloom_columns_) {
+      list += (list.empty() ? "" : ",") + name;
+    }
+    return list;
+  }
+
+  /** Columns from a comma-separated list */
+  void SplitColumns(const std::string &list) {
+    bloom_columns_.clear();
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+      if (!name.empty()) {
+        bloom_columns_.push_back(name);
+      }
+    }
+  }
+};
+
+/**
+ * Little-endian encoding of the index file
+ */
+class IndexCodec {
+public:
+  static void Put(std::string &out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+      out.push_back(static_cast<char>(v >> (8 * i)));
+    }
+  }
+
+  static void PutString(std::string &out, const std::string &s) {
+    Put(out, s.size());
+    out.append(s);
+  }
+
+  /** Read a value at pos; throws if the file is too short */
+  static uint64_t Get(const std::string &in, size_t &pos) {
+    Need(in, pos, 8);
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+      v |= static_cast<uint64_t>(static_cast<unsigned char>(in[pos++]))
+           << (8 * i);
+    }
+    return v;
+  }
+
+  static std::string GetString(const std::string &in, size_t &pos) {
+    uint64_t len = Get(in, pos);
+    Need(in, pos, len);
+    std::string s = in.substr(pos, len);
+    pos += len;
+    return s;
+  }
+
+  /**
+   * Read a count of items at pos; throws unless the rest of the file can
+   * hold that many, so a corrupt count never sizes an allocation
+   * @param item_bytes Fewest bytes one item takes
+   */
+  static uint64_t GetCount(const std::string &in, size_t &pos,
+                           uint64_t item_bytes) {
+    uint64_t count = Get(in, pos);
+    if (count > (in.size() - pos) / item_bytes) {
+      throw std::runtime_error("Corrupt record index");
+    }
+    return count;
+  }
+
+  static void Need(const std::string &in, size_t pos, uint64_t len) {
+    if (pos > in.size() || in.size() - pos < len) {
+      throw std::runtime_error("Truncated record index");
+    }
+  }
+};
+
+/**
+ * Split-block Bloom filter over the distinct values of a column
+ */
+class BlockedBloomFilter {
+public:
+  static constexpr size_t WORDS_PER_BLOCK = 8; // 32-byte blocks
+  static constexpr size_t BITS_PER_KEY = 10;
+
+  /** Hash of a field value */
+  static uint64_t HashValue(const std::string &value) {
+    return Xxh64::Hash(value.data(), value.size());
+  }
+
+  /**
+   * Size the filter for a set of hashes and insert them
+   * @param hashes Hashes of the values; sorted and deduplicated here
+   */
+  void Build(std::vector<uint64_t> &hashes) {
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    size_t bits = hashes.size() * BITS_PER_KEY;
+    size_t blocks = std::max<size_t>(1, (bits + 255) / 256);
+    words_.assign(blocks * WORDS_PER_BLOCK, 0);
+    for (uint64_t h : hashes) {
+      uint32_t *block = &words_[GetBlock(h) * WORDS_PER_BLOCK];
+      for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) {
+        block[i] |= GetMask(h, i);
+      }
+    }
+  }
+
+  /** False only if the value was certainly not inserted */
+  bool MayContain(uint64_t h) const {
+    if (words_.empty()) {
+      return true;
+    }
+    const uint32_t *block = &words_[GetBlock(h) * WORDS_PER_BLOCK];
+    for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) {
+      if (!(block[i] & GetMask(h, i))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t GetByteCount() const { return words_.size() * sizeof(uint32_t); }
+
+  void Serialize(std::string &out) const {
+    IndexCodec::Put(out, words_.size() / WORDS_PER_BLOCK);
+    for (uint32_t w : words_) {
+      char le[4] = {static_cast<char>(w), static_cast<char>(w >> 8),
+                    static_cast<char>(w >> 16), static_cast<char>(w >> 24)};
+      out.append(le, sizeof(le));
+    }
+  }
+
+  void Deserialize(const std::string &in, size_t &pos) {
+    uint64_t blocks = IndexCodec::GetCount(in, pos, WORDS_PER_BLOCK * 4);
+    words_.resize(blocks * WORDS_PER_BLOCK);
+    for (auto &w : words_) {
+      w = 0;
+      for (int b = 0; b < 4; ++b) {
+        w |= static_cast<uint32_t>(static_cast<unsigned char>(in[pos++]))
+             << (8 * b);
+      }
+    }
+  }
+
+private:
+  size_t GetBlock(uint64_t h) const {
+    uint64_t blocks = words_.size() / WORDS_PER_BLOCK;
+    return static_cast<size_t>(((h >> 32) * blocks) >> 32);
+  }
+
+  static uint32_t GetMask(uint64_t h, size_t i) {
+    static constexpr uint32_t SALT[WORDS_PER_BLOCK] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+    return 1U << ((static_cast<uint32_t>(h) * SALT[i]) >> 27);
+  }
+
+  std::vector<uint32_t> words_;
+};
+
+/**
+ * Bounds of one column of a chunk
+ */
+struct ZoneMap {
+  static constexpr size_t MAX_ZONE_BYTES = 64;
+
+  std::string type_; // "int", "float" or "string"
+  std::string min_;
+  std::string max_;
+  bool max_bounded_; // False once a long string maximum was cut
+  size_t nulls_;     // Null fields
+  size_t rows_;
+
+  ZoneMap() : type_("string"), max_bounded_(true), nulls_(0), rows_(0) {}
+
+  /** Zone map of a column block; long string bounds are cut */
+  ZoneMap(const std::string &type, const std::string &min,
+          const std::string &max, size_t nulls, size_t rows)
+      : type_(type), min_(min.substr(0, MAX_ZONE_BYTES)), max_(max),
+        max_bounded_(true), nulls_(nulls), rows_(rows) {
+    if (max_.size() > MAX_ZONE_BYTES) {
+      max_.clear();
+      max_bounded_ = false;
+    }
+  }
+
+  /** Whether a field may hold exactly this text */
+  bool MayEqual(const std::string &value) const {
+    if (ValueClass::Of(value).type_ == ValueType::kNull) {
+      return nulls_ > 0;
+    }
+    if (nulls_ == rows_) {
+      return false;
+    }
+    if (type_ == "string") {
+      return value >= min_ && (!max_bounded_ || value <= max_);
+    }
+    // Every non-null field of a numeric column is a number of its type
+    long double v;
+    if (!ParseNumber(value, type_ == "int", v)) {
+      return false;
+    }
+    return v >= GetNumber(min_) && v <= GetNumber(max_);
+  }
+
+  /**
+   * Whether a field may lie in [lo, hi]; numeric columns compare as numbers
+   * @param lo Lower bound, empty = none
+   * @param hi Upper bound, empty = none
+   */
+  bool MayOverlap(const std::string &lo, const std::string &hi) const {
+    if (nulls_ == rows_) {
+      return false;
+    }
+    if (type_ == "string") {
+      return (hi.empty() || hi >= min_) &&
+             (lo.empty() || !max_bounded_ || lo <= max_);
+    }
+    long double l = 0, h = 0;
+    if ((!lo.empty() && !ParseNumber(lo, false, l)) ||
+        (!hi.empty() && !ParseNumber(hi, false, h))) {
+      return true; // Not a number; nothing to compare with
+    }
+    return (hi.empty() || h >= GetNumber(min_)) &&
+           (lo.empty() || l <= GetNumber(max_));
+  }
+
+  void Serialize(std::string &out) const {
+    IndexCodec::PutString(out, type_);
+    IndexCodec::PutString(out, min_);
+    IndexCodec::PutString(out, max_);
+    IndexCodec::Put(out, max_bounded_ ? 1 : 0);
+    IndexCodec::Put(out, nulls_);
+    IndexCodec::Put(out, rows_);
+  }
+
+  void Deserialize(const std::string &in, size_t &pos) {
+    type_ = IndexCodec::GetString(in, pos);
+    min_ = IndexCodec::GetString(in, pos);
+    max_ = IndexCodec::GetString(in, pos);
+    max_bounded_ = IndexCodec::Get(in, pos) != 0;
+    nulls_ = IndexCodec::Get(in, pos);
+    rows_ = IndexCodec::Get(in, pos);
+  }
+
+private:
+  /**
+   * A value as a number, classified like the column's values; long double
+   * holds every 64-bit integer
+   * @param integer Accept only int64 values
+   */
+  static bool ParseNumber(const std::string &s, bool integer,
+                          long double &value) {
+    ValueClass v = ValueClass::Of(s);
+    if (integer ? v.type_ != ValueType::kInt64 : !v.IsNumber()) {
+      return false;
+    }
+    value = v.type_ == ValueType::kInt64 ? static_cast<long double>(v.int_)
+                                         : static_cast<long double>(v.double_);
+    return true;
+  }
+
+  static long double GetNumber(const std::string &s) {
+    return std::strtold(s.c_str(), nullptr);
+  }
+};
+
+/**
+ * One column of an indexed chunk
+ */
+struct IndexedColumn {
+  std::string name_;
+  ZoneMap zone_;
+  BlockedBloomFilter bloom_; // Empty = not a key column
+};
+
+/**
+ * One column batch: where its records are and what they can hold
+ */
+struct IndexedChunk {
+  std::string source_;
+  size_t offset_; // First record in the (uncompressed) source
+  size_t size_;   // Bytes of the records, 0 = unknown
+  size_t rows_;
+  std::vector<IndexedColumn> columns_;
+
+  IndexedChunk() : offset_(0), size_(0), rows_(0) {}
+};
+
+/**
+ * Predicate on one column; a chunk is kept unless it certainly has no
+ * matching row
+ */
+struct IndexPredicate {
+  std::string column_;
+  bool equals_; // Else a range
+  std::string value_;
+  std::string lo_; // Range bounds, inclusive; empty = open
+  std::string hi_;
+
+  IndexPredicate() : equals_(true) {}
+
+  /**
+   * Parse "col=value" (equals) or "col=lo..hi" (range)
+   * @return False if the text has no column
+   */
+  static bool Parse(const std::string &text, bool equals,
+                    IndexPredicate &pred) {
+    size_t eq = text.find('=');
+    if (eq == std::string::npos || eq == 0) {
+      return false;
+    }
+    pred.column_ = text.substr(0, eq);
+    pred.equals_ = equals;
+    std::string value = text.substr(eq + 1);
+    if (equals) {
+      pred.value_ = value;
+      return true;
+    }
+    size_t dots = value.find("..");
+    if (dots == std::string::npos) {
+      return false;
+    }
+    pred.lo_ = value.substr(0, dots);
+    pred.hi_ = value.substr(dots + 2);
+    return true;
+  }
+
+  /** Whether some row of the chunk may match */
+  bool MayMatch(const IndexedChunk &chunk) const {
+    for (const auto &col : chunk.columns_) {
+      if (col.name_ != column_) {
+        continue;
+      }
+      if (!equals_) {
+        return col.zone_.MayOverlap(lo_, hi_);
+      }
+      if (!col.zone_.MayEqual(value_)) {
+        return false;
+      }
+      return value_.empty() ||
+             col.bloom_.MayContain(BlockedBloomFilter::HashValue(value_));
+    }
+    return false; // No row of the chunk has the column
+  }
+};
+
+/**
+ * A range of a source that may hold matching records
+ */
+struct CandidateRange {
+  std::string source_;
+  size_t offset_;
+  size_t size_; // 0 = to the end of the source
+  size_t rows_;
+
+  CandidateRange() : offset_(0), size_(0), rows_(0) {}
+};
+
+/**
+ * Per-chunk index of the records a rank wrote
+ */
+class RecordIndex {
+public:
+  static constexpr const char *EXTENSION = ".idx";
+
+  /**
+   * Index a column batch
+   * @param source File the records came from
+   * @param offset Offset of the first record
+   * @param batch The records; source_size_ gives their extent
+   * @param zones Zone map of each column of the batch
+   * @param options Which columns get Bloom filters
+   */
+  void Add(const std::string &source, size_t offset, const ColumnBatch &batch,
+           std::vector<ZoneMap> zones, const RecordIndexOptions &options) {
+    IndexedChunk chunk;
+    chunk.source_ = source;
+    chunk.offset_ = offset;
+    chunk.size_ = batch.source_size_;
+    chunk.rows_ = batch.GetRowCount();
+    chunk.columns_.resize(batch.columns_.size());
+    std::vector<uint64_t> hashes;
+    for (size_t c = 0; c < batch.columns_.size(); ++c) {
+      IndexedColumn &col = chunk.columns_[c];
+      col.name_ = batch.GetName(c);
+      col.zone_ = std::move(zones[c]);
+      if (!options.HasBloom(col.name_)) {
+        continue;
+      }
+      hashes.clear();
+      for (const auto &v : batch.columns_[c]) {
+        if (!v.empty()) {
+          hashes.push_back(BlockedBloomFilter::HashValue(v));
+        }
+      }
+      col.bloom_.Build(hashes);
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    chunks_.push_back(std::move(chunk));
+  }
+
+  /** Number of chunks indexed so far */
+  size_t GetChunkCount() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return chunks_.size();
+  }
+
+  /** Bytes of the Bloom filters so far */
+  size_t GetBloomBytes() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t bytes = 0;
+    for (const auto &chunk : chunks_) {
+      for (const auto &col : chunk.columns_) {
+        bytes += col.bloom_.GetByteCount();
+      }
+    }
+    return bytes;
+  }
+
+  /**
+   * Write the index, aside and renamed like the shard index
+   * @param path Index file
+   */
+  void Save(const std::string &path) const {
+    std::string data(MAGIC, sizeof(MAGIC));
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      IndexCodec::Put(data, chunks_.size());
+      for (const auto &chunk : chunks_) {
+        IndexCodec::PutString(data, chunk.source_);
+        IndexCodec::Put(data, chunk.offset_);
+        IndexCodec::Put(data, chunk.size_);
+        IndexCodec::Put(data, chunk.rows_);
+        IndexCodec::Put(data, chunk.columns_.size());
+        for (const auto &col : chunk.columns_) {
+          IndexCodec::PutString(data, col.name_);
+          col.zone_.Serialize(data);
+          col.bloom_.Serialize(data);
+        }
+      }
+    }
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("Could not write record index: " + path);
+    }
+  }
+
+  /** Read the chunks of an index file; throws if it is not one */
+  static std::vector<IndexedChunk> Load(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    if (!in.good() && !in.eof()) {
+      throw std::runtime_error("Could not read record index: " + path);
+    }
+    if (data.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) {
+      throw std::runtime_error("Not a record index: " + path);
+    }
+    size_t pos = sizeof(MAGIC);
+    std::vector<IndexedChunk> chunks(
+        IndexCodec::GetCount(data, pos, MIN_CHUNK_BYTES));
+    for (auto &chunk : chunks) {
+      chunk.source_ = IndexCodec::GetString(data, pos);
+      chunk.offset_ = IndexCodec::Get(data, pos);
+      chunk.size_ = IndexCodec::Get(data, pos);
+      chunk.rows_ = IndexCodec::Get(data, pos);
+      chunk.columns_.resize(IndexCodec::GetCount(data, pos, MIN_COLUMN_BYTES));
+      for (auto &col : chunk.columns_) {
+        col.name_ = IndexCodec::GetString(data, pos);
+        col.zone_.Deserialize(data, pos);
+        col.bloom_.Deserialize(data, pos);
+      }
+    }
+    return chunks;
+  }
+
+  /**
+   * Ranges of the chunks every predicate may match; adjacent ranges of a
+   * source are merged
+   * @param chunks Chunks of one or more index files
+   * @param predicates All must match
+   */
+  static std::vector<CandidateRange>
+  Query(std::vector<IndexedChunk> chunks,
+        const std::vector<IndexPredicate> &predicates) {
+    std::sort(chunks.begin(), chunks.end(),
+              [](const IndexedChunk &a, const IndexedChunk &b) {
+                return std::tie(a.source_, a.offset_) <
+                       std::tie(b.source_, b.offset_);
+              });
+    // The same range imported into several datasets counts once
+    auto same = [](const IndexedChunk &a, const IndexedChunk &b) {
+      return a.source_ == b.source_ && a.offset_ == b.offset_;
+    };
+    chunks.erase(std::unique(chunks.begin(), chunks.end(), same),
+                 chunks.end());
+    std::vector<CandidateRange> ranges;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      const IndexedChunk &chunk = chunks[i];
+      bool match = true;
+      for (const auto &pred : predicates) {
+        match = match && pred.MayMatch(chunk);
+      }
+      if (!match) {
+        continue;
+      }
+      // Unknown extents reach to the next chunk of the source
+      size_t size = chunk.size_;
+      if (size == 0 && i + 1 < chunks.size() &&
+          chunks[i + 1].source_ == chunk.source_) {
+        size = chunks[i + 1].offset_ - chunk.offset_;
+      }
+      if (!ranges.empty() && ranges.back().source_ == chunk.source_) {
+        CandidateRange &last = ranges.back();
+        size_t last_end = last.offset_ + last.size_;
+        if (last.size_ == 0 || last_end >= chunk.offset_) {
+          if (last.size_ != 0) {
+            last.size_ = size == 0 ? 0
+                                   : std::max(last_end, chunk.offset_ + size) -
+                                         last.offset_;
+          }
+          last.rows_ += chunk.rows_;
+          continue;
+        }
+      }
+      CandidateRange range;
+      range.source_ = chunk.source_;
+      range.offset_ = chunk.offset_;
+      range.size_ = size;
+      range.rows_ = chunk.rows_;
+      ranges.push_back(std::move(range));
+    }
+    return ranges;
+  }
+
+private:
+  static constexpr char MAGIC[8] = {'C', 'A', 'E', 'R', 'I', 'D', 'X', '1'};
+  // Fewest bytes of a serialized chunk (source, offset, size, rows, column
+  // count) and column (name, zone map of three strings and three values,
+  // Bloom block count)
+  static constexpr uint64_t MIN_CHUNK_BYTES = 5 * 8;
+  static constexpr uint64_t MIN_COLUMN_BYTES = 8 + 6 * 8 + 8;
+
+  mutable std::mutex mtx_;
+  std::vector<IndexedChunk> chunks_;
+};
+
+} // namespace cae
+
+#endif // CAE_SINK_RECORD_INDEX_H_
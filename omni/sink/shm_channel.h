@@ -0,0 +1,663 @@
+#ifndef CAE_SINK_SHM_CHANNEL_H_
+#define CAE_SINK_SHM_CHANNEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Shared-Memory Chunk Channels:
+ *
+ * 1. Segments: A channel is one POSIX shm segment per producing rank, named
+ *    /cae.<channel>.<rank>, so consumers on the node attach by name
+ * 2. Ring: A fixed ring of slots, each a chunk descriptor plus a data area
+ *    of slot_size bytes; every slot carries a sequence number that tells
+ *    producers and consumers whose turn it is (bounded-queue protocol), so
+ *    publishing and claiming are single compare-and-swaps without locks
+ * 3. Zero Copy: Consumers read chunk data in place and release the slot
+ *    when done; only then can the producer reuse it
+ * 4. Many Consumers: Every chunk goes to exactly one consumer, so several
+ *    analysis processes can share the stream of a rank
+ * 5. Large Pages: The data area is aligned to 2MB and advised for
+ *    transparent huge pages when requested
+ * 6. End of Stream: The producer marks the segment closed; consumers drain
+ *    what is left and then see the end
+ * 7. Bounded Blocking: A blocking producer waits for consumers at most
+ *    consumer_timeout_ms without a chunk being claimed; then it warns and
+ *    drops what the ring cannot hold, counting it, until a consumer claims
+ *    a chunk again. Chunks still unclaimed at Close count as dropped too
+ */
+
+namespace cae {
+
+/**
+ * What a full ring does to the producer
+ */
+enum class ShmOverflow { kBlock, kDrop };
+
+/**
+ * Kind of a chunk in a channel
+ */
+enum class ShmChunkKind : uint32_t { kBytes = 0, kHole = 1, kColumn = 2 };
+
+/**
+ * Shape of a channel, declared once and shared by all of its segments
+ */
+struct ShmChannelConfig {
+  static constexpr uint32_t DEFAULT_SLOTS = 64;
+  static constexpr size_t DEFAULT_SLOT_SIZE = 4 * 1024 * 1024; // 4MB
+  static constexpr unsigned DEFAULT_CONSUMER_TIMEOUT_MS = 60000;
+
+  std::string name_;
+  uint32_t slots_;
+  size_t slot_size_; // Bytes of source name, column name and payload
+  bool huge_pages_;
+  ShmOverflow overflow_;
+  unsigned consumer_timeout_ms_; // Blocking: longest wait, 0 = no limit
+
+  ShmChannelConfig()
+      : slots_(DEFAULT_SLOTS), slot_size_(DEFAULT_SLOT_SIZE), huge_pages_(true),
+        overflow_(ShmOverflow::kBlock),
+        consumer_timeout_ms_(DEFAULT_CONSUMER_TIMEOUT_MS) {}
+
+  /** Channel names become shm names, so keep them to [A-Za-z0-9_-] */
+  static bool IsValidName(const std::string &name) {
+    if (name.empty() || name.size() > 200) {
+      return false;
+    }
+    for (char c : name) {
+      if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+            c == '-')) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Parse an overflow policy ("block" or "drop") */
+  static bool ParseOverflow(const std::string &name, ShmOverflow &overflow) {
+    if (name == "block") {
+      overflow = ShmOverflow::kBlock;
+    } else if (name == "drop") {
+      overflow = ShmOverflow::kDrop;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  /** Name of an overflow policy */
+  static const char *OverflowName(ShmOverflow overflow) {
+    return overflow == ShmOverflow::kDrop ? "drop" : "block";
+  }
+};
+
+/**
+ * A chunk handed to a consumer; data_ points into the shared segment and
+ * stays valid until the chunk is released
+ */
+struct ShmChunk {
+  ShmChunkKind kind_;
+  std::string source_;
+  std::string column_; // Column chunks only
+  size_t offset_;      // Offset in the source file (columns: of the batch)
+  size_t length_;      // Payload bytes (holes: hole length)
+  size_t rows_;        // Column chunks: values in this chunk
+  size_t first_row_;   // Column chunks: row of the batch the chunk starts at
+  const char *data_;
+  uint64_t seq_; // Ring position, used by Release
+
+  ShmChunk()
+      : kind_(ShmChunkKind::kBytes), offset_(0), length_(0), rows_(0),
+        first_row_(0), data_(nullptr), seq_(0) {}
+};
+
+/**
+ * Memory layout shared by producer and consumers
+ */
+struct ShmLayout {
+  static constexpr char MAGIC[8] = {'C', 'A', 'E', 'S', 'H', 'M', '0', '1'};
+  static constexpr size_t CACHE_LINE = 64;
+  static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+  struct alignas(CACHE_LINE) Header {
+    char magic_[8];
+    uint32_t slots_;
+    uint32_t ready_; // Set last, once the layout is initialized
+    uint64_t slot_size_;
+    uint64_t data_offset_;
+    alignas(CACHE_LINE) std::atomic<uint64_t> head_; // Next slot to publish
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail_; // Next slot to claim
+    alignas(CACHE_LINE) std::atomic<uint32_t> closed_;
+    std::atomic<uint32_t> consumers_;
+    std::atomic<uint64_t> dropped_;
+  };
+
+  struct alignas(CACHE_LINE) Slot {
+    std::atomic<uint64_t> seq_; // pos: free, pos + 1: published
+    uint64_t offset_;
+    uint64_t length_;
+    uint64_t rows_;
+    uint64_t first_row_;
+    uint32_t kind_;
+    uint32_t source_len_;
+    uint32_t column_len_;
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "shm channels need lock-free 64-bit atomics");
+
+  /** shm name of a rank's segment */
+  static std::string SegmentName(const std::string &channel, int rank) {
+    return "/cae." + channel + "." + std::to_string(rank);
+  }
+
+  /** Offset of the data area, after the header and slot table */
+  static size_t DataOffset(uint32_t slots, bool huge_pages) {
+    size_t offset = sizeof(Header) + sizeof(Slot) * slots;
+    size_t align = huge_pages ? HUGE_PAGE : 4096;
+    return (offset + align - 1) / align * align;
+  }
+
+  static Slot *GetSlot(Header *h, uint64_t pos) {
+    return reinterpret_cast<Slot *>(reinterpret_cast<char *>(h) +
+                                    sizeof(Header)) +
+           pos % h->slots_;
+  }
+
+  static char *GetData(Header *h, uint64_t pos) {
+    return reinterpret_cast<char *>(h) + h->data_offset_ +
+           (pos % h->slots_) * h->slot_size_;
+  }
+
+  /** Spin briefly, then yield, then sleep while waiting for a slot */
+  static void Backoff(unsigned &round) {
+    if (round < 64) {
+      // Busy wait
+    } else if (round < 128) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(
+          round < 256 ? 50 : 1000));
+    }
+    round++;
+  }
+};
+
+/**
+ * Producer side of one rank's segment
+ * Publish may be called concurrently by the threads of the rank.
+ */
+class ShmProducer {
+public:
+  ShmProducer()
+      : header_(nullptr), map_size_(0), published_(0), bytes_(0),
+        abandoned_tail_(NOT_ABANDONED) {}
+
+  ~ShmProducer() {
+    if (header_) {
+      munmap(header_, map_size_);
+    }
+  }
+
+  ShmProducer(const ShmProducer &) = delete;
+  ShmProducer &operator=(const ShmProducer &) = delete;
+
+  /**
+   * Create (or replace a stale) segment for a rank
+   * @param config Channel shape
+   * @param rank Producing rank
+   */
+  void Create(const ShmChannelConfig &config, int rank) {
+    if (!ShmChannelConfig::IsValidName(config.name_)) {
+      throw std::runtime_error("Invalid shm channel name: " + config.name_);
+    }
+    config_ = config;
+    name_ = ShmLayout::SegmentName(config.name_, rank);
+    size_t data_offset =
+        ShmLayout::DataOffset(config.slots_, config.huge_pages_);
+    map_size_ = data_offset + config.slot_size_ * config.slots_;
+
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+      throw std::runtime_error("Could not create shm segment " + name_ +
+                               ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd, static_cast<off_t>(map_size_)) != 0) {
+      int err = errno;
+      close(fd);
+      shm_unlink(name_.c_str());
+      throw std::runtime_error("Could not size shm segment " + name_ + ": " +
+                               std::strerror(err));
+    }
+    void *addr =
+        mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      shm_unlink(name_.c_str());
+      throw std::runtime_error("Could not map shm segment " + name_ + ": " +
+                               std::strerror(errno));
+    }
+#ifdef MADV_HUGEPAGE
+    if (config.huge_pages_) {
+      // Best effort; needs shmem transparent huge pages enabled
+      madvise(static_cast<char *>(addr) + data_offset,
+              map_size_ - data_offset, MADV_HUGEPAGE);
+    }
+#endif
+
+    header_ = new (addr) ShmLayout::Header();
+    std::memcpy(header_->magic_, ShmLayout::MAGIC, sizeof(ShmLayout::MAGIC));
+    header_->slots_ = config.slots_;
+    header_->slot_size_ = config.slot_size_;
+    header_->data_offset_ = data_offset;
+    header_->head_.store(0);
+    header_->tail_.store(0);
+    header_->closed_.store(0);
+    header_->consumers_.store(0);
+    header_->dropped_.store(0);
+    for (uint64_t i = 0; i < config.slots_; ++i) {
+      ShmLayout::Slot *slot = new (ShmLayout::GetSlot(header_, i))
+          ShmLayout::Slot();
+      slot->seq_.store(i, std::memory_order_relaxed);
+    }
+    __atomic_store_n(&header_->ready_, 1u, __ATOMIC_RELEASE);
+  }
+
+  /**
+   * Publish bytes, split over as many slots as needed
+   * @return false if chunks were dropped because the ring was full
+   */
+  bool PublishBytes(const std::string &source, size_t offset,
+                    const char *data, size_t length) {
+    size_t room = Room(source, "");
+    bool ok = true;
+    do {
+      size_t n = std::min(length, room);
+      ok &= Publish(ShmChunkKind::kBytes, source, "", offset, data, n, n, 0,
+                    0);
+      data += n;
+      offset += n;
+      length -= n;
+    } while (length > 0);
+    return ok;
+  }
+
+  /** Publish a hole; it carries no payload */
+  bool PublishHole(const std::string &source, size_t offset, size_t length) {
+    return Publish(ShmChunkKind::kHole, source, "", offset, nullptr, 0, length,
+                   0, 0);
+  }
+
+  /**
+   * Publish encoded column values, split at value boundaries
+   * @param encoded Values as produced by ColumnBatch::EncodeValue
+   * @param ends End of each value in encoded
+   */
+  bool PublishColumn(const std::string &source, const std::string &column,
+                     size_t offset, const std::string &encoded,
+                     const std::vector<size_t> &ends) {
+    size_t room = Room(source, column);
+    bool ok = true;
+    size_t row = 0;
+    size_t begin = 0;
+    while (row < ends.size()) {
+      size_t last = row;
+      while (last < ends.size() && ends[last] - begin <= room) {
+        last++;
+      }
+      if (last == row) {
+        throw std::runtime_error("Value of column " + column +
+                                 " does not fit in an shm slot");
+      }
+      size_t end = ends[last - 1];
+      ok &= Publish(ShmChunkKind::kColumn, source, column, offset,
+                    encoded.data() + begin, end - begin, end - begin,
+                    last - row, row);
+      begin = end;
+      row = last;
+    }
+    return ok;
+  }
+
+  /**
+   * Mark the end of the stream and, when blocking, wait until consumers
+   * have released every published chunk, then remove the segment name;
+   * chunks no consumer claimed in time count as dropped
+   */
+  void Close() {
+    if (!header_) {
+      return;
+    }
+    header_->closed_.store(1, std::memory_order_release);
+    if (config_.overflow_ == ShmOverflow::kBlock) {
+      uint64_t head = header_->head_.load(std::memory_order_acquire);
+      Wait wait;
+      for (uint64_t pos = head > config_.slots_ ? head - config_.slots_ : 0;
+           pos < head; ++pos) {
+        ShmLayout::Slot *slot = ShmLayout::GetSlot(header_, pos);
+        while (slot->seq_.load(std::memory_order_acquire) <
+               pos + config_.slots_) {
+          if (!WaitForConsumers(wait, slot)) {
+            break;
+          }
+        }
+      }
+      // Chunks not claimed in time are lost to consumers that attach later
+      uint64_t tail = header_->tail_.load(std::memory_order_acquire);
+      head = header_->head_.load(std::memory_order_acquire);
+      if (head > tail) {
+        header_->dropped_.fetch_add(head - tail, std::memory_order_relaxed);
+      }
+    }
+    shm_unlink(name_.c_str());
+  }
+
+  const std::string &GetName() const { return name_; }
+  size_t GetPublished() const { return published_.load(); }
+  size_t GetBytes() const { return bytes_.load(); }
+  size_t GetDropped() const {
+    return header_ ? header_->dropped_.load() : 0;
+  }
+
+private:
+  static constexpr uint64_t NOT_ABANDONED =
+      std::numeric_limits<uint64_t>::max();
+
+  /** One blocking wait for consumers */
+  struct Wait {
+    uint64_t progress_; // Claims plus the awaited slot's sequence number
+    std::chrono::steady_clock::time_point since_; // Of the last progress
+    unsigned round_;
+
+    Wait()
+        : progress_(0), since_(std::chrono::steady_clock::now()), round_(0) {}
+  };
+
+  /**
+   * Back off once while blocked on a slot
+   * @return false when consumers have neither claimed a chunk nor released
+   *         the slot for the consumer timeout, or claimed none since an
+   *         earlier wait gave up
+   */
+  bool WaitForConsumers(Wait &wait, const ShmLayout::Slot *slot) {
+    uint64_t tail = header_->tail_.load(std::memory_order_acquire);
+    uint64_t abandoned = abandoned_tail_.load(std::memory_order_relaxed);
+    if (abandoned != NOT_ABANDONED) {
+      if (tail == abandoned) {
+        return false;
+      }
+      abandoned_tail_.store(NOT_ABANDONED, std::memory_order_relaxed);
+    }
+    auto now = std::chrono::steady_clock::now();
+    // Both only grow, so their sum changes whenever either does
+    uint64_t progress = tail + slot->seq_.load(std::memory_order_acquire);
+    if (progress != wait.progress_) {
+      wait.progress_ = progress;
+      wait.since_ = now;
+      wait.round_ = 0;
+    } else if (config_.consumer_timeout_ms_ > 0 &&
+               now - wait.since_ >= std::chrono::milliseconds(
+                                        config_.consumer_timeout_ms_)) {
+      uint64_t expected = NOT_ABANDONED;
+      if (abandoned_tail_.compare_exchange_strong(expected, tail)) {
+        std::cerr << "Warning: "
+                  << (header_->consumers_.load() == 0
+                          ? "no consumer attached to "
+                          : "consumers stopped taking chunks from ")
+                  << name_ << " within " << config_.consumer_timeout_ms_
+                  << " ms; chunks the ring cannot hold are dropped"
+                  << std::endl;
+      }
+      return false;
+    }
+    ShmLayout::Backoff(wait.round_);
+    return true;
+  }
+
+  /** Payload bytes left in a slot after the names */
+  size_t Room(const std::string &source, const std::string &column) const {
+    if (source.size() + column.size() >= config_.slot_size_) {
+      throw std::runtime_error("shm slot too small for source name " +
+                               source);
+    }
+    return config_.slot_size_ - source.size() - column.size();
+  }
+
+  bool Publish(ShmChunkKind kind, const std::string &source,
+               const std::string &column, size_t offset, const char *data,
+               size_t payload, size_t length, size_t rows, size_t first_row) {
+    // Claim the next free slot
+    uint64_t pos = header_->head_.load(std::memory_order_relaxed);
+    Wait wait;
+    while (true) {
+      ShmLayout::Slot *slot = ShmLayout::GetSlot(header_, pos);
+      uint64_t seq = slot->seq_.load(std::memory_order_acquire);
+      if (seq == pos) {
+        if (header_->head_.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (seq < pos) {
+        // Ring full: the slot is still held from the previous lap
+        if (config_.overflow_ == ShmOverflow::kDrop ||
+            !WaitForConsumers(wait, slot)) {
+          header_->dropped_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+        pos = header_->head_.load(std::memory_order_relaxed);
+      } else {
+        pos = header_->head_.load(std::memory_order_relaxed);
+      }
+    }
+
+    ShmLayout::Slot *slot = ShmLayout::GetSlot(header_, pos);
+    char *area = ShmLayout::GetData(header_, pos);
+    std::memcpy(area, source.data(), source.size());
+    std::memcpy(area + source.size(), column.data(), column.size());
+    if (payload > 0) {
+      std::memcpy(area + source.size() + column.size(), data, payload);
+    }
+    slot->offset_ = offset;
+    slot->length_ = length;
+    slot->rows_ = rows;
+    slot->first_row_ = first_row;
+    slot->kind_ = static_cast<uint32_t>(kind);
+    slot->source_len_ = static_cast<uint32_t>(source.size());
+    slot->column_len_ = static_cast<uint32_t>(column.size());
+    slot->seq_.store(pos + 1, std::memory_order_release);
+
+    published_++;
+    bytes_ += payload;
+    return true;
+  }
+
+  ShmChannelConfig config_;
+  std::string name_;
+  ShmLayout::Header *header_;
+  size_t map_size_;
+  std::atomic<size_t> published_;
+  std::atomic<size_t> bytes_;
+  std::atomic<uint64_t> abandoned_tail_; // Claims when a wait gave up
+};
+
+/**
+ * Consumer side of one rank's segment; the client library for in-situ
+ * analysis processes on the same node
+ * Acquire and Release may be called concurrently by consumer threads.
+ */
+class ShmConsumer {
+public:
+  ShmConsumer() : header_(nullptr), map_size_(0) {}
+
+  ~ShmConsumer() { Close(); }
+
+  ShmConsumer(const ShmConsumer &) = delete;
+  ShmConsumer &operator=(const ShmConsumer &) = delete;
+
+  /**
+   * Attach to a rank's segment of a channel, waiting for it to appear
+   * @param channel Channel name
+   * @param rank Producing rank
+   * @param timeout_ms How long to wait for the producer (0 = do not wait)
+   * @return false if the segment did not appear in time
+   */
+  bool Open(const std::string &channel, int rank, unsigned timeout_ms = 0) {
+    std::string name = ShmLayout::SegmentName(channel, rank);
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+    while (true) {
+      if (TryMap(name)) {
+        header_->consumers_.fetch_add(1);
+        return true;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  /**
+   * Claim the next chunk, waiting for the producer if the ring is empty
+   * @param chunk Receives the chunk; its data stays valid until Release
+   * @return false once the producer has closed and the ring is drained
+   */
+  bool Acquire(ShmChunk &chunk) {
+    uint64_t pos = header_->tail_.load(std::memory_order_relaxed);
+    unsigned round = 0;
+    while (true) {
+      ShmLayout::Slot *slot = ShmLayout::GetSlot(header_, pos);
+      uint64_t seq = slot->seq_.load(std::memory_order_acquire);
+      if (seq == pos + 1) {
+        if (header_->tail_.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (seq < pos + 1) {
+        // Empty; the end is reached once the producer closed and every
+        // claimed position has been published
+        if (header_->closed_.load(std::memory_order_acquire) &&
+            header_->head_.load(std::memory_order_acquire) == pos) {
+          return false;
+        }
+        ShmLayout::Backoff(round);
+        pos = header_->tail_.load(std::memory_order_relaxed);
+      } else {
+        pos = header_->tail_.load(std::memory_order_relaxed);
+      }
+    }
+
+    ShmLayout::Slot *slot = ShmLayout::GetSlot(header_, pos);
+    const char *area = ShmLayout::GetData(header_, pos);
+    chunk.kind_ = static_cast<ShmChunkKind>(slot->kind_);
+    chunk.source_.assign(area, slot->source_len_);
+    chunk.column_.assign(area + slot->source_len_, slot->column_len_);
+    chunk.offset_ = slot->offset_;
+    chunk.length_ = slot->length_;
+    chunk.rows_ = slot->rows_;
+    chunk.first_row_ = slot->first_row_;
+    chunk.data_ = area + slot->source_len_ + slot->column_len_;
+    chunk.seq_ = pos;
+    return true;
+  }
+
+  /** Hand a chunk's slot back to the producer */
+  void Release(const ShmChunk &chunk) {
+    ShmLayout::Slot *slot = ShmLayout::GetSlot(header_, chunk.seq_);
+    slot->seq_.store(chunk.seq_ + header_->slots_, std::memory_order_release);
+  }
+
+  /** Detach from the segment */
+  void Close() {
+    if (header_) {
+      header_->consumers_.fetch_sub(1);
+      munmap(header_, map_size_);
+      header_ = nullptr;
+    }
+  }
+
+  /** Chunks the producer dropped because the ring was full */
+  size_t GetDropped() const {
+    return header_ ? header_->dropped_.load() : 0;
+  }
+
+  /**
+   * Ranks that currently have a segment for a channel on this node
+   * @param channel Channel name
+   */
+  static std::vector<int> ListRanks(const std::string &channel) {
+    std::vector<int> ranks;
+    std::string prefix = "cae." + channel + ".";
+    DIR *dir = opendir("/dev/shm");
+    if (!dir) {
+      return ranks;
+    }
+    while (struct dirent *entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      if (name.compare(0, prefix.size(), prefix) == 0 &&
+          name.size() > prefix.size() &&
+          name.find_first_not_of("0123456789", prefix.size()) ==
+              std::string::npos) {
+        ranks.push_back(std::stoi(name.substr(prefix.size())));
+      }
+    }
+    closedir(dir);
+    std::sort(ranks.begin(), ranks.end());
+    return ranks;
+  }
+
+private:
+  bool TryMap(const std::string &name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(ShmLayout::Header)) {
+      close(fd);
+      return false;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      return false;
+    }
+    auto *header = static_cast<ShmLayout::Header *>(addr);
+    if (!__atomic_load_n(&header->ready_, __ATOMIC_ACQUIRE) ||
+        std::memcmp(header->magic_, ShmLayout::MAGIC,
+                    sizeof(ShmLayout::MAGIC)) != 0) {
+      munmap(addr, st.st_size);
+      return false;
+    }
+    header_ = header;
+    map_size_ = static_cast<size_t>(st.st_size);
+    return true;
+  }
+
+  ShmLayout::Header *header_;
+  size_t map_size_;
+};
+
+} // namespace cae
+
+#endif // CAE_SINK_SHM_CHANNEL_H_
@@ -0,0 +1,73 @@
+#ifndef CAE_SINK_SHM_SINK_H_
+#define CAE_SINK_SHM_SINK_H_
+
+#include "output_sink.h"
+#include "shm_channel.h"
+#include <string>
+#include <vector>
+
+namespace cae {
+
+/**
+ * Sink that publishes chunks into a shared-memory channel for consumers on
+ * the same node (see sink/shm_channel.h)
+ */
+class ShmSink : public OutputSink {
+public:
+  /**
+   * Construct a shared-memory sink
+   * @param config Channel to publish into
+   */
+  explicit ShmSink(const ShmChannelConfig &config)
+      : config_(config), rank_(0) {}
+
+  void Open(const SinkContext &ctx) override {
+    rank_ = ctx.rank_;
+    producer_.Create(config_, ctx.rank_);
+  }
+
+  void WriteChunk(const FormatContext &ctx, size_t offset, const char *data,
+                  size_t length) override {
+    producer_.PublishBytes(ctx.filename_, offset, data, length);
+  }
+
+  void WriteHole(const FormatContext &ctx, size_t offset,
+                 size_t length) override {
+    producer_.PublishHole(ctx.filename_, offset, length);
+  }
+
+  void WriteColumns(const FormatContext &ctx, size_t offset,
+                    const ColumnBatch &batch) override {
+    std::string encoded;
+    std::vector<size_t> ends;
+    for (size_t c = 0; c < batch.columns_.size(); ++c) {
+      encoded.clear();
+      ends.clear();
+      for (const auto &v : batch.columns_[c]) {
+        ColumnBatch::EncodeValue(v, encoded);
+        ends.push_back(encoded.size());
+      }
+      producer_.PublishColumn(ctx.filename_, batch.GetName(c), offset,
+                              encoded, ends);
+    }
+  }
+
+  void Close() override { producer_.Close(); }
+
+  std::string GetSummary() const override {
+    return "{\"rank\": " + std::to_string(rank_) +
+           ", \"segment\": " + JsonString(producer_.GetName()) +
+           ", \"chunks\": " + std::to_string(producer_.GetPublished()) +
+           ", \"bytes\": " + std::to_string(producer_.GetBytes()) +
+           ", \"dropped\": " + std::to_string(producer_.GetDropped()) + "}";
+  }
+
+private:
+  ShmChannelConfig config_;
+  ShmProducer producer_;
+  int rank_;
+};
+
+} // namespace cae
+
+#endif // CAE_SINK_SHM_SINK_H_
@@ -0,0 +1,31 @@
+#include "sink_factory.h"
+#include "container_sink.h"
+#include "shm_sink.h"
+#include <stdexcept>
+
+namespace cae {
+
+std::shared_ptr<OutputSink> SinkFactory::Get(const SinkConfig &config) {
+  if (config.name_ == "none" || config.name_.empty()) {
+    return nullptr;
+  } else if (config.name_ == "container") {
+    Codec block_codec;
+    if (!ParseCodec(config.codec_, block_codec)) {
+      throw std::runtime_error("Unknown or unavailable codec: " +
+                               config.codec_);
+    }
+    return std::make_shared<ContainerSink>(block_codec, config.dedup_,
+                                           config.index_);
+  } else if (config.name_ == "shm") {
+    return std::make_shared<ShmSink>(config.channel_);
+  } else {
+    throw std::runtime_error("Unknown sink: " + config.name_);
+  }
+}
+
+bool SinkFactory::IsValid(const std::string &name) {
+  return name.empty() || name == "none" || name == "container" ||
+         name == "shm";
+}
+
+} // namespace cae
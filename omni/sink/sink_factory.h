@@ -0,0 +1,43 @@
+#ifndef CAE_SINK_SINK_FACTORY_H_
+#define CAE_SINK_SINK_FACTORY_H_
+
+#include "output_sink.h"
+#include "record_index.h"
+#include "shm_channel.h"
+#include <memory>
+#include <string>
+
+namespace cae {
+
+/**
+ * Which sink to create and how to configure it
+ */
+struct SinkConfig {
+  std::string name_;         // "container", "shm", or "none" for no output
+  std::string codec_;        // container: block codec ("auto" = best)
+  bool dedup_;               // container: deduplicate content chunks
+  RecordIndexOptions index_; // container: per-chunk lookup index
+  ShmChannelConfig channel_; // shm: channel to publish into
+
+  SinkConfig() : name_("none"), codec_("auto"), dedup_(false) {}
+};
+
+/**
+ * Factory class for creating output sinks
+ */
+class SinkFactory {
+public:
+  /**
+   * Get an output sink
+   * @param config Sink name and its settings
+   * @return Shared pointer to the sink, or nullptr for "none"
+   */
+  static std::shared_ptr<OutputSink> Get(const SinkConfig &config);
+
+  /** Whether a sink name is known */
+  static bool IsValid(const std::string &name);
+};
+
+} // namespace cae
+
+#endif // CAE_SINK_SINK_FACTORY_H_
@@ -0,0 +1,189 @@
+#ifndef CAE_UTIL_HASH_H_
+#define CAE_UTIL_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+/**
+ * Non-cryptographic hashing used on the import path:
+ *
+ * 1. Fnv1a64: tiny byte-at-a-time hash for short keys (paths, field values)
+ * 2. Xxh64: streaming XXH64 digest for chunk and whole-file content
+ *
+ * Both produce the same values as the reference implementations so digests
+ * can be compared against externally computed ones.
+ */
+
+namespace cae {
+
+/** FNV-1a 64-bit hash over a byte range */
+inline uint64_t Fnv1a64(const void *data, size_t len,
+                        uint64_t seed = 0xcbf29ce484222325ULL) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  uint64_t h = seed;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/**
+ * Streaming XXH64 digest
+ */
+class Xxh64 {
+private:
+  static constexpr uint64_t P1 = 11400714785074694791ULL;
+  static constexpr uint64_t P2 = 14029467366897019727ULL;
+  static constexpr uint64_t P3 = 1609587929392839161ULL;
+  static constexpr uint64_t P4 = 9650029242287828579ULL;
+  static constexpr uint64_t P5 = 2870177450012600261ULL;
+
+public:
+  /** Construct a digest with the given seed */
+  explicit Xxh64(uint64_t seed = 0) { Reset(seed); }
+
+  /** Reset the digest state */
+  void Reset(uint64_t seed = 0) {
+    seed_ = seed;
+    v_[0] = seed + P1 + P2;
+    v_[1] = seed + P2;
+    v_[2] = seed;
+    v_[3] = seed - P1;
+    total_len_ = 0;
+    buf_len_ = 0;
+  }
+
+  /** Add bytes to the digest */
+  void Update(const void *data, size_t len) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    total_len_ += len;
+
+    if (buf_len_ + len < 32) {
+      std::memcpy(buf_ + buf_len_, p, len);
+      buf_len_ += len;
+      return;
+    }
+
+    if (buf_len_ > 0) {
+      size_t fill = 32 - buf_len_;
+      std::memcpy(buf_ + buf_len_, p, fill);
+      ConsumeStripe(buf_);
+      p += fill;
+      len -= fill;
+      buf_len_ = 0;
+    }
+
+    while (len >= 32) {
+      ConsumeStripe(p);
+      p += 32;
+      len -= 32;
+    }
+
+    if (len > 0) {
+      std::memcpy(buf_, p, len);
+      buf_len_ = len;
+    }
+  }
+
+  /** Finalize and return the 64-bit digest (state is left unchanged) */
+  uint64_t Digest() const {
+    uint64_t h;
+    if (total_len_ >= 32) {
+      h = Rotl(v_[0], 1) + Rotl(v_[1], 7) + Rotl(v_[2], 12) + Rotl(v_[3], 18);
+      for (int i = 0; i < 4; ++i) {
+        h = (h ^ Round(0, v_[i])) * P1 + P4;
+      }
+    } else {
+      h = seed_ + P5;
+    }
+    h += total_len_;
+
+    const unsigned char *p = buf_;
+    size_t len = buf_len_;
+    while (len >= 8) {
+      h ^= Round(0, Read64(p));
+      h = Rotl(h, 27) * P1 + P4;
+      p += 8;
+      len -= 8;
+    }
+    if (len >= 4) {
+      h ^= static_cast<uint64_t>(Read32(p)) * P1;
+      h = Rotl(h, 23) * P2 + P3;
+      p += 4;
+      len -= 4;
+    }
+    while (len > 0) {
+      h ^= (*p) * P5;
+      h = Rotl(h, 11) * P1;
+      ++p;
+      --len;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  /** Finalize and return the digest as a 16-character hex string */
+  std::string HexDigest() const { return ToHex(Digest()); }
+
+  /** One-shot digest of a byte range */
+  static uint64_t Hash(const void *data, size_t len, uint64_t seed = 0) {
+    Xxh64 h(seed);
+    h.Update(data, len);
+    return h.Digest();
+  }
+
+  /** Format a 64-bit digest as hex */
+  static std::string ToHex(uint64_t value) {
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return oss.str();
+  }
+
+private:
+  static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+  static uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    acc = Rotl(acc, 31);
+    return acc * P1;
+  }
+
+  static uint64_t Read64(const unsigned char *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  static uint32_t Read32(const unsigned char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  void ConsumeStripe(const unsigned char *p) {
+    v_[0] = Round(v_[0], Read64(p));
+    v_[1] = Round(v_[1], Read64(p + 8));
+    v_[2] = Round(v_[2], Read64(p + 16));
+    v_[3] = Round(v_[3], Read64(p + 24));
+  }
+
+  uint64_t seed_;
+  uint64_t v_[4];
+  uint64_t total_len_;
+  unsigned char buf_[32];
+  size_t buf_len_;
+};
+
+} // namespace cae
+
+#endif // CAE_UTIL_HASH_H_
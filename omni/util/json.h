@@ -0,0 +1,176 @@
+#ifndef CAE_UTIL_JSON_H_
+#define CAE_UTIL_JSON_H_
+
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace cae {
+
+/** Escape a string for use inside a JSON string literal */
+inline std::string JsonEscape(std::string_view s) {
+  std::ostringstream oss;
+  for (char c : s) {
+    switch (c) {
+    case '"':
+      oss << "\\\"";
+      break;
+    case '\\':
+      oss << "\\\\";
+      break;
+    case '\n':
+      oss << "\\n";
+      break;
+    case '\t':
+      oss << "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        oss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+            << static_cast<int>(c) << std::dec << std::setfill(' ');
+      } else {
+        oss << c;
+      }
+    }
+  }
+  return oss.str();
+}
+
+/** A JSON string literal, quotes included */
+inline std::string JsonString(std::string_view s) {
+  return "\"" + JsonEscape(s) + "\"";
+}
+
+/**
+ * Decode the body of a JSON string literal (without its quotes)
+ * Unicode escapes above 0x7f are encoded as UTF-8.
+ */
+inline std::string JsonUnescape(std::string_view s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] != '\\' || i + 1 == s.size()) {
+      out.push_back(s[i]);
+      continue;
+    }
+    char c = s[++i];
+    switch (c) {
+    case 'n':
+      out.push_back('\n');
+      break;
+    case 't':
+      out.push_back('\t');
+      break;
+    case 'r':
+      out.push_back('\r');
+      break;
+    case 'b':
+      out.push_back('\b');
+      break;
+    case 'f':
+      out.push_back('\f');
+      break;
+    case 'u': {
+      unsigned long cp =
+          std::strtoul(std::string(s.substr(i + 1, 4)).c_str(), nullptr, 16);
+      i += 4;
+      if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+      } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+      } else {
+        out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+      }
+      break;
+    }
+    default:
+      out.push_back(c); // \" \\ \/
+    }
+  }
+  return out;
+}
+
+/** Members of a flat JSON object; strings unescaped, other values verbatim */
+using JsonFields = std::map<std::string, std::string>;
+
+/**
+ * Call back for every object in a JSON document that has no nested objects
+ * or arrays, such as the entries of the index files this engine writes
+ * @param text JSON document
+ * @param callback Receives the members of each flat object
+ */
+inline void ForEachFlatObject(std::string_view text,
+                              const std::function<void(const JsonFields &)>
+                                  &callback) {
+  size_t start = std::string_view::npos; // Innermost open object
+  for (size_t i = 0; i < text.size(); ++i) {
+    char c = text[i];
+    if (c == '"') {
+      // Skip string literals so braces inside them are not counted
+      for (++i; i < text.size() && text[i] != '"'; ++i) {
+        if (text[i] == '\\') {
+          ++i;
+        }
+      }
+    } else if (c == '{') {
+      start = i;
+    } else if (c == '[') {
+      start = std::string_view::npos;
+    } else if (c == '}' && start != std::string_view::npos) {
+      JsonFields fields;
+      std::string_view body = text.substr(start + 1, i - start - 1);
+      size_t p = 0;
+      while (p < body.size()) {
+        size_t kq = body.find('"', p);
+        if (kq == std::string_view::npos) {
+          break;
+        }
+        size_t ke = kq + 1;
+        while (ke < body.size() && body[ke] != '"') {
+          ke += body[ke] == '\\' ? 2 : 1;
+        }
+        std::string key = JsonUnescape(body.substr(kq + 1, ke - kq - 1));
+        size_t v = body.find(':', ke) + 1;
+        while (v < body.size() && (body[v] == ' ' || body[v] == '\n')) {
+          ++v;
+        }
+        size_t ve;
+        if (v < body.size() && body[v] == '"') {
+          ve = v + 1;
+          while (ve < body.size() && body[ve] != '"') {
+            ve += body[ve] == '\\' ? 2 : 1;
+          }
+          fields[key] = JsonUnescape(body.substr(v + 1, ve - v - 1));
+          ++ve;
+        } else {
+          ve = body.find(',', v);
+          if (ve == std::string_view::npos) {
+            ve = body.size();
+          }
+          std::string_view raw = body.substr(v, ve - v);
+          while (!raw.empty() && (raw.back() == ' ' || raw.back() == '\n')) {
+            raw.remove_suffix(1);
+          }
+          fields[key] = std::string(raw);
+        }
+        p = body.find(',', ve);
+        if (p == std::string_view::npos) {
+          break;
+        }
+        ++p;
+      }
+      callback(fields);
+      start = std::string_view::npos;
+    }
+  }
+}
+
+} // namespace cae
+
+#endif // CAE_UTIL_JSON_H_
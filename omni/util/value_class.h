@@ -0,0 +1,87 @@
+#ifndef CAE_UTIL_VALUE_CLASS_H_
+#define CAE_UTIL_VALUE_CLASS_H_
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+/**
+ * Classification of text field values, shared by everything that types a
+ * column (the catalog's column profiles, the container's column statistics
+ * and the record index's zone maps), so they agree on what a value is:
+ *
+ * 1. Blanks: Surrounding spaces, tabs and carriage returns are ignored
+ * 2. Nulls: Empty fields and the tokens NA, N/A, null, NULL, NaN and nan
+ * 3. Types: true/false (any of three casings) are bools; whole base-10
+ *    numbers that fit 64 bits are int64; other whole numbers that strtod
+ *    reads and that are finite are doubles; everything else is a string
+ */
+
+namespace cae {
+
+/** Type of a value, from narrowest to widest */
+enum class ValueType { kNull, kBool, kInt64, kDouble, kString };
+
+/**
+ * A classified value
+ */
+struct ValueClass {
+  ValueType type_;
+  std::string text_; // Without surrounding blanks
+  int64_t int_;      // If kInt64
+  double double_;    // If kInt64 or kDouble
+
+  ValueClass() : type_(ValueType::kNull), int_(0), double_(0) {}
+
+  bool IsNumber() const {
+    return type_ == ValueType::kInt64 || type_ == ValueType::kDouble;
+  }
+
+  /** Classify one field value */
+  static ValueClass Of(const std::string &value) {
+    ValueClass v;
+    size_t first = value.find_first_not_of(" \t\r");
+    if (first != std::string::npos) {
+      v.text_ = value.substr(first,
+                             value.find_last_not_of(" \t\r") - first + 1);
+    }
+    const std::string &t = v.text_;
+    if (IsNullToken(t)) {
+      return v;
+    }
+    if (t == "true" || t == "false" || t == "True" || t == "False" ||
+        t == "TRUE" || t == "FALSE") {
+      v.type_ = ValueType::kBool;
+      return v;
+    }
+    char *end = nullptr;
+    errno = 0;
+    long long i = std::strtoll(t.c_str(), &end, 10);
+    if (*end == '\0' && errno == 0) {
+      v.type_ = ValueType::kInt64;
+      v.int_ = static_cast<int64_t>(i);
+      v.double_ = static_cast<double>(i);
+      return v;
+    }
+    double d = std::strtod(t.c_str(), &end);
+    if (*end == '\0' && std::isfinite(d)) {
+      v.type_ = ValueType::kDouble;
+      v.double_ = d;
+      return v;
+    }
+    v.type_ = ValueType::kString;
+    return v;
+  }
+
+  /** Whether a value without surrounding blanks is null */
+  static bool IsNullToken(const std::string &v) {
+    return v.empty() || v == "NA" || v == "N/A" || v == "null" ||
+           v == "NULL" || v == "NaN" || v == "nan";
+  }
+};
+
+} // namespace cae
+
+#endif // CAE_UTIL_VALUE_CLASS_H_
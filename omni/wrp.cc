@@ -1,220 +1,457 @@
+#include "catalog/catalog_writer.h"
+#include "format/binary_file_omni.h"
 #include "format/format_factory.h"
+#include "format/format_registry.h"
+#include "io/block_codec.h"
+#include "io/file_extents.h"
+#include "io/io_throttle.h"
+#include "io/io_tuner.h"
+#include "io/private_dir.h"
+#include "io/retry_policy.h"
+#include "plugin/plugin_loader.h"
+#include "repo/file_pattern.h"
 #include "repo/filesystem_repo_omni.h"
 #include "repo/repo_factory.h"
+#include "runtime/ingest_server.h"
+#include "runtime/job_plan.h"
+#include "runtime/local_runner.h"
+#include "runtime/placement.h"
+#include "runtime/resource_governor.h"
+#include "runtime/stream_follower.h"
+#include "sink/container_sink.h"
+#include "sink/sink_factory.h"
 #include <cstdlib>
 #include <iostream>
 #include <limits.h> // For PATH_MAX
-#include <mpi.h>
-#include <pwd.h>
 #include <sstream>
 #include <string>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 #include <yaml-cpp/yaml.h>
 #include <filesystem>
-#include <glob.h>
 #include <future>
 #include <thread>
 #include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <fstream>
+#include <map>
+#include <numeric>
 #include <cctype> // For isspace
+#include <chrono>
+#include <csignal>
 #include <cstdio> // For std::remove
+#include <fcntl.h>
 
 using namespace cae;
 namespace fs = std::filesystem;
 
-std::string ExpandPath(const std::string &path) {
-  if (path.empty() || path[0] != '~') {
-    return path;
+struct OmniJobConfig {
+  std::string name;
+  int max_scale;
+  int threads_per_rank; // 0 = cores per NUMA domain
+  std::string hostfile; // Add hostfile to config
+  PlacementPolicy placement;
+  ExtentMethod extent_method;
+  bool decompress; // Decode gzip/bzip2/zstd inputs
+  bool auto_tune;  // Tune chunk size and read-ahead while reading
+  std::string plugin_path; // Colon-separated plugin directories
+
+  struct OutputConfig {
+    std::string sink;    // "none" = read only
+    std::string path;    // Directory that receives one dataset per import
+    std::string codec;   // Block codec, "auto" = best in this build
+    std::string channel; // Channel of the shm sink
+    bool dedup;          // Store repeated content chunks once
+    RecordIndexOptions index; // Per-chunk index for lookups
+
+    OutputConfig() : sink("none"), codec("auto"), dedup(false) {}
+  };
+  OutputConfig output;
+  std::map<std::string, ShmChannelConfig> channels; // Declared shm channels
+  std::string catalog_path; // Empty = no metadata catalog
+  CatalogOptions catalog;
+  ResourceCredits resources; // Budget per node, 0 = sized from the node
+  QosLimits qos; // Default priority and limits of the whole job
+  RetryPolicy retry; // I/O retries in workers; attempts also bound relaunches
+
+  std::string stat_cache; // Plan file workers take file layouts from
+  std::string settings;             // Job settings without data, as YAML
+  std::vector<PlanEntrySpec> data; // Entries before planning
+  std::vector<PlanEntrySpec> follow; // Entries imported as they grow
+  FollowOptions follow_options;
+
+  OmniJobConfig()
+      : max_scale(100), threads_per_rank(0),
+        extent_method(ExtentMethod::kSeekData), decompress(true),
+        auto_tune(true) {}
+};
+
+// Parse a qos block: priority class, bandwidth (bytes per second, with an
+// optional K, M, G or T suffix) and IOPS
+void ParseQos(const YAML::Node &node, const std::string &where,
+              QosLimits &qos) {
+  if (node["priority"]) {
+    std::string priority = node["priority"].as<std::string>();
+    if (!ParseQosPriority(priority, qos.priority_)) {
+      throw std::runtime_error("Invalid " + where + ".priority: " + priority +
+                               " (bulk, normal or high)");
+    }
   }
+  if (node["bandwidth"]) {
+    std::string bandwidth = node["bandwidth"].as<std::string>();
+    if (!ParseByteSize(bandwidth, qos.bandwidth_)) {
+      throw std::runtime_error("Invalid " + where + ".bandwidth: " +
+                               bandwidth);
+    }
+  }
+  if (node["iops"]) {
+    qos.iops_ = node["iops"].as<size_t>();
+  }
+}
+
+// Parse the job settings: everything in an OMNI file but its data entries
+void ParseOmniSettings(const YAML::Node &yaml, OmniJobConfig &config) {
+  try {
+    if (yaml["name"]) {
+      config.name = yaml["name"].as<std::string>();
+    }
+
+    if (yaml["max_scale"]) {
+      config.max_scale = yaml["max_scale"].as<int>();
+    }
 
-  if (path.length() == 1 || path[1] == '/') {
-    // ~/... case
-    const char *home = getenv("HOME");
-    if (!home) {
-      struct passwd *pw = getpwuid(getuid());
-      if (pw) {
-        home = pw->pw_dir;
+    if (yaml["threads_per_rank"]) {
+      config.threads_per_rank = yaml["threads_per_rank"].as<int>();
+    }
+
+    if (yaml["extents"]) {
+      std::string method = yaml["extents"].as<std::string>();
+      if (!ParseExtentMethod(method, config.extent_method)) {
+        throw std::runtime_error("Invalid extents method: " + method);
       }
     }
-    if (home) {
-      return std::string(home) + (path.length() > 1 ? path.substr(1) : "");
+
+    if (yaml["decompress"]) {
+      config.decompress = yaml["decompress"].as<bool>();
     }
-  }
 
-  // If we can't expand, return original path
-  return path;
-}
+    if (yaml["auto_tune"]) {
+      config.auto_tune = yaml["auto_tune"].as<bool>();
+    }
 
-std::vector<std::string> ExpandFilePattern(const std::string &pattern) {
-  std::vector<std::string> files;
-  
-  if (pattern.empty()) {
-    std::cerr << "Warning: Empty file pattern provided" << std::endl;
-    return files;
-  }
-  
-  // Check if the pattern contains wildcards
-  bool has_wildcards = (pattern.find('*') != std::string::npos) || 
-                       (pattern.find('?') != std::string::npos) ||
-                       (pattern.find('[') != std::string::npos);
-  
-  if (has_wildcards) {
-    // Use glob to expand wildcards
-    glob_t glob_result;
-    int glob_ret = glob(pattern.c_str(), GLOB_TILDE | GLOB_BRACE, nullptr, &glob_result);
-    
-    if (glob_ret == 0) {
-      for (size_t i = 0; i < glob_result.gl_pathc; ++i) {
-        std::string file_path = glob_result.gl_pathv[i];
-        if (fs::is_regular_file(file_path)) {
-          files.push_back(file_path);
+    // Plugins are loaded before the entries so their formats are known
+    if (yaml["plugins"]) {
+      for (const auto &node : yaml["plugins"]) {
+        std::string dir = fs::absolute(node.as<std::string>()).string();
+        config.plugin_path += (config.plugin_path.empty() ? "" : ":") + dir;
+      }
+    }
+    PluginLoader::LoadAll(config.plugin_path);
+
+    if (yaml["channels"]) {
+      for (const auto &node : yaml["channels"]) {
+        ShmChannelConfig channel;
+        if (node["name"]) {
+          channel.name_ = node["name"].as<std::string>();
+        }
+        if (!ShmChannelConfig::IsValidName(channel.name_)) {
+          throw std::runtime_error("Invalid channel name: " + channel.name_);
         }
+        if (node["slots"]) {
+          channel.slots_ = node["slots"].as<uint32_t>();
+        }
+        if (node["slot_size"]) {
+          channel.slot_size_ = node["slot_size"].as<size_t>();
+        }
+        if (node["huge_pages"]) {
+          channel.huge_pages_ = node["huge_pages"].as<bool>();
+        }
+        if (node["overflow"]) {
+          std::string overflow = node["overflow"].as<std::string>();
+          if (!ShmChannelConfig::ParseOverflow(overflow, channel.overflow_)) {
+            throw std::runtime_error("Invalid channel overflow: " + overflow);
+          }
+        }
+        if (node["consumer_timeout_ms"]) {
+          channel.consumer_timeout_ms_ =
+              node["consumer_timeout_ms"].as<unsigned>();
+        }
+        if (channel.slots_ == 0 || channel.slot_size_ == 0) {
+          throw std::runtime_error("Channel " + channel.name_ +
+                                   " needs slots and slot_size above 0");
+        }
+        config.channels[channel.name_] = channel;
       }
-      std::cout << "Expanded pattern '" << pattern << "' to " << files.size() << " files" << std::endl;
-    } else if (glob_ret == GLOB_NOMATCH) {
-      std::cerr << "Warning: No files match pattern: " << pattern << std::endl;
-    } else {
-      std::cerr << "Warning: Error expanding pattern: " << pattern << " (error code: " << glob_ret << ")" << std::endl;
     }
-    
-    globfree(&glob_result);
-  } else {
-    // Check if it's a directory
-    if (fs::is_directory(pattern)) {
-      for (const auto &entry : fs::directory_iterator(pattern)) {
-        if (entry.is_regular_file()) {
-          files.push_back(entry.path().string());
+
+    if (yaml["output"]) {
+      const YAML::Node &output = yaml["output"];
+      if (output["sink"]) {
+        config.output.sink = output["sink"].as<std::string>();
+        if (!SinkFactory::IsValid(config.output.sink)) {
+          throw std::runtime_error("Invalid output.sink: " +
+                                   config.output.sink);
         }
       }
-      std::cout << "Expanded directory '" << pattern << "' to " << files.size() << " files" << std::endl;
-    } else if (fs::is_regular_file(pattern)) {
-      // Single file
-      files.push_back(pattern);
-      std::cout << "Single file: " << pattern << std::endl;
-    } else {
-      std::cerr << "Warning: Path is neither a file nor directory: " << pattern << std::endl;
+      if (output["path"]) {
+        config.output.path = ExpandPath(output["path"].as<std::string>());
+      }
+      if (output["codec"]) {
+        config.output.codec = output["codec"].as<std::string>();
+        Codec codec;
+        if (!ParseCodec(config.output.codec, codec)) {
+          throw std::runtime_error("Invalid or unavailable output.codec: " +
+                                   config.output.codec);
+        }
+      }
+      if (output["dedup"]) {
+        config.output.dedup = output["dedup"].as<bool>();
+      }
+      if (output["channel"]) {
+        config.output.channel = output["channel"].as<std::string>();
+      }
+      // index: true (zone maps only), or a map naming the Bloom columns
+      if (output["index"]) {
+        const YAML::Node &index = output["index"];
+        config.output.index.enabled_ =
+            index.IsMap() || (index.IsScalar() && index.as<bool>());
+        if (index.IsMap() && index["columns"]) {
+          for (const auto &node : index["columns"]) {
+            std::string column = node.as<std::string>();
+            if (column.empty() || column.find(',') != std::string::npos) {
+              throw std::runtime_error("Invalid output.index column: " +
+                                       column);
+            }
+            config.output.index.bloom_columns_.push_back(column);
+          }
+        }
+        if (config.output.index.enabled_ && config.output.sink != "container") {
+          throw std::runtime_error("output.index needs output.sink container");
+        }
+      }
+      if (config.output.sink == "container" && config.output.path.empty()) {
+        throw std::runtime_error("output.path is required with output.sink " +
+                                 config.output.sink);
+      }
+      if (config.output.sink == "shm" &&
+          !config.channels.count(config.output.channel)) {
+        throw std::runtime_error("output.channel must name a declared "
+                                 "channel with output.sink shm");
+      }
     }
-  }
-  
-  // Sort files for consistent ordering
-  std::sort(files.begin(), files.end());
-  
-  return files;
-}
 
-struct OmniJobConfig {
-  std::string name;
-  int max_scale;
-  std::string hostfile; // Add hostfile to config
+    if (yaml["catalog"]) {
+      const YAML::Node &catalog = yaml["catalog"];
+      if (!catalog["path"]) {
+        throw std::runtime_error("catalog.path is required");
+      }
+      config.catalog_path = fs::absolute(
+          ExpandPath(catalog["path"].as<std::string>())).string();
+      auto get = [&](const char *key, std::string &out) {
+        if (catalog[key]) {
+          out = catalog[key].as<std::string>();
+        }
+      };
+      get("platform", config.catalog.platform_);
+      get("env", config.catalog.env_);
+      get("domain", config.catalog.domain_);
+      get("ownership_type", config.catalog.ownership_type_);
+      get("ownership_type_urn", config.catalog.ownership_type_urn_);
+      for (const auto &node : catalog["owners"]) {
+        config.catalog.owners_.push_back(node.as<std::string>());
+      }
+      for (const auto &node : catalog["glossary_terms"]) {
+        config.catalog.glossary_terms_.push_back(node.as<std::string>());
+      }
+    }
+
+    if (yaml["retry"]) {
+      const YAML::Node &retry = yaml["retry"];
+      if (retry["attempts"]) {
+        config.retry.attempts_ = retry["attempts"].as<int>();
+      }
+      if (retry["backoff_ms"]) {
+        config.retry.backoff_ms_ = retry["backoff_ms"].as<int>();
+      }
+      if (config.retry.attempts_ < 1 || config.retry.backoff_ms_ < 0) {
+        throw std::runtime_error(
+            "retry.attempts must be at least 1 and retry.backoff_ms "
+            "not negative");
+      }
+    }
 
-  struct DataEntry {
-    std::vector<std::string> paths;  // Changed from single path to multiple paths
-    std::vector<size_t> range;
-    size_t offset;
-    size_t size;
-    std::vector<std::string> description;
-    std::string hash;
+    if (yaml["follow"]) {
+      const YAML::Node &follow = yaml["follow"];
+      FollowOptions &opts = config.follow_options;
+      if (follow["poll_ms"]) {
+        opts.poll_ms_ = follow["poll_ms"].as<int>();
+      }
+      if (follow["batch_ms"]) {
+        opts.batch_ms_ = follow["batch_ms"].as<int>();
+      }
+      if (follow["idle_timeout_ms"]) {
+        opts.idle_timeout_ms_ = follow["idle_timeout_ms"].as<int>();
+      }
+      if (follow["state"]) {
+        opts.state_path_ = fs::absolute(
+            ExpandPath(follow["state"].as<std::string>())).string();
+      }
+      if (opts.poll_ms_ < 1 || opts.batch_ms_ < 0 ||
+          opts.idle_timeout_ms_ < 0) {
+        throw std::runtime_error("follow.poll_ms must be at least 1 and "
+                                 "follow.batch_ms and idle_timeout_ms not "
+                                 "negative");
+      }
+    }
 
-    DataEntry() : offset(0), size(0) {}
-  };
+    if (yaml["resources"]) {
+      const YAML::Node &resources = yaml["resources"];
+      if (resources["memory"]) {
+        std::string memory = resources["memory"].as<std::string>();
+        if (!ParseByteSize(memory, config.resources.memory_)) {
+          throw std::runtime_error("Invalid resources.memory: " + memory);
+        }
+      }
+      if (resources["fds"]) {
+        config.resources.fds_ = resources["fds"].as<size_t>();
+      }
+      if (resources["processes"]) {
+        config.resources.processes_ = resources["processes"].as<size_t>();
+      }
+    }
 
-  std::vector<DataEntry> data_entries;
+    if (yaml["qos"]) {
+      ParseQos(yaml["qos"], "qos", config.qos);
+    }
 
-  OmniJobConfig() : max_scale(100) {}
-};
+    if (yaml["placement"]) {
+      const YAML::Node &placement = yaml["placement"];
+      if (placement["map_by"]) {
+        config.placement.map_by_ = placement["map_by"].as<std::string>();
+        if (!PlacementPolicy::IsValidMapBy(config.placement.map_by_)) {
+          throw std::runtime_error("Invalid placement.map_by: " +
+                                   config.placement.map_by_);
+        }
+      }
+      if (placement["bind_to"]) {
+        config.placement.bind_to_ = placement["bind_to"].as<std::string>();
+        if (!PlacementPolicy::IsValidBindTo(config.placement.bind_to_)) {
+          throw std::runtime_error("Invalid placement.bind_to: " +
+                                   config.placement.bind_to_);
+        }
+      }
+      if (placement["threads"]) {
+        std::string binding = placement["threads"].as<std::string>();
+        if (!ParseThreadBinding(binding, config.placement.thread_binding_)) {
+          throw std::runtime_error("Invalid placement.threads: " + binding);
+        }
+      }
+    }
+
+  } catch (const YAML::Exception &e) {
+    std::cerr << "YAML parsing error: " << e.what() << std::endl;
+    throw;
+  }
+}
 
 OmniJobConfig ParseOmniFile(const std::string &yaml_file) {
   OmniJobConfig config;
 
   try {
     YAML::Node yaml = YAML::LoadFile(yaml_file);
-
-    if (yaml["name"]) {
-      config.name = yaml["name"].as<std::string>();
-    }
-
-    if (yaml["max_scale"]) {
-      config.max_scale = yaml["max_scale"].as<int>();
-    }
+    ParseOmniSettings(yaml, config);
+    YAML::Node settings = YAML::Clone(yaml);
+    settings.remove("data");
+    config.settings = YAML::Dump(settings);
 
     if (yaml["data"]) {
       const YAML::Node &data_node = yaml["data"];
       for (const auto &entry : data_node) {
-        OmniJobConfig::DataEntry data_entry;
+        PlanEntrySpec data_entry;
+        data_entry.qos_.priority_ = config.qos.priority_;
 
+        // Patterns are expanded later, all at once (see runtime/job_plan.h)
         if (entry["path"]) {
-          std::string expanded_path = ExpandPath(entry["path"].as<std::string>());
-          std::vector<std::string> expanded_files = ExpandFilePattern(expanded_path);
-          data_entry.paths = expanded_files;
-        }
-
-        if (entry["range"]) {
-          const YAML::Node &range_node = entry["range"];
-          for (const auto &val : range_node) {
-            data_entry.range.push_back(val.as<size_t>());
-          }
+          data_entry.pattern_ = entry["path"].as<std::string>();
         }
 
         if (entry["offset"]) {
-          data_entry.offset = entry["offset"].as<size_t>();
+          data_entry.offset_ = entry["offset"].as<size_t>();
         }
 
         if (entry["size"]) {
-          data_entry.size = entry["size"].as<size_t>();
+          data_entry.size_ = entry["size"].as<size_t>();
+        }
+
+        // A range [start, end] stands for offset and size
+        if (entry["range"] && !entry["offset"] && !entry["size"]) {
+          std::vector<size_t> range;
+          for (const auto &val : entry["range"]) {
+            range.push_back(val.as<size_t>());
+          }
+          if (range.size() != 2 || range[1] < range[0]) {
+            throw std::runtime_error("range must be [start, end]");
+          }
+          data_entry.offset_ = range[0];
+          data_entry.size_ = range[1] - range[0];
         }
 
         if (entry["description"]) {
           const YAML::Node &desc_node = entry["description"];
           for (const auto &desc : desc_node) {
-            data_entry.description.push_back(desc.as<std::string>());
+            data_entry.description_ +=
+                (data_entry.description_.empty() ? "" : ",") +
+                desc.as<std::string>();
           }
         }
 
         if (entry["hash"]) {
-          data_entry.hash = entry["hash"].as<std::string>();
+          data_entry.hash_ = entry["hash"].as<std::string>();
         }
 
-        // If size is not specified (0), automatically detect file size
-        if (data_entry.size == 0 && !data_entry.paths.empty()) {
-          FilesystemRepoClient fs_client;
-          
-          // For multiple files, we'll use the size of the first file as a template
-          // In practice, you might want to handle each file individually
-          size_t file_size = fs_client.GetFileSize(data_entry.paths[0]);
-          if (file_size > 0) {
-            // Calculate size as file_size - offset to read from offset to end
-            // of file
-            if (data_entry.offset < file_size) {
-              data_entry.size = file_size - data_entry.offset;
-              std::cout << "Auto-detected size for " << data_entry.paths[0] << ": "
-                        << data_entry.size << " bytes (from offset "
-                        << data_entry.offset << " to end of file)" << std::endl;
-            } else {
-              std::cerr << "Warning: Offset " << data_entry.offset
-                        << " is beyond file size " << file_size << " for "
-                        << data_entry.paths[0] << std::endl;
-            }
-          } else {
-            std::cerr << "Warning: Could not determine file size for "
-                      << data_entry.paths[0] << std::endl;
+        if (entry["channel"]) {
+          data_entry.channel_ = entry["channel"].as<std::string>();
+          if (!config.channels.count(data_entry.channel_)) {
+            throw std::runtime_error("Undeclared channel: " +
+                                     data_entry.channel_);
           }
-          
-          // Check if all files have the same size (optional validation)
-          if (data_entry.paths.size() > 1) {
-            std::cout << "Note: Processing " << data_entry.paths.size() 
-                      << " files with same parameters" << std::endl;
+        }
+
+        if (entry["qos"]) {
+          ParseQos(entry["qos"], "data qos", data_entry.qos_);
+        }
+
+        if (entry["format"]) {
+          data_entry.format_ =
+              FormatRegistry::ToLower(entry["format"].as<std::string>());
+          if (!FormatRegistry::Get().Find(data_entry.format_)) {
+            throw std::runtime_error("Invalid format: " + data_entry.format_);
           }
         }
 
-        // Derive range from offset and size if range is not specified
-        if (data_entry.range.empty() && data_entry.size > 0) {
-          data_entry.range.push_back(data_entry.offset);
-          data_entry.range.push_back(data_entry.offset + data_entry.size);
+        // Followed entries name one growing file, FIFO or stdin ("-")
+        if (entry["follow"] && entry["follow"].as<bool>()) {
+          const std::string &path = data_entry.pattern_;
+          if (path.empty() || path.find_first_of("*?[") != std::string::npos ||
+              (path != "-" && fs::is_directory(path))) {
+            throw std::runtime_error("A follow entry needs the path of one "
+                                     "file, FIFO or \"-\" for stdin: " +
+                                     path);
+          }
+          if (data_entry.size_ != 0) {
+            throw std::runtime_error("size and range cannot be used with "
+                                     "follow: " + path);
+          }
+          if (path != "-") {
+            data_entry.pattern_ = fs::absolute(ExpandPath(path)).string();
+          }
+          config.follow.push_back(std::move(data_entry));
+          continue;
         }
 
-        config.data_entries.push_back(data_entry);
+        config.data.push_back(std::move(data_entry));
       }
     }
 
@@ -226,21 +463,21 @@ OmniJobConfig ParseOmniFile(const std::string &yaml_file) {
   return config;
 }
 
-std::string BuildMpiCommand(const OmniJobConfig::DataEntry &entry, int nprocs,
-                            const std::string &hostfile) {
-  std::ostringstream cmd;
+// Credits as text, 0 = unlimited
+std::string FormatCredits(const ResourceCredits &credits) {
+  auto amount = [](size_t n, size_t scale) {
+    return n ? std::to_string(n / scale) : std::string("unlimited");
+  };
+  return amount(credits.memory_, 1 << 20) + " MB memory, " +
+         amount(credits.fds_, 1) + " fds, " + amount(credits.processes_, 1) +
+         " processes";
+}
 
-  // Build description string
-  std::string description;
-  if (!entry.description.empty()) {
-    std::ostringstream desc_stream;
-    for (size_t i = 0; i < entry.description.size(); ++i) {
-      if (i > 0)
-        desc_stream << ",";
-      desc_stream << entry.description[i];
-    }
-    description = desc_stream.str();
-  }
+// mpirun invocation of the worker, up to its per-entry arguments
+std::string BuildWorkerLaunch(int nprocs, int nthreads,
+                              const std::string &hostfile,
+                              const OmniJobConfig &config) {
+  std::ostringstream cmd;
 
   // Construct MPI command with environment forwarding
   cmd << "mpirun -x LD_PRELOAD"; // Forward LD_PRELOAD explicitly
@@ -260,6 +497,8 @@ std::string BuildMpiCommand(const OmniJobConfig::DataEntry &entry, int nprocs,
                                       "CUDA_VISIBLE_DEVICES",
                                       "HERMES_CONF",
                                       "IOWARP_CAE_CONF",
+                                      "CAE_PLUGIN_PATH",
+                                      "CAE_TUNING_FILE",
                                       nullptr};
 
   for (int i = 0; important_env_vars[i] != nullptr; ++i) {
@@ -268,122 +507,751 @@ std::string BuildMpiCommand(const OmniJobConfig::DataEntry &entry, int nprocs,
     }
   }
 
+  // Rank placement; by default one rank per NUMA domain, bound to it
+  cmd << config.placement.GetMpirunOptions(nthreads);
+
   cmd << " -np " << nprocs;
   cmd << " wrp_binary_format_mpi";
-  cmd << " \"" << entry.paths[0] << "\""; // Use the first (and only) path
-  cmd << " " << entry.offset;
-  cmd << " " << entry.size;
+  cmd << " --threads " << nthreads;
+  cmd << " --thread-bind " << ThreadBindingName(config.placement.thread_binding_);
+  cmd << " --extents " << ExtentMethodName(config.extent_method);
+  cmd << " --retries " << config.retry.attempts_ << " --retry-backoff "
+      << config.retry.backoff_ms_;
+  if (!config.decompress) {
+    cmd << " --no-decompress";
+  }
+  if (!config.auto_tune) {
+    cmd << " --no-auto-tune";
+  }
+  if (!config.plugin_path.empty()) {
+    cmd << " --plugin-path \"" << config.plugin_path << "\"";
+  }
+  if (!config.catalog_path.empty()) {
+    cmd << " --catalog \"" << config.catalog_path << "\"";
+  }
+  if (!config.stat_cache.empty()) {
+    cmd << " --stat-cache \"" << config.stat_cache << "\"";
+  }
+  return cmd.str();
+}
+
+// Output sink of an entry with a channel, or none; an entry's channel
+// takes precedence over the job's output
+SinkConfig GetSinkConfig(std::string channel, const OmniJobConfig &config) {
+  SinkConfig sink;
+  if (channel.empty() && config.output.sink == "shm") {
+    channel = config.output.channel;
+  }
+  if (!channel.empty()) {
+    sink.name_ = "shm";
+    sink.channel_ = config.channels.at(channel);
+  } else if (config.output.sink == "container") {
+    sink.name_ = "container";
+    sink.codec_ = config.output.codec;
+    sink.dedup_ = config.output.dedup;
+    sink.index_ = config.output.index;
+  }
+  return sink;
+}
+
+// Output sink of a planned entry
+SinkConfig GetEntrySink(const JobPlan &plan, const PlanEntry &entry,
+                        const OmniJobConfig &config) {
+  return GetSinkConfig(std::string(plan.GetString(entry.channel_)), config);
+}
+
+// Credits held by one worker launch of an entry: mpirun and its ranks.
+// A rank holds its MPI runtime and pipes, and the ring of its shm channel;
+// each thread holds the read buffer of its largest chunk and, with a
+// container sink, a block and its encoded copy
+ResourceCredits LaunchCredits(const JobPlan &plan, const PlanEntry &entry,
+                              const OmniJobConfig &config, int nprocs,
+                              int nthreads) {
+  constexpr size_t RUNTIME_BYTES = 32ull << 20;
+  constexpr size_t MPIRUN_FDS = 32;
+  constexpr size_t RANK_FDS = 16;
+  SinkConfig sink = GetEntrySink(plan, entry, config);
+  size_t rank_bytes = RUNTIME_BYTES;
+  if (sink.name_ == "shm") {
+    rank_bytes += sink.channel_.slots_ * sink.channel_.slot_size_;
+  }
+  size_t thread_bytes = config.auto_tune ? IoTuner::MAX_CHUNK
+                                         : BinaryFileOmni::DEFAULT_CHUNK_SIZE;
+  if (sink.name_ == "container") {
+    thread_bytes += 2 * ContainerSink::BLOCK_SIZE;
+  }
+  size_t ranks = static_cast<size_t>(std::max(nprocs, 1));
+  size_t threads = static_cast<size_t>(std::max(nthreads, 1));
+  return ResourceCredits(ranks * (rank_bytes + threads * thread_bytes),
+                         MPIRUN_FDS + ranks * RANK_FDS, ranks + 1);
+}
+
+// Directory that receives the datasets of the job, empty = none
+std::string GetOutputDir(const OmniJobConfig &config) {
+  return config.output.sink != "none" ? config.output.path : std::string();
+}
+
+/**
+ * Directory for the files this process hands its workers: the output,
+ * which every node sees, else a private directory under $TMPDIR
+ */
+std::string GetScratchDir(const OmniJobConfig &config) {
+  std::string dir = GetOutputDir(config);
+  if (dir.empty()) {
+    return fs::absolute(PrivateDir::GetTemp("cae")).string();
+  }
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  return fs::absolute(dir).string();
+}
+
+/**
+ * Create the file the workers of this process take file layouts from,
+ * under a name made by mkstemp
+ * @return Its absolute path; throws if it cannot be created
+ */
+std::string CreateStatCache(const OmniJobConfig &config) {
+  std::string path;
+  close(PrivateDir::CreateTemp(GetScratchDir(config), ".plan_job_", path));
+  return path;
+}
+
+/** Removes a temporary file when it goes out of scope */
+class TempFileGuard {
+public:
+  TempFileGuard() = default;
+  TempFileGuard(const TempFileGuard &) = delete;
+  TempFileGuard &operator=(const TempFileGuard &) = delete;
+  ~TempFileGuard() {
+    if (!path_.empty()) {
+      std::remove(path_.c_str());
+    }
+  }
+
+  void Set(const std::string &path) { path_ = path; }
+
+private:
+  std::string path_;
+};
+
+// Worker options selecting the output sink of an entry
+std::string BuildSinkArgs(const JobPlan &plan, const PlanEntry &entry,
+                          const OmniJobConfig &config) {
+  std::ostringstream cmd;
+  SinkConfig sink = GetEntrySink(plan, entry, config);
+  if (sink.name_ == "shm") {
+    const ShmChannelConfig &shm = sink.channel_;
+    cmd << " --sink shm --channel " << shm.name_;
+    cmd << " --slots " << shm.slots_;
+    cmd << " --slot-size " << shm.slot_size_;
+    cmd << " --overflow " << ShmChannelConfig::OverflowName(shm.overflow_);
+    cmd << " --consumer-timeout " << shm.consumer_timeout_ms_;
+    if (!shm.huge_pages_) {
+      cmd << " --no-huge-pages";
+    }
+  } else if (sink.name_ == "container") {
+    cmd << " --sink container";
+    cmd << " --codec " << sink.codec_;
+    if (sink.dedup_) {
+      cmd << " --dedup";
+    }
+    if (sink.index_.enabled_) {
+      cmd << " --record-index";
+      if (!sink.index_.bloom_columns_.empty()) {
+        cmd << " --bloom \"" << sink.index_.JoinColumns() << "\"";
+      }
+    }
+  }
+  std::string output_dir = GetOutputDir(config);
+  if (!output_dir.empty()) {
+    cmd << " --output \"" << output_dir << "\"";
+  }
+  return cmd.str();
+}
 
-  if (!description.empty()) {
+// Worker options limiting the reads of an entry's launch: the tighter of
+// the entry's and the job's limits
+std::string BuildQosArgs(const PlanEntry &entry, const OmniJobConfig &config) {
+  std::ostringstream cmd;
+  size_t bandwidth = QosLimits::Min(entry.bandwidth_, config.qos.bandwidth_);
+  size_t iops = QosLimits::Min(entry.iops_, config.qos.iops_);
+  if (bandwidth) {
+    cmd << " --max-bandwidth " << bandwidth;
+  }
+  if (iops) {
+    cmd << " --max-iops " << iops;
+  }
+  return cmd.str();
+}
+
+std::string BuildMpiCommand(const JobPlan &plan, const PlanEntry &entry,
+                            const PlanFile &file, int nprocs, int nthreads,
+                            const std::string &hostfile,
+                            const OmniJobConfig &config) {
+  std::ostringstream cmd;
+  std::string_view description = plan.GetString(entry.description_);
+  std::string_view hash = plan.GetString(entry.hash_);
+
+  cmd << BuildWorkerLaunch(nprocs, nthreads, hostfile, config);
+  cmd << BuildSinkArgs(plan, entry, config);
+  cmd << BuildQosArgs(entry, config);
+  cmd << " --format " << plan.GetString(file.format_);
+  cmd << " \"" << plan.GetString(file.path_) << "\"";
+  cmd << " " << file.offset_;
+  cmd << " " << file.size_; // 0 = to end of file
+
+  if (!description.empty() || !hash.empty()) {
     cmd << " \"" << description << "\"";
   }
 
-  if (!entry.hash.empty()) {
-    cmd << " \"" << entry.hash << "\"";
+  if (!hash.empty()) {
+    cmd << " \"" << hash << "\"";
   }
 
   return cmd.str();
 }
 
-void ProcessDataEntry(const OmniJobConfig::DataEntry &entry, int nprocs,
-                      const std::string &hostfile) {
-  std::cout << "\n" << std::string(50, '=') << std::endl;
-  std::cout << "Processing Data Entry" << std::endl;
-  std::cout << std::string(50, '=') << std::endl;
-  std::cout << "Files: " << entry.paths.size() << std::endl;
-  for (size_t i = 0; i < entry.paths.size(); ++i) {
-    std::cout << "  File " << (i + 1) << ": " << entry.paths[i] << std::endl;
+/**
+ * Outcome of every launch of a job, for the final report
+ */
+class JobReport {
+public:
+  enum class Outcome { kSucceeded, kPartial, kFailed };
+
+  JobReport() : counts_{0, 0, 0}, relaunches_(0) {}
+
+  /** Record the outcome of a launch after its last attempt */
+  void Add(const std::string &label, Outcome outcome, int attempts) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    counts_[static_cast<int>(outcome)]++;
+    relaunches_ += static_cast<size_t>(attempts - 1);
+    if (outcome == Outcome::kPartial) {
+      problems_.push_back("partially imported: " + label);
+    } else if (outcome == Outcome::kFailed) {
+      problems_.push_back("failed after " + std::to_string(attempts) +
+                          " attempt(s): " + label);
+    }
   }
-  std::cout << "Offset: " << entry.offset << " bytes" << std::endl;
-  std::cout << "Size: " << entry.size << " bytes" << std::endl;
-  std::cout << "MPI Processes: " << nprocs << std::endl;
 
-  // Process each file in the entry
-  for (size_t i = 0; i < entry.paths.size(); ++i) {
-    std::cout << "\nProcessing file " << (i + 1) << "/" << entry.paths.size() 
-              << ": " << entry.paths[i] << std::endl;
-    
-    // Create a single-file entry for this file
-    OmniJobConfig::DataEntry single_file_entry;
-    single_file_entry.paths = {entry.paths[i]};
-    single_file_entry.range = entry.range;
-    single_file_entry.offset = entry.offset;
-    single_file_entry.size = entry.size;
-    single_file_entry.description = entry.description;
-    single_file_entry.hash = entry.hash;
-    
-    // Build and execute MPI command for this file
-    std::string mpi_command = BuildMpiCommand(single_file_entry, nprocs, hostfile);
-    std::cout << "Executing: " << mpi_command << std::endl;
+  /**
+   * Print the summary
+   * @return Exit code of the job: 0 if every launch succeeded, the partial
+   *         status if some ranges were not imported, 1 if a launch failed
+   */
+  int Print() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t total = counts_[0] + counts_[1] + counts_[2];
+    std::cout << "\n" << std::string(50, '=') << std::endl;
+    if (problems_.empty()) {
+      std::cout << "✓ All data entries processed successfully!" << std::endl;
+    } else {
+      std::cout << "✗ " << problems_.size() << " of " << total
+                << " launch(es) did not import everything:" << std::endl;
+      for (const auto &problem : problems_) {
+        std::cout << "  - " << problem << std::endl;
+      }
+    }
+    std::cout << "Launches: " << counts_[0] << " succeeded, " << counts_[1]
+              << " partial, " << counts_[2] << " failed, " << relaunches_
+              << " relaunch(es)" << std::endl;
+    std::cout << std::string(50, '=') << std::endl;
+    if (counts_[2] > 0) {
+      return 1;
+    }
+    return counts_[1] > 0 ? ImportFailure::EXIT_STATUS : 0;
+  }
+
+private:
+  mutable std::mutex mtx_;
+  size_t counts_[3]; // By Outcome
+  size_t relaunches_;
+  std::vector<std::string> problems_;
+};
+
+/**
+ * Whether a launch that ended with an exit status may succeed if it is
+ * relaunched: a rank or mpirun was killed by a signal (-1, or 128 + the
+ * signal as mpirun reports it), or mpirun lost a node or daemon (255).
+ * Status 1 is a setup or usage error that a relaunch would repeat.
+ */
+bool IsResumable(int status) { return status < 0 || status > 128; }
+
+/**
+ * Run a worker launch, relaunching it with backoff while it ends without
+ * reporting for a resumable reason (killed ranks, lost nodes). A worker
+ * that reports failed ranges has already retried and reassigned them, and
+ * one that fails to set up fails again, so neither is relaunched.
+ */
+void RunLaunch(const std::string &command, const std::string &label,
+               const OmniJobConfig &config, JobReport &report) {
+  for (int attempt = 1;; ++attempt) {
+    std::cout << "Executing: " << command << std::endl;
     std::cout << std::string(50, '-') << std::endl;
 
-    int result = system(mpi_command.c_str());
+    int result = system(command.c_str());
+    int status = result != -1 && WIFEXITED(result) ? WEXITSTATUS(result) : -1;
 
     std::cout << std::string(50, '-') << std::endl;
-    if (result == 0) {
-      std::cout << "✓ Successfully completed processing " << entry.paths[i]
+    if (status == 0) {
+      std::cout << "✓ Successfully completed processing " << label
                 << std::endl;
-    } else {
-      std::cerr << "✗ Failed to process " << entry.paths[i]
-                << " (exit code: " << result << ")" << std::endl;
+      report.Add(label, JobReport::Outcome::kSucceeded, attempt);
+      return;
     }
+    if (status == ImportFailure::EXIT_STATUS) {
+      std::cerr << "✗ Some ranges of " << label << " were not imported"
+                << std::endl;
+      report.Add(label, JobReport::Outcome::kPartial, attempt);
+      return;
+    }
+    if (!IsResumable(status) || attempt >= config.retry.attempts_) {
+      std::cerr << "✗ Failed to process " << label
+                << " (exit code: " << status << ")" << std::endl;
+      report.Add(label, JobReport::Outcome::kFailed, attempt);
+      return;
+    }
+    int delay = config.retry.GetDelayMs(attempt);
+    std::cerr << "✗ Launch for " << label << " ended with exit code "
+              << status << "; relaunching in " << delay << " ms (attempt "
+              << attempt + 1 << "/" << config.retry.attempts_ << ")"
+              << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+  }
+}
+
+/**
+ * Gates that let one worker launch at a time use a bandwidth or IOPS limit
+ * The launch reads with the whole limit and its ranks divide it (see
+ * io/io_throttle.h). With a job limit every launch of the job shares one
+ * gate; otherwise an entry with its own limit has a gate for its launches.
+ * Waiters of higher priority classes enter first.
+ */
+class QosGates {
+public:
+  QosGates(const JobPlan &plan, const OmniJobConfig &config)
+      : plan_(plan), job_limited_(config.qos.IsLimited()),
+        job_(ResourceCredits(0, 0, 1)) {
+    for (size_t i = 0; i < plan.GetEntryCount(); ++i) {
+      entries_.push_back(
+          std::make_unique<ResourceGovernor>(ResourceCredits(0, 0, 1)));
+    }
+  }
+
+  /**
+   * Wait until a launch of an entry may read
+   * @return Lease that opens the gate again; empty if the entry is unlimited
+   */
+  ResourceGovernor::Lease Enter(const PlanEntry &entry) {
+    int priority = static_cast<int>(entry.priority_);
+    if (job_limited_) {
+      return job_.Acquire(ResourceCredits(0, 0, 1), priority);
+    }
+    if (entry.bandwidth_ || entry.iops_) {
+      size_t index = static_cast<size_t>(&entry - &plan_.GetEntry(0));
+      return entries_[index]->Acquire(ResourceCredits(0, 0, 1), priority);
+    }
+    return ResourceGovernor::Lease();
+  }
+
+private:
+  const JobPlan &plan_;
+  bool job_limited_;
+  ResourceGovernor job_;
+  std::vector<std::unique_ptr<ResourceGovernor>> entries_;
+};
+
+/**
+ * Write the files of an entry to a worker batch list, a new file next to
+ * the stat cache. Each line is <path>\t<offset>\t<size>[\t<description>].
+ * @return Its path; throws if it could not be written
+ */
+std::string WriteBatchList(const JobPlan &plan, const PlanEntry &entry,
+                           const std::vector<const PlanFile *> &files,
+                           const OmniJobConfig &config) {
+  std::string batch_file;
+  close(PrivateDir::CreateTemp(GetScratchDir(config), "batch_job_",
+                               batch_file));
+  std::string_view description = plan.GetString(entry.description_);
+  std::ofstream outfile(batch_file);
+  for (const PlanFile *file : files) {
+    outfile << plan.GetString(file->path_) << "\t" << file->offset_ << "\t"
+            << file->size_;
+    if (!description.empty()) {
+      outfile << "\t" << description;
+    }
+    outfile << "\n";
+  }
+  outfile.close();
+  if (!outfile) {
+    std::remove(batch_file.c_str());
+    throw std::runtime_error("Could not write batch list " + batch_file);
+  }
+  return batch_file;
+}
+
+/**
+ * Import files too small to fill a worker with a single batched launch
+ * instead of one mpirun per file
+ */
+void ProcessSmallFiles(const JobPlan &plan, const PlanEntry &entry,
+                       const std::vector<const PlanFile *> &files,
+                       int nthreads, const std::string &hostfile,
+                       const OmniJobConfig &config, JobReport &report) {
+  std::string label = "batch of " + std::to_string(files.size()) +
+                      " small files (" +
+                      std::string(plan.GetString(files.front()->path_)) +
+                      ", ...)";
+  TempFileGuard batch_file;
+  std::string path;
+  try {
+    path = WriteBatchList(plan, entry, files, config);
+    batch_file.Set(path);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    report.Add(label, JobReport::Outcome::kFailed, 1);
+    return;
   }
+  std::string mpi_command =
+      BuildWorkerLaunch(1, nthreads, hostfile, config) +
+      BuildSinkArgs(plan, entry, config) + BuildQosArgs(entry, config) +
+      " --format " + std::string(plan.GetString(files.front()->format_)) +
+      " --batch \"" + path + "\"";
+  std::cout << "\nPacking " << files.size() << " small files into one batch"
+            << std::endl;
+  RunLaunch(mpi_command, label, config, report);
 }
 
-void ProcessDataEntryAsync(const OmniJobConfig::DataEntry &entry, int nprocs,
-                          const std::string &hostfile) {
+// Import one file of an entry with its own mpirun
+void ProcessFile(const JobPlan &plan, const PlanEntry &entry,
+                 const PlanFile &file, int nprocs, int nthreads,
+                 const std::string &hostfile, const OmniJobConfig &config,
+                 JobReport &report) {
+  std::string mpi_command =
+      BuildMpiCommand(plan, entry, file, nprocs, nthreads, hostfile, config);
+  RunLaunch(mpi_command, std::string(plan.GetString(file.path_)), config,
+            report);
+}
+
+// Print an entry before it is processed
+void PrintDataEntry(const JobPlan &plan, const PlanEntry &entry, int nprocs,
+                    int nthreads, const char *title) {
   std::cout << "\n" << std::string(50, '=') << std::endl;
-  std::cout << "Processing Data Entry (Async)" << std::endl;
+  std::cout << title << std::endl;
   std::cout << std::string(50, '=') << std::endl;
-  std::cout << "Files: " << entry.paths.size() << std::endl;
-  for (size_t i = 0; i < entry.paths.size(); ++i) {
-    std::cout << "  File " << (i + 1) << ": " << entry.paths[i] << std::endl;
+  std::cout << "Files: " << entry.nfiles_ << std::endl;
+  for (size_t i = 0; i < entry.nfiles_; ++i) {
+    const PlanFile &file = plan.GetFile(entry.first_file_ + i);
+    std::cout << "  File " << (i + 1) << ": " << plan.GetString(file.path_)
+              << " (offset " << file.offset_ << ", size "
+              << (file.size_ ? std::to_string(file.size_) : "to end") << ")"
+              << std::endl;
   }
-  std::cout << "Offset: " << entry.offset << " bytes" << std::endl;
-  std::cout << "Size: " << entry.size << " bytes" << std::endl;
   std::cout << "MPI Processes: " << nprocs << std::endl;
+  std::cout << "Threads per Process: " << nthreads << std::endl;
+}
+
+/**
+ * A launch allowed to start: it has entered its QoS gate, then taken its
+ * credits. Gate first, so launches queued on a gate hold no credits
+ */
+struct Admission {
+  ResourceGovernor::Lease gate_;
+  ResourceGovernor::Lease credits_;
+};
+
+// Wait until a launch of an entry may start
+Admission Admit(const JobPlan &plan, const PlanEntry &entry,
+                const OmniJobConfig &config, int nprocs, int nthreads,
+                ResourceGovernor &governor, QosGates &gates) {
+  Admission admission;
+  admission.gate_ = gates.Enter(entry);
+  admission.credits_ =
+      governor.Acquire(LaunchCredits(plan, entry, config, nprocs, nthreads),
+                       static_cast<int>(entry.priority_));
+  return admission;
+}
+
+/**
+ * Import the files of an entry one after another
+ * @param admission Admission of the first launch
+ */
+void ProcessDataEntry(const JobPlan &plan, const PlanEntry &entry, int nprocs,
+                      int nthreads, const std::string &hostfile,
+                      const OmniJobConfig &config, JobReport &report,
+                      ResourceGovernor &governor, Admission admission,
+                      QosGates &gates) {
+  PrintDataEntry(plan, entry, nprocs, nthreads, "Processing Data Entry");
+
+  // Process each file in the entry
+  for (size_t i = 0; i < entry.nfiles_; ++i) {
+    const PlanFile &file = plan.GetFile(entry.first_file_ + i);
+    std::cout << "\nProcessing file " << (i + 1) << "/" << entry.nfiles_
+              << ": " << plan.GetString(file.path_) << std::endl;
+    Admission scope = i == 0 ? std::move(admission)
+                             : Admit(plan, entry, config, nprocs, nthreads,
+                                     governor, gates);
+    ProcessFile(plan, entry, file, nprocs, nthreads, hostfile, config,
+                report);
+  }
+}
+
+/**
+ * Import the files of an entry concurrently, as far as the budget allows
+ * @param admission Admission of the entry, used by its first launch
+ */
+void ProcessDataEntryAsync(const JobPlan &plan, const PlanEntry &entry,
+                           int nprocs, int nthreads,
+                           const std::string &hostfile,
+                           const OmniJobConfig &config, JobReport &report,
+                           ResourceGovernor &governor, Admission admission,
+                           QosGates &gates) {
+  PrintDataEntry(plan, entry, nprocs, nthreads,
+                 "Processing Data Entry (Async)");
+
+  // Files smaller than one worker's share go to a single batched launch
+  std::vector<const PlanFile *> small_files;
+  std::vector<size_t> large_files;
+  for (size_t i = 0; i < entry.nfiles_; ++i) {
+    const PlanFile &file = plan.GetFile(entry.first_file_ + i);
+    if (file.allocated_ < FilesystemRepoClient::MIN_BYTES_PER_WORKER) {
+      small_files.push_back(&file);
+    } else {
+      large_files.push_back(i);
+    }
+  }
+  if (small_files.size() < 2) {
+    small_files.clear();
+    large_files.clear();
+    for (size_t i = 0; i < entry.nfiles_; ++i) {
+      large_files.push_back(i);
+    }
+  }
 
   // Create async tasks for each file
   std::vector<std::future<void>> futures;
-  
-  for (size_t i = 0; i < entry.paths.size(); ++i) {
-    futures.push_back(std::async(std::launch::async, [&, i, nprocs, hostfile]() {
-      std::cout << "\nProcessing file " << (i + 1) << "/" << entry.paths.size() 
-                << ": " << entry.paths[i] << " (async)" << std::endl;
-      
-      // Create a single-file entry for this file
-      OmniJobConfig::DataEntry single_file_entry;
-      single_file_entry.paths = {entry.paths[i]};
-      single_file_entry.range = entry.range;
-      single_file_entry.offset = entry.offset;
-      single_file_entry.size = entry.size;
-      single_file_entry.description = entry.description;
-      single_file_entry.hash = entry.hash;
-      
-      // Build and execute MPI command for this file
-      std::string mpi_command = BuildMpiCommand(single_file_entry, nprocs, hostfile);
-      std::cout << "Executing: " << mpi_command << std::endl;
-      std::cout << std::string(50, '-') << std::endl;
-
-      int result = system(mpi_command.c_str());
-
-      std::cout << std::string(50, '-') << std::endl;
-      if (result == 0) {
-        std::cout << "✓ Successfully completed processing " << entry.paths[i]
-                  << std::endl;
-      } else {
-        std::cerr << "✗ Failed to process " << entry.paths[i]
-                  << " (exit code: " << result << ")" << std::endl;
-      }
-    }));
+
+  // One batch per format, since a worker parses a single format
+  std::map<std::string_view, std::vector<const PlanFile *>> small_by_format;
+  for (const PlanFile *file : small_files) {
+    small_by_format[plan.GetString(file->format_)].push_back(file);
+  }
+  // Each launch is admitted before its thread starts; the first one runs
+  // on the entry's admission
+  auto next_admission = [&](int launch_procs) {
+    if (futures.empty()) {
+      return std::move(admission);
+    }
+    return Admit(plan, entry, config, launch_procs, nthreads, governor,
+                 gates);
+  };
+  for (const auto &group : small_by_format) {
+    Admission held = next_admission(1);
+    futures.push_back(std::async(
+        std::launch::async, [&, held = std::move(held)]() mutable {
+          Admission scope = std::move(held);
+          ProcessSmallFiles(plan, entry, group.second, nthreads, hostfile,
+                            config, report);
+        }));
   }
-  
+
+  for (size_t i : large_files) {
+    Admission held = next_admission(nprocs);
+    futures.push_back(std::async(
+        std::launch::async, [&, i, held = std::move(held)]() mutable {
+          Admission scope = std::move(held);
+          const PlanFile &file = plan.GetFile(entry.first_file_ + i);
+          std::cout << "\nProcessing file " << (i + 1) << "/"
+                    << entry.nfiles_ << ": " << plan.GetString(file.path_)
+                    << " (async)" << std::endl;
+          ProcessFile(plan, entry, file, nprocs, nthreads, hostfile, config,
+                      report);
+        }));
+  }
+
   // Wait for all async tasks to complete
   for (auto &future : futures) {
     future.wait();
   }
 }
 
+// Throttle of the whole job, or null without a job limit
+std::shared_ptr<IoThrottle> GetJobThrottle(const OmniJobConfig &config) {
+  if (!config.qos.IsLimited()) {
+    return nullptr;
+  }
+  return std::make_shared<IoThrottle>(config.qos.bandwidth_,
+                                      config.qos.iops_);
+}
+
+// Throttle of an entry, charging the job's as well; the job's throttle
+// alone when the entry has no limits of its own
+std::shared_ptr<IoThrottle>
+GetEntryThrottle(size_t bandwidth, size_t iops,
+                 const std::shared_ptr<IoThrottle> &job) {
+  if (!bandwidth && !iops) {
+    return job;
+  }
+  return std::make_shared<IoThrottle>(bandwidth, iops, job);
+}
+
+// Time the job's reads waited for tokens, if it is throttled
+void PrintThrottleSummary(const std::shared_ptr<IoThrottle> &job) {
+  if (job) {
+    std::cout << "QoS: job limited to "
+              << IoThrottle::Describe(job->GetBandwidth(), job->GetIops())
+              << ", reads waited " << job->GetWaitedMs() << " ms for it"
+              << std::endl;
+  }
+}
+
+/**
+ * Import every file of the plan in this process, on one work-stealing pool
+ * (see runtime/local_runner.h); each file is reported like a launch
+ */
+void RunLocal(const JobPlan &plan, const OmniJobConfig &config,
+              JobReport &report) {
+  LocalOptions opts;
+  opts.nthreads_ = config.threads_per_rank;
+  opts.thread_binding_ = config.placement.thread_binding_;
+  opts.extent_method_ = config.extent_method;
+  opts.decompress_ = config.decompress;
+  opts.auto_tune_ = config.auto_tune;
+  opts.retry_ = config.retry;
+  opts.catalog_dir_ = config.catalog_path;
+
+  // All threads share the job's and their entry's token buckets
+  std::shared_ptr<IoThrottle> job_throttle = GetJobThrottle(config);
+  std::vector<LocalTask> tasks;
+  tasks.reserve(plan.GetFileCount());
+  for (size_t i = 0; i < plan.GetEntryCount(); ++i) {
+    const PlanEntry &entry = plan.GetEntry(i);
+    if (entry.nfiles_ == 0) {
+      std::cerr << "Warning: data entry " << (i + 1)
+                << " has no files left to import" << std::endl;
+      continue;
+    }
+    SinkConfig sink = GetEntrySink(plan, entry, config);
+    std::shared_ptr<IoThrottle> throttle =
+        GetEntryThrottle(entry.bandwidth_, entry.iops_, job_throttle);
+    for (size_t f = 0; f < entry.nfiles_; ++f) {
+      const PlanFile &file = plan.GetFile(entry.first_file_ + f);
+      LocalTask task;
+      task.path_ = plan.GetString(file.path_);
+      task.format_ = plan.GetString(file.format_);
+      task.description_ = plan.GetString(entry.description_);
+      task.hash_ = plan.GetString(entry.hash_);
+      task.offset_ = file.offset_;
+      task.size_ = file.size_;
+      task.file_size_ = file.file_size_;
+      task.sink_ = sink;
+      task.output_dir_ = GetOutputDir(config);
+      task.priority_ = static_cast<QosPriority>(entry.priority_);
+      task.throttle_ = throttle;
+      tasks.push_back(std::move(task));
+    }
+  }
+
+  LocalRunner runner(opts);
+  std::cout << "\nImporting " << tasks.size() << " file(s) in-process on "
+            << runner.GetThreadCount() << " thread(s)" << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<LocalResult> results = runner.Run(tasks);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  size_t bytes = 0;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    size_t missing = 0;
+    const std::vector<ImportFailure> &failures = results[i].failures_;
+    for (const auto &failure : failures) {
+      missing += failure.size_;
+      std::cerr << "Not imported: " << failure.filename_ << " ["
+                << failure.offset_ << ", +" << failure.size_
+                << "): " << failure.reason_ << std::endl;
+    }
+    bytes += results[i].bytes_ - std::min(missing, results[i].bytes_);
+    report.Add(tasks[i].path_,
+               failures.empty() ? JobReport::Outcome::kSucceeded
+                                : JobReport::Outcome::kPartial,
+               1);
+  }
+  std::cout << "Imported " << bytes << " bytes in "
+            << static_cast<long>(seconds * 1000) << " ms ("
+            << static_cast<long>(bytes / std::max(seconds, 1e-9) / 1e6)
+            << " MB/s, " << runner.GetStealCount() << " steal(s))"
+            << std::endl;
+  PrintThrottleSummary(job_throttle);
+  if (config.auto_tune) {
+    IoTuner::SaveAll();
+  }
+}
+
+/**
+ * Import the follow entries as they grow, in this process, until every
+ * source ends, the idle timeout passes or the job is interrupted (see
+ * runtime/stream_follower.h); each source is reported like a launch
+ */
+void RunFollow(const OmniJobConfig &config, JobReport &report) {
+  FollowOptions opts = config.follow_options;
+  opts.auto_tune_ = config.auto_tune;
+  opts.retry_ = config.retry;
+
+  std::shared_ptr<IoThrottle> job_throttle = GetJobThrottle(config);
+  std::vector<FollowSource> sources;
+  for (const auto &entry : config.follow) {
+    FollowSource source;
+    source.path_ = entry.pattern_;
+    source.format_ = entry.format_;
+    source.description_ = entry.description_;
+    source.hash_ = entry.hash_;
+    source.offset_ = entry.offset_;
+    source.sink_ = GetSinkConfig(entry.channel_, config);
+    source.output_dir_ = GetOutputDir(config);
+    source.throttle_ = GetEntryThrottle(entry.qos_.bandwidth_,
+                                        entry.qos_.iops_, job_throttle);
+    sources.push_back(std::move(source));
+  }
+
+  std::cout << "\nFollowing " << sources.size() << " source(s), checking "
+            << "every " << opts.poll_ms_ << " ms";
+  if (opts.idle_timeout_ms_ > 0) {
+    std::cout << " until idle for " << opts.idle_timeout_ms_ << " ms";
+  }
+  std::cout << " (Ctrl-C to stop)" << std::endl;
+
+  // An interrupt ends the session after the current batch, so the
+  // committed offsets and datasets stay consistent
+  auto on_signal = [](int) { StreamFollower::RequestStop(); };
+  auto old_int = std::signal(SIGINT, on_signal);
+  auto old_term = std::signal(SIGTERM, on_signal);
+  StreamFollower follower(opts);
+  std::vector<FollowResult> results = follower.Run(sources);
+  std::signal(SIGINT, old_int);
+  std::signal(SIGTERM, old_term);
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    const FollowResult &result = results[i];
+    for (const auto &failure : result.failures_) {
+      std::cerr << "Not imported: " << failure.filename_ << " ["
+                << failure.offset_ << ", +" << failure.size_
+                << "): " << failure.reason_ << std::endl;
+    }
+    std::cout << "Followed " << sources[i].path_ << ": "
+              << result.committed_ - result.start_ << " bytes in "
+              << result.batches_ << " micro-batch(es), committed offset "
+              << result.committed_ << std::endl;
+    report.Add(sources[i].path_,
+               result.failures_.empty() ? JobReport::Outcome::kSucceeded
+                                        : JobReport::Outcome::kPartial,
+               1);
+  }
+  PrintThrottleSummary(job_throttle);
+  if (config.auto_tune) {
+    IoTuner::SaveAll();
+  }
+}
+
 // Parse hostfile into vector of hostnames
 std::vector<std::string> ParseHostfile(const std::string &hostfile_path) {
     std::vector<std::string> hosts;
@@ -432,97 +1300,488 @@ std::string WriteTempHostfile(const std::vector<std::string> &hosts, const std::
     return temp_hostfile;
 }
 
-int main(int argc, char *argv[]) {
-  // Initialize MPI for the main orchestrator
-  MPI_Init(&argc, &argv);
+/**
+ * Launch every entry of the plan with mpirun, concurrently as far as the
+ * budget allows, balancing the launches over the hosts; entries of higher
+ * priority classes are launched first
+ */
+void RunLaunches(const JobPlan &plan, const OmniJobConfig &config,
+                 const std::string &hostfile,
+                 const std::vector<std::string> &hosts,
+                 ResourceGovernor &governor, JobReport &report) {
+  std::vector<int> node_proc_counts(hosts.size(), 0);
+  std::mutex node_mutex;
+  QosGates gates(plan, config);
 
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <omni_yaml_file> [hostfile]"
-              << std::endl;
-    MPI_Finalize();
-    return 1;
+  std::vector<size_t> order(plan.GetEntryCount());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return plan.GetEntry(a).priority_ > plan.GetEntry(b).priority_;
+  });
+
+  // Launch all jobs concurrently, balancing node usage
+  int job_id = 0;
+  std::vector<std::future<void>> job_futures;
+  for (size_t i : order) {
+    const PlanEntry &entry = plan.GetEntry(i);
+    if (entry.nfiles_ == 0) {
+      std::cerr << "Warning: data entry " << (i + 1)
+                << " has no files left to import" << std::endl;
+      continue;
+    }
+    const PlanFile &first = plan.GetFile(entry.first_file_);
+    FilesystemRepoClient fs_client;
+    int nprocs, nthreads;
+    fs_client.RecommendScaleForSize(
+        std::string(plan.GetString(first.path_)), first.file_size_,
+        first.allocated_, config.max_scale, nprocs, nthreads,
+        config.threads_per_rank);
+    // A file that cannot be split is read by a single rank
+    const FormatCapabilities *caps = FormatRegistry::Get().Find(
+        std::string(plan.GetString(first.format_)));
+    if (caps && !caps->splittable_) {
+      nprocs = 1;
+    }
+
+    // Backpressure: wait until the entry's QoS gate lets its first launch
+    // in and the budget can hold it
+    Admission admission =
+        Admit(plan, entry, config, nprocs, nthreads, governor, gates);
+
+    int nodes_needed = (!hosts.empty()) ? std::min(nprocs, (int)hosts.size()) : nprocs;
+    std::vector<int> node_indices;
+    std::string temp_hostfile;
+    if (!hosts.empty()) {
+      node_indices = AllocateNodes(nodes_needed, node_proc_counts, node_mutex);
+      temp_hostfile = WriteTempHostfile(hosts, node_indices, job_id);
+    } else {
+      temp_hostfile = hostfile; // fallback: use original hostfile or none
+    }
+
+    // Launch each job asynchronously
+    job_futures.push_back(std::async(std::launch::async, [&, i, nprocs, nthreads, temp_hostfile, admission = std::move(admission)]() mutable {
+      const PlanEntry &entry = plan.GetEntry(i);
+      if (entry.nfiles_ > 1) {
+        ProcessDataEntryAsync(plan, entry, nprocs, nthreads, temp_hostfile,
+                              config, report, governor, std::move(admission),
+                              gates);
+      } else {
+        ProcessDataEntry(plan, entry, nprocs, nthreads, temp_hostfile, config,
+                         report, governor, std::move(admission), gates);
+      }
+      if (!temp_hostfile.empty() && temp_hostfile.find("hostfile_job_") == 0) {
+        std::remove(temp_hostfile.c_str());
+      }
+    }));
+    job_id++;
   }
+  // Wait for all jobs to finish
+  for (auto &f : job_futures) f.wait();
+  std::cout << "Peak use: " << FormatCredits(governor.GetPeak()) << " ("
+            << governor.GetWaitCount() << " launches waited for credits)"
+            << std::endl;
+}
 
-  int rank;
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+void PrintUsage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [--mpi] <omni_yaml_file> [hostfile]\n"
+            << "       " << program
+            << " [--mpi] --plan <plan_file> [hostfile]\n"
+            << "       " << program
+            << " --write-plan <plan_file> <omni_yaml_file>\n"
+            << "       " << program << " serve [--socket <path>]\n"
+            << "       " << program
+            << " submit [--socket <path>] <omni_yaml_file> | --plan "
+               "<plan_file>\n"
+            << "       " << program
+            << " query <dataset_dir>... --eq <col=value> | --range "
+               "<col=lo..hi> [--yaml <out.yaml>]\n"
+            << "Without a hostfile the job runs in this process; --mpi "
+               "launches workers with mpirun instead" << std::endl;
+}
 
+// Plan a job and save the plan for later runs
+int WritePlan(const std::string &plan_file, const std::string &yaml_file) {
   try {
-    // Parse the OMNI YAML file
-    OmniJobConfig config = ParseOmniFile(argv[1]);
+    OmniJobConfig config = ParseOmniFile(yaml_file);
+    JobPlan plan = JobPlan::Build(config.data, config.settings);
+    if (!config.follow.empty()) {
+      std::cerr << "Warning: follow entries are not saved in plans; run "
+                   "them from the job file" << std::endl;
+    }
+    plan.Save(plan_file);
+    std::cout << "Plan: " << plan.GetEntryCount() << " entries, "
+              << plan.GetFileCount() << " files ("
+              << plan.GetDuplicateCount() << " duplicates dropped) in "
+              << plan_file << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
 
-    // Get hostfile from command line or config
-    std::string hostfile;
-    if (argc > 2) {
-      hostfile = argv[2];
-    } else if (getenv("OMNI_HOSTFILE")) {
-      hostfile = getenv("OMNI_HOSTFILE");
+/**
+ * Run one job
+ * @param from_plan The file is a saved plan, else an OMNI YAML file
+ * @param file The plan or OMNI file
+ * @param hostfile Nodes to launch workers on, empty = local mode
+ * @param force_mpi Launch workers with mpirun even without a hostfile
+ * @return The job's exit code
+ */
+int RunJob(bool from_plan, const std::string &file,
+           const std::string &hostfile, bool force_mpi) {
+  int exit_code = 0;
+  try {
+    OmniJobConfig config;
+    JobPlan plan;
+    auto plan_start = std::chrono::steady_clock::now();
+    if (from_plan) {
+      // A saved plan carries its settings; the file system is not scanned
+      plan = JobPlan::Map(file);
+      ParseOmniSettings(YAML::Load(std::string(plan.GetSettings())), config);
+    } else {
+      // Parse the OMNI YAML file and plan its entries
+      config = ParseOmniFile(file);
+      plan = JobPlan::Build(config.data, config.settings);
     }
+    double plan_ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - plan_start)
+                         .count();
+
+    bool local = hostfile.empty() && !force_mpi;
 
     std::vector<std::string> hosts;
-    std::vector<int> node_proc_counts;
-    std::mutex node_mutex;
     if (!hostfile.empty()) {
       hosts = ParseHostfile(hostfile);
-      node_proc_counts.resize(hosts.size(), 0);
     }
 
-    if (rank == 0) {
-      std::cout << "OMNI Content Assimilation Engine" << std::endl;
-      std::cout << "=================================" << std::endl;
-      std::cout << "Job: " << config.name << std::endl;
-      std::cout << "Max scale: " << config.max_scale << std::endl;
-      std::cout << "Hostfile: "
-                << (hostfile.empty() ? "not specified" : hostfile) << std::endl;
-      std::cout << "Number of data entries: " << config.data_entries.size()
-                << std::endl;
+    // The job's budget covers every node it may run on
+    ResourceCredits budget = ResourceGovernor::GetNodeBudget();
+    if (config.resources.memory_) budget.memory_ = config.resources.memory_;
+    if (config.resources.fds_) budget.fds_ = config.resources.fds_;
+    if (config.resources.processes_) {
+      budget.processes_ = config.resources.processes_;
+    }
+    size_t nnodes = std::max<size_t>(hosts.size(), 1);
+    budget.memory_ *= nnodes;
+    budget.fds_ *= nnodes;
+    budget.processes_ *= nnodes;
+    ResourceGovernor governor(budget);
+    JobReport report;
 
-      // Launch all jobs concurrently, balancing node usage
-      int job_id = 0;
-      std::vector<std::future<void>> job_futures;
-      for (size_t i = 0; i < config.data_entries.size(); ++i) {
-        const auto &entry = config.data_entries[i];
-        FilesystemRepoClient fs_client;
-        int nprocs, nthreads;
-        fs_client.RecommendScaleForFile(entry.paths[0], config.max_scale, nprocs, nthreads);
-
-        int nodes_needed = (!hosts.empty()) ? std::min(nprocs, (int)hosts.size()) : nprocs;
-        std::vector<int> node_indices;
-        std::string temp_hostfile;
-        if (!hosts.empty()) {
-          node_indices = AllocateNodes(nodes_needed, node_proc_counts, node_mutex);
-          temp_hostfile = WriteTempHostfile(hosts, node_indices, job_id);
-        } else {
-          temp_hostfile = hostfile; // fallback: use original hostfile or none
-        }
+    std::cout << "OMNI Content Assimilation Engine" << std::endl;
+    std::cout << "=================================" << std::endl;
+    std::cout << "Job: " << config.name << std::endl;
+    std::cout << "Max scale: " << config.max_scale << std::endl;
+    std::cout << "Threads per rank: "
+              << (config.threads_per_rank > 0
+                      ? std::to_string(config.threads_per_rank)
+                      : "auto")
+              << std::endl;
+    std::cout << "Placement: map-by "
+              << (config.placement.map_by_.empty() ? "default"
+                                                   : config.placement.map_by_)
+              << ", bind-to "
+              << (config.placement.bind_to_.empty() ? "default"
+                                                    : config.placement.bind_to_)
+              << ", threads "
+              << ThreadBindingName(config.placement.thread_binding_)
+              << std::endl;
+    std::cout << "Hostfile: "
+              << (hostfile.empty() ? "not specified" : hostfile) << std::endl;
+    std::cout << "QoS: " << QosPriorityName(config.qos.priority_)
+              << " priority, "
+              << IoThrottle::Describe(config.qos.bandwidth_, config.qos.iops_)
+              << std::endl;
+    if (local) {
+      std::cout << "Mode: local (in-process, no MPI)" << std::endl;
+    } else {
+      std::cout << "Mode: MPI" << std::endl;
+      std::cout << "Budget: " << FormatCredits(budget) << std::endl;
+    }
+    std::cout << "Number of data entries: " << plan.GetEntryCount();
+    if (!config.follow.empty()) {
+      std::cout << " (+" << config.follow.size() << " followed)";
+    }
+    std::cout << std::endl;
+    std::cout << "Plan: " << plan.GetFileCount() << " files ("
+              << plan.GetDuplicateCount() << " duplicates dropped) in "
+              << static_cast<long>(plan_ms) << " ms" << std::endl;
 
-        // Launch each job asynchronously
-        job_futures.push_back(std::async(std::launch::async, [&, entry, nprocs, temp_hostfile, job_id]() {
-          if (entry.paths.size() > 1)
-            ProcessDataEntryAsync(entry, nprocs, temp_hostfile);
-          else
-            ProcessDataEntry(entry, nprocs, temp_hostfile);
-          if (!temp_hostfile.empty() && temp_hostfile.find("hostfile_job_") == 0) {
-            std::remove(temp_hostfile.c_str());
+    // Workers add one catalog part per import; stale parts are dropped
+    if (!config.catalog_path.empty()) {
+      fs::create_directories(config.catalog_path);
+      fs::remove_all(config.catalog_path + "/parts");
+      config.catalog.Save(
+          CatalogWriter::GetOptionsPath(config.catalog_path));
+    }
+
+    // Entries that are followed are imported after the others
+    if (plan.GetEntryCount() > 0 || config.follow.empty()) {
+      if (local) {
+        RunLocal(plan, config, report);
+      } else {
+        // Workers take file layouts from the plan just built instead of
+        // stat'ing every file on every rank; without it they stat them
+        TempFileGuard stat_cache;
+        if (!from_plan && plan.GetFileCount() > 0) {
+          try {
+            std::string path = CreateStatCache(config);
+            stat_cache.Set(path);
+            plan.Save(path);
+            config.stat_cache = path;
+          } catch (const std::exception &e) {
+            std::cerr << "Warning: no stat cache: " << e.what() << std::endl;
           }
-        }));
-        job_id++;
+        }
+        RunLaunches(plan, config, hostfile, hosts, governor, report);
       }
-      // Wait for all jobs to finish
-      for (auto &f : job_futures) f.wait();
+    }
+    if (!config.follow.empty()) {
+      RunFollow(config, report);
+    }
 
-      std::cout << "\n" << std::string(50, '=') << std::endl;
-      std::cout << "✓ All data entries processed successfully!" << std::endl;
-      std::cout << std::string(50, '=') << std::endl;
+    if (!config.catalog_path.empty()) {
+      size_t count = CatalogWriter::Assemble(config.catalog_path);
+      std::cout << "Catalog: " << count << " file(s) in "
+                << config.catalog_path << "/file_assets.csv" << std::endl;
     }
 
+    exit_code = report.Print();
+
   } catch (const std::exception &e) {
-    if (rank == 0) {
-      std::cerr << "Error: " << e.what() << std::endl;
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return exit_code;
+}
+
+// Priority of a submitted job, from the qos block of its settings
+int GetJobPriority(const IngestJob &job) {
+  YAML::Node settings;
+  if (job.plan_) {
+    settings = YAML::Load(std::string(JobPlan::Map(job.path_).GetSettings()));
+  } else {
+    settings = YAML::LoadFile(job.path_);
+  }
+  QosLimits qos;
+  if (settings["qos"]) {
+    ParseQos(settings["qos"], "qos", qos);
+  }
+  return static_cast<int>(qos.priority_);
+}
+
+// wrp serve / wrp submit (see runtime/ingest_server.h)
+int RunService(const char *program, int argc, char *argv[]) {
+  std::string command = argv[0];
+  std::string socket_path = IngestServer::GetDefaultSocketPath();
+  IngestJob job;
+  int arg = 1;
+  if (arg + 1 < argc && std::string(argv[arg]) == "--socket") {
+    socket_path = argv[arg + 1];
+    arg += 2;
+  }
+  if (command == "submit" && arg < argc &&
+      std::string(argv[arg]) == "--plan") {
+    job.plan_ = true;
+    ++arg;
+  }
+  bool valid = command == "serve" ? arg == argc : arg + 1 == argc;
+  if (!valid) {
+    PrintUsage(program);
+    return 1;
+  }
+  if (command == "submit") {
+    job.path_ = argv[arg];
+    return IngestClient::Submit(socket_path, job);
+  }
+
+  // Jobs run in local mode; stdin is not the clients', so it is closed
+  int null_fd = open("/dev/null", O_RDONLY);
+  if (null_fd >= 0) {
+    dup2(null_fd, STDIN_FILENO);
+    close(null_fd);
+  }
+  IngestServer server(
+      socket_path,
+      [](const IngestJob &job) {
+        return RunJob(job.plan_, job.path_, "", false);
+      },
+      GetJobPriority);
+  auto on_signal = [](int) { IngestServer::RequestStop(); };
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+  return server.Run();
+}
+
+// Record index files of a dataset directory, or of the datasets in an
+// output directory
+std::vector<std::string> FindRecordIndexes(const std::string &dir) {
+  std::vector<fs::path> datasets;
+  std::error_code ec;
+  if (fs::exists(fs::path(dir) / "manifest.json", ec)) {
+    datasets.push_back(dir);
+  } else {
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+      if (fs::exists(entry.path() / "manifest.json", ec)) {
+        datasets.push_back(entry.path());
+      }
     }
-    MPI_Finalize();
+    std::sort(datasets.begin(), datasets.end());
+  }
+  std::vector<std::string> files;
+  for (const auto &dataset : datasets) {
+    std::ifstream in(dataset / "manifest.json");
+    std::stringstream text;
+    text << in.rdbuf();
+    ForEachFlatObject(text.str(), [&](const JsonFields &fields) {
+      auto it = fields.find("record_index");
+      if (it != fields.end()) {
+        files.push_back((dataset / it->second).string());
+      }
+    });
+  }
+  return files;
+}
+
+// An OMNI job that reads the candidate ranges again
+void WriteQueryJob(const std::string &yaml_file,
+                   const std::vector<CandidateRange> &ranges) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  out << YAML::Key << "name" << YAML::Value << "query";
+  out << YAML::Key << "data" << YAML::Value << YAML::BeginSeq;
+  for (const auto &range : ranges) {
+    out << YAML::BeginMap;
+    out << YAML::Key << "path" << YAML::Value << range.source_;
+    out << YAML::Key << "offset" << YAML::Value << range.offset_;
+    if (range.size_ != 0) {
+      out << YAML::Key << "size" << YAML::Value << range.size_;
+    }
+    out << YAML::EndMap;
+  }
+  out << YAML::EndSeq << YAML::EndMap;
+  std::ofstream file(yaml_file);
+  file << out.c_str() << std::endl;
+  if (!file) {
+    throw std::runtime_error("Could not write " + yaml_file);
+  }
+}
+
+// wrp query: ranges that may hold matching records (see
+// sink/record_index.h); prints "<file>\t<offset>\t<size>", size 0 = to
+// the end of the file
+int RunQuery(const char *program, int argc, char *argv[]) {
+  std::vector<std::string> dirs;
+  std::vector<IndexPredicate> predicates;
+  std::string yaml_file;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    IndexPredicate pred;
+    if ((arg == "--eq" || arg == "--range") && i + 1 < argc) {
+      if (!IndexPredicate::Parse(argv[++i], arg == "--eq", pred)) {
+        PrintUsage(program);
+        return 1;
+      }
+      predicates.push_back(pred);
+    } else if (arg == "--yaml" && i + 1 < argc) {
+      yaml_file = argv[++i];
+    } else if (arg.rfind("--", 0) == 0) {
+      PrintUsage(program);
+      return 1;
+    } else {
+      dirs.push_back(arg);
+    }
+  }
+  if (dirs.empty() || predicates.empty()) {
+    PrintUsage(program);
     return 1;
   }
 
-  MPI_Finalize();
+  try {
+    std::vector<IndexedChunk> chunks;
+    size_t files = 0;
+    for (const auto &dir : dirs) {
+      for (const auto &path : FindRecordIndexes(dir)) {
+        std::vector<IndexedChunk> loaded = RecordIndex::Load(path);
+        std::move(loaded.begin(), loaded.end(), std::back_inserter(chunks));
+        ++files;
+      }
+    }
+    if (files == 0) {
+      std::cerr << "Error: No record index found; import with "
+                   "output.index set" << std::endl;
+      return 1;
+    }
+    size_t indexed = chunks.size();
+    std::vector<CandidateRange> ranges =
+        RecordIndex::Query(std::move(chunks), predicates);
+    size_t rows = 0;
+    for (const auto &range : ranges) {
+      std::cout << range.source_ << "\t" << range.offset_ << "\t"
+                << range.size_ << "\n";
+      rows += range.rows_;
+    }
+    std::cout.flush();
+    std::cerr << "Query: " << ranges.size() << " ranges, " << rows
+              << " records, from " << indexed << " chunks in " << files
+              << " index files" << std::endl;
+    if (!yaml_file.empty()) {
+      WriteQueryJob(yaml_file, ranges);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
   return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char *argv[]) {
+  // The orchestrator itself never needs MPI; workers are started with
+  // mpirun, or not at all in local mode
+  // Started with mpirun, only the first rank orchestrates, as before
+  for (const char *var : {"OMPI_COMM_WORLD_RANK", "PMIX_RANK", "PMI_RANK"}) {
+    const char *value = getenv(var);
+    if (value && std::atoi(value) != 0) {
+      return 0;
+    }
+  }
+
+  const char *program = argv[0];
+  std::string command = argc > 1 ? argv[1] : "";
+  if (command == "serve" || command == "submit") {
+    return RunService(program, argc - 1, argv + 1);
+  }
+  if (command == "query") {
+    return RunQuery(program, argc - 1, argv + 1);
+  }
+  bool force_mpi = command == "--mpi";
+  if (force_mpi) {
+    --argc;
+    ++argv;
+  }
+  if (argc < 2 || (std::string(argv[1]) == "--plan" && argc < 3) ||
+      (std::string(argv[1]) == "--write-plan" && argc < 4)) {
+    PrintUsage(program);
+    return 1;
+  }
+
+  std::string mode = argv[1];
+  if (mode == "--write-plan") {
+    return WritePlan(argv[2], argv[3]);
+  }
+  bool from_plan = mode == "--plan";
+  int hostfile_arg = from_plan ? 3 : 2;
+
+  // Get hostfile from command line or config
+  std::string hostfile;
+  if (argc > hostfile_arg) {
+    hostfile = argv[hostfile_arg];
+  } else if (getenv("OMNI_HOSTFILE")) {
+    hostfile = getenv("OMNI_HOSTFILE");
+  }
+  return RunJob(from_plan, from_plan ? argv[2] : argv[1], hostfile,
+                force_mpi);
+}
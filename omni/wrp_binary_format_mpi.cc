@@ -1,124 +1,1530 @@
-#include "format/binary_file_omni.h"
+#include "catalog/catalog_writer.h"
+#include "catalog/metadata_collector.h"
+#include "format/format_registry.h"
 #include "format/progress_bar.h"
+#include "io/compressed_reader.h"
+#include "io/file_extents.h"
+#include "io/file_layout.h"
+#include "io/io_throttle.h"
+#include "io/io_tuner.h"
+#include "io/retry_policy.h"
+#include "plugin/plugin_loader.h"
+#include "runtime/cpu_topology.h"
+#include "runtime/placement.h"
+#include "runtime/job_plan.h"
+#include "runtime/range_work_queue.h"
+#include "sink/sink_factory.h"
+#include "util/hash.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
+#include <exception>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mpi.h>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace cae {
 
 void PrintUsage(const char *program_name) {
   std::cerr << "Usage: " << program_name
-            << " <filename> <offset> <size> [description] [hash]" << std::endl;
+            << " [options] <filename> [offset] [size] [description] [hash]"
+            << std::endl;
+  std::cerr << "       " << program_name << " [options] --batch <list>"
+            << std::endl;
   std::cerr << "Parameters:" << std::endl;
   std::cerr << "  filename    - Path to the file to process (required)"
             << std::endl;
-  std::cerr << "  offset      - Starting offset in bytes (required)"
+  std::cerr << "  offset      - Starting offset in bytes (default: 0)"
             << std::endl;
-  std::cerr << "  size        - Number of bytes to process (required)"
+  std::cerr << "  size        - Number of bytes to process (default: to end "
+               "of file)"
             << std::endl;
   std::cerr << "  description - Optional description string" << std::endl;
   std::cerr << "  hash        - Optional hash value for verification"
             << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  --threads <n>     Threads per rank (default: 1, 0 = one "
+               "per CPU of the rank)"
+            << std::endl;
+  std::cerr << "  --block-size <n>  Work-stealing block size in bytes "
+               "(default: the format's granularity, else 16MB)"
+            << std::endl;
+  std::cerr << "  --thread-bind <p>  Thread placement: core, numa or none "
+               "(default: core)"
+            << std::endl;
+  std::cerr << "  --no-pin          Same as --thread-bind none" << std::endl;
+  std::cerr << "  --extents <m>     Hole discovery: seek_data, fiemap or none "
+               "(default: seek_data)"
+            << std::endl;
+  std::cerr << "  --no-decompress    Read gzip/bzip2/zstd files as raw bytes"
+            << std::endl;
+  std::cerr << "  --no-auto-tune    Read in fixed 1MB chunks instead of tuning "
+               "chunk size and read-ahead at runtime"
+            << std::endl;
+  std::cerr << "  --batch <list>    Import the ranges listed one per line as "
+               "<path>\\t<offset>\\t<size>[\\t<description>]"
+            << std::endl;
+  std::cerr << "  --format <f>      Input format: a registered format, or auto "
+               "to detect it per file (default: binary)"
+            << std::endl;
+  std::cerr << "  --format-opt <k=v>  Option passed to the format client "
+               "(repeatable)"
+            << std::endl;
+  std::cerr << "  --plugin-path <d>  Colon-separated plugin directories "
+               "searched before $CAE_PLUGIN_PATH"
+            << std::endl;
+  std::cerr << "  --sink <s>        Output sink: container, shm or none "
+               "(default: none)"
+            << std::endl;
+  std::cerr << "  --output <dir>    Directory that receives sink output"
+            << std::endl;
+  std::cerr << "  --codec <c>       Block codec: auto, zstd, zlib or none "
+               "(default: auto)"
+            << std::endl;
+  std::cerr << "  --dedup           Container: store repeated content chunks "
+               "once"
+            << std::endl;
+  std::cerr << "  --record-index    Container: index column batches for "
+               "lookups"
+            << std::endl;
+  std::cerr << "  --bloom <cols>    Record index: comma-separated key columns "
+               "with Bloom filters, * = all"
+            << std::endl;
+  std::cerr << "  --channel <name>  Shared-memory channel of the shm sink"
+            << std::endl;
+  std::cerr << "  --slots <n>       Ring slots per rank (default: 64)"
+            << std::endl;
+  std::cerr << "  --slot-size <n>   Bytes per ring slot (default: 4MB)"
+            << std::endl;
+  std::cerr << "  --overflow <p>    Full ring: block or drop (default: block)"
+            << std::endl;
+  std::cerr << "  --consumer-timeout <ms>  Blocking: drop after ms without "
+               "consumer progress (default: 60000, 0 = wait forever)"
+            << std::endl;
+  std::cerr << "  --no-huge-pages   Do not advise huge pages for the ring"
+            << std::endl;
+  std::cerr << "  --catalog <dir>   Write the metadata of the imported files "
+               "to a catalog part in dir"
+            << std::endl;
+  std::cerr << "  --retries <n>     Attempts per I/O call on transient errors "
+               "(default: 4)"
+            << std::endl;
+  std::cerr << "  --retry-backoff <ms>  Delay before the first retry, doubled "
+               "per retry (default: 100)"
+            << std::endl;
+  std::cerr << "  --max-bandwidth <n>  Bytes per second all ranks may read "
+               "together (default: unlimited)"
+            << std::endl;
+  std::cerr << "  --max-iops <n>    Read calls per second all ranks may make "
+               "together (default: unlimited)"
+            << std::endl;
+  std::cerr << "  --stat-cache <plan>  Take file sizes, formats and "
+               "compression from a plan instead of the file system"
+            << std::endl;
+  std::cerr << "Exit status: 0 when every range was imported, "
+            << ImportFailure::EXIT_STATUS
+            << " when some ranges failed, 1 on other errors" << std::endl;
+}
+
+/**
+ * Command line options of a worker rank
+ */
+struct WorkerOptions {
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 16 * 1024 * 1024; // 16MB
+
+  std::string filename_;
+  std::string batch_file_; // Range list; replaces filename/offset/size
+  size_t offset_;
+  size_t size_; // 0 = to end of file
+  std::string description_;
+  std::string hash_;
+  int nthreads_;
+  size_t block_size_;
+  bool block_size_set_; // Otherwise the format's granularity is used
+  ThreadBinding thread_binding_;
+  ExtentMethod extent_method_;
+  bool decompress_; // Offsets and sizes of compressed files are uncompressed
+  bool auto_tune_;  // Chunk size and read-ahead tuned while reading
+  std::string format_; // Registered name, or "auto"
+  std::vector<std::pair<std::string, std::string>> format_opts_;
+  std::string plugin_path_;
+  SinkConfig sink_;
+  std::string output_dir_;
+  std::string catalog_dir_; // Empty = no metadata catalog
+  RetryPolicy retry_;
+  size_t max_bandwidth_; // Bytes per second of all ranks, 0 = unlimited
+  size_t max_iops_;      // Read calls per second of all ranks, 0 = unlimited
+  std::string stat_cache_; // Plan holding file layouts, read by rank 0
+  std::shared_ptr<IoThrottle> throttle_; // This rank's share, set in main
+  std::shared_ptr<const KnownFiles> known_files_; // From rank 0, set in main
+
+  WorkerOptions()
+      : offset_(0), size_(0), nthreads_(1), block_size_(DEFAULT_BLOCK_SIZE),
+        block_size_set_(false), thread_binding_(ThreadBinding::kCore),
+        extent_method_(ExtentMethod::kSeekData), decompress_(true),
+        auto_tune_(true), format_("binary"), max_bandwidth_(0),
+        max_iops_(0) {}
+};
+
+/** Parse worker options; returns false on malformed arguments */
+bool ParseWorkerArgs(int argc, char *argv[], WorkerOptions &opts) {
+  std::vector<std::string> positional;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--threads" && i + 1 < argc) {
+        opts.nthreads_ = std::stoi(argv[++i]);
+      } else if (arg == "--block-size" && i + 1 < argc) {
+        opts.block_size_ = std::stoull(argv[++i]);
+        opts.block_size_set_ = true;
+      } else if (arg == "--thread-bind" && i + 1 < argc) {
+        if (!ParseThreadBinding(argv[++i], opts.thread_binding_)) {
+          return false;
+        }
+      } else if (arg == "--extents" && i + 1 < argc) {
+        if (!ParseExtentMethod(argv[++i], opts.extent_method_)) {
+          return false;
+        }
+      } else if (arg == "--batch" && i + 1 < argc) {
+        opts.batch_file_ = argv[++i];
+      } else if (arg == "--format" && i + 1 < argc) {
+        opts.format_ = FormatRegistry::ToLower(argv[++i]);
+      } else if (arg == "--format-opt" && i + 1 < argc) {
+        std::string opt = argv[++i];
+        size_t eq = opt.find('=');
+        if (eq == std::string::npos || eq == 0) {
+          return false;
+        }
+        opts.format_opts_.emplace_back(opt.substr(0, eq), opt.substr(eq + 1));
+      } else if (arg == "--plugin-path" && i + 1 < argc) {
+        opts.plugin_path_ = argv[++i];
+      } else if (arg == "--sink" && i + 1 < argc) {
+        opts.sink_.name_ = argv[++i];
+      } else if (arg == "--output" && i + 1 < argc) {
+        opts.output_dir_ = argv[++i];
+      } else if (arg == "--catalog" && i + 1 < argc) {
+        opts.catalog_dir_ = argv[++i];
+      } else if (arg == "--retries" && i + 1 < argc) {
+        opts.retry_.attempts_ = std::stoi(argv[++i]);
+      } else if (arg == "--retry-backoff" && i + 1 < argc) {
+        opts.retry_.backoff_ms_ = std::stoi(argv[++i]);
+      } else if (arg == "--codec" && i + 1 < argc) {
+        opts.sink_.codec_ = argv[++i];
+      } else if (arg == "--channel" && i + 1 < argc) {
+        opts.sink_.channel_.name_ = argv[++i];
+      } else if (arg == "--slots" && i + 1 < argc) {
+        opts.sink_.channel_.slots_ =
+            static_cast<uint32_t>(std::stoul(argv[++i]));
+      } else if (arg == "--slot-size" && i + 1 < argc) {
+        opts.sink_.channel_.slot_size_ = std::stoull(argv[++i]);
+      } else if (arg == "--overflow" && i + 1 < argc) {
+        if (!ShmChannelConfig::ParseOverflow(argv[++i],
+                                             opts.sink_.channel_.overflow_)) {
+          return false;
+        }
+      } else if (arg == "--consumer-timeout" && i + 1 < argc) {
+        opts.sink_.channel_.consumer_timeout_ms_ =
+            static_cast<unsigned>(std::stoul(argv[++i]));
+      } else if (arg == "--max-bandwidth" && i + 1 < argc) {
+        opts.max_bandwidth_ = std::stoull(argv[++i]);
+      } else if (arg == "--max-iops" && i + 1 < argc) {
+        opts.max_iops_ = std::stoull(argv[++i]);
+      } else if (arg == "--stat-cache" && i + 1 < argc) {
+        opts.stat_cache_ = argv[++i];
+      } else if (arg == "--bloom" && i + 1 < argc) {
+        opts.sink_.index_.SplitColumns(argv[++i]);
+      } else if (arg == "--dedup") {
+        opts.sink_.dedup_ = true;
+      } else if (arg == "--record-index") {
+        opts.sink_.index_.enabled_ = true;
+      } else if (arg == "--no-huge-pages") {
+        opts.sink_.channel_.huge_pages_ = false;
+      } else if (arg == "--no-decompress") {
+        opts.decompress_ = false;
+      } else if (arg == "--no-auto-tune") {
+        opts.auto_tune_ = false;
+      } else if (arg == "--no-pin") {
+        opts.thread_binding_ = ThreadBinding::kNone;
+      } else if (arg.rfind("--", 0) == 0) {
+        return false;
+      } else {
+        positional.push_back(arg);
+      }
+    }
+    const SinkConfig &sink = opts.sink_;
+    if (!SinkFactory::IsValid(sink.name_) ||
+        (sink.name_ == "container" && opts.output_dir_.empty()) ||
+        (sink.name_ == "shm" &&
+         (!ShmChannelConfig::IsValidName(sink.channel_.name_) ||
+          sink.channel_.slots_ == 0 || sink.channel_.slot_size_ == 0))) {
+      return false;
+    }
+    if (!opts.batch_file_.empty()) {
+      return positional.empty() && opts.nthreads_ >= 0 &&
+             opts.retry_.attempts_ > 0 && opts.retry_.backoff_ms_ >= 0;
+    }
+    if (positional.empty()) {
+      return false;
+    }
+    opts.filename_ = positional[0];
+    if (positional.size() > 1) {
+      opts.offset_ = std::stoull(positional[1]);
+    }
+    if (positional.size() > 2) {
+      opts.size_ = std::stoull(positional[2]);
+    }
+    if (positional.size() > 3) {
+      opts.description_ = positional[3];
+    }
+    if (positional.size() > 4) {
+      opts.hash_ = positional[4];
+    }
+  } catch (const std::exception &) {
+    return false;
+  }
+  return opts.nthreads_ >= 0 && opts.block_size_ > 0 &&
+         opts.retry_.attempts_ > 0 && opts.retry_.backoff_ms_ >= 0;
 }
 
-class BinaryFileOmniWithProgress : public BinaryFileOmni {
+/**
+ * Progress shared by all threads of a rank
+ */
+class RankProgress {
 public:
-  BinaryFileOmniWithProgress(const std::string &filename, size_t total_size,
-                             int rank)
-      : progress_(std::make_unique<ProgressBar>(
-            std::filesystem::path(filename).filename().string(), total_size,
-            rank)),
-        total_size_(total_size) {}
-
-protected:
-  virtual void OnChunkProcessed(size_t bytes_processed) override {
-    progress_->Update(bytes_processed);
-    if (bytes_processed == total_size_) {
-      progress_->Finish();
+  RankProgress(const std::string &filename, size_t total_size, int rank)
+      : bar_(std::filesystem::path(filename).filename().string(), total_size,
+             rank),
+        total_size_(total_size), done_(0) {}
+
+  void Add(size_t bytes) {
+    size_t done = done_ += bytes;
+    std::lock_guard<std::mutex> lock(mtx_);
+    bar_.Update(done);
+    if (done == total_size_) {
+      bar_.Finish();
       std::cout << std::endl; // Move to next line after completion
     }
   }
 
 private:
-  std::unique_ptr<ProgressBar> progress_;
+  std::mutex mtx_;
+  ProgressBar bar_;
   size_t total_size_;
+  std::atomic<size_t> done_;
 };
 
+/**
+ * Forwards a client's per-call progress into a shared RankProgress
+ */
+class ClientProgress {
+public:
+  ClientProgress(RankProgress &progress, FormatClient &client)
+      : progress_(progress), last_(0) {
+    client.SetProgressCallback([this](size_t bytes_processed) {
+      progress_.Add(bytes_processed - last_);
+      last_ = bytes_processed;
+    });
+  }
+
+  ClientProgress(const ClientProgress &) = delete;
+  ClientProgress &operator=(const ClientProgress &) = delete;
+
+  /** Call before every Import or ImportBatch */
+  void Begin() { last_ = 0; }
+
+private:
+  RankProgress &progress_;
+  size_t last_;
+};
+
+/** Format of a file: the requested one, or the detected one for "auto" */
+std::string ResolveFormat(const WorkerOptions &opts,
+                          const std::string &filename) {
+  if (opts.format_ != "auto") {
+    return opts.format_;
+  }
+  const FormatCapabilities *caps = FormatRegistry::Get().Detect(filename);
+  return caps ? caps->name_ : "binary";
+}
+
+/** Format of a file as rank 0 resolved it, else as resolved here */
+std::string GetKnownFormat(const WorkerOptions &opts,
+                           const std::string &filename) {
+  if (opts.known_files_) {
+    auto it = opts.known_files_->find(filename);
+    if (it != opts.known_files_->end() && !it->second.format_.empty()) {
+      return it->second.format_;
+    }
+  }
+  return ResolveFormat(opts, filename);
+}
+
+/**
+ * Create a client of a format from the registry and apply the worker
+ * options; generic options a client does not know are ignored, while
+ * --format-opt options must be accepted
+ */
+std::unique_ptr<FormatClient>
+CreateClient(const std::string &format, const WorkerOptions &opts,
+             const std::shared_ptr<OutputSink> &sink,
+             const std::shared_ptr<MetadataCollector> &catalog, int io_depth) {
+  std::unique_ptr<FormatClient> client = FormatRegistry::Get().Create(format);
+  client->SetOption("decompress", opts.decompress_ ? "true" : "false");
+  client->SetOption("extents", ExtentMethodName(opts.extent_method_));
+  client->SetOption("io_depth", std::to_string(io_depth));
+  client->SetOption("auto_tune", opts.auto_tune_ ? "true" : "false");
+  client->SetOption("retries", std::to_string(opts.retry_.attempts_));
+  client->SetOption("retry_backoff_ms", std::to_string(opts.retry_.backoff_ms_));
+  for (const auto &opt : opts.format_opts_) {
+    if (!client->SetOption(opt.first, opt.second)) {
+      throw std::runtime_error("Format " + format + " does not accept " +
+                               opt.first + "=" + opt.second);
+    }
+  }
+  client->SetSink(sink);
+  client->SetCatalog(catalog);
+  client->SetThrottle(opts.throttle_);
+  client->SetKnownFiles(opts.known_files_);
+  return client;
+}
+
+/**
+ * Import a rank's byte range with a pool of pinned threads that share the
+ * range through work stealing
+ * A block that throws is recorded as failed and the thread moves on; blocks
+ * of a thread that cannot start are stolen by the others.
+ * @return Ranges that could not be imported
+ */
+std::vector<ImportFailure>
+ImportRange(const WorkerOptions &opts, const std::string &format,
+            size_t offset, size_t size, size_t block_size,
+            const std::vector<int> &cpus, int nthreads,
+            RankProgress &progress, const std::shared_ptr<OutputSink> &sink,
+            const std::shared_ptr<MetadataCollector> &catalog) {
+  RangeWorkQueue queue(offset, size, block_size, nthreads);
+  std::mutex failures_mtx;
+  std::vector<ImportFailure> failures;
+  std::string thread_error;
+
+  auto worker = [&](int tid) {
+    std::unique_ptr<FormatClient> client;
+    try {
+      // Bind before the client allocates its buffer so first touch is local
+      ApplyThreadPlacement(opts.thread_binding_, cpus, tid);
+      client = CreateClient(format, opts, sink, catalog, 1);
+    } catch (const std::exception &e) {
+      std::lock_guard<std::mutex> lock(failures_mtx);
+      thread_error = e.what();
+      return;
+    }
+    ClientProgress client_progress(progress, *client);
+    FormatContext ctx;
+    ctx.filename_ = opts.filename_;
+    ctx.description_ = opts.description_;
+    ctx.hash_ = opts.hash_;
+    size_t block_off, block_len;
+    while (queue.Next(tid, block_off, block_len)) {
+      ctx.offset_ = block_off;
+      ctx.size_ = block_len;
+      client_progress.Begin();
+      try {
+        client->Import(ctx);
+      } catch (const std::exception &e) {
+        // Part of the block may have been passed on
+        std::lock_guard<std::mutex> lock(failures_mtx);
+        failures.emplace_back(ctx.filename_, block_off, block_len, false,
+                              e.what());
+      }
+    }
+    std::vector<ImportFailure> mine = client->TakeFailures();
+    std::lock_guard<std::mutex> lock(failures_mtx);
+    failures.insert(failures.end(), mine.begin(), mine.end());
+  };
+
+  if (nthreads == 1) {
+    worker(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; ++t) {
+      threads.emplace_back(worker, t);
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+  // Blocks left when no thread could start
+  size_t block_off, block_len;
+  while (queue.Next(0, block_off, block_len)) {
+    failures.emplace_back(opts.filename_, block_off, block_len, true,
+                          thread_error);
+  }
+  return failures;
+}
+
+/**
+ * Run an import phase while rank 0 divides the launch's bandwidth and IOPS
+ * among the ranks by their demand (see io/io_throttle.h)
+ * The phase runs on its own thread. The main thread, the only one that
+ * makes MPI calls, reports this rank's demand every RATE_PERIOD_MS and
+ * applies the share rank 0 sends back, until every rank has finished.
+ * @return Ranges the phase could not import
+ */
+std::vector<ImportFailure>
+RunThrottled(const WorkerOptions &opts, int rank, int nranks,
+             const std::function<std::vector<ImportFailure>()> &phase) {
+  IoThrottle *throttle = opts.throttle_.get();
+  if (!throttle || nranks == 1) {
+    return phase();
+  }
+  std::vector<ImportFailure> failures;
+  std::exception_ptr error;
+  std::atomic<bool> done(false);
+  std::thread runner([&] {
+    try {
+      failures = phase();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    done = true;
+  });
+
+  // Up: bytes and calls asked for, finished; down: rates, all finished
+  std::vector<double> all(rank == 0 ? 3 * nranks : 0);
+  std::vector<double> shares(rank == 0 ? 3 * nranks : 0);
+  for (;;) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(IoThrottle::RATE_PERIOD_MS));
+    double demand[3];
+    demand[2] = done ? 1 : 0;
+    throttle->TakeDemand(demand[0], demand[1]);
+    MPI_Gather(demand, 3, MPI_DOUBLE, all.data(), 3, MPI_DOUBLE, 0,
+               MPI_COMM_WORLD);
+    if (rank == 0) {
+      double bytes = 0, ops = 0, finished = 1;
+      for (int r = 0; r < nranks; ++r) {
+        bytes += all[3 * r];
+        ops += all[3 * r + 1];
+        finished = std::min(finished, all[3 * r + 2]);
+      }
+      for (int r = 0; r < nranks; ++r) {
+        shares[3 * r] = IoThrottle::GetShare(
+            static_cast<double>(opts.max_bandwidth_), all[3 * r], bytes,
+            nranks);
+        shares[3 * r + 1] = IoThrottle::GetShare(
+            static_cast<double>(opts.max_iops_), all[3 * r + 1], ops, nranks);
+        shares[3 * r + 2] = finished;
+      }
+    }
+    double mine[3];
+    MPI_Scatter(shares.data(), 3, MPI_DOUBLE, mine, 3, MPI_DOUBLE, 0,
+                MPI_COMM_WORLD);
+    throttle->SetRates(mine[0], mine[1]);
+    if (mine[2] != 0) {
+      break;
+    }
+  }
+  runner.join();
+
+  // Reads after the phase, such as recovered ranges, get equal shares
+  throttle->SetRates(static_cast<double>(opts.max_bandwidth_) / nranks,
+                     static_cast<double>(opts.max_iops_) / nranks);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return failures;
+}
+
+/**
+ * A range of a batch list, with its format and the layout of its file
+ */
+struct BatchRange {
+  FormatContext ctx_;
+  std::string format_;
+  FileLayout layout_;
+};
+
+/** A file as the plan of the job recorded it */
+struct CachedFile {
+  FileLayout layout_;
+  std::string format_;
+  std::string error_; // Why its compressed index could not be built
+};
+
+/**
+ * Rank 0's view of file metadata: the plan's stat cache first, the file
+ * system for files the plan does not cover
+ */
+class LayoutResolver {
+public:
+  explicit LayoutResolver(const WorkerOptions &opts)
+      : opts_(opts), cached_(0), opened_(0) {
+    if (opts.stat_cache_.empty()) {
+      return;
+    }
+    try {
+      JobPlan plan = JobPlan::Map(opts.stat_cache_);
+      for (size_t i = 0; i < plan.GetFileCount(); ++i) {
+        const PlanFile &file = plan.GetFile(i);
+        if (file.io_block_ == 0) {
+          continue; // Not stat'ed when planned
+        }
+        CachedFile &entry = files_[std::string(plan.GetString(file.path_))];
+        entry.layout_.size_ = file.file_size_;
+        entry.layout_.allocated_ = file.allocated_;
+        entry.layout_.io_block_ = file.io_block_;
+        entry.layout_.compression_ = file.compression_;
+        entry.layout_.uncompressed_size_ = file.file_size_;
+        entry.layout_.valid_ = 1;
+        entry.format_ = std::string(plan.GetString(file.format_));
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "Warning: stat cache not used: " << e.what() << std::endl;
+    }
+  }
+
+  /**
+   * Layout and format of a file, looked up once per file
+   * @param fd The file if the caller has it open, else -1
+   */
+  const CachedFile &Resolve(const std::string &path, int fd = -1) {
+    auto it = resolved_.find(path);
+    if (it != resolved_.end()) {
+      return it->second;
+    }
+    CachedFile file;
+    auto hit = files_.find(path);
+    if (hit != files_.end()) {
+      file = hit->second;
+      ResolveUncompressedSize(path, file);
+      ++cached_;
+    } else {
+      // One open for the layout and the magic bytes
+      std::string head;
+      int own = fd < 0 ? open(path.c_str(), O_RDONLY) : -1;
+      int use = fd < 0 ? own : fd;
+      if (use >= 0) {
+        file.layout_ = FileLayout::Of(use);
+        head.resize(FormatRegistry::MAX_MAGIC_SIZE);
+        ssize_t n = pread(use, &head[0], head.size(), 0);
+        head.resize(n > 0 ? static_cast<size_t>(n) : 0);
+        ResolveUncompressedSize(path, file);
+      }
+      if (own >= 0) {
+        close(own);
+      }
+      if (opts_.format_ == "auto") {
+        const FormatCapabilities *caps =
+            FormatRegistry::Get().Detect(path, head);
+        file.format_ = caps ? caps->name_ : "binary";
+      }
+      ++opened_;
+    }
+    if (opts_.format_ != "auto") {
+      file.format_ = opts_.format_;
+    }
+    return resolved_.emplace(path, file).first->second;
+  }
+
+  size_t GetCachedCount() const { return cached_; }
+  size_t GetOpenedCount() const { return opened_; }
+
+private:
+  /** Decode the size of a compressed file; a corrupt one keeps the error */
+  void ResolveUncompressedSize(const std::string &path, CachedFile &file) {
+    try {
+      file.layout_.ResolveUncompressedSize(path, opts_.decompress_);
+    } catch (const std::exception &e) {
+      file.error_ = e.what();
+    }
+  }
+
+  const WorkerOptions &opts_;
+  std::unordered_map<std::string, CachedFile> files_;
+  std::unordered_map<std::string, CachedFile> resolved_;
+  size_t cached_;
+  size_t opened_;
+};
+
+/**
+ * Load a batch list with the layout and format of each file (rank 0)
+ * @param failures Receives the ranges of files that cannot be decoded
+ */
+std::vector<BatchRange> LoadBatch(const WorkerOptions &opts,
+                                  LayoutResolver &resolver,
+                                  std::vector<ImportFailure> &failures) {
+  std::ifstream in(opts.batch_file_);
+  if (!in) {
+    throw std::runtime_error("Could not open batch list: " +
+                             opts.batch_file_);
+  }
+  std::vector<BatchRange> batch;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t tab; (tab = line.find('\t', start)) != std::string::npos;
+         start = tab + 1) {
+      fields.push_back(line.substr(start, tab - start));
+    }
+    fields.push_back(line.substr(start));
+    if (fields.size() < 3) {
+      throw std::runtime_error("Malformed batch line: " + line);
+    }
+
+    BatchRange range;
+    range.ctx_.filename_ = fields[0];
+    range.ctx_.offset_ = std::stoull(fields[1]);
+    range.ctx_.size_ = std::stoull(fields[2]);
+    if (fields.size() > 3) {
+      range.ctx_.description_ = fields[3];
+    }
+    const CachedFile &file = resolver.Resolve(range.ctx_.filename_);
+    if (!file.error_.empty()) {
+      std::cerr << "Error: cannot decode " << range.ctx_.filename_ << ": "
+                << file.error_ << std::endl;
+      failures.emplace_back(range.ctx_.filename_, range.ctx_.offset_,
+                            range.ctx_.size_, false, file.error_);
+      continue;
+    }
+    range.layout_ = file.layout_;
+    range.format_ = file.format_;
+    batch.push_back(range);
+  }
+  return batch;
+}
+
+/** Broadcast a string from rank 0 */
+void BroadcastString(std::string &value, int rank) {
+  unsigned long long length = value.size();
+  MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+  if (rank != 0) {
+    value.assign(static_cast<size_t>(length), '\0');
+  }
+  if (length > 0) {
+    MPI_Bcast(&value[0], static_cast<int>(length), MPI_CHAR, 0,
+              MPI_COMM_WORLD);
+  }
+}
+
+/**
+ * Give every rank rank 0's batch, LAYOUT_BATCH ranges per broadcast
+ * @return The number of broadcast batches
+ */
+size_t BroadcastBatch(std::vector<BatchRange> &batch, int rank) {
+  unsigned long long count = batch.size();
+  MPI_Bcast(&count, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+  if (rank != 0) {
+    batch.resize(static_cast<size_t>(count));
+  }
+  size_t nbatches = 0;
+  std::vector<FileLayout> layouts;
+  for (size_t first = 0; first < batch.size();
+       first += FileLayout::LAYOUT_BATCH, ++nbatches) {
+    size_t n = std::min(FileLayout::LAYOUT_BATCH, batch.size() - first);
+    // Ranges as "path\toffset\tsize\tdescription\tformat" lines
+    std::string text;
+    layouts.resize(n);
+    if (rank == 0) {
+      for (size_t i = 0; i < n; ++i) {
+        const BatchRange &range = batch[first + i];
+        text += range.ctx_.filename_ + '\t' +
+                std::to_string(range.ctx_.offset_) + '\t' +
+                std::to_string(range.ctx_.size_) + '\t' +
+                range.ctx_.description_ + '\t' + range.format_ + '\n';
+        layouts[i] = range.layout_;
+      }
+    }
+    BroadcastString(text, rank);
+    MPI_Bcast(layouts.data(), static_cast<int>(n * sizeof(FileLayout)),
+              MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+      continue;
+    }
+    std::istringstream lines(text);
+    std::string line;
+    for (size_t i = 0; i < n && std::getline(lines, line); ++i) {
+      BatchRange &range = batch[first + i];
+      size_t a = line.find('\t');
+      size_t b = line.find('\t', a + 1);
+      size_t c = line.find('\t', b + 1);
+      size_t d = line.find('\t', c + 1);
+      range.ctx_.filename_ = line.substr(0, a);
+      range.ctx_.offset_ = std::stoull(line.substr(a + 1, b - a - 1));
+      range.ctx_.size_ = std::stoull(line.substr(b + 1, c - b - 1));
+      range.ctx_.description_ = line.substr(c + 1, d - c - 1);
+      range.format_ = line.substr(d + 1);
+      range.layout_ = layouts[i];
+    }
+  }
+  return nbatches;
+}
+
+/** Give every rank rank 0's layout, format and extents of a file */
+void BroadcastKnownFile(KnownFile &file, int rank) {
+  BroadcastString(file.format_, rank);
+  MPI_Bcast(&file.layout_, static_cast<int>(sizeof(FileLayout)), MPI_BYTE, 0,
+            MPI_COMM_WORLD);
+  unsigned long long span[3] = {file.extents_.size(), file.extents_begin_,
+                                file.extents_end_};
+  MPI_Bcast(span, 3, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+  file.extents_.resize(static_cast<size_t>(span[0]));
+  file.extents_begin_ = static_cast<size_t>(span[1]);
+  file.extents_end_ = static_cast<size_t>(span[2]);
+  for (size_t first = 0; first < file.extents_.size();
+       first += FileLayout::LAYOUT_BATCH) {
+    size_t n = std::min(FileLayout::LAYOUT_BATCH, file.extents_.size() - first);
+    MPI_Bcast(&file.extents_[first], static_cast<int>(n * sizeof(FileExtent)),
+              MPI_BYTE, 0, MPI_COMM_WORLD);
+  }
+}
+
+/**
+ * Resolve each range against its file's size: a size of 0 means to end of
+ * file, and ranges are clamped to end of file. Compressed files are
+ * addressed in uncompressed bytes
+ */
+void ClampBatch(std::vector<BatchRange> &batch, bool decompress) {
+  for (BatchRange &range : batch) {
+    if (!range.layout_.valid_) {
+      continue; // Reported when the range is read
+    }
+    size_t file_size =
+        static_cast<size_t>(range.layout_.GetAddressableSize(decompress));
+    FormatContext &ctx = range.ctx_;
+    size_t avail = ctx.offset_ < file_size ? file_size - ctx.offset_ : 0;
+    ctx.size_ = ctx.size_ == 0 ? avail : std::min(ctx.size_, avail);
+  }
+}
+
+/**
+ * Assign batch ranges to ranks, largest first to the least loaded rank
+ * @return The ranges owned by rank
+ */
+std::vector<BatchRange> PartitionBatch(const std::vector<BatchRange> &batch,
+                                       int rank, int nranks) {
+  std::vector<size_t> order(batch.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return batch[a].ctx_.size_ > batch[b].ctx_.size_;
+  });
+  std::vector<size_t> load(static_cast<size_t>(nranks), 0);
+  std::vector<BatchRange> mine;
+  for (size_t i : order) {
+    size_t owner = static_cast<size_t>(
+        std::min_element(load.begin(), load.end()) - load.begin());
+    load[owner] += std::max<size_t>(batch[i].ctx_.size_, 1);
+    if (owner == static_cast<size_t>(rank)) {
+      mine.push_back(batch[i]);
+    }
+  }
+  return mine;
+}
+
+/**
+ * This rank's share of the batch list: rank 0 reads the list and looks up
+ * every file once, the other ranks receive it
+ * @param known Receives the layout and format of every file of the list
+ * @param failures Receives, on rank 0, the ranges left out of the batch
+ *        because their file cannot be decoded
+ */
+std::vector<BatchRange>
+LoadBatchShare(const WorkerOptions &opts, int rank, int nranks,
+               std::shared_ptr<const KnownFiles> &known,
+               std::vector<ImportFailure> &failures) {
+  std::vector<BatchRange> batch;
+  size_t cached = 0;
+  size_t opened = 0;
+  if (rank == 0) {
+    // Only rank 0 maps the stat cache
+    LayoutResolver resolver(opts);
+    batch = LoadBatch(opts, resolver, failures);
+    cached = resolver.GetCachedCount();
+    opened = resolver.GetOpenedCount();
+  }
+  size_t nbatches = BroadcastBatch(batch, rank);
+  if (rank == 0) {
+    std::cout << "Metadata: " << batch.size() << " range(s) in "
+              << cached + opened << " file(s), " << cached
+              << " from the stat cache, " << opened
+              << " opened by rank 0; " << nbatches
+              << " layout broadcast(s)" << std::endl;
+  }
+  auto files = std::make_shared<KnownFiles>();
+  for (const BatchRange &range : batch) {
+    KnownFile &file = (*files)[range.ctx_.filename_];
+    file.layout_ = range.layout_;
+    file.format_ = range.format_;
+  }
+  known = files;
+  ClampBatch(batch, opts.decompress_);
+  return PartitionBatch(batch, rank, nranks);
+}
+
+/**
+ * Import this rank's share of a batch list with one ImportBatch call per
+ * format
+ * @return Ranges that could not be imported
+ */
+std::vector<ImportFailure> ImportBatchList(const WorkerOptions &opts, const std::vector<int> &cpus,
+                     int rank, const std::vector<BatchRange> &batch,
+                     const std::shared_ptr<OutputSink> &sink,
+                     const std::shared_ptr<MetadataCollector> &catalog) {
+  size_t total = 0;
+  for (const auto &range : batch) {
+    total += range.ctx_.size_;
+  }
+
+  // Batch threads inherit the rank's CPU set
+  if (opts.thread_binding_ != ThreadBinding::kNone) {
+    CpuTopology::BindCurrentThread(cpus);
+  }
+  int depth =
+      opts.nthreads_ > 0 ? opts.nthreads_ : static_cast<int>(cpus.size());
+
+  std::cout << "Rank " << rank << ": " << batch.size() << " range(s), "
+            << total << " bytes, I/O depth " << depth << std::endl;
+
+  // With --format auto every range gets the client of its file's format,
+  // as rank 0 resolved it
+  std::map<std::string, std::vector<FormatContext>> by_format;
+  for (const auto &range : batch) {
+    if (catalog) {
+      catalog->AddFile(range.ctx_.filename_, range.format_,
+                       range.ctx_.description_);
+    }
+    by_format[range.format_].push_back(range.ctx_);
+  }
+
+  RankProgress progress(opts.batch_file_, total, rank);
+  std::vector<ImportFailure> failures;
+  for (const auto &group : by_format) {
+    try {
+      std::unique_ptr<FormatClient> client =
+          CreateClient(group.first, opts, sink, catalog, depth);
+      ClientProgress client_progress(progress, *client);
+      client_progress.Begin();
+      client->ImportBatch(group.second);
+      std::vector<ImportFailure> mine = client->TakeFailures();
+      failures.insert(failures.end(), mine.begin(), mine.end());
+    } catch (const std::exception &e) {
+      for (const auto &ctx : group.second) {
+        failures.emplace_back(ctx.filename_, ctx.offset_, ctx.size_, false,
+                              e.what());
+      }
+    }
+  }
+  return failures;
+}
+
+/**
+ * Import the resumable failures of every rank again on other ranks
+ * The ranges a rank could not import are spread round robin over the other
+ * ranks, so a fault local to one rank or node is sidestepped. A range that
+ * fails again, or that was not resumable, is final.
+ * @param failures This rank's failures
+ * @return This rank's final failures
+ */
+std::vector<ImportFailure>
+RecoverFailures(const WorkerOptions &opts,
+                const std::vector<ImportFailure> &failures, int rank,
+                int nranks, const std::shared_ptr<OutputSink> &sink,
+                const std::shared_ptr<MetadataCollector> &catalog) {
+  // Resumable ranges as batch list lines
+  std::vector<ImportFailure> remaining;
+  std::string mine;
+  for (const auto &failure : failures) {
+    if (!failure.resumable_ || failure.size_ == 0) {
+      remaining.push_back(failure);
+      continue;
+    }
+    std::string description = opts.batch_file_.empty()
+                                  ? opts.description_
+                                  : std::string();
+    std::string reason = failure.reason_;
+    std::replace(reason.begin(), reason.end(), '\t', ' ');
+    std::replace(reason.begin(), reason.end(), '\n', ' ');
+    mine += failure.filename_ + "\t" + std::to_string(failure.offset_) +
+            "\t" + std::to_string(failure.size_) + "\t" + description +
+            "\t" + reason + "\n";
+  }
+
+  int length = static_cast<int>(mine.size());
+  std::vector<int> lengths(nranks);
+  MPI_Allgather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT,
+                MPI_COMM_WORLD);
+  std::vector<int> displs(nranks, 0);
+  for (int r = 1; r < nranks; ++r) {
+    displs[r] = displs[r - 1] + lengths[r - 1];
+  }
+  int total = displs[nranks - 1] + lengths[nranks - 1];
+  if (total == 0) {
+    return remaining;
+  }
+  std::string all(static_cast<size_t>(total), '\0');
+  MPI_Allgatherv(mine.data(), length, MPI_CHAR, &all[0], lengths.data(),
+                 displs.data(), MPI_CHAR, MPI_COMM_WORLD);
+
+  // Take the ranges assigned to this rank, grouped by format
+  std::map<std::string, std::vector<FormatContext>> by_format;
+  for (int r = 0; r < nranks; ++r) {
+    std::istringstream lines(all.substr(displs[r], lengths[r]));
+    std::string line;
+    for (size_t k = 0; std::getline(lines, line); ++k) {
+      int target = nranks == 1
+                       ? 0
+                       : (r + 1 + static_cast<int>(k % (nranks - 1))) % nranks;
+      if (target != rank) {
+        continue;
+      }
+      std::vector<std::string> fields;
+      std::istringstream tabs(line);
+      for (std::string field; std::getline(tabs, field, '\t');) {
+        fields.push_back(field);
+      }
+      fields.resize(5);
+      FormatContext ctx;
+      ctx.filename_ = fields[0];
+      ctx.offset_ = std::stoull(fields[1]);
+      ctx.size_ = std::stoull(fields[2]);
+      ctx.description_ = fields[3];
+      ctx.hash_ = opts.hash_;
+      std::cerr << "Rank " << rank << ": retrying " << ctx.filename_ << " ["
+                << ctx.offset_ << ", +" << ctx.size_ << ") from rank " << r
+                << " (" << fields[4] << ")" << std::endl;
+      by_format[GetKnownFormat(opts, ctx.filename_)].push_back(ctx);
+    }
+  }
+
+  for (const auto &group : by_format) {
+    try {
+      std::unique_ptr<FormatClient> client =
+          CreateClient(group.first, opts, sink, catalog, 1);
+      for (const auto &ctx : group.second) {
+        try {
+          client->Import(ctx);
+        } catch (const std::exception &e) {
+          remaining.emplace_back(ctx.filename_, ctx.offset_, ctx.size_, false,
+                                 e.what());
+        }
+      }
+      std::vector<ImportFailure> again = client->TakeFailures();
+      remaining.insert(remaining.end(), again.begin(), again.end());
+    } catch (const std::exception &e) {
+      for (const auto &ctx : group.second) {
+        remaining.emplace_back(ctx.filename_, ctx.offset_, ctx.size_, false,
+                               e.what());
+      }
+    }
+  }
+  return remaining;
+}
+
+/**
+ * Print the final failures of every rank and count them job-wide
+ * @return Number of ranges not imported by any rank
+ */
+unsigned long long ReportFailures(const std::vector<ImportFailure> &failures,
+                                  int rank) {
+  unsigned long long local[3] = {failures.size(), 0,
+                                 RetryPolicy::GetRetryCount().load()};
+  for (const auto &failure : failures) {
+    local[1] += failure.size_;
+    std::cerr << "Rank " << rank << ": not imported: " << failure.filename_
+              << " [" << failure.offset_ << ", +" << failure.size_
+              << "): " << failure.reason_ << std::endl;
+  }
+  unsigned long long global[3];
+  MPI_Allreduce(local, global, 3, MPI_UNSIGNED_LONG_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+  if (rank == 0) {
+    if (global[2] > 0) {
+      std::cout << "Transient I/O errors retried: " << global[2]
+                << std::endl;
+    }
+    if (global[0] > 0) {
+      std::cerr << "Import incomplete: " << global[0] << " range(s), "
+                << global[1] << " bytes not imported" << std::endl;
+    }
+  }
+  return global[0];
+}
+
+/**
+ * Save the read settings this rank converged to, so the next job on the
+ * same mounts starts from them
+ */
+void SaveTuning(const WorkerOptions &opts, int rank) {
+  if (!opts.auto_tune_) {
+    return;
+  }
+  for (const auto &mount : IoTuner::SaveAll()) {
+    std::cout << "Rank " << rank << ": I/O tuning for " << mount.first
+              << ": chunk " << mount.second.settings_.chunk_size_
+              << " bytes, read-ahead depth " << mount.second.settings_.depth_
+              << ", " << static_cast<size_t>(mount.second.bandwidth_ / 1e6)
+              << " MB/s" << std::endl;
+  }
+}
+
+/** Time this rank's reads waited for QoS tokens, if throttled */
+void ReportThrottle(const WorkerOptions &opts, int rank) {
+  if (opts.throttle_) {
+    std::cout << "Rank " << rank << ": reads waited "
+              << opts.throttle_->GetWaitedMs() << " ms for QoS tokens"
+              << std::endl;
+  }
+}
+
+/**
+ * Dataset name of a job: the file or batch list name with a digest of its
+ * path (and range), so no two jobs share a directory
+ */
+std::string GetDatasetName(const WorkerOptions &opts) {
+  if (opts.batch_file_.empty()) {
+    return OutputSink::GetDatasetName(opts.filename_, opts.offset_,
+                                      opts.size_);
+  }
+  const std::string &key = opts.batch_file_;
+  return std::filesystem::path(key).filename().string() + "-" +
+         Xxh64::ToHex(Xxh64::Hash(key.data(), key.size()));
+}
+
+/** Dataset directory of a job under the output directory */
+std::string GetDatasetDir(const WorkerOptions &opts) {
+  return opts.output_dir_ + "/" + GetDatasetName(opts);
+}
+
+/**
+ * Gather a string from every rank
+ * @return The strings by rank on rank 0, empty elsewhere
+ */
+std::vector<std::string> GatherStrings(const std::string &value, int rank,
+                                       int nranks) {
+  int length = static_cast<int>(value.size());
+  std::vector<int> lengths(nranks, 0);
+  MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0,
+             MPI_COMM_WORLD);
+  std::vector<int> displs(nranks, 0);
+  int total = 0;
+  for (int r = 0; r < nranks; ++r) {
+    displs[r] = total;
+    total += lengths[r];
+  }
+  std::vector<char> all(rank == 0 ? std::max(total, 1) : 1);
+  MPI_Gatherv(value.data(), length, MPI_CHAR, all.data(), lengths.data(),
+              displs.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+  std::vector<std::string> values;
+  if (rank == 0) {
+    for (int r = 0; r < nranks; ++r) {
+      values.emplace_back(all.data() + displs[r], lengths[r]);
+    }
+  }
+  return values;
+}
+
+/**
+ * Open this rank's output sink, or return nullptr when output is disabled
+ */
+std::shared_ptr<OutputSink> OpenSink(const WorkerOptions &opts, int rank,
+                                     int nranks) {
+  std::shared_ptr<OutputSink> sink = SinkFactory::Get(opts.sink_);
+  if (sink) {
+    SinkContext ctx;
+    if (!opts.output_dir_.empty()) {
+      ctx.output_dir_ = GetDatasetDir(opts);
+    }
+    ctx.rank_ = rank;
+    ctx.nranks_ = nranks;
+    sink->Open(ctx);
+  }
+  return sink;
+}
+
+/**
+ * Close this rank's sink and have rank 0 write the dataset manifest, or
+ * print the summaries when there is no output directory
+ * Only the short per-rank summaries travel to rank 0.
+ */
+void CloseSink(const WorkerOptions &opts, const std::shared_ptr<OutputSink> &sink,
+               int rank, int nranks) {
+  if (!sink) {
+    return;
+  }
+  sink->Close();
+  std::vector<std::string> summaries =
+      GatherStrings(sink->GetSummary(), rank, nranks);
+  if (rank == 0) {
+    if (opts.output_dir_.empty()) {
+      for (const auto &summary : summaries) {
+        std::cout << "Output (" << opts.sink_.name_ << "): " << summary
+                  << std::endl;
+      }
+      return;
+    }
+    std::string dir = GetDatasetDir(opts);
+    std::filesystem::create_directories(dir);
+    OutputSink::WriteManifest(dir, opts.sink_.name_, summaries);
+    std::cout << "Output: " << dir << " (" << nranks << " shard(s))"
+              << std::endl;
+  }
+}
+
+/**
+ * Open this rank's metadata collector, or return nullptr without --catalog
+ */
+std::shared_ptr<MetadataCollector> OpenCatalog(const WorkerOptions &opts) {
+  if (opts.catalog_dir_.empty()) {
+    return nullptr;
+  }
+  return std::make_shared<MetadataCollector>();
+}
+
+/**
+ * Merge every rank's collector into rank 0's along a binary tree
+ * A rank receives at most log2(nranks) collectors, each already holding
+ * the merged sketches of its subtree.
+ */
+void ReduceCatalog(MetadataCollector &catalog, int rank, int nranks) {
+  static constexpr size_t MAX_MESSAGE = 1 << 30; // MPI counts are int
+  for (int step = 1; step < nranks; step <<= 1) {
+    if (rank & step) {
+      std::string data = catalog.Serialize();
+      unsigned long long length = data.size();
+      MPI_Send(&length, 1, MPI_UNSIGNED_LONG_LONG, rank - step, 0,
+               MPI_COMM_WORLD);
+      for (size_t pos = 0; pos < data.size(); pos += MAX_MESSAGE) {
+        int count = static_cast<int>(std::min(MAX_MESSAGE, data.size() - pos));
+        MPI_Send(data.data() + pos, count, MPI_CHAR, rank - step, 0,
+                 MPI_COMM_WORLD);
+      }
+      return;
+    }
+    if (rank + step < nranks) {
+      unsigned long long length = 0;
+      MPI_Recv(&length, 1, MPI_UNSIGNED_LONG_LONG, rank + step, 0,
+               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      std::string data(length, '\0');
+      for (size_t pos = 0; pos < data.size(); pos += MAX_MESSAGE) {
+        int count = static_cast<int>(std::min(MAX_MESSAGE, data.size() - pos));
+        MPI_Recv(&data[pos], count, MPI_CHAR, rank + step, 0, MPI_COMM_WORLD,
+                 MPI_STATUS_IGNORE);
+      }
+      catalog.Merge(data);
+    }
+  }
+}
+
+/**
+ * Merge every rank's metadata on rank 0 and write the job's catalog part
+ * Partial digest segments travel with the metadata, so a segment split
+ * between ranks is still hashed.
+ */
+void CloseCatalog(const WorkerOptions &opts,
+                  const std::shared_ptr<MetadataCollector> &catalog, int rank,
+                  int nranks) {
+  if (!catalog) {
+    return;
+  }
+  ReduceCatalog(*catalog, rank, nranks);
+  if (rank != 0) {
+    return;
+  }
+  std::map<std::string, FileMetadata> files = catalog->TakeFiles();
+  // Jobs over files of the same name must not share a part
+  std::string key =
+      opts.batch_file_.empty() ? opts.filename_ : opts.batch_file_;
+  std::string name = GetDatasetName(opts) + "-" +
+                     Xxh64::ToHex(Xxh64::Hash(key.data(), key.size()));
+  size_t count = CatalogWriter::WritePart(opts.catalog_dir_, name, files,
+                                          opts.decompress_);
+  std::cout << "Catalog: " << count << " file(s) described in "
+            << opts.catalog_dir_ << std::endl;
+}
+
 } // namespace cae
 
 int main(int argc, char *argv[]) {
-  // Initialize MPI
-  MPI_Init(&argc, &argv);
+  // Threads never make MPI calls, so funneled support is enough
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
   int rank, size;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-  // Check command line arguments
-  if (argc < 2) {
+  // Check command line arguments; formats may come from plugins
+  cae::WorkerOptions opts;
+  bool valid = cae::ParseWorkerArgs(argc, argv, opts);
+  if (valid) {
+    cae::PluginLoader::LoadAll(opts.plugin_path_);
+    valid = opts.format_ == "auto" ||
+            cae::FormatRegistry::Get().Find(opts.format_) != nullptr;
+  }
+  if (!valid) {
     if (rank == 0) {
-      std::cerr << "Usage: " << argv[0] << " <binary_file>" << std::endl;
+      cae::PrintUsage(argv[0]);
     }
     MPI_Finalize();
     return 1;
   }
 
+  // Every rank starts with an equal share of the launch's limits
+  if (opts.max_bandwidth_ || opts.max_iops_) {
+    opts.throttle_ = std::make_shared<cae::IoThrottle>(opts.max_bandwidth_,
+                                                       opts.max_iops_);
+    opts.throttle_->SetRates(static_cast<double>(opts.max_bandwidth_) / size,
+                             static_cast<double>(opts.max_iops_) / size);
+    if (rank == 0) {
+      std::cout << "QoS: reads limited to "
+                << cae::IoThrottle::Describe(opts.max_bandwidth_,
+                                             opts.max_iops_)
+                << " across " << size << " rank(s)" << std::endl;
+    }
+  }
+
+  unsigned long long failed = 0;
   try {
-    std::string filename = argv[1];
-    size_t file_size = 0;
+    if (!opts.batch_file_.empty()) {
+      MPI_Comm node_comm;
+      MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                          MPI_INFO_NULL, &node_comm);
+      int local_rank;
+      MPI_Comm_rank(node_comm, &local_rank);
+      MPI_Comm_free(&node_comm);
+
+      std::shared_ptr<cae::OutputSink> sink = cae::OpenSink(opts, rank, size);
+      std::shared_ptr<cae::MetadataCollector> catalog = cae::OpenCatalog(opts);
+      std::vector<int> cpus = cae::CpuTopology::SelectRankCpus(local_rank);
+      std::vector<cae::ImportFailure> undecodable;
+      std::vector<cae::BatchRange> batch = cae::LoadBatchShare(
+          opts, rank, size, opts.known_files_, undecodable);
+      std::vector<cae::ImportFailure> failures =
+          cae::RunThrottled(opts, rank, size, [&] {
+            return cae::ImportBatchList(opts, cpus, rank, batch, sink,
+                                        catalog);
+          });
+      failures.insert(failures.end(), undecodable.begin(), undecodable.end());
+      failures =
+          cae::RecoverFailures(opts, failures, rank, size, sink, catalog);
+      cae::CloseSink(opts, sink, rank, size);
+      cae::CloseCatalog(opts, catalog, rank, size);
+      cae::SaveTuning(opts, rank);
+      cae::ReportThrottle(opts, rank);
+      failed = cae::ReportFailures(failures, rank);
+      MPI_Barrier(MPI_COMM_WORLD);
+      MPI_Finalize();
+      return failed ? cae::ImportFailure::EXIT_STATUS : 0;
+    }
 
-    // Get file size (only rank 0 needs to do this)
+    // Only rank 0 looks at the file before it is read, in one open: its
+    // layout and format come from the stat cache or that open, its extents
+    // from one walk, and every rank's clients take them from there
+    std::string filename = opts.filename_;
+    std::string format;
+    cae::KnownFile known;
+    std::string undecodable; // Why rank 0 could not index the file
+    int fd = -1;
     if (rank == 0) {
-      std::ifstream file(filename, std::ios::binary | std::ios::ate);
-      if (!file) {
+      fd = open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
         throw std::runtime_error("Could not open file: " + filename);
       }
-      file_size = file.tellg();
+      cae::LayoutResolver resolver(opts);
+      const cae::CachedFile &file = resolver.Resolve(filename, fd);
+      known.layout_ = file.layout_;
+      known.format_ = format = file.format_;
+      undecodable = file.error_;
+      std::cout << "Metadata: " << filename << " opened once by rank 0, "
+                << (resolver.GetCachedCount() ? "layout from the stat cache"
+                                              : "layout read")
+                << std::endl;
+    }
+    cae::BroadcastString(format, rank);
+    const cae::FormatCapabilities *caps =
+        cae::FormatRegistry::Get().Find(format);
+    if (!caps) {
+      throw std::runtime_error("Unknown format: " + format);
+    }
+    if (rank == 0) {
+      std::cout << "Format: " << caps->name_ << " (" << caps->source_ << ")"
+                << std::endl;
     }
+    size_t default_block_size = opts.block_size_set_ || caps->granularity_ == 0
+                                    ? opts.block_size_
+                                    : caps->granularity_;
 
-    // Broadcast file size to all ranks
-    MPI_Bcast(&file_size, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+    // Rank 0 maps the data extents of the range once and partitions it so
+    // every rank gets an equal share of allocated bytes, not logical bytes.
+    // The last slot carries the work-stealing block size.
+    std::vector<unsigned long long> bounds(size + 2, 0);
+    if (rank == 0) {
+      if (!known.layout_.valid_) {
+        throw std::runtime_error("Could not open file: " + filename);
+      }
+      size_t range_size = opts.size_ > 0 ? opts.size_ : SIZE_MAX - opts.offset_;
+      bounds[size + 1] = default_block_size;
+      cae::Compression compression = opts.decompress_
+                                         ? known.layout_.GetCompression()
+                                         : cae::Compression::kNone;
+      std::vector<cae::FileExtent> &extents = known.extents_;
+      if (undecodable.empty() && compression == cae::Compression::kNone) {
+        extents = cae::FileExtents::Map(fd, opts.offset_, range_size,
+                                        opts.extent_method_);
+        if (!extents.empty()) {
+          known.extents_begin_ = extents.front().offset_;
+          known.extents_end_ =
+              extents.back().offset_ + extents.back().length_;
+        }
+      }
+      close(fd);
 
-    // Calculate per-process work distribution
-    size_t bytes_per_process = file_size / size;
-    size_t remaining_bytes = file_size % size;
+      if (!undecodable.empty()) {
+        // No rank reads anything; rank 0 reports the range as failed
+        std::cerr << "Error: cannot decode " << filename << ": "
+                  << undecodable << std::endl;
+        for (int r = 0; r <= size; ++r) {
+          bounds[r] = opts.offset_;
+        }
+      } else if (compression != cae::Compression::kNone) {
+        // Split uncompressed bytes at access points; a block never spans
+        // less than the distance between two points
+        auto index = cae::CompressedIndex::Get(filename, compression);
+        std::string index_path =
+            cae::CompressedIndex::GetCachePath(filename);
+        size_t total = index->uncompressed_size_;
+        size_t begin = std::min(opts.offset_, total);
+        size_t end = begin + std::min(range_size, total - begin);
+        std::cout << "Compressed (" << cae::CompressionName(compression)
+                  << "): " << index->blocks_.size() << " access points, "
+                  << total << " uncompressed bytes, index "
+                  << (index_path.empty() ? "not cached" : index_path)
+                  << std::endl;
+        std::vector<size_t> split = index->Split(begin, end, size);
+        for (int r = 0; r <= size; ++r) {
+          bounds[r] = split[r];
+        }
+        bounds[size + 1] = std::max(default_block_size, index->GetMaxSpan());
+      } else {
+        size_t logical = 0;
+        if (!extents.empty()) {
+          logical = extents.back().offset_ + extents.back().length_ -
+                    extents.front().offset_;
+        }
+        size_t allocated = cae::FileExtents::AllocatedBytes(extents);
+        std::cout << "Extents (" << cae::ExtentMethodName(opts.extent_method_)
+                  << "): " << extents.size() << " extents, " << allocated
+                  << " allocated of " << logical << " logical bytes"
+                  << std::endl;
 
-    // Calculate this process's portion
-    size_t process_offset = rank * bytes_per_process;
-    size_t process_size = bytes_per_process;
+        std::vector<size_t> split =
+            cae::FileExtents::SplitByAllocated(extents, size);
+        if (extents.empty()) {
+          split.assign(size + 1, opts.offset_);
+        }
+        for (int r = 0; r <= size; ++r) {
+          bounds[r] = split[r];
+        }
+      }
 
-    // Distribute remaining bytes to the first few processes
-    if (rank < remaining_bytes) {
-      process_offset += rank;
-      process_size += 1;
-    } else {
-      process_offset += remaining_bytes;
+      // A format that cannot be split is read whole, by rank 0 in one block
+      if (!caps->splittable_) {
+        for (int r = 1; r < size; ++r) {
+          bounds[r] = bounds[size];
+        }
+        bounds[size + 1] =
+            std::max(bounds[size + 1], bounds[size] - bounds[0]);
+      }
     }
 
-    // Create format client with progress bar
-    cae::BinaryFileOmniWithProgress format(filename, process_size, rank);
+    // Broadcast the partition boundaries to all ranks
+    MPI_Bcast(bounds.data(), size + 2, MPI_UNSIGNED_LONG_LONG, 0,
+              MPI_COMM_WORLD);
+    size_t block_size = bounds[size + 1];
+    cae::BroadcastKnownFile(known, rank);
+    auto known_files = std::make_shared<cae::KnownFiles>();
+    (*known_files)[filename] = known;
+    opts.known_files_ = known_files;
 
-    // Create context for this process's portion
-    cae::FormatContext ctx;
-    ctx.filename_ = filename;
-    ctx.offset_ = process_offset;
-    ctx.size_ = process_size;
+    // Calculate this process's portion
+    size_t process_offset = bounds[rank];
+    size_t process_size = bounds[rank + 1] - bounds[rank];
+
+    // Ranks sharing a node spread over its NUMA domains
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &node_comm);
+    int local_rank;
+    MPI_Comm_rank(node_comm, &local_rank);
+    MPI_Comm_free(&node_comm);
+
+    std::vector<int> cpus = cae::CpuTopology::SelectRankCpus(local_rank);
+    int nthreads =
+        opts.nthreads_ > 0 ? opts.nthreads_ : static_cast<int>(cpus.size());
+
+    // Never start more threads than there are blocks to read
+    size_t nblocks = (process_size + block_size - 1) / block_size;
+    nthreads = static_cast<int>(
+        std::max<size_t>(1, std::min<size_t>(nthreads, nblocks)));
 
-    // Process the data
-    format.Import(ctx);
+    std::cout << "Rank " << rank << ": " << nthreads << " thread(s), "
+              << cae::ThreadBindingName(opts.thread_binding_)
+              << " binding, NUMA node "
+              << cae::CpuTopology::GetNumaNodeOfCpu(cpus.front()) << ", CPUs "
+              << cae::CpuTopology::FormatCpuList(cpus) << std::endl;
+
+    std::shared_ptr<cae::OutputSink> sink = cae::OpenSink(opts, rank, size);
+    std::shared_ptr<cae::MetadataCollector> catalog = cae::OpenCatalog(opts);
+    if (catalog) {
+      catalog->AddFile(filename, format, opts.description_);
+    }
+    cae::RankProgress progress(filename, process_size, rank);
+    std::vector<cae::ImportFailure> failures =
+        cae::RunThrottled(opts, rank, size, [&] {
+          return cae::ImportRange(opts, format, process_offset, process_size,
+                                  block_size, cpus, nthreads, progress, sink,
+                                  catalog);
+        });
+    if (!undecodable.empty()) {
+      failures.emplace_back(filename, opts.offset_, opts.size_, false,
+                            undecodable);
+    }
+    failures = cae::RecoverFailures(opts, failures, rank, size, sink, catalog);
+    cae::CloseSink(opts, sink, rank, size);
+    cae::CloseCatalog(opts, catalog, rank, size);
+    cae::SaveTuning(opts, rank);
+    cae::ReportThrottle(opts, rank);
+    failed = cae::ReportFailures(failures, rank);
 
     // Wait for all ranks to complete
     MPI_Barrier(MPI_COMM_WORLD);
 
   } catch (const std::exception &e) {
+    // Range failures are recorded above; this is a setup or collective error
     std::cerr << "Rank " << rank << " error: " << e.what() << std::endl;
     MPI_Abort(MPI_COMM_WORLD, 1);
   }
 
   MPI_Finalize();
-  return 0;
-}
\ No newline at end of file
+  return failed ? cae::ImportFailure::EXIT_STATUS : 0;
+}